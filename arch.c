@@ -0,0 +1,127 @@
+#include <stdlib.h>
+
+#include <libelf.h>
+#include <gelf.h>
+#include <libdwarf/libdwarf.h>
+
+#include "arch.h"
+#include "util.h"
+
+
+#define X86_64_GPR_NAMES						\
+	"%rax", "%rdx", "%rcx", "%rbx", "%rsi", "%rdi", "%rbp", "%rsp",	\
+	"%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"
+
+#define ARM64_GPR_NAMES							\
+	"x0", "x1", "x2", "x3", "x4", "x5", "x6", "x7",			\
+	"x8", "x9", "x10", "x11", "x12", "x13", "x14", "x15",		\
+	"x16", "x17", "x18", "x19", "x20", "x21", "x22", "x23",		\
+	"x24", "x25", "x26", "x27", "x28", "x29", "x30", "sp"
+
+#define PPC64_GPR_NAMES							\
+	"r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",			\
+	"r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",		\
+	"r16", "r17", "r18", "r19", "r20", "r21", "r22", "r23",		\
+	"r24", "r25", "r26", "r27", "r28", "r29", "r30", "r31"
+
+#define S390X_GPR_NAMES							\
+	"%r0", "%r1", "%r2", "%r3", "%r4", "%r5", "%r6", "%r7",		\
+	"%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"
+
+static const char *const x86_64_regs[] = {
+	X86_64_GPR_NAMES, "retaddr",
+};
+
+static const char *const arm64_regs[] = {
+	ARM64_GPR_NAMES,
+};
+
+static const char *const ppc64_regs[] = {
+	PPC64_GPR_NAMES, "lr",
+};
+
+static const char *const s390x_regs[] = {
+	S390X_GPR_NAMES,
+};
+
+/* DWARF register 16 of x86_64 is the return address column */
+const char *const x86_64_dwarf_regs[ARCH_DWARF_REGS] = {
+	X86_64_GPR_NAMES, "retaddr", [17 ... ARCH_DWARF_REGS - 1] = "?",
+};
+
+const char *const arm64_dwarf_regs[ARCH_DWARF_REGS] = {
+	ARM64_GPR_NAMES,
+};
+
+const char *const ppc64_dwarf_regs[ARCH_DWARF_REGS] = {
+	PPC64_GPR_NAMES,
+};
+
+/* 16-31 are the floating point registers */
+const char *const s390x_dwarf_regs[ARCH_DWARF_REGS] = {
+	S390X_GPR_NAMES, [16 ... ARCH_DWARF_REGS - 1] = "?",
+};
+
+#define ARCH_DEFINE(arch, em, NAME) {					\
+	.name = #arch,							\
+	.machine = em,							\
+	.regs = arch##_regs,						\
+	.regs_nb = ARRAY_SIZE(arch##_regs),				\
+	.gprs_nb = ARCH_##NAME##_GPRS,					\
+	.sp = ARCH_##NAME##_SP,						\
+	.fp = ARCH_##NAME##_FP,						\
+	.fp_cfa = ARCH_##NAME##_FP_CFA,					\
+	.ra = ARCH_##NAME##_RA,						\
+	.ra_column = ARCH_##NAME##_RA_COLUMN,				\
+	.columns_nb = ARCH_##NAME##_RA_COLUMN >= ARCH_##NAME##_GPRS ?	\
+		ARCH_##NAME##_RA_COLUMN + 1 : ARCH_##NAME##_GPRS,	\
+},
+
+static const struct arch arches[] = {
+	ARCH_LIST(ARCH_DEFINE)
+};
+
+
+/* NULL if machine cannot be unwound */
+const struct arch *arch_find(unsigned int machine)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(arches); i++) {
+		if (arches[i].machine == machine) {
+			return &arches[i];
+		}
+	}
+	return NULL;
+}
+
+
+const struct arch *arch_of_dwarf(Dwarf_Debug dwarf)
+{
+	GElf_Ehdr ehdr;
+	Elf *elf;
+
+	if (dwarf_get_elf(dwarf, &elf, NULL) != DW_DLV_OK ||
+	    gelf_getehdr(elf, &ehdr) == NULL) {
+		return NULL;
+	}
+	return arch_find(ehdr.e_machine);
+}
+
+
+/* -1 if the CFI column is not kept by the unwinder */
+int arch_column_slot(const struct arch *arch, unsigned int column)
+{
+	if (column == arch->ra_column) {
+		return arch->ra;
+	}
+	return column < arch->gprs_nb ? column : -1;
+}
+
+
+const char *arch_column_name(const struct arch *arch, unsigned int column)
+{
+	int slot = arch ? arch_column_slot(arch, column) : -1;
+
+	return slot == -1 ? "?" : arch->regs[slot];
+}
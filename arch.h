@@ -0,0 +1,95 @@
+#ifndef _ARCH_H
+#define _ARCH_H
+
+#include <libdwarf/libdwarf.h>
+
+/*
+ * Registers of the architectures that can be unwound, chosen by the
+ * e_machine of the image. Unwinding keeps registers in slots: slot n holds
+ * DWARF register n for the general purpose registers, the return address
+ * column comes after them if it is not one of them.
+ *
+ * Frames chained through a frame pointer point it to their frame record,
+ * the frame pointer of the caller followed by the return address. _FP_CFA
+ * is the CFA relative to the frame pointer if the record is always right
+ * under the CFA, 0 if it depends on the frame.
+ *
+ * The constants are also used to instantiate the unwinder once per
+ * architecture, see ARCH_LIST.
+ */
+
+#define ARCH_X86_64_GPRS 16
+#define ARCH_X86_64_SP 7
+#define ARCH_X86_64_FP 6
+#define ARCH_X86_64_FP_CFA 16
+#define ARCH_X86_64_RA 16
+#define ARCH_X86_64_RA_COLUMN 16
+
+/* stp x29, x30, [sp, #-N]!; mov x29, sp puts the frame record at the
+ * bottom of the frame, CFA = x29 + N */
+#define ARCH_ARM64_GPRS 32
+#define ARCH_ARM64_SP 31
+#define ARCH_ARM64_FP 29
+#define ARCH_ARM64_FP_CFA 0
+#define ARCH_ARM64_RA 30
+#define ARCH_ARM64_RA_COLUMN 30
+
+/* frames are chained through the back chain at r1, not a frame pointer */
+#define ARCH_PPC64_GPRS 32
+#define ARCH_PPC64_SP 1
+#define ARCH_PPC64_FP (-1)
+#define ARCH_PPC64_FP_CFA 0
+#define ARCH_PPC64_RA 32
+#define ARCH_PPC64_RA_COLUMN 65
+
+#define ARCH_S390X_GPRS 16
+#define ARCH_S390X_SP 15
+#define ARCH_S390X_FP (-1)
+#define ARCH_S390X_FP_CFA 0
+#define ARCH_S390X_RA 14
+#define ARCH_S390X_RA_COLUMN 14
+
+/* slots of the largest architecture, ppc64 */
+#define ARCH_REGS_MAX 33
+
+/* ARCH(name, e_machine, prefix of the constants) for each architecture */
+#define ARCH_LIST(ARCH)					\
+	ARCH(x86_64, EM_X86_64, X86_64)			\
+	ARCH(arm64, EM_AARCH64, ARM64)			\
+	ARCH(ppc64, EM_PPC64, PPC64)			\
+	ARCH(s390x, EM_S390, S390X)
+
+/* registers of DW_OP_reg0-31 and DW_OP_breg0-31 */
+#define ARCH_DWARF_REGS 32
+
+/* <name>_dwarf_regs: names of DWARF registers 0-31, "?" for those that are
+ * not general purpose registers. Code specialized for an architecture
+ * indexes them directly. */
+#define ARCH_DWARF_REGS_DECLARE(arch, em, NAME)				\
+	extern const char *const arch##_dwarf_regs[ARCH_DWARF_REGS];
+
+ARCH_LIST(ARCH_DWARF_REGS_DECLARE)
+
+struct arch {
+	const char *name;
+	unsigned int machine;
+	/* names of the slots, regs_nb of them */
+	const char *const *regs;
+	unsigned int regs_nb;
+	unsigned int gprs_nb;
+	int sp;
+	/* -1 if frames are not chained through a frame pointer */
+	int fp;
+	unsigned int fp_cfa;
+	int ra;
+	unsigned int ra_column;
+	/* size of the CFI register tables to read */
+	unsigned int columns_nb;
+};
+
+const struct arch *arch_find(unsigned int machine);
+const struct arch *arch_of_dwarf(Dwarf_Debug dwarf);
+int arch_column_slot(const struct arch *arch, unsigned int column);
+const char *arch_column_name(const struct arch *arch, unsigned int column);
+
+#endif
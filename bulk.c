@@ -0,0 +1,215 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bulk.h"
+#include "emit.h"
+#include "image.h"
+#include "rescache.h"
+#include "resolve.h"
+#include "strpool.h"
+#include "symtab.h"
+
+/* shorter hex numbers are pids, counts, timestamps... */
+#define ADDR_DIGITS_MIN 8
+
+struct addr_ref {
+	uint64_t addr;
+	/* position in the input */
+	unsigned long index;
+};
+
+struct addr_list {
+	uint64_t *addrs;
+	unsigned long nr;
+	unsigned long alloc;
+};
+
+
+static void addr_list_add(struct addr_list *list, uint64_t addr)
+{
+	if (list->nr == list->alloc) {
+		list->alloc = list->alloc ? list->alloc * 2 : 4096;
+		list->addrs = realloc(list->addrs, list->alloc *
+				      sizeof(*list->addrs));
+	}
+	list->addrs[list->nr++] = addr;
+}
+
+
+/* Add the hex numbers of line that fall in [lo, hi[. Numbers must be whole
+ * words, ex. "ffffffff8134e51d", "0xffffffff8134e51d" or
+ * "[<ffffffff8134e51d>]". */
+static void scan_line(const char *line, uint64_t lo, uint64_t hi,
+		      struct addr_list *list)
+{
+	const char *p = line;
+
+	while (*p) {
+		const char *start;
+		uint64_t addr;
+		char *end;
+
+		if (!isxdigit(*p) || (p > line && isalnum(p[-1]))) {
+			p++;
+			continue;
+		}
+		start = p;
+		if (p[0] == '0' && p[1] == 'x') {
+			start += 2;
+		}
+		addr = strtoull(start, &end, 16);
+		if (end - start >= ADDR_DIGITS_MIN && end - start <= 16 &&
+		    !isalnum(*end) && *end != '_' && lo <= addr &&
+		    addr < hi) {
+			addr_list_add(list, addr);
+		}
+		p = end > p ? end : p + 1;
+		while (isalnum(*p) || *p == '_') {
+			p++;
+		}
+	}
+}
+
+
+static int addr_ref_cmp(const void *a, const void *b)
+{
+	const struct addr_ref *ra = a, *rb = b;
+
+	return ra->addr < rb->addr ? -1 : ra->addr > rb->addr;
+}
+
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec - start->tv_sec +
+		(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+/*
+ * Addresses are deduplicated and sorted so that the DWARF indexes are swept
+ * once, in address order, by resolve_sorted_pcs(). Results are then
+ * scattered back to input order.
+ */
+void bulk_symbolize(struct image *image, FILE *in, struct emitter *out,
+		    struct rescache *cache, bool verbose)
+{
+	struct symtab *symtab = image_symtab(image);
+	struct addr_list input = {};
+	struct resolved_frame *frames, *missing_frames;
+	struct addr_ref *refs;
+	unsigned long *slots, *missing_slots;
+	uint64_t *unique, *missing, build_id = 0;
+	unsigned long i, unique_nb = 0, missing_nb = 0, resolved = 0;
+	uint64_t lo = 0, hi = UINT64_MAX;
+	struct strpool pool = {};
+	struct timespec start;
+	char *line = NULL;
+	size_t n = 0;
+	double seconds;
+
+	if (symtab && symtab->nr) {
+		lo = symtab->starts[0];
+		/* + 1 for a last symbol without size, ex. _etext */
+		hi = symtab->starts[symtab->nr - 1] +
+			symtab->sizes[symtab->nr - 1] + 1;
+	}
+	while (getline(&line, &n, in) != -1) {
+		scan_line(line, lo, hi, &input);
+	}
+	free(line);
+
+	if (cache) {
+		const unsigned char *id;
+		size_t len = image_build_id(image, &id);
+
+		if (len) {
+			build_id = rescache_build_id(id, len);
+		} else {
+			fprintf(stderr,
+				"Warning: \"%s\" has no build-id, not using the result cache.\n",
+				image->path);
+			cache = NULL;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* sort and deduplicate */
+	refs = malloc(input.nr * sizeof(*refs));
+	for (i = 0; i < input.nr; i++) {
+		refs[i] = (struct addr_ref) {
+			.addr = input.addrs[i],
+			.index = i,
+		};
+	}
+	qsort(refs, input.nr, sizeof(*refs), addr_ref_cmp);
+	unique = malloc(input.nr * sizeof(*unique));
+	slots = malloc(input.nr * sizeof(*slots));
+	for (i = 0; i < input.nr; i++) {
+		if (!unique_nb || unique[unique_nb - 1] != refs[i].addr) {
+			unique[unique_nb++] = refs[i].addr;
+		}
+		slots[refs[i].index] = unique_nb - 1;
+	}
+	free(refs);
+
+	/* answer what can be from the cache, and sweep the rest */
+	frames = calloc(unique_nb, sizeof(*frames));
+	missing = malloc(unique_nb * sizeof(*missing));
+	missing_slots = malloc(unique_nb * sizeof(*missing_slots));
+	for (i = 0; i < unique_nb; i++) {
+		if (cache && rescache_get(cache, build_id, unique[i],
+					  &frames[i]) == 0) {
+			resolved++;
+			continue;
+		}
+		missing_slots[missing_nb] = i;
+		missing[missing_nb++] = unique[i];
+	}
+	missing_frames = calloc(missing_nb, sizeof(*missing_frames));
+	resolved += resolve_sorted_pcs(image, missing, missing_nb, &pool,
+				       missing_frames);
+	for (i = 0; i < missing_nb; i++) {
+		frames[missing_slots[i]] = missing_frames[i];
+		if (cache && missing_frames[i].locs_nb) {
+			rescache_put(cache, build_id, &missing_frames[i]);
+		}
+	}
+
+	for (i = 0; i < input.nr; i++) {
+		emit_frame(out, &frames[slots[i]], true);
+	}
+	emitter_flush(out);
+	seconds = elapsed(&start);
+
+	fprintf(stderr,
+		"%lu addresses, %lu unique, %lu resolved in %.3f s (%.0f addresses/s)\n",
+		input.nr, unique_nb, resolved, seconds,
+		seconds > 0 ? input.nr / seconds : 0.);
+	if (verbose && cache) {
+		fprintf(stderr, "result cache: %lu hits, %lu misses\n",
+			cache->hits, cache->misses);
+	}
+	if (verbose) {
+		fprintf(stderr, "output: %lu records in %lu writes\n",
+			out->records, out->writes);
+	}
+
+	free(missing_frames);
+	free(missing_slots);
+	free(missing);
+	free(frames);
+	free(slots);
+	free(unique);
+	free(input.addrs);
+	strpool_free(&pool);
+}
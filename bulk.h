@@ -0,0 +1,21 @@
+#ifndef _BULK_H
+#define _BULK_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+struct emitter;
+struct image;
+struct rescache;
+
+/*
+ * Symbolization of large batches of code addresses, such as the sample
+ * addresses of "perf script" or ftrace output. Every kernel address found in
+ * the input is resolved, and one line is printed per address, in input
+ * order.
+ */
+
+void bulk_symbolize(struct image *image, FILE *in, struct emitter *out,
+		    struct rescache *cache, bool verbose);
+
+#endif
@@ -0,0 +1,551 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libdwarf/libdwarf.h>
+
+#include "cluster.h"
+#include "core_walk.h"
+#include "image.h"
+#include "oops.h"
+#include "symtab.h"
+#include "util.h"
+
+/* frames that show up in reports of unrelated bugs */
+static const char *default_skip[] = {
+	"dump_stack*",
+	"show_stack",
+	"show_trace_log_lvl",
+	"panic",
+	"__warn*",
+	"warn_slowpath*",
+	"report_bug",
+	"handle_bug",
+	"die",
+	"oops_end",
+	"do_trap",
+	"do_error_trap",
+	"do_invalid_op",
+	"invalid_op",
+	"exc_*",
+	"asm_exc_*",
+	"no_context",
+	"bad_area*",
+	"__bad_area*",
+	"page_fault",
+	"async_page_fault",
+	"do_page_fault",
+	"__do_page_fault",
+	"error_entry",
+	"error_exit",
+	"printk*",
+	"vprintk*",
+	"_printk",
+	"schedule",
+	"__schedule",
+	"schedule_timeout",
+};
+
+
+void signer_init(struct signer *signer, struct image *image,
+		 unsigned int depth)
+{
+	int i;
+
+	*signer = (struct signer) {
+		.image = image,
+		.depth = depth,
+		.files_size = 1024,
+	};
+	signer->files = calloc(signer->files_size, sizeof(*signer->files));
+	signer->skip.patterns = malloc(ARRAY_SIZE(default_skip) *
+				       sizeof(*signer->skip.patterns));
+	for (i = 0; i < ARRAY_SIZE(default_skip); i++) {
+		signer->skip.patterns[signer->skip.nr++] =
+			strdup(default_skip[i]);
+	}
+}
+
+
+/* Add the function names of path, one per line, to the skip list. Blank
+ * lines and lines starting with '#' are ignored. */
+int signer_load_skip(struct signer *signer, const char *path)
+{
+	char *line = NULL;
+	size_t n = 0;
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "Error: open \"%s\" failed: %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+	while (getline(&line, &n, f) != -1) {
+		line[strcspn(line, " \t\r\n")] = '\0';
+		if (line[0] == '\0' || line[0] == '#') {
+			continue;
+		}
+		signer->skip.patterns = realloc(signer->skip.patterns,
+						(signer->skip.nr + 1) *
+						sizeof(*signer->skip.patterns));
+		signer->skip.patterns[signer->skip.nr++] = strdup(line);
+	}
+	free(line);
+	fclose(f);
+
+	return 0;
+}
+
+
+static bool pattern_match(const struct pattern_list *list, const char *name)
+{
+	int i;
+
+	for (i = 0; i < list->nr; i++) {
+		const char *pattern = list->patterns[i];
+		size_t len = strlen(pattern);
+
+		if (len && pattern[len - 1] == '*') {
+			if (strncmp(pattern, name, len - 1) == 0) {
+				return true;
+			}
+		} else if (strcmp(pattern, name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/* FNV-1a */
+static uint64_t hash_string(const char *s)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	while (*s) {
+		hash ^= (unsigned char) *s++;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+
+uint64_t signature_hash(const char *signature)
+{
+	return hash_string(signature);
+}
+
+
+static struct func_file *files_slot(struct func_file *files,
+				    unsigned int size, const char *name)
+{
+	unsigned int i = hash_string(name) & (size - 1);
+
+	while (files[i].name && strcmp(files[i].name, name) != 0) {
+		i = (i + 1) & (size - 1);
+	}
+	return &files[i];
+}
+
+
+/* Source file of the start of the function, relative to the compilation
+ * directory. NULL if unknown. */
+static const char *resolve_file(struct signer *signer,
+				const struct oops_frame *frame)
+{
+	struct image *image = signer->image;
+	struct symtab *symtab = image_symtab(image);
+	Dwarf_Addr pc = frame->pc;
+	Dwarf_Die cu_die;
+	unsigned int line;
+	char *file;
+	int index;
+
+	/* the symbol is unaffected by KASLR */
+	if (symtab && (index = symtab_find(symtab, frame->symbol)) != -1) {
+		pc = symtab->starts[index];
+	}
+	if (!pc || image_find_cu(image, pc, &cu_die) == -1) {
+		return NULL;
+	}
+	if (find_lineno_by_pc(image->dwarf, cu_die, pc, &file, &line) != 0) {
+		file = NULL;
+	}
+	dwarf_dealloc(image->dwarf, cu_die, DW_DLA_DIE);
+
+	return file ? strpool_add(&signer->pool, file) : NULL;
+}
+
+
+static const char *function_file(struct signer *signer,
+				 const struct oops_frame *frame)
+{
+	struct func_file *slot;
+
+	slot = files_slot(signer->files, signer->files_size, frame->symbol);
+	if (slot->name) {
+		return slot->file;
+	}
+
+	*slot = (struct func_file) {
+		.name = strpool_add(&signer->pool, frame->symbol),
+		.file = resolve_file(signer, frame),
+	};
+	if (++signer->files_nb * 2 > signer->files_size) {
+		struct func_file *old = signer->files;
+		unsigned int i, old_size = signer->files_size;
+		const char *file = slot->file;
+
+		signer->files_size *= 2;
+		signer->files = calloc(signer->files_size,
+				       sizeof(*signer->files));
+		for (i = 0; i < old_size; i++) {
+			if (old[i].name) {
+				*files_slot(signer->files, signer->files_size,
+					    old[i].name) = old[i];
+			}
+		}
+		free(old);
+		return file;
+	}
+	return slot->file;
+}
+
+
+/* the title with numbers replaced, for reports without usable frames */
+static size_t sign_title(const char *title, char *buf, size_t len)
+{
+	size_t pos = 0;
+
+	while (*title && pos + 1 < len) {
+		if (isdigit(*title)) {
+			buf[pos++] = '#';
+			while (isxdigit(*title) || *title == 'x') {
+				title++;
+			}
+		} else {
+			buf[pos++] = *title++;
+		}
+	}
+	buf[pos] = '\0';
+	return pos;
+}
+
+
+/*
+ * Write the signature of oops in buf: "func (file) < caller (file) < ...",
+ * innermost first. Returns its length.
+ */
+size_t signer_sign(struct signer *signer, const struct oops *oops, char *buf,
+		   size_t len)
+{
+	unsigned int i, kept = 0;
+	size_t pos = 0;
+
+	buf[0] = '\0';
+	for (i = 0; i < oops->frames_nb && kept < signer->depth &&
+		     pos + 1 < len; i++) {
+		const struct oops_frame *frame = &oops->frames[i];
+		const char *file = NULL;
+		char name[256];
+
+		if (!frame->reliable || !frame->symbol) {
+			continue;
+		}
+		/* drop compiler suffixes, ex. ".isra.0", ".cold" */
+		snprintf(name, sizeof(name), "%.*s",
+			 (int) strcspn(frame->symbol, "."), frame->symbol);
+		if (pattern_match(&signer->skip, name)) {
+			continue;
+		}
+
+		if (!frame->module) {
+			file = function_file(signer, frame);
+		}
+		pos += snprintf(buf + pos, len - pos, "%s%s", kept ? " < " : "",
+				name);
+		if (file && pos + 1 < len) {
+			pos += snprintf(buf + pos, len - pos, " (%s)", file);
+		} else if (frame->module && pos + 1 < len) {
+			pos += snprintf(buf + pos, len - pos, " [%s]",
+					frame->module);
+		}
+		kept++;
+	}
+
+	if (pos >= len) {
+		pos = len - 1;
+	}
+	if (!kept) {
+		pos = sign_title(oops->title, buf, len);
+	}
+	return pos;
+}
+
+
+void signer_free(struct signer *signer)
+{
+	int i;
+
+	for (i = 0; i < signer->skip.nr; i++) {
+		free(signer->skip.patterns[i]);
+	}
+	free(signer->skip.patterns);
+	free(signer->files);
+	strpool_free(&signer->pool);
+}
+
+
+void cluster_set_init(struct cluster_set *set, unsigned int max)
+{
+	*set = (struct cluster_set) {
+		.max = max,
+		.heap = malloc(max * sizeof(*set->heap)),
+		.table_size = 1,
+	};
+	while (set->table_size < max * 2) {
+		set->table_size *= 2;
+	}
+	set->table = calloc(set->table_size, sizeof(*set->table));
+}
+
+
+static uint32_t *table_slot(struct cluster_set *set, uint64_t hash)
+{
+	unsigned int mask = set->table_size - 1;
+	unsigned int i;
+
+	for (i = hash & mask; set->table[i] &&
+	     set->heap[set->table[i] - 1].hash != hash; i = (i + 1) & mask) {
+	}
+	return &set->table[i];
+}
+
+
+/* linear probing deletion, entries after the hole are moved back */
+static void table_remove(struct cluster_set *set, uint64_t hash)
+{
+	unsigned int mask = set->table_size - 1;
+	unsigned int i = table_slot(set, hash) - set->table;
+	unsigned int j = i;
+
+	set->table[i] = 0;
+	while (true) {
+		unsigned int home;
+
+		j = (j + 1) & mask;
+		if (!set->table[j]) {
+			break;
+		}
+		home = set->heap[set->table[j] - 1].hash & mask;
+		/* the entry at j can not move if its home is in ]i, j] */
+		if (i <= j ? (i < home && home <= j) :
+		    (i < home || home <= j)) {
+			continue;
+		}
+		set->table[i] = set->table[j];
+		set->table[j] = 0;
+		i = j;
+	}
+}
+
+
+/* The slots are found while the entries are still where they point to:
+ * table_slot() compares the hashes of the heap entries. */
+static void heap_swap(struct cluster_set *set, unsigned int a,
+		      unsigned int b)
+{
+	uint32_t *slot_a = table_slot(set, set->heap[a].hash);
+	uint32_t *slot_b = table_slot(set, set->heap[b].hash);
+	struct cluster tmp = set->heap[a];
+
+	set->heap[a] = set->heap[b];
+	set->heap[b] = tmp;
+	*slot_a = b + 1;
+	*slot_b = a + 1;
+}
+
+
+static void sift_up(struct cluster_set *set, unsigned int i)
+{
+	while (i > 0 && set->heap[(i - 1) / 2].count > set->heap[i].count) {
+		heap_swap(set, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+
+static void sift_down(struct cluster_set *set, unsigned int i)
+{
+	while (true) {
+		unsigned int smallest = i, child;
+
+		for (child = 2 * i + 1; child <= 2 * i + 2 && child < set->nr;
+		     child++) {
+			if (set->heap[child].count <
+			    set->heap[smallest].count) {
+				smallest = child;
+			}
+		}
+		if (smallest == i) {
+			break;
+		}
+		heap_swap(set, i, smallest);
+		i = smallest;
+	}
+}
+
+
+static void seen(struct cluster *cluster, double timestamp, bool wall_clock)
+{
+	if (timestamp == -1) {
+		return;
+	}
+	if (cluster->first_seen == -1 || timestamp < cluster->first_seen) {
+		cluster->first_seen = timestamp;
+	}
+	if (cluster->last_seen == -1 || timestamp > cluster->last_seen) {
+		cluster->last_seen = timestamp;
+	}
+	cluster->wall_clock = wall_clock;
+}
+
+
+void cluster_add(struct cluster_set *set, const char *signature,
+		 const char *title, double timestamp, bool wall_clock)
+{
+	uint64_t hash = signature_hash(signature);
+	struct cluster *cluster;
+	unsigned long count = 0;
+	uint32_t *slot;
+	unsigned int i;
+
+	set->reports++;
+	slot = table_slot(set, hash);
+	if (*slot) {
+		i = *slot - 1;
+		set->heap[i].count++;
+		seen(&set->heap[i], timestamp, wall_clock);
+		sift_down(set, i);
+		return;
+	}
+
+	if (set->nr < set->max) {
+		i = set->nr++;
+	} else {
+		/* replace the smallest cluster, whose count is inherited */
+		i = 0;
+		count = set->heap[0].count;
+		table_remove(set, set->heap[0].hash);
+		free(set->heap[0].signature);
+		free(set->heap[0].title);
+		set->evictions++;
+	}
+
+	cluster = &set->heap[i];
+	*cluster = (struct cluster) {
+		.hash = hash,
+		.count = count + 1,
+		.error = count,
+		.first_seen = -1,
+		.last_seen = -1,
+		.signature = strdup(signature),
+		.title = strdup(title),
+	};
+	seen(cluster, timestamp, wall_clock);
+	*table_slot(set, hash) = i + 1;
+	if (count) {
+		sift_down(set, i);
+	} else {
+		sift_up(set, i);
+	}
+}
+
+
+static int cluster_count_cmp(const void *a, const void *b)
+{
+	const struct cluster *ca = *(const struct cluster **) a;
+	const struct cluster *cb = *(const struct cluster **) b;
+
+	if (ca->count != cb->count) {
+		return ca->count < cb->count ? 1 : -1;
+	}
+	return strcmp(ca->signature, cb->signature);
+}
+
+
+static const char *format_time(double t, bool wall_clock, char *buf,
+			       size_t len)
+{
+	time_t seconds = t;
+	struct tm tm;
+
+	if (t == -1) {
+		snprintf(buf, len, "-");
+	} else if (wall_clock) {
+		strftime(buf, len, "%Y-%m-%d %H:%M:%S", gmtime_r(&seconds, &tm));
+	} else {
+		snprintf(buf, len, "%.6f", t);
+	}
+	return buf;
+}
+
+
+/* largest clusters first */
+void cluster_set_print(FILE *stream, const struct cluster_set *set)
+{
+	const struct cluster **sorted;
+	unsigned int i;
+
+	fprintf(stream, "%lu reports, %u clusters", set->reports, set->nr);
+	if (set->evictions) {
+		fprintf(stream,
+			", %lu evicted: counts may be overestimated by the given error",
+			set->evictions);
+	}
+	fprintf(stream, "\n\n");
+
+	sorted = malloc(set->nr * sizeof(*sorted));
+	for (i = 0; i < set->nr; i++) {
+		sorted[i] = &set->heap[i];
+	}
+	qsort(sorted, set->nr, sizeof(*sorted), cluster_count_cmp);
+
+	for (i = 0; i < set->nr; i++) {
+		const struct cluster *cluster = sorted[i];
+		char first[32], last[32];
+
+		fprintf(stream, "%8lu", cluster->count);
+		if (cluster->error) {
+			fprintf(stream, " (error %lu)", cluster->error);
+		}
+		fprintf(stream, "  first: %s  last: %s  hash: %016llx\n",
+			format_time(cluster->first_seen, cluster->wall_clock,
+				    first, sizeof(first)),
+			format_time(cluster->last_seen, cluster->wall_clock,
+				    last, sizeof(last)),
+			(unsigned long long) cluster->hash);
+		fprintf(stream, "    %s\n", cluster->signature);
+		if (cluster->title[0]) {
+			fprintf(stream, "    %s\n", cluster->title);
+		}
+	}
+	free(sorted);
+}
+
+
+void cluster_set_free(struct cluster_set *set)
+{
+	int i;
+
+	for (i = 0; i < set->nr; i++) {
+		free(set->heap[i].signature);
+		free(set->heap[i].title);
+	}
+	free(set->heap);
+	free(set->table);
+}
@@ -0,0 +1,90 @@
+#ifndef _CLUSTER_H
+#define _CLUSTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "strpool.h"
+
+struct image;
+struct oops;
+
+#define SIGNATURE_DEPTH_DEFAULT 5
+/* clusters kept in memory, whatever the number of reports */
+#define CLUSTER_MAX 65536
+
+/*
+ * Crash signatures: the functions (and their source files) of the top frames
+ * of a trace, without offsets, unreliable frames and frames that are common
+ * to many unrelated reports, such as the exception entry code.
+ */
+
+struct pattern_list {
+	/* a trailing '*' matches any suffix */
+	char **patterns;
+	unsigned int nr;
+};
+
+struct func_file {
+	const char *name;
+	const char *file;
+};
+
+struct signer {
+	struct image *image;
+	struct pattern_list skip;
+	/* frames kept in signatures */
+	unsigned int depth;
+	/* source file of each function name seen, open addressing */
+	struct func_file *files;
+	unsigned int files_nb;
+	unsigned int files_size;
+	struct strpool pool;
+};
+
+void signer_init(struct signer *signer, struct image *image,
+		 unsigned int depth);
+int signer_load_skip(struct signer *signer, const char *path);
+size_t signer_sign(struct signer *signer, const struct oops *oops, char *buf,
+		   size_t len);
+void signer_free(struct signer *signer);
+
+/*
+ * Reports bucketed by signature hash. At most max clusters are kept: when a
+ * new signature comes and the set is full, the smallest cluster is replaced
+ * (Space-Saving), so counts of clusters may be overestimated by up to error.
+ */
+
+struct cluster {
+	uint64_t hash;
+	unsigned long count;
+	unsigned long error;
+	double first_seen;
+	double last_seen;
+	bool wall_clock;
+	char *signature;
+	char *title;
+};
+
+struct cluster_set {
+	/* min-heap by count */
+	struct cluster *heap;
+	unsigned int nr;
+	unsigned int max;
+	/* open addressing, heap index + 1 keyed by hash */
+	uint32_t *table;
+	unsigned int table_size;
+	/* statistics */
+	unsigned long reports;
+	unsigned long evictions;
+};
+
+uint64_t signature_hash(const char *signature);
+void cluster_set_init(struct cluster_set *set, unsigned int max);
+void cluster_add(struct cluster_set *set, const char *signature,
+		 const char *title, double timestamp, bool wall_clock);
+void cluster_set_print(FILE *stream, const struct cluster_set *set);
+void cluster_set_free(struct cluster_set *set);
+
+#endif
@@ -1,6 +1,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,45 +16,801 @@
 #include <libdwarf/libdwarf.h>
 #include <libdwarf/dwarf.h>
 
+#include "arch.h"
+#include "bulk.h"
+#include "cluster.h"
+#include "core_walk.h"
+#include "daemon.h"
+#include "datasym.h"
+#include "decompress.h"
+#include "emit.h"
+#include "image.h"
+#include "lineidx.h"
 #include "list.h"
+#include "listwalk.h"
+#include "location.h"
+#include "memsrc.h"
+#include "oops.h"
+#include "pipeline.h"
+#include "rescache.h"
+#include "resolve.h"
+#include "script.h"
+#include "slots.h"
+#include "stackscan.h"
+#include "symtab.h"
+#include "tasks.h"
+#include "types.h"
+#include "unwind.h"
 #include "util.h"
-
-
-struct call_entry {
-	unsigned long pc;
-	char *symbol;
-	unsigned int offset;
-	unsigned int size;
-};
-
-int print_call_info(Dwarf_Debug dwarf, const struct call_entry *call,
-		    Dwarf_Die sp_die);
-void print_die_info(Dwarf_Debug dwarf, Dwarf_Die die);
-void print_attr_info(Dwarf_Debug dwarf, Dwarf_Attribute attr);
-void print_locdesc(Dwarf_Debug dwarf, Dwarf_Locdesc *ld);
-void print_cfi(Dwarf_Debug dwarf, const struct call_entry *call);
-void print_regtable_entry(const char *regname, Dwarf_Regtable_Entry3 *entry);
-void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die);
-void print_line_info(Dwarf_Debug dwarf, Dwarf_Die cu_die, Dwarf_Die sp_die);
-
-int find_cu_by_pc(Dwarf_Debug dwarf, Dwarf_Arange *aranges,
-		  Dwarf_Signed ar_cnt, Dwarf_Addr pc, Dwarf_Die *result);
-int find_subprogram_by_pc(Dwarf_Debug dwarf, Dwarf_Die die, Dwarf_Addr pc,
-			  Dwarf_Die *result);
-int find_lineno_by_pc(Dwarf_Debug dwarf, Dwarf_Die cu_die, Dwarf_Addr pc,
-		      char **file, unsigned int *line);
+#include "value.h"
 
 
 void usage(FILE *stream, const char *progname)
 {
 	fprintf(stream,
 		"Usage: %s [OPTION]... <vmlinux>\n"
+		"  or:  %s --listen=SOCKET [--memory=MB]\n"
 		"\n"
-		"Options:\n", progname);
+		"Options:\n", progname, progname);
 	fprintf(stream,
 		"General options:\n"
 		"  -h, --help            Print this help message and exit.\n"
-		"  -v, --verbose         Print content of debugging information.\n");
+		"  -v, --verbose         Print content of debugging information.\n"
+		"  -a, --address=ADDR    Symbolize address ADDR instead of walking\n"
+		"                        the call trace. May be repeated.\n"
+		"  -P, --percpu          Take the --address values that fall in\n"
+		"                        the per-cpu section as offsets of per-cpu\n"
+		"                        variables.\n"
+		"  -k, --kallsyms=FILE   Read function symbols from FILE, in\n"
+		"                        /proc/kallsyms format, instead of .symtab.\n"
+		"  -B, --bulk=FILE       Symbolize every kernel address found in\n"
+		"                        FILE (\"-\" for stdin), ex. the output of\n"
+		"                        \"perf script\", one line per address.\n"
+		"  -f, --format=FORMAT   Print the results of --address and --bulk\n"
+		"                        as text (default), json (one object per\n"
+		"                        line) or binary (length-prefixed records,\n"
+		"                        see emit.h).\n"
+		"  -R, --result-cache=FILE\n"
+		"                        Keep the frames resolved by --address and\n"
+		"                        --bulk in FILE, keyed by build-id, and\n"
+		"                        answer from it on later runs.\n"
+		"  -D, --decompressed=DIR\n"
+		"                        Keep the copies of images with compressed\n"
+		"                        debug sections, decompressed, in DIR.\n"
+		"  -c, --core=FILE       Read memory from FILE, an ELF vmcore.\n"
+		"  -p, --print=EXPR      Print global variable EXPR, ex.\n"
+		"                        \"init_task.comm\", from the core. May be\n"
+		"                        repeated.\n"
+		"  -w, --walk=HEAD:TYPE:MEMBER[:FIELD]\n"
+		"                        Print the objects of TYPE linked through\n"
+		"                        MEMBER on the list, hlist or rbtree at\n"
+		"                        HEAD, ex.\n"
+		"                        \"init_task.tasks:struct task_struct:tasks:comm\".\n"
+		"                        Requires --core. May be repeated.\n"
+		"  -W, --where=FILE:LINE Print the address ranges that line LINE of\n"
+		"                        FILE, a path or its trailing components,\n"
+		"                        compiled to, inlined copies included. \"-\"\n"
+		"                        reads one query per line from stdin. May\n"
+		"                        be repeated.\n"
+		"  -g, --gdb-script=FILE Write to FILE the gdb commands that fetch\n"
+		"                        the variables of the call trace from a\n"
+		"                        dump: x reads, merged when the variables\n"
+		"                        are close, register prints and structure\n"
+		"                        dumps.\n"
+		"  -K, --crash-script=FILE\n"
+		"                        Same as --gdb-script, for the crash\n"
+		"                        utility.\n"
+		"  -n, --max=N           Stop walks after N objects (default: %lu).\n"
+		"  -T, --all-tasks       Print the backtraces of all the tasks of the\n"
+		"                        core, grouped by identical stacks.\n"
+		"                        Running tasks are only listed. Stacks in\n"
+		"                        vmalloc space (CONFIG_VMAP_STACK) are\n"
+		"                        only read on x86_64, through the kernel\n"
+		"                        page tables.\n"
+		"  -F, --frame-pointer[=N]\n"
+		"                        Unwind --all-tasks through the frame\n"
+		"                        pointer chains of kernels built with\n"
+		"                        CONFIG_FRAME_POINTER, checking one frame in\n"
+		"                        N against CFI, 0 for none (default: %u).\n"
+		"  -j, --jobs=N          Unwind, or resolve addresses, with N\n"
+		"                        threads (default: number of online\n"
+		"                        cpus).\n"
+		"  -C, --cluster=FILE    Group the kernel reports of the log FILE\n"
+		"                        (\"-\" for stdin) by crash signature.\n"
+		"  -O, --oops=FILE       Unwind the kernel reports of the log FILE\n"
+		"                        (\"-\" for stdin) from their register and\n"
+		"                        stack dumps, annotating the stack slots of\n"
+		"                        each frame. Uses --core for the stack if a\n"
+		"                        report has no \"Stack:\" dump.\n"
+		"  -S, --scan            When unwinding stops early, scan the rest\n"
+		"                        of the stack for return addresses, printed\n"
+		"                        with '?' like the kernel does. Applies to\n"
+		"                        --all-tasks and --oops.\n"
+		"  -o, --kaslr-offset=OFFSET\n"
+		"                        The kernel of --core, or of the reports\n"
+		"                        of --oops, was relocated by OFFSET\n"
+		"                        (hex) by KASLR, as its \"Kernel Offset:\"\n"
+		"                        line shows. Applies to --print, --walk\n"
+		"                        and --all-tasks. Reports that show\n"
+		"                        addresses along symbols tell it\n"
+		"                        otherwise.\n"
+		"  -x, --skip=FILE       Leave the functions listed in FILE, one per\n"
+		"                        line, out of signatures. A trailing '*'\n"
+		"                        matches any suffix.\n"
+		"  -d, --depth=N         Keep N frames in signatures (default: %u).\n"
+		"  -L, --listen=SOCKET   Serve symbolization requests on the Unix\n"
+		"                        socket SOCKET, keeping images loaded.\n"
+		"  -m, --memory=MB       Close the least recently used images when\n"
+		"                        the loaded ones exceed MB (default: %u).\n"
+		"  -s, --server=SOCKET   Send the --address requests to the server\n"
+		"                        listening on SOCKET instead of loading\n"
+		"                        vmlinux.\n",
+		WALK_MAX_DEFAULT, TASK_FP_CHECK_DEFAULT,
+		SIGNATURE_DEPTH_DEFAULT, DAEMON_MEMORY_DEFAULT);
+}
+
+
+/* what an address of print_addresses() turned out to be */
+enum addr_kind {
+	ADDR_CACHED,
+	ADDR_DATA,
+	ADDR_CODE,
+};
+
+
+/* Emit "addr: symbol" for each of the addresses. Code addresses are looked
+ * up in cache first, if given, and added to it. Those that are not are
+ * resolved ahead of printing by up to jobs - 1 helper threads. lookup_flags
+ * are the DATA_LOOKUP_* flags of data addresses. */
+void print_addresses(struct image *image, const Dwarf_Addr *addrs,
+		     unsigned int nr, struct rescache *cache, unsigned int jobs,
+		     int lookup_flags, struct emitter *out)
+{
+	struct data_index *index = NULL;
+	struct resolve_pipeline *pipe;
+	struct resolved_frame *cached;
+	enum addr_kind *kinds;
+	struct data_ref *refs;
+	uint64_t *code, build_id = 0;
+	unsigned int code_nb = 0;
+	int i;
+
+	if (cache) {
+		const unsigned char *id;
+		size_t len = image_build_id(image, &id);
+
+		if (len) {
+			build_id = rescache_build_id(id, len);
+		} else {
+			fprintf(stderr,
+				"Warning: \"%s\" has no build-id, not using the result cache.\n",
+				image->path);
+			cache = NULL;
+		}
+	}
+
+	kinds = malloc(nr * sizeof(*kinds));
+	cached = malloc(nr * sizeof(*cached));
+	refs = malloc(nr * sizeof(*refs));
+	code = malloc(nr * sizeof(*code));
+	for (i = 0; i < nr; i++) {
+		if (cache && rescache_get(cache, build_id, addrs[i],
+					  &cached[i]) == 0) {
+			kinds[i] = ADDR_CACHED;
+			continue;
+		}
+
+		if (!index) {
+			index = image_data_index(image);
+		}
+		if (data_index_lookup(index, addrs[i], lookup_flags,
+				      &refs[i]) == 0) {
+			kinds[i] = ADDR_DATA;
+		} else {
+			kinds[i] = ADDR_CODE;
+			code[code_nb++] = addrs[i];
+		}
+	}
+
+	image_prefetch(image, code, code_nb);
+	/* short lists are not worth opening the image again */
+	pipe = resolve_pipeline_start(image, code, code_nb,
+				      code_nb > PIPELINE_DEPTH ? jobs - 1 : 0);
+	for (i = 0; i < nr; i++) {
+		const struct resolved_frame *frame;
+		char buf[256];
+
+		switch (kinds[i]) {
+		case ADDR_CACHED:
+			emit_frame(out, &cached[i], false);
+			break;
+
+		case ADDR_DATA:
+			data_ref_format(image_type_cache(image), &refs[i], buf,
+					sizeof(buf));
+			emit_data(out, addrs[i], buf);
+			break;
+
+		case ADDR_CODE:
+			frame = resolve_pipeline_next(pipe);
+			emit_frame(out, frame, false);
+			if (cache && frame->locs_nb) {
+				rescache_put(cache, build_id, frame);
+			}
+			break;
+		}
+	}
+	resolve_pipeline_finish(pipe);
+	emitter_flush(out);
+
+	free(code);
+	free(refs);
+	free(cached);
+	free(kinds);
+}
+
+
+/* Symbolize the addresses of the file at path, "-" for stdin */
+void print_bulk(struct image *image, const char *path,
+		struct rescache *cache, bool verbose, struct emitter *out)
+{
+	FILE *stream = stdin;
+
+	if (strcmp(path, "-") != 0 && (stream = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "Error: open \"%s\" failed: %s\n", path,
+			strerror(errno));
+		return;
+	}
+	bulk_symbolize(image, stream, out, cache, verbose);
+	if (stream != stdin) {
+		fclose(stream);
+	}
+}
+
+
+/* Find the address and type of a global variable expression like
+ * "var->a.b[3]", in a kernel relocated by slide. Prints an error and returns
+ * -1 on failure. */
+int resolve_expression(struct image *image, const char *expr, uint64_t slide,
+		       Dwarf_Addr *addr, const struct type_desc **type)
+{
+	struct data_index *index = image_data_index(image);
+	const struct data_sym *sym;
+	Dwarf_Unsigned offset;
+	const char *path;
+	char name[256];
+	size_t len;
+
+	len = strcspn(expr, ".[-");
+	if (len == 0 || len >= sizeof(name)) {
+		fprintf(stderr, "Invalid expression \"%s\".\n", expr);
+		return -1;
+	}
+	memcpy(name, expr, len);
+	name[len] = '\0';
+	path = expr + len;
+
+	sym = data_index_find(index, name);
+	if (!sym || !sym->type_offset) {
+		fprintf(stderr, "No variable \"%s\" with type information.\n",
+			name);
+		return -1;
+	}
+	*type = type_cache_get(image_type_cache(image), sym->type_offset);
+	*addr = data_sym_address(index, sym, slide);
+
+	if (strncmp(path, "->", 2) == 0) {
+		uint64_t ptr = 0;
+
+		if (mem_read(image->mem, *addr, &ptr, image->addr_size) != 0) {
+			fprintf(stderr,
+				"Cannot read \"%s\" at 0x%" DW_PR_DUx ".\n",
+				name, *addr);
+			return -1;
+		}
+		*addr = ptr;
+	}
+	if (type_resolve_path(*type, path, &offset, type) != 0) {
+		fprintf(stderr, "Cannot resolve \"%s\".\n", expr);
+		return -1;
+	}
+	*addr += offset;
+
+	return 0;
+}
+
+
+/* print the value of global variable expressions */
+void print_expressions(struct image *image, char * const *exprs,
+		       unsigned int nr, uint64_t slide, bool verbose)
+{
+	struct value_printer vp;
+	int i;
+
+	value_printer_init(&vp, image->mem, stdout);
+	vp.data_index = image_data_index(image);
+	vp.types = image_type_cache(image);
+
+	for (i = 0; i < nr; i++) {
+		const struct type_desc *type;
+		Dwarf_Addr addr;
+
+		if (resolve_expression(image, exprs[i], slide, &addr,
+				       &type) == 0) {
+			value_print(&vp, exprs[i], type, addr);
+		}
+	}
+
+	if (verbose) {
+		printf("memory: %lu reads, %llu bytes\n", image->mem->reads,
+		       image->mem->bytes_read);
+	}
+	value_printer_free(&vp);
+}
+
+
+/*
+ * Walk "HEAD:TYPE:MEMBER[:FIELD]", ex.
+ * "init_task.tasks:struct task_struct:tasks:comm", and print the address of
+ * each object, and FIELD if given. HEAD is found as resolve_expression()
+ * does.
+ */
+void print_walk(struct image *image, const char *spec, unsigned long max,
+		uint64_t slide, bool verbose)
+{
+	const struct type_desc *head_type, *container, *field_type = NULL;
+	char *copy, *head, *type_name, *member, *field;
+	Dwarf_Unsigned field_offset = 0;
+	struct mem_cache cache;
+	struct list_walk walk;
+	enum walk_kind kind;
+	Dwarf_Addr addr;
+	uint64_t obj;
+
+	copy = strdup(spec);
+	head = strtok(copy, ":");
+	type_name = strtok(NULL, ":");
+	member = strtok(NULL, ":");
+	field = strtok(NULL, "");
+	if (!head || !type_name || !member) {
+		fprintf(stderr, "Invalid walk \"%s\", expected HEAD:TYPE:MEMBER[:FIELD].\n",
+			spec);
+		goto out;
+	}
+
+	if (resolve_expression(image, head, slide, &addr, &head_type) != 0) {
+		goto out;
+	}
+	if (walk_kind_from_type(head_type, &kind) != 0) {
+		fprintf(stderr, "\"%s\" is not a list, hlist or rbtree head.\n",
+			head);
+		goto out;
+	}
+	if ((container = type_cache_find(image_type_cache(image),
+					 type_name)) == NULL) {
+		fprintf(stderr, "No type \"%s\".\n", type_name);
+		goto out;
+	}
+	if (field && type_resolve_path(container, field, &field_offset,
+				       &field_type) != 0) {
+		fprintf(stderr, "No member \"%s\" in \"%s\".\n", field,
+			type_name);
+		goto out;
+	}
+	mem_cache_init(&cache, image->mem, WALK_CACHE_PAGES, WALK_READAHEAD);
+	if (list_walk_init(&walk, &cache, image->addr_size, kind, addr,
+			   container, member, max) != 0) {
+		fprintf(stderr, "No member \"%s\" in \"%s\".\n", member,
+			type_name);
+		mem_cache_free(&cache);
+		goto out;
+	}
+
+	while (list_walk_next(&walk, &obj)) {
+		printf("0x%0*" PRIx64, 2 * (int) image->addr_size, obj);
+		if (field_type) {
+			struct value_printer vp;
+
+			/* a fresh plan for each object keeps memory usage
+			 * flat on long lists */
+			value_printer_init(&vp, image->mem, stdout);
+			vp.data_index = image_data_index(image);
+			vp.types = image_type_cache(image);
+			printf(": ");
+			value_print(&vp, field, field_type,
+				    obj + field_offset);
+			value_printer_free(&vp);
+		} else {
+			printf("\n");
+		}
+	}
+	printf("%lu objects, %s\n", walk.nr, walk_status_names[walk.status]);
+	if (verbose) {
+		printf("cache: %lu hits, %lu misses\n", cache.hits,
+		       cache.misses);
+	}
+	mem_cache_free(&cache);
+
+out:
+	free(copy);
+}
+
+
+/* Group the reports of the log at path ("-" for stdin) by signature. */
+void print_clusters(struct image *image, const char *path,
+		    const char *skip_path, unsigned int depth)
+{
+	struct oops_reader reader;
+	struct oops oops = {};
+	struct cluster_set set;
+	struct signer signer;
+	char signature[1024];
+	FILE *stream = stdin;
+
+	if (strcmp(path, "-") != 0 && (stream = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "Error: open \"%s\" failed: %s\n", path,
+			strerror(errno));
+		return;
+	}
+
+	signer_init(&signer, image, depth);
+	if (skip_path && signer_load_skip(&signer, skip_path) == -1) {
+		goto out;
+	}
+	cluster_set_init(&set, CLUSTER_MAX);
+	oops_reader_init(&reader, stream);
+	while (oops_read(&reader, &oops)) {
+		signer_sign(&signer, &oops, signature, sizeof(signature));
+		cluster_add(&set, signature, oops.title, oops.timestamp,
+			    oops.wall_clock);
+	}
+	cluster_set_print(stdout, &set);
+
+	oops_free(&oops);
+	oops_reader_free(&reader);
+	cluster_set_free(&set);
+out:
+	signer_free(&signer);
+	if (stream != stdin) {
+		fclose(stream);
+	}
+}
+
+
+/* Print the words of the stack dump of oops in the frame of pc, from the
+ * stack pointer to the CFA, with the objects they hold. */
+static void print_frame_stack(struct image *image, const struct oops *oops,
+			      uint64_t pc, const struct unwind_regs *regs)
+{
+	uint64_t stack_start = oops->regs.regs[REG_SP];
+	uint64_t stack_end = stack_start + oops->stack_nb * sizeof(uint64_t);
+	uint64_t start = regs->regs[REG_SP], end, cfa;
+	Dwarf_Addr cu_base = 0;
+	Dwarf_Die cu_die, sp_die;
+	struct slot_map map;
+
+	if (image_find_cu(image, pc, &cu_die) == -1) {
+		return;
+	}
+	if (find_subprogram_by_pc(image->dwarf, cu_die, pc, &sp_die) == -1) {
+		dwarf_dealloc(image->dwarf, cu_die, DW_DLA_DIE);
+		return;
+	}
+	dwarf_lowpc(cu_die, &cu_base, NULL);
+	if (slot_map_build(image->dwarf, image_type_cache(image), sp_die,
+			   cu_base, pc, &map) == 0 &&
+	    regs->valid & (1ULL << map.cfa_reg)) {
+		cfa = regs->regs[map.cfa_reg] + map.cfa_offset;
+		end = cfa < stack_end ? cfa : stack_end;
+		if (start < stack_start) {
+			start = stack_start;
+		}
+		/* the words are used in place, no copy */
+		if (start < end && (start - stack_start) % sizeof(uint64_t) ==
+		    0) {
+			slot_map_annotate(&map, cfa, start,
+					  &oops->stack[(start - stack_start) /
+						       sizeof(uint64_t)],
+					  (end - start) / sizeof(uint64_t));
+		}
+	}
+	slot_map_free(&map);
+	dwarf_dealloc(image->dwarf, sp_die, DW_DLA_DIE);
+	dwarf_dealloc(image->dwarf, cu_die, DW_DLA_DIE);
+}
+
+
+/* Print the words of the stack dump above sp that look like return
+ * addresses, as frames numbered from first. slide is the KASLR slide of the
+ * kernel that printed oops. */
+static void print_oops_scan(struct image *image, const struct oops *oops,
+			    uint64_t sp, uint64_t slide, unsigned int first,
+			    struct strpool *pool)
+{
+	const struct text_filter *text = image_text_filter(image);
+	uint64_t stack_lo = oops->regs.regs[REG_SP];
+	unsigned int found[OOPS_FRAMES_MAX];
+	unsigned int i, start, nr;
+
+	if (!text) {
+		return;
+	}
+	start = sp > stack_lo ? (sp - stack_lo) / sizeof(uint64_t) : 0;
+	if (start >= oops->stack_nb) {
+		return;
+	}
+	nr = stack_scan(text, slide, &oops->stack[start],
+			oops->stack_nb - start, found, OOPS_FRAMES_MAX);
+	for (i = 0; i < nr; i++) {
+		struct resolved_frame frame = {
+			.pc = oops->stack[start + found[i]] - slide,
+		};
+
+		printf("#%-2u ? ", first + i);
+		resolve_return_pc(image, frame.pc, pool, &frame);
+		resolved_frame_print(stdout, &frame, image->addr_size);
+	}
+}
+
+
+/* KASLR aligns the kernel on 2 MiB */
+#define KASLR_ALIGN 0x200000
+
+
+/* The KASLR slide of the kernel that printed oops, the runtime addresses
+ * minus the link addresses, from the first frame of the core kernel that
+ * shows both its address and its symbol. Slides that are not aligned come
+ * from symbols found twice in the image and are not trusted. 0 if no frame
+ * tells. */
+static uint64_t oops_slide(struct image *image, const struct oops *oops)
+{
+	struct symtab *symtab = image_symtab(image);
+	unsigned int i;
+
+	for (i = 0; symtab && i < oops->frames_nb; i++) {
+		const struct oops_frame *frame = &oops->frames[i];
+		uint64_t slide;
+		int sym;
+
+		if (!frame->pc || !frame->symbol || frame->module ||
+		    (sym = symtab_find(symtab, frame->symbol)) == -1) {
+			continue;
+		}
+		slide = frame->pc - (symtab->starts[sym] + frame->offset);
+		if (slide % KASLR_ALIGN == 0) {
+			return slide;
+		}
+	}
+	return 0;
+}
+
+
+/*
+ * Unwind a report from its register dump through CFI, reading the stack
+ * from its "Stack:" dump, or from the core if it has none, and print each
+ * frame with the stack slots of its variables. The addresses of the report
+ * are rebased by its KASLR slide before they are looked up: slide if not
+ * NULL, else the one found from the report.
+ */
+static void print_oops_frames(struct image *image, const struct oops *oops,
+			      bool scan, const uint64_t *slide)
+{
+	struct unwind_regs regs = oops->regs;
+	enum unwind_status status = UNWIND_MAX_FRAMES;
+	struct mem_source *src = NULL;
+	struct mem_cache cache;
+	struct strpool pool = {};
+	uint64_t stack_lo = regs.regs[REG_SP], stack_hi = UINT64_MAX;
+	unsigned int i;
+
+	regs.slide = slide ? *slide : oops_slide(image, oops);
+	if (regs.slide) {
+		printf("    KASLR offset 0x%" PRIx64 "\n", regs.slide);
+	}
+	/* a RIP printed as an address is a runtime one, one printed as a
+	 * symbol is found at its link address. It is the pc, not the return
+	 * address column. */
+	if (regs.valid & (1ULL << REG_RA)) {
+		regs.pc = regs.regs[REG_RA] - regs.slide;
+		regs.valid &= ~(1ULL << REG_RA);
+	} else if (oops->rip_symbol) {
+		struct symtab *symtab = image_symtab(image);
+		int sym;
+
+		if (symtab && (sym = symtab_find(symtab,
+						 oops->rip_symbol)) != -1) {
+			regs.pc = symtab->starts[sym] + oops->rip_offset;
+		}
+	}
+	if (!regs.pc || !(regs.valid & (1ULL << REG_SP))) {
+		printf("    no register dump\n");
+		return;
+	}
+
+	if (oops->stack_nb) {
+		src = mem_source_open_words(stack_lo, oops->stack,
+					    oops->stack_nb);
+		stack_hi = stack_lo + oops->stack_nb * sizeof(uint64_t);
+	} else if (image->mem) {
+		src = image->mem;
+	}
+	if (src) {
+		mem_cache_init(&cache, src, 64, 1);
+	}
+
+	for (i = 0; i < OOPS_FRAMES_MAX; i++) {
+		struct resolved_frame frame = {
+			.pc = regs.pc,
+		};
+		/* outer pcs are return addresses */
+		uint64_t pc = i ? frame.pc - 1 : frame.pc;
+
+		if (!frame.pc) {
+			status = UNWIND_END;
+			break;
+		}
+		printf("#%-2u ", i);
+		if (i) {
+			resolve_return_pc(image, frame.pc, &pool, &frame);
+		} else {
+			resolve_pc(image, frame.pc, &pool, &frame);
+		}
+		resolved_frame_print(stdout, &frame, image->addr_size);
+		if (oops->stack_nb) {
+			print_frame_stack(image, oops, pc, &regs);
+		}
+		if (!src) {
+			status = UNWIND_FAULT;
+			break;
+		}
+		if (unwind_step(image_cfi(image), &cache, image->addr_size,
+				&regs, i == 0, stack_lo, stack_hi,
+				&status) == -1) {
+			break;
+		}
+	}
+	printf("    %s\n", unwind_status_names[status]);
+	if (scan && status != UNWIND_END && status != UNWIND_MAX_FRAMES &&
+	    oops->stack_nb) {
+		print_oops_scan(image, oops, regs.regs[REG_SP], regs.slide,
+				i + 1, &pool);
+	}
+
+	if (src) {
+		mem_cache_free(&cache);
+	}
+	if (src && src != image->mem) {
+		mem_source_close(src);
+	}
+	strpool_free(&pool);
+}
+
+
+/* Print the frames of the reports of the log at path ("-" for stdin) that
+ * have register dumps. slide is the KASLR slide of the kernel, NULL to find
+ * it from each report. */
+void print_oopses(struct image *image, const char *path, bool scan,
+		  const uint64_t *slide)
+{
+	struct oops_reader reader;
+	struct oops oops = {};
+	FILE *stream = stdin;
+
+	if (strcmp(path, "-") != 0 && (stream = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "Error: open \"%s\" failed: %s\n", path,
+			strerror(errno));
+		return;
+	}
+
+	oops_reader_init(&reader, stream);
+	while (oops_read(&reader, &oops)) {
+		printf("%s\n", oops.title);
+		print_oops_frames(image, &oops, scan, slide);
+	}
+	oops_free(&oops);
+	oops_reader_free(&reader);
+	if (stream != stdin) {
+		fclose(stream);
+	}
+}
+
+
+static void print_where_one(const struct line_index *index, const char *query,
+			    int addr_size)
+{
+	const struct line_file *file = NULL;
+	const char *colon = strrchr(query, ':');
+	unsigned long line, found = 0;
+	char *path, *end;
+
+	errno = 0;
+	line = colon ? strtoul(colon + 1, &end, 10) : 0;
+	if (!colon || errno || *end != '\0' || end == colon + 1) {
+		fprintf(stderr, "Invalid location \"%s\".\n", query);
+		return;
+	}
+	path = strndup(query, colon - query);
+
+	while ((file = line_index_next_file(index, path, file)) != NULL) {
+		const struct line_range *ranges;
+		unsigned long i, nr;
+
+		ranges = line_file_find(index, file, line, &nr);
+		for (i = 0; i < nr; i++) {
+			printf("%s:%lu [0x%0*" DW_PR_DUx ", 0x%0*" DW_PR_DUx
+			       "[\n", file->name, line, 2 * addr_size,
+			       ranges[i].lo, 2 * addr_size, ranges[i].hi);
+		}
+		found += nr;
+	}
+	free(path);
+	if (!found) {
+		fprintf(stderr, "Warning: no code for \"%s\".\n", query);
+	}
+}
+
+
+/* Print the address ranges of each FILE:LINE query, "-" reads them from
+ * stdin, one per line. */
+void print_where(struct image *image, char **queries, unsigned int nr,
+		 bool verbose)
+{
+	const struct line_index *index = image_line_index(image);
+	unsigned int i;
+
+	if (verbose) {
+		printf("line index: %u files, %lu ranges\n", index->files_nb,
+		       index->ranges_nb);
+	}
+	for (i = 0; i < nr; i++) {
+		char *line = NULL;
+		size_t n = 0;
+		ssize_t len;
+
+		if (strcmp(queries[i], "-") != 0) {
+			print_where_one(index, queries[i], image->addr_size);
+			continue;
+		}
+		while ((len = getline(&line, &n, stdin)) != -1) {
+			if (len && line[len - 1] == '\n') {
+				line[len - 1] = '\0';
+			}
+			if (*line) {
+				print_where_one(index, line, image->addr_size);
+			}
+		}
+		free(line);
+	}
+	fflush(stdout);
+}
+
+
+/* Code without subprogram entries can only be checked against the symbol
+ * table. */
+void check_call_symbol(struct image *image, const struct call_entry *call,
+		       bool verbose)
+{
+	Dwarf_Unsigned offset, size;
+	char name[256];
+
+	if (find_symbol_by_pc(image, call->pc, name, sizeof(name), &offset,
+			      &size) == -1) {
+		fprintf(stderr,
+			"Warning: no symbol found for the following call:\n");
+		fprintf(stderr, "[<%016lx>] %s\n", call->pc, call->symbol);
+		return;
+	}
+
+	if (strcmp(name, call->symbol) != 0) {
+		fprintf(stderr,
+			"Warning: symbol table says \"%s\", expected \"%s\".\n",
+			name, call->symbol);
+	}
+	if (verbose) {
+		printf("Symbol\n");
+		printf("    %s+0x%" DW_PR_DUx "/0x%" DW_PR_DUx "\n", name,
+		       offset, size);
+	}
 }
 
 
@@ -62,14 +820,46 @@ int main(int argc, char *argv[])
 	extern int optind;
 	bool verbose = false;
 	char *objname;
-	int fd, i;
-
-	Elf *elf;
-
+	int i;
+	Dwarf_Addr *addrs = NULL;
+	unsigned int addrs_nb = 0;
+	const char *kallsyms_path = NULL;
+	const char *core_path = NULL;
+	const char *bulk_path = NULL;
+	const char *rescache_path = NULL;
+	struct rescache *rescache = NULL;
+	enum emit_format format = EMIT_TEXT;
+	struct emitter out;
+	char **exprs = NULL;
+	unsigned int exprs_nb = 0;
+	char **walks = NULL;
+	unsigned int walks_nb = 0;
+	char **wheres = NULL;
+	unsigned int wheres_nb = 0;
+	char *script_paths[] = {
+		[SCRIPT_GDB] = NULL,
+		[SCRIPT_CRASH] = NULL,
+	};
+	bool scripts;
+	struct script script;
+	unsigned long walk_max = WALK_MAX_DEFAULT;
+	bool all_tasks = false;
+	bool scan = false;
+	uint64_t kaslr_offset = 0;
+	bool kaslr_known = false;
+	int lookup_flags = 0;
+	long fp_check = -1;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *cluster_path = NULL;
+	const char *skip_path = NULL;
+	const char *oops_path = NULL;
+	unsigned int depth = SIGNATURE_DEPTH_DEFAULT;
+	const char *listen_path = NULL;
+	const char *server_path = NULL;
+	unsigned long memory_mb = DAEMON_MEMORY_DEFAULT;
+
+	struct image image;
 	Dwarf_Debug dwarf;
-	Dwarf_Half addr_size;
-	Dwarf_Arange *aranges;
-	Dwarf_Signed ar_cnt;
 
 	struct call_entry calltrace[] = {
 		/* bogus entry, good test of location descriptions */
@@ -89,6 +879,7 @@ int main(int argc, char *argv[])
 		{0xffffffff81001186, "cpu_idle", 0x66},
 		{0xffffffff8171d40c, "start_secondary", 0x232},
 	};
+	uint64_t calltrace_pcs[ARRAY_SIZE(calltrace)];
 
 	int retval;
 
@@ -96,10 +887,39 @@ int main(int argc, char *argv[])
 		static struct option long_options[] = {
 			{"help", no_argument, 0, 'h'},
 			{"verbose", no_argument, 0, 'v'},
+			{"address", required_argument, 0, 'a'},
+			{"percpu", no_argument, 0, 'P'},
+			{"kallsyms", required_argument, 0, 'k'},
+			{"bulk", required_argument, 0, 'B'},
+			{"format", required_argument, 0, 'f'},
+			{"result-cache", required_argument, 0, 'R'},
+			{"decompressed", required_argument, 0, 'D'},
+			{"core", required_argument, 0, 'c'},
+			{"print", required_argument, 0, 'p'},
+			{"walk", required_argument, 0, 'w'},
+			{"where", required_argument, 0, 'W'},
+			{"gdb-script", required_argument, 0, 'g'},
+			{"crash-script", required_argument, 0, 'K'},
+			{"max", required_argument, 0, 'n'},
+			{"all-tasks", no_argument, 0, 'T'},
+			{"frame-pointer", optional_argument, 0, 'F'},
+			{"jobs", required_argument, 0, 'j'},
+			{"cluster", required_argument, 0, 'C'},
+			{"oops", required_argument, 0, 'O'},
+			{"scan", no_argument, 0, 'S'},
+			{"kaslr-offset", required_argument, 0, 'o'},
+			{"skip", required_argument, 0, 'x'},
+			{"depth", required_argument, 0, 'd'},
+			{"listen", required_argument, 0, 'L'},
+			{"memory", required_argument, 0, 'm'},
+			{"server", required_argument, 0, 's'},
 			{0, 0, 0, 0}
 		};
+		char *end;
 
-		c = getopt_long(argc, argv, "hv", long_options, NULL);
+		c = getopt_long(argc, argv,
+				"hva:Pk:B:f:R:D:c:p:w:W:g:K:n:TF::j:C:O:So:x:d:L:m:s:",
+				long_options, NULL);
 
 		switch (c) {
 		case -1:
@@ -114,6 +934,173 @@ int main(int argc, char *argv[])
 			verbose = true;
 			break;
 
+		case 'a':
+			addrs = realloc(addrs, (addrs_nb + 1) *
+					sizeof(*addrs));
+			errno = 0;
+			addrs[addrs_nb] = strtoull(optarg, &end, 16);
+			if (errno || *end != '\0' || end == optarg) {
+				fprintf(stderr, "Invalid address \"%s\".\n",
+					optarg);
+				exit(EXIT_FAILURE);
+			}
+			addrs_nb++;
+			break;
+
+		case 'P':
+			lookup_flags |= DATA_LOOKUP_PERCPU_OFFSET;
+			break;
+
+		case 'k':
+			kallsyms_path = optarg;
+			break;
+
+		case 'B':
+			bulk_path = optarg;
+			break;
+
+		case 'f':
+			if (emit_format_parse(optarg, &format) == -1) {
+				fprintf(stderr, "Invalid format \"%s\".\n",
+					optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'R':
+			rescache_path = optarg;
+			break;
+
+		case 'D':
+			decompress_set_cache_dir(optarg);
+			break;
+
+		case 'c':
+			core_path = optarg;
+			break;
+
+		case 'p':
+			exprs = realloc(exprs, (exprs_nb + 1) *
+					sizeof(*exprs));
+			exprs[exprs_nb++] = optarg;
+			break;
+
+		case 'w':
+			walks = realloc(walks, (walks_nb + 1) *
+					sizeof(*walks));
+			walks[walks_nb++] = optarg;
+			break;
+
+		case 'W':
+			wheres = realloc(wheres, (wheres_nb + 1) *
+					 sizeof(*wheres));
+			wheres[wheres_nb++] = optarg;
+			break;
+
+		case 'g':
+			script_paths[SCRIPT_GDB] = optarg;
+			break;
+
+		case 'K':
+			script_paths[SCRIPT_CRASH] = optarg;
+			break;
+
+		case 'n':
+			errno = 0;
+			walk_max = strtoul(optarg, &end, 0);
+			if (errno || *end != '\0' || end == optarg) {
+				fprintf(stderr, "Invalid maximum \"%s\".\n",
+					optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'T':
+			all_tasks = true;
+			break;
+
+		case 'F':
+			fp_check = TASK_FP_CHECK_DEFAULT;
+			if (!optarg) {
+				break;
+			}
+			errno = 0;
+			fp_check = strtol(optarg, &end, 0);
+			if (errno || *end != '\0' || end == optarg ||
+			    fp_check < 0 || fp_check > INT_MAX) {
+				fprintf(stderr, "Invalid check \"%s\".\n",
+					optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'j':
+			errno = 0;
+			jobs = strtol(optarg, &end, 0);
+			if (errno || *end != '\0' || end == optarg ||
+			    jobs < 1) {
+				fprintf(stderr, "Invalid jobs \"%s\".\n",
+					optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'C':
+			cluster_path = optarg;
+			break;
+
+		case 'O':
+			oops_path = optarg;
+			break;
+
+		case 'S':
+			scan = true;
+			break;
+
+		case 'o':
+			errno = 0;
+			kaslr_offset = strtoull(optarg, &end, 16);
+			if (errno || *end != '\0' || end == optarg) {
+				fprintf(stderr, "Invalid offset \"%s\".\n",
+					optarg);
+				exit(EXIT_FAILURE);
+			}
+			kaslr_known = true;
+			break;
+
+		case 'x':
+			skip_path = optarg;
+			break;
+
+		case 'd':
+			errno = 0;
+			depth = strtoul(optarg, &end, 0);
+			if (errno || *end != '\0' || end == optarg ||
+			    depth < 1) {
+				fprintf(stderr, "Invalid depth \"%s\".\n",
+					optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'L':
+			listen_path = optarg;
+			break;
+
+		case 'm':
+			errno = 0;
+			memory_mb = strtoul(optarg, &end, 0);
+			if (errno || *end != '\0' || end == optarg) {
+				fprintf(stderr, "Invalid memory \"%s\".\n",
+					optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 's':
+			server_path = optarg;
+			break;
+
 		case '?':
 			usage(stderr, argv[0]);
 			exit(EXIT_FAILURE);
@@ -124,12 +1111,22 @@ int main(int argc, char *argv[])
 		}
 	} while (c != -1);
 
-	if (argc - optind != 1) {
+	if (argc - optind != (listen_path ? 0 : 1)) {
 		fprintf(stderr, "Wrong number of arguments.\n");
 		usage(stderr, argv[0]);
 		return EXIT_FAILURE;
 	}
 	objname = argv[optind];
+	if (server_path) {
+		/* nothing is loaded locally */
+		retval = daemon_client(server_path, objname, addrs, addrs_nb);
+		free(addrs);
+		return retval ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+	if ((exprs_nb || walks_nb || all_tasks) && !core_path) {
+		fprintf(stderr, "--print, --walk and --all-tasks require --core.\n");
+		return EXIT_FAILURE;
+	}
 
 	if (elf_version(EV_CURRENT) == EV_NONE) {
 		fprintf(stderr,
@@ -141,43 +1138,83 @@ int main(int argc, char *argv[])
 	dwarf_record_cmdline_options(
 		(Dwarf_Cmdline_Options) {.check_verbose_mode = false});
 
-	if ((fd = open(objname, O_RDONLY, 0)) == -1) {
-		fprintf(stderr, "Error: open \"%s\" failed: %s\n", objname,
-			strerror(errno));
-		abort();
-	}
-
-	if ((elf = elf_begin(fd, ELF_C_READ, NULL)) == NULL) {
-		fprintf(stderr, "Error: at line %d, libelf says: %s\n",
-			__LINE__, elf_errmsg(-1));
-		abort();
+	if (listen_path) {
+		daemon_serve(listen_path, memory_mb);
+		return EXIT_FAILURE;
 	}
 
-	if (elf_kind(elf) != ELF_K_ELF) {
-		fprintf(stderr, "Error: \"%s\" is not an ELF object.\n",
-			objname);
-		abort();
+	image_open(&image, objname);
+	image.kallsyms_path = kallsyms_path;
+	image_index_background(&image);
+	if (core_path) {
+		image.mem = mem_source_open_elfcore(core_path);
 	}
+	dwarf = image.dwarf;
 
-	retval = dwarf_elf_init(elf, DW_DLC_READ, NULL, NULL, &dwarf, NULL);
-	if (retval == DW_DLV_NO_ENTRY) {
-		fprintf(stderr,
-			"Error: \"%s\" does not contain debug information.\n",
-			objname);
-		abort();
+	if (addrs_nb || bulk_path || exprs_nb || walks_nb || all_tasks ||
+	    cluster_path || wheres_nb || oops_path) {
+		if (rescache_path) {
+			rescache = rescache_open(rescache_path);
+		}
+		/* the emitter writes to the descriptor directly */
+		fflush(stdout);
+		emitter_init(&out, STDOUT_FILENO, format, image.addr_size);
+		if (addrs_nb) {
+			print_addresses(&image, addrs, addrs_nb, rescache,
+					jobs, lookup_flags, &out);
+			if (rescache && verbose) {
+				fprintf(stderr,
+					"result cache: %lu hits, %lu misses\n",
+					rescache->hits, rescache->misses);
+			}
+		}
+		if (bulk_path) {
+			print_bulk(&image, bulk_path, rescache, verbose,
+				   &out);
+		}
+		emitter_close(&out);
+		if (rescache) {
+			rescache_close(rescache);
+		}
+		if (exprs_nb) {
+			print_expressions(&image, exprs, exprs_nb,
+					  kaslr_offset, verbose);
+		}
+		for (i = 0; i < walks_nb; i++) {
+			print_walk(&image, walks[i], walk_max, kaslr_offset,
+				   verbose);
+		}
+		if (all_tasks) {
+			tasks_print_backtraces(&image, jobs, scan, fp_check,
+					       kaslr_offset, verbose);
+		}
+		if (cluster_path) {
+			print_clusters(&image, cluster_path, skip_path, depth);
+		}
+		if (wheres_nb) {
+			print_where(&image, wheres, wheres_nb, verbose);
+		}
+		if (oops_path) {
+			print_oopses(&image, oops_path, scan,
+				     kaslr_known ? &kaslr_offset : NULL);
+		}
+		free(addrs);
+		free(exprs);
+		free(walks);
+		free(wheres);
+		image_close(&image);
+		if (core_path) {
+			mem_source_close(image.mem);
+		}
+		return EXIT_SUCCESS;
 	}
 
-	dwarf_get_address_size(dwarf, &addr_size, NULL);
-
-	/* todo: fallback to traversing all DIEs, especially if searching by
-	 * symbol instead of address */
-	retval = dwarf_get_aranges(dwarf, &aranges, &ar_cnt, NULL);
-	if (retval == DW_DLV_NO_ENTRY) {
-		fprintf(stderr,
-			"Error: \"%s\" does not contain a .debug_aranges section.\n",
-			objname);
-		abort();
+	for (i = 0; i < ARRAY_SIZE(calltrace); i++) {
+		calltrace_pcs[i] = calltrace[i].pc;
 	}
+	image_prefetch(&image, calltrace_pcs, ARRAY_SIZE(calltrace));
+	scripts = script_paths[SCRIPT_GDB] || script_paths[SCRIPT_CRASH];
+	script_init(&script, arch_of_dwarf(dwarf), image.addr_size);
 
 	for (i = 0; i < ARRAY_SIZE(calltrace); i++) {
 		const struct call_entry *call = &calltrace[i];
@@ -186,13 +1223,25 @@ int main(int argc, char *argv[])
 		char *name;
 		unsigned int line;
 
-		retval = find_cu_by_pc(dwarf, aranges, ar_cnt, call->pc,
-				       &cu_die);
+		retval = image_find_cu(&image, call->pc, &cu_die);
 		if (retval == -1) {
-			fprintf(stderr,
-				"Error: no arange entry found for the following call:\n");
-			fprintf(stderr, "[<%016lx>] %s\n", call->pc, call->symbol);
-			abort();
+			Dwarf_Unsigned offset, size;
+			char sym_name[256];
+
+			/* code without debugging information */
+			if (find_symbol_by_pc(&image, call->pc, sym_name,
+					      sizeof(sym_name), &offset,
+					      &size) == -1) {
+				fprintf(stderr,
+					"Error: no arange entry found for the following call:\n");
+				fprintf(stderr, "[<%016lx>] %s\n", call->pc,
+					call->symbol);
+				abort();
+			}
+			printf("[<%0*lx>] %s+0x%" DW_PR_DUx "/0x%" DW_PR_DUx
+			       " (no debug info)\n", 2 * (int) image.addr_size,
+			       call->pc, sym_name, offset, size);
+			continue;
 		}
 
 		retval = find_lineno_by_pc(dwarf, cu_die, call->pc, &name,
@@ -220,7 +1269,7 @@ int main(int argc, char *argv[])
 			abort();
 		}
 		printf("[<%0*lx>] %s+0x%x/0x%x (%s:%u)\n",
-		       2 * (int) addr_size, call->pc, call->symbol,
+		       2 * (int) image.addr_size, call->pc, call->symbol,
 		       call->offset, call->size, name, line);
 		dwarf_dealloc(dwarf, name, DW_DLA_STRING);
 
@@ -236,9 +1285,11 @@ int main(int argc, char *argv[])
 			print_die_info(dwarf, cu_die);
 			abort();
 		} else if (lang == DW_LANG_Mips_Assembler) {
-			printf("Info: \"%s\" is defined in assembly source, stopping here for now.\n",
-			       call->symbol);
-			break;
+			/* assembly has line numbers but no subprogram
+			 * entries */
+			check_call_symbol(&image, call, verbose);
+			dwarf_dealloc(dwarf, cu_die, DW_DLA_DIE);
+			continue;
 		}
 
 		retval = find_subprogram_by_pc(dwarf, cu_die, call->pc, &sp_die);
@@ -277,19 +1328,21 @@ int main(int argc, char *argv[])
 		}
 
 		if (verbose) {
-			print_call_info(dwarf, call, sp_die);
+			print_call_info(&image, call, sp_die);
+		}
+		if (scripts) {
+			script_add_call(&image, &script, i, call, sp_die);
 		}
 
 		dwarf_dealloc(dwarf, sp_die, DW_DLA_DIE);
 	}
+	write_scripts(&script, script_paths);
+	script_free(&script);
 
-	for (i = 0; i < ar_cnt; i++) {
-		dwarf_dealloc(dwarf, aranges[i], DW_DLA_ARANGE);
+	image_close(&image);
+	if (core_path) {
+		mem_source_close(image.mem);
 	}
-	dwarf_dealloc(dwarf, aranges, DW_DLA_LIST);
-	dwarf_finish(dwarf, NULL);
-	elf_end(elf);
-	close(fd);
 
 	return EXIT_SUCCESS;
 }
@@ -354,47 +1407,217 @@ int find_lineno_by_pc(Dwarf_Debug dwarf, Dwarf_Die cu_die, Dwarf_Addr pc,
 		previous = laddr;
 	}
 
-	if (i != nlines) {
-		dwarf_lineno(lines[i], &lineno, NULL);
-		*line = lineno;
-		dwarf_linesrc(lines[i], file, NULL);
+	if (i != nlines) {
+		dwarf_lineno(lines[i], &lineno, NULL);
+		*line = lineno;
+		dwarf_linesrc(lines[i], file, NULL);
+	}
+	dwarf_srclines_dealloc(dwarf, lines, nlines);
+	if (i == nlines) {
+		return -2;
+	}
+
+	/* Strip the compilation directory from the file name. */
+	retval = dwarf_attr(cu_die, DW_AT_comp_dir, &comp_dir_attr, NULL);
+	if (retval == DW_DLV_NO_ENTRY) {
+		fprintf(stderr,
+			"Warning: expected CU DIE to have a compilation directory attribute.\n");
+		return 0;
+	}
+	dwarf_formstring(comp_dir_attr, &comp_dir, NULL);
+	len = strlen(comp_dir);
+	if (strlen(*file) >= len && memcmp(comp_dir, *file, len) == 0) {
+		*file += len;
+		if (**file == '/') {
+			(*file)++;
+		}
+	}
+
+	return 0;
+}
+
+
+/* name is set to the function symbol containing pc */
+int find_symbol_by_pc(struct image *image, Dwarf_Addr pc, char *name,
+		      size_t len, Dwarf_Unsigned *offset, Dwarf_Unsigned *size)
+{
+	struct symtab *symtab = image_symtab(image);
+	int index;
+
+	if (!symtab || (index = symtab_lookup(symtab, pc)) == -1) {
+		return -1;
+	}
+
+	symtab_name(symtab, index, name, len);
+	*offset = pc - symtab->starts[index];
+	*size = symtab->sizes[index];
+	return 0;
+}
+
+
+/* Read the FDEs of .eh_frame, or of .debug_frame if there is none, as in
+ * kernels built without unwind tables.
+ * result must be free'ed using dwarf_fde_cie_list_dealloc() */
+int get_fde_list(Dwarf_Debug dwarf, Dwarf_Cie **cie_list,
+		 Dwarf_Signed *cie_count, Dwarf_Fde **fde_list,
+		 Dwarf_Signed *fde_count)
+{
+	if (dwarf_get_fde_list_eh(dwarf, cie_list, cie_count, fde_list,
+				  fde_count, NULL) == DW_DLV_OK ||
+	    dwarf_get_fde_list(dwarf, cie_list, cie_count, fde_list,
+			       fde_count, NULL) == DW_DLV_OK) {
+		return 0;
+	}
+	return -1;
+}
+
+
+/* The caller must set reg_table->rt3_reg_table_size and allocate
+ * reg_table->rt3_rules accordingly. */
+int find_regtable_by_pc(Dwarf_Debug dwarf, Dwarf_Addr pc,
+			Dwarf_Regtable3 *reg_table, Dwarf_Addr *lopc,
+			Dwarf_Addr *hipc, Dwarf_Addr *row_pc)
+{
+	Dwarf_Cie *cie_list;
+	Dwarf_Fde *fde_list, fde;
+	Dwarf_Signed cie_count, fde_count;
+	int retval;
+
+	if (get_fde_list(dwarf, &cie_list, &cie_count, &fde_list,
+			 &fde_count) == -1) {
+		return -1;
+	}
+
+	retval = dwarf_get_fde_at_pc(fde_list, pc, &fde, lopc, hipc, NULL);
+	if (retval == DW_DLV_OK) {
+		dwarf_get_fde_info_for_all_regs3(fde, pc, reg_table, row_pc,
+						 NULL);
+	}
+
+	dwarf_fde_cie_list_dealloc(dwarf, cie_list, cie_count, fde_list,
+				   fde_count);
+	return retval == DW_DLV_OK ? 0 : -1;
+}
+
+
+/* What locations are relative to in a frame: pc, for location lists, and
+ * the register and offset that DW_AT_frame_base amounts to at pc */
+struct var_frame {
+	Dwarf_Addr pc;
+	bool base_valid;
+	Dwarf_Half base_reg;
+	Dwarf_Signed base_offset;
+};
+
+
+/* CFA = reg + offset at pc, -1 if the CFA is not a register plus an
+ * offset */
+static int find_cfa_rule(Dwarf_Debug dwarf, Dwarf_Addr pc, Dwarf_Half *reg,
+			 Dwarf_Signed *offset)
+{
+	const struct arch *arch = arch_of_dwarf(dwarf);
+	Dwarf_Addr lopc, hipc, row_pc;
+	Dwarf_Regtable3 reg_table;
+	Dwarf_Regtable_Entry3 *cfa_rule = &reg_table.rt3_cfa_rule;
+	int retval = -1;
+
+	if (!arch) {
+		return -1;
 	}
-	dwarf_srclines_dealloc(dwarf, lines, nlines);
-	if (i == nlines) {
-		return -2;
+	reg_table.rt3_reg_table_size = arch->columns_nb;
+	reg_table.rt3_rules = malloc(sizeof(Dwarf_Regtable_Entry3) *
+				     reg_table.rt3_reg_table_size);
+	if (find_regtable_by_pc(dwarf, pc, &reg_table, &lopc, &hipc,
+				&row_pc) == 0 &&
+	    cfa_rule->dw_value_type == DW_EXPR_OFFSET &&
+	    cfa_rule->dw_offset_relevant) {
+		*reg = cfa_rule->dw_regnum;
+		*offset = cfa_rule->dw_offset_or_block_len;
+		retval = 0;
 	}
+	free(reg_table.rt3_rules);
+	return retval;
+}
 
-	/* Strip the compilation directory from the file name. */
-	retval = dwarf_attr(cu_die, DW_AT_comp_dir, &comp_dir_attr, NULL);
-	if (retval == DW_DLV_NO_ENTRY) {
-		fprintf(stderr,
-			"Warning: expected CU DIE to have a compilation directory attribute.\n");
-		return 0;
+
+/* The frame of sp_die at pc. The frame base is unknown unless it is the CFA
+ * or a register plus an offset. */
+static void get_var_frame(Dwarf_Debug dwarf, Dwarf_Die sp_die, Dwarf_Addr pc,
+			  struct var_frame *frame)
+{
+	const struct loc_expr *expr;
+	Dwarf_Attribute attr;
+	struct loc_list list;
+
+	*frame = (struct var_frame) {
+		.pc = pc,
+	};
+	if (dwarf_attr(sp_die, DW_AT_frame_base, &attr, NULL) != DW_DLV_OK) {
+		return;
 	}
-	dwarf_formstring(comp_dir_attr, &comp_dir, NULL);
-	len = strlen(comp_dir);
-	if (strlen(*file) >= len && memcmp(comp_dir, *file, len) == 0) {
-		*file += len;
-		if (**file == '/') {
-			(*file)++;
+	if (loc_list_get(attr, &list) == 0) {
+		expr = loc_list_find(&list, pc);
+		if (expr && expr->ops_nb == 1 &&
+		    expr->ops[0].atom == DW_OP_call_frame_cfa) {
+			frame->base_valid = find_cfa_rule(dwarf, pc,
+							  &frame->base_reg,
+							  &frame->base_offset)
+				== 0;
+		} else if (expr && expr->ops_nb == 1 &&
+			   expr->ops[0].atom >= DW_OP_breg0 &&
+			   expr->ops[0].atom <= DW_OP_breg31) {
+			frame->base_valid = true;
+			frame->base_reg = expr->ops[0].atom - DW_OP_breg0;
+			frame->base_offset = expr->ops[0].number;
 		}
+		loc_list_free(&list);
 	}
+	dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+}
 
-	return 0;
+
+/* Base address of the CU of die, for its DWARF 4 range lists */
+static Dwarf_Addr die_cu_base(Dwarf_Debug dwarf, Dwarf_Die die)
+{
+	Dwarf_Addr cu_base = 0;
+	Dwarf_Off cu_offset;
+	Dwarf_Die cu_die;
+
+	dwarf_CU_dieoffset_given_die(die, &cu_offset, NULL);
+	if (dwarf_offdie(dwarf, cu_offset, &cu_die, NULL) == DW_DLV_OK) {
+		if (dwarf_lowpc(cu_die, &cu_base, NULL) != DW_DLV_OK) {
+			cu_base = 0;
+		}
+		dwarf_dealloc(dwarf, cu_die, DW_DLA_DIE);
+	}
+	return cu_base;
 }
 
 
-int print_call_info(Dwarf_Debug dwarf, const struct call_entry *call,
+int print_call_info(struct image *image, const struct call_entry *call,
 		    Dwarf_Die sp_die)
 {
+	Dwarf_Debug dwarf = image->dwarf;
+	struct var_frame frame;
+	struct slot_map map;
 	int retval;
 
 	printf("Call frame information\n");
 	print_cfi(dwarf, call);
 
+	printf("Stack slots\n");
+	if (slot_map_build(dwarf, image_type_cache(image), sp_die,
+			   die_cu_base(dwarf, sp_die), call->pc, &map) == 0) {
+		slot_map_print(&map);
+		slot_map_free(&map);
+	} else {
+		printf("    no CFA rule at this pc\n");
+	}
+
 	/* print parameters and variables */
 	Dwarf_Die child, sibling;
 
+	get_var_frame(dwarf, sp_die, call->pc, &frame);
 	foreach_child(dwarf, sp_die, child, sibling, retval) {
 		Dwarf_Half tag;
 
@@ -403,7 +1626,7 @@ int print_call_info(Dwarf_Debug dwarf, const struct call_entry *call,
 			printf("Data object entry\n");
 			print_die_info(dwarf, child);
 
-			print_var_info(dwarf, child);
+			print_var_info(image, child, &frame);
 		}
 	}
 	return 0;
@@ -453,26 +1676,22 @@ void print_attr_info(Dwarf_Debug dwarf, Dwarf_Attribute attr)
 	printf("    %s (%s)", attr_name, form_name);
 
 	switch(at) {
-		Dwarf_Locdesc **llbufs;
+		struct loc_list list;
 		Dwarf_Signed retsdata;
 		Dwarf_Unsigned retudata;
 		int i;
 
 	case DW_AT_location:
 	case DW_AT_frame_base:
-		if (dwarf_loclist_n(attr, &llbufs, &retsdata, NULL) !=
-		    DW_DLV_OK) {
-			fprintf(stderr,
-				"Error: expected a location description\n");
-			abort();
+		if (loc_list_get(attr, &list) == -1) {
+			printf(" = no location\n");
+			break;
 		}
-		printf(" %" DW_PR_DSd " location descriptions:\n", retsdata);
-		for (i = 0; i < retsdata; i++) {
-			print_locdesc(dwarf, llbufs[i]);
-			dwarf_dealloc(dwarf, llbufs[i]->ld_s, DW_DLA_LOC_BLOCK);
-			dwarf_dealloc(dwarf, llbufs[i], DW_DLA_LOCDESC);
+		printf(" %u location descriptions:\n", list.nr);
+		for (i = 0; i < list.nr; i++) {
+			print_loc_expr(dwarf, &list.exprs[i]);
 		}
-		dwarf_dealloc(dwarf, llbufs, DW_DLA_LIST);
+		loc_list_free(&list);
 		break;
 	
 	case DW_AT_language:
@@ -493,9 +1712,17 @@ void print_attr_info(Dwarf_Debug dwarf, Dwarf_Attribute attr)
 			Dwarf_Bool retflag;
 			Dwarf_Addr retaddr;
 			Dwarf_Half addr_size;
+			Dwarf_Form_Data16 retdata16;
 
 		case DW_FORM_strp:
 		case DW_FORM_string:
+		case DW_FORM_line_strp:
+		case DW_FORM_strx:
+		case DW_FORM_strx1:
+		case DW_FORM_strx2:
+		case DW_FORM_strx3:
+		case DW_FORM_strx4:
+		case DW_FORM_GNU_str_index:
 			dwarf_formstring(attr, &retstring, NULL);
 			printf(" = %s", retstring);
 			break;
@@ -513,18 +1740,39 @@ void print_attr_info(Dwarf_Debug dwarf, Dwarf_Attribute attr)
 		case DW_FORM_data2:
 		case DW_FORM_data4:
 		case DW_FORM_data8:
+		case DW_FORM_implicit_const:
 			dwarf_formsdata(attr, &retsdata, NULL);
 			dwarf_formudata(attr, &retudata, NULL);
 			printf(" = %" DW_PR_DSd "/%" DW_PR_DUu, retsdata,
 			       retudata);
 			break;
 
+		case DW_FORM_data16:
+			dwarf_formdata16(attr, &retdata16, NULL);
+			printf(" = 0x");
+			for (i = sizeof(retdata16.fd_data) - 1; i >= 0; i--) {
+				printf("%02x", retdata16.fd_data[i]);
+			}
+			break;
+
+		case DW_FORM_rnglistx:
+		case DW_FORM_loclistx:
+			dwarf_formudata(attr, &retudata, NULL);
+			printf(" = list %" DW_PR_DUu, retudata);
+			break;
+
 		case DW_FORM_flag:
 			dwarf_formflag(attr, &retflag, NULL);
 			printf(" = %s", retflag ? "True" : "False");
 			break;
 
 		case DW_FORM_addr:
+		case DW_FORM_addrx:
+		case DW_FORM_addrx1:
+		case DW_FORM_addrx2:
+		case DW_FORM_addrx3:
+		case DW_FORM_addrx4:
+		case DW_FORM_GNU_addr_index:
 			dwarf_formaddr(attr, &retaddr, NULL);
 			dwarf_get_address_size(dwarf, &addr_size, NULL);
 			printf(" = 0x%0*" DW_PR_DUx, 2 * (int) addr_size,
@@ -536,28 +1784,11 @@ void print_attr_info(Dwarf_Debug dwarf, Dwarf_Attribute attr)
 }
 
 
-const char *register_abbrev[] = {
-	[0] = "%rax",
-	[1] = "%rdx",
-	[2] = "%rcx",
-	[3] = "%rbx",
-	[4] = "%rsi",
-	[5] = "%rdi",
-	[6] = "%rbp",
-	[7] = "%rsp",
-	[8] = "%r8",
-	[9] = "%r9",
-	[10] = "%r10",
-	[11] = "%r11",
-	[12] = "%r12",
-	[13] = "%r13",
-	[14] = "%r14",
-	[15] = "%r15",
-	[16] = "retaddr",
-};
-
-
-void print_locdesc(Dwarf_Debug dwarf, Dwarf_Locdesc *ld)
+/* print_loc_expr, instantiated for each architecture with the names of its
+ * DWARF registers */
+static inline __attribute__((always_inline)) void print_loc_expr_arch(
+	const char *const *regs, Dwarf_Debug dwarf,
+	const struct loc_expr *expr)
 {
 	int i;
 	unsigned int indent = 8;
@@ -565,28 +1796,31 @@ void print_locdesc(Dwarf_Debug dwarf, Dwarf_Locdesc *ld)
 
 	dwarf_get_address_size(dwarf, &addr_size, NULL);
 
-	if (ld->ld_from_loclist) {
+	if (expr->fallback) {
+		printf("%*cdefault\n", indent, ' ');
+		indent += 4;
+	} else if (expr->from_list) {
 		printf("%2$*1$c[0x%4$0*3$" DW_PR_DUx ", 0x%5$0*3$" DW_PR_DUx "[\n",
-		       indent, ' ', 2 * (int) addr_size, ld->ld_lopc,
-		       ld->ld_hipc);
+		       indent, ' ', 2 * (int) addr_size, expr->lopc,
+		       expr->hipc);
 		indent += 4;
 	}
 
-	for (i = 0; i < ld->ld_cents; i++) {
-		Dwarf_Small op = ld->ld_s[i].lr_atom;
-		Dwarf_Unsigned arg1 = ld->ld_s[i].lr_number,
-			       arg2 = ld->ld_s[i].lr_number2;
+	for (i = 0; i < expr->ops_nb; i++) {
+		Dwarf_Small op = expr->ops[i].atom;
+		Dwarf_Unsigned arg1 = expr->ops[i].number,
+			       arg2 = expr->ops[i].number2;
 		const char *op_name;
 
 		dwarf_get_OP_name(op, &op_name);
 		printf("%*c%s", indent, ' ', op_name);
 
-		if (op >= DW_OP_reg0 && op <= DW_OP_reg15) {
-			printf("() # %s", register_abbrev[op - DW_OP_reg0]);
-		} else if (op >= DW_OP_breg0 && op <= DW_OP_breg15) {
+		if (op >= DW_OP_reg0 && op <= DW_OP_reg31) {
+			printf("() # %s", regs[op - DW_OP_reg0]);
+		} else if (op >= DW_OP_breg0 && op <= DW_OP_breg31) {
 			printf("(%+" DW_PR_DSd ") # %s0x%lx(%s)",
 			       arg1, (Dwarf_Signed) arg1 < 0 ? "-" : "",
-			       labs(arg1), register_abbrev[op - DW_OP_breg0]);
+			       labs(arg1), regs[op - DW_OP_breg0]);
 		} else if (op == DW_OP_stack_value) {
 			printf("()");
 		} else if (op == DW_OP_fbreg) {
@@ -618,30 +1852,57 @@ void print_locdesc(Dwarf_Debug dwarf, Dwarf_Locdesc *ld)
 }
 
 
+#define PRINT_LOC_EXPR_DEFINE(arch, em, NAME)				\
+static void print_loc_expr_##arch(Dwarf_Debug dwarf,			\
+				  const struct loc_expr *expr)		\
+{									\
+	print_loc_expr_arch(arch##_dwarf_regs, dwarf, expr);		\
+}
+
+ARCH_LIST(PRINT_LOC_EXPR_DEFINE)
+
+
+/* registers of architectures that are not described are not named */
+static const char *const unknown_dwarf_regs[ARCH_DWARF_REGS] = {
+	[0 ... ARCH_DWARF_REGS - 1] = "?",
+};
+
+
+void print_loc_expr(Dwarf_Debug dwarf, const struct loc_expr *expr)
+{
+	const struct arch *arch = arch_of_dwarf(dwarf);
+
+#define PRINT_LOC_EXPR_SELECT(name, em, NAME)				\
+	if (arch && arch->machine == em) {				\
+		print_loc_expr_##name(dwarf, expr);			\
+		return;							\
+	}
+	ARCH_LIST(PRINT_LOC_EXPR_SELECT)
+	print_loc_expr_arch(unknown_dwarf_regs, dwarf, expr);
+}
+
+
 void print_cfi(Dwarf_Debug dwarf, const struct call_entry *call)
 {
-	Dwarf_Cie *cie_list;
-	Dwarf_Fde *fde_list, fde;
-	Dwarf_Signed cie_count, fde_count;
 	Dwarf_Addr lopc, hipc, row_pc;
 	Dwarf_Regtable3 reg_table;
 	Dwarf_Half addr_size;
+	const struct arch *arch = arch_of_dwarf(dwarf);
 	int width, i;
 
-	if (dwarf_get_fde_list_eh(dwarf, &cie_list, &cie_count, &fde_list,
-				  &fde_count, NULL) != DW_DLV_OK) {
-		fprintf(stderr,
-			"Error: could not retrieve FDE list from eh_frame section\n");
-		abort();
+	if (!arch) {
+		printf("    unsupported architecture\n");
+		return;
 	}
-
-	dwarf_get_fde_at_pc(fde_list, call->pc, &fde, &lopc, &hipc, NULL);
-
-	reg_table.rt3_reg_table_size = ARRAY_SIZE(register_abbrev);
+	reg_table.rt3_reg_table_size = arch->columns_nb;
 	reg_table.rt3_rules = malloc(sizeof(Dwarf_Regtable_Entry3) *
 				     reg_table.rt3_reg_table_size);
-	dwarf_get_fde_info_for_all_regs3(fde, call->pc, &reg_table, &row_pc,
-					 NULL);
+	if (find_regtable_by_pc(dwarf, call->pc, &reg_table, &lopc, &hipc,
+				&row_pc) == -1) {
+		fprintf(stderr,
+			"Error: no FDE found for pc 0x%lx\n", call->pc);
+		abort();
+	}
 
 	dwarf_get_address_size(dwarf, &addr_size, NULL);
 	width = 2 * (int) addr_size;
@@ -651,19 +1912,20 @@ void print_cfi(Dwarf_Debug dwarf, const struct call_entry *call)
 	printf("    regtable row low pc = 0x%0*" DW_PR_DUx "\n", width,
 	       row_pc);
 	printf("    value of register in previous frame:\n");
-	print_regtable_entry("CFA", &reg_table.rt3_cfa_rule);
+	print_regtable_entry(arch, "CFA", &reg_table.rt3_cfa_rule);
 	for (i = 0; i < reg_table.rt3_reg_table_size; i++) {
-		print_regtable_entry(register_abbrev[i],
-				     &reg_table.rt3_rules[i]);
+		if (arch_column_slot(arch, i) != -1) {
+			print_regtable_entry(arch, arch_column_name(arch, i),
+					     &reg_table.rt3_rules[i]);
+		}
 	}
 
 	free(reg_table.rt3_rules);
-	dwarf_fde_cie_list_dealloc(dwarf, cie_list, cie_count, fde_list,
-				   fde_count);
 }
 
 
-void print_regtable_entry(const char *regname, Dwarf_Regtable_Entry3 *entry)
+void print_regtable_entry(const struct arch *arch, const char *regname,
+			  Dwarf_Regtable_Entry3 *entry)
 {
 	/* register rule type name */
 	const char *rr_type_name[] = {
@@ -687,25 +1949,27 @@ void print_regtable_entry(const char *regname, Dwarf_Regtable_Entry3 *entry)
 			if (entry->dw_regnum == DW_FRAME_CFA_COL3) {
 				basereg = "CFA";
 			} else {
-				if (entry->dw_regnum >
-				    ARRAY_SIZE(register_abbrev)) {
+				if (arch_column_slot(arch, entry->dw_regnum) ==
+				    -1) {
 					fprintf(stderr,
 						"Error: register number out of bounds (%u)\n",
 						entry->dw_regnum);
 					abort();
 				}
-				basereg = register_abbrev[entry->dw_regnum];
+				basereg = arch_column_name(arch,
+							   entry->dw_regnum);
 			}
 			printf("%" DW_PR_DSd "(%s)\n",
 			       entry->dw_offset_or_block_len, basereg);
 		} else {
-			if (entry->dw_regnum > ARRAY_SIZE(register_abbrev)) {
+			if (arch_column_slot(arch, entry->dw_regnum) == -1) {
 				fprintf(stderr,
 					"Error: register number out of bounds (%u)\n",
 					entry->dw_regnum);
 				abort();
 			}
-			printf("(%%%s)\n", register_abbrev[entry->dw_regnum]);
+			printf("(%%%s)\n",
+			       arch_column_name(arch, entry->dw_regnum));
 		}
 		break;
 	default:
@@ -763,17 +2027,6 @@ struct type_atom {
 	} alloc_type;
 };
 
-enum formats {
-	FORMAT_X,
-	FORMAT_D,
-	FORMAT_U,
-	FORMAT_F,
-	FORMAT_P,
-	FORMAT_C,
-	FORMAT_S,
-	FORMAT_B,
-};
-
 const char* format_names[] = {
 	[FORMAT_X] = "hex",
 	[FORMAT_D] = "signed",
@@ -785,16 +2038,12 @@ const char* format_names[] = {
 	[FORMAT_B] = "bool",
 };
 
-enum locations {
-	LOC_REG,
-	LOC_MEM,
-	LOC_IMM,
-};
-
 const char* location_names[] = {
+	[LOC_NONE] = "none",
 	[LOC_REG] = "register",
 	[LOC_MEM] = "memory",
 	[LOC_IMM] = "constant",
+	[LOC_FRAME] = "frame",
 };
 
 struct type_info {
@@ -808,27 +2057,85 @@ struct type_info {
 		char *string;
 		Dwarf_Unsigned udata;
 	} value;
+	/* LOC_FRAME: the object is at register value.udata plus offset */
+	Dwarf_Signed offset;
 	unsigned int indir_nb;
+	/* cached enumerator table of enum types */
+	const struct type_desc *enum_type;
 };
 
 
-/* technically, it prints info about a "data object entry", not just a "var" */
-void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
+/* The location expressions made of a single operation: a static address, a
+ * register, or memory at a register plus an offset. frame is NULL if the
+ * frame is unknown. */
+static void set_location(struct type_info *type, const struct loc_op *op,
+			 const struct var_frame *frame)
+{
+	if (op->atom == DW_OP_addr) {
+		type->loctype = LOC_MEM;
+		type->value.udata = op->number;
+	} else if (op->atom >= DW_OP_reg0 && op->atom <= DW_OP_reg31) {
+		type->loctype = LOC_REG;
+		type->value.udata = op->atom - DW_OP_reg0;
+	} else if (op->atom == DW_OP_regx) {
+		type->loctype = LOC_REG;
+		type->value.udata = op->number;
+	} else if (op->atom >= DW_OP_breg0 && op->atom <= DW_OP_breg31) {
+		type->loctype = LOC_FRAME;
+		type->value.udata = op->atom - DW_OP_breg0;
+		type->offset = op->number;
+	} else if (op->atom == DW_OP_fbreg && frame && frame->base_valid) {
+		type->loctype = LOC_FRAME;
+		type->value.udata = frame->base_reg;
+		type->offset = frame->base_offset + (Dwarf_Signed) op->number;
+	}
+}
+
+
+/* The entry that holds the name and type of a data object: itself, or the
+ * abstract origin of a concrete instance. origin_die is set to the latter,
+ * to be released by the caller, or to NULL. */
+static Dwarf_Die get_decl_die(Dwarf_Debug dwarf, Dwarf_Die die,
+			      Dwarf_Die *origin_die)
+{
+	Dwarf_Bool typed;
+
+	*origin_die = NULL;
+	if ((dwarf_hasattr(die, DW_AT_type, &typed, NULL) != DW_DLV_OK ||
+	     !typed) && find_abstract_origin(dwarf, die, origin_die) == 0) {
+		return *origin_die;
+	}
+	return die;
+}
+
+
+/* Fill type from the location and the type chain of a data object entry,
+ * and set var_type_offset to the offset of its type DIE. Location lists are
+ * evaluated at the pc of frame, NULL if there is none. Concrete instances
+ * of inlined data objects take their name and type from their abstract
+ * origin. The repr list must be released with free_type_atoms(). */
+static void get_var_info(struct image *image, Dwarf_Die var_die,
+			 const struct var_frame *frame,
+			 struct type_info *type, Dwarf_Off *var_type_offset)
 {
+	Dwarf_Debug dwarf = image->dwarf;
+	Dwarf_Die decl_die, origin_die;
 	Dwarf_Attribute attr;
-	struct type_info type = {
-		.repr = LIST_HEAD_INIT(type.repr),
+	struct type_atom *atom;
+	int retval;
+
+	*type = (struct type_info) {
 		.start = NULL,
 		.repeat = 1,
 		.indir_nb = 0,
+		.enum_type = NULL,
 	};
-	struct type_atom *atom;
-	int retval;
+	INIT_LIST_HEAD(&type->repr);
 
 	if (dwarf_attr(var_die, DW_AT_const_value, &attr, NULL) == DW_DLV_OK) {
 		Dwarf_Half form;
 
-		type.loctype = LOC_IMM;
+		type->loctype = LOC_IMM;
 
 		dwarf_whatform(attr, &form, NULL);
 		switch (form) {
@@ -836,15 +2143,43 @@ void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
 
 		case DW_FORM_strp:
 		case DW_FORM_string:
-			dwarf_formstring(attr, &type.value.string, NULL);
+		case DW_FORM_line_strp:
+		case DW_FORM_strx:
+		case DW_FORM_strx1:
+		case DW_FORM_strx2:
+		case DW_FORM_strx3:
+		case DW_FORM_strx4:
+		case DW_FORM_GNU_str_index:
+			dwarf_formstring(attr, &type->value.string, NULL);
 			break;
 
 		case DW_FORM_data1:
 		case DW_FORM_data2:
 		case DW_FORM_data4:
 		case DW_FORM_data8:
-			dwarf_formudata(attr, &type.value.udata, NULL);
+		case DW_FORM_udata:
+			dwarf_formudata(attr, &type->value.udata, NULL);
+			break;
+
+		case DW_FORM_sdata:
+		case DW_FORM_implicit_const: {
+			Dwarf_Signed sdata;
+
+			dwarf_formsdata(attr, &sdata, NULL);
+			type->value.udata = sdata;
+			break;
+		}
+
+		case DW_FORM_data16: {
+			Dwarf_Form_Data16 data16;
+
+			/* values are at most 64 bits wide here, keep the low
+			 * half (little-endian) */
+			dwarf_formdata16(attr, &data16, NULL);
+			memcpy(&type->value.udata, data16.fd_data,
+			       sizeof(type->value.udata));
 			break;
+		}
 
 		default:
 			dwarf_get_FORM_name(form, &form_name);
@@ -856,13 +2191,31 @@ void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
 		}
 	} else if (dwarf_attr(var_die, DW_AT_location, &attr, NULL) ==
 		   DW_DLV_OK) {
-		/* evaluate the location expression, oh boy! */
+		const struct loc_expr *expr = NULL;
+		struct loc_list list;
+
+		/* evaluate the location expression, oh boy! Only static
+		 * addresses, registers, and registers plus an offset for
+		 * now. */
+		if (loc_list_get(attr, &list) == 0) {
+			if (frame) {
+				expr = loc_list_find(&list, frame->pc);
+			} else if (list.nr == 1 && !list.exprs[0].from_list) {
+				expr = &list.exprs[0];
+			}
+			if (expr && expr->ops_nb == 1) {
+				set_location(type, &expr->ops[0], frame);
+			}
+			loc_list_free(&list);
+		}
 	}
 
+	decl_die = get_decl_die(dwarf, var_die, &origin_die);
+
 	/* traverse the DW_TAG_*_type chain */
 	atom = malloc(sizeof(*atom));
-	list_add(&atom->list, &type.repr);
-	if (dwarf_diename(var_die, &atom->string, NULL) == DW_DLV_NO_ENTRY) {
+	list_add(&atom->list, &type->repr);
+	if (dwarf_diename(decl_die, &atom->string, NULL) == DW_DLV_NO_ENTRY) {
 		fprintf(stderr,
 			"Error: expected variable DIE to have a name.\n");
 		print_die_info(dwarf, var_die);
@@ -871,12 +2224,13 @@ void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
 	atom->alloc_type = ALLOC_DWARF;
 	atom->tag = DW_TAG_variable;
 
-	if (dwarf_attr(var_die, DW_AT_type, &attr, NULL) == DW_DLV_NO_ENTRY) {
+	if (dwarf_attr(decl_die, DW_AT_type, &attr, NULL) == DW_DLV_NO_ENTRY) {
 		fprintf(stderr,
 			"Error: expected variable DIE to have a type.\n");
 		print_die_info(dwarf, var_die);
 		abort();
 	}
+	dwarf_global_formref(attr, var_type_offset, NULL);
 	while (true) {
 		Dwarf_Off type_offset;
 		Dwarf_Die type_die;
@@ -889,7 +2243,7 @@ void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
 
 		/* malloc and fill a repr element */
 		atom = malloc(sizeof(*atom));
-		list_add(&atom->list, &type.repr);
+		list_add(&atom->list, &type->repr);
 		atom->tag = tag;
 
 		switch (tag) {
@@ -906,7 +2260,7 @@ void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
 			}
 			atom->alloc_type = ALLOC_STATIC;
 
-			type.indir_nb++;
+			type->indir_nb++;
 			break;
 
 		case DW_TAG_array_type:
@@ -934,7 +2288,7 @@ void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
 				abort();
 			}
 			dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
-			type.repeat *= repeat;
+			type->repeat *= repeat;
 
 			atom->string = malloc(24);
 			atom->alloc_type = ALLOC_MALLOC;
@@ -950,17 +2304,38 @@ void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
 			atom->alloc_type = ALLOC_STATIC;
 			break;
 
+		case DW_TAG_volatile_type:
+			atom->string = "volatile ";
+			atom->alloc_type = ALLOC_STATIC;
+			break;
+
+		case DW_TAG_restrict_type:
+			atom->string = "restrict ";
+			atom->alloc_type = ALLOC_STATIC;
+			break;
+
+		case DW_TAG_subroutine_type:
+			atom->string = "func ";
+			atom->alloc_type = ALLOC_STATIC;
+			break;
+
 		case DW_TAG_structure_type:
 			atom->string = get_type_name(dwarf, type_die,
 						     "struct ");
 			atom->alloc_type = ALLOC_MALLOC;
 			break;
 
+		case DW_TAG_union_type:
+			atom->string = get_type_name(dwarf, type_die,
+						     "union ");
+			atom->alloc_type = ALLOC_MALLOC;
+			break;
+
 		case DW_TAG_typedef:
 			atom->string = get_type_name(dwarf, type_die, "");
 			atom->alloc_type = ALLOC_MALLOC;
-			if (type.start == NULL) {
-				type.start = atom;
+			if (type->start == NULL) {
+				type->start = atom;
 			}
 			break;
 
@@ -968,8 +2343,8 @@ void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
 			atom->string = get_type_name(dwarf, type_die,
 						     "enum ");
 			atom->alloc_type = ALLOC_MALLOC;
-			if (type.start == NULL) {
-				type.start = atom;
+			if (type->start == NULL) {
+				type->start = atom;
 			}
 			break;
 
@@ -987,17 +2362,33 @@ void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
 			abort();
 		}
 
+		if (tag == DW_TAG_subroutine_type) {
+			/* function pointers are shown as addresses, the
+			 * return type is not part of the chain */
+			if (type->indir_nb) {
+				type->indir_nb--;
+			}
+			type->format = FORMAT_P;
+			type->size = image->addr_size;
+			dwarf_dealloc(dwarf, type_die, DW_DLA_DIE);
+			break;
+		}
+
 		retval = dwarf_attr(type_die, DW_AT_type, &attr, NULL);
 		if (retval == DW_DLV_NO_ENTRY) {
 			/* we've reached the end of the type chain */
 			if (tag == DW_TAG_pointer_type) {
-				type.format = FORMAT_P;
-			} else if (tag == DW_TAG_structure_type) {
-				type.format = FORMAT_X;
+				type->format = FORMAT_P;
+			} else if (tag == DW_TAG_structure_type ||
+				   tag == DW_TAG_union_type) {
+				type->format = FORMAT_X;
 			} else if (tag == DW_TAG_enumeration_type) {
-				/* todo: add a member to type with
-				 * DW_TAG_enumerator values */
-				type.format = FORMAT_U;
+				Dwarf_Off enum_offset;
+
+				dwarf_dieoffset(type_die, &enum_offset, NULL);
+				type->enum_type = type_cache_get(
+					image_type_cache(image), enum_offset);
+				type->format = FORMAT_U;
 			} else {
 				Dwarf_Unsigned encoding;
 
@@ -1014,19 +2405,19 @@ void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
 					const char *ate_name;
 
 				case DW_ATE_float:
-					type.format = FORMAT_F;
+					type->format = FORMAT_F;
 					break;
 				case DW_ATE_signed:
-					type.format = FORMAT_D;
+					type->format = FORMAT_D;
 					break;
 				case DW_ATE_unsigned:
-					type.format = FORMAT_U;
+					type->format = FORMAT_U;
 					break;
 				case DW_ATE_signed_char:
-					type.format = FORMAT_C;
+					type->format = FORMAT_C;
 					break;
 				case DW_ATE_boolean:
-					type.format = FORMAT_B;
+					type->format = FORMAT_B;
 					break;
 				default:
 					dwarf_get_ATE_name(encoding, &ate_name);
@@ -1044,7 +2435,7 @@ void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
 				print_die_info(dwarf, type_die);
 				abort();
 			}
-			dwarf_formudata(attr, &type.size, NULL);
+			dwarf_formudata(attr, &type->size, NULL);
 
 			dwarf_dealloc(dwarf, type_die, DW_DLA_DIE);
 			break;
@@ -1052,22 +2443,21 @@ void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
 			dwarf_dealloc(dwarf, type_die, DW_DLA_DIE);
 		}
 	}
-	if (type.start == NULL) {
-		type.start = list_first_entry(&type.repr, typeof(*type.start),
-					      list);
+	if (type->start == NULL) {
+		type->start = list_first_entry(&type->repr,
+					       typeof(*type->start), list);
 	}
+	if (origin_die) {
+		dwarf_dealloc(dwarf, origin_die, DW_DLA_DIE);
+	}
+}
 
-	/* print and destroy the repr list */
+
+static void free_type_atoms(Dwarf_Debug dwarf, struct type_info *type)
+{
 	struct type_atom *pos, *n;
-	bool print = false;
 
-	list_for_each_entry_safe(pos, n, &type.repr, list) {
-		if (!print && pos == type.start) {
-			print = true;
-		}
-		if (print) {
-			printf("%s", pos->string);
-		}
+	list_for_each_entry_safe(pos, n, &type->repr, list) {
 		switch (pos->alloc_type) {
 		case ALLOC_DWARF:
 			dwarf_dealloc(dwarf, pos->string, DW_DLA_STRING);
@@ -1085,10 +2475,259 @@ void print_var_info(Dwarf_Debug dwarf, Dwarf_Die var_die)
 		}
 		free(pos);
 	}
+}
+
+
+/* technically, it prints info about a "data object entry", not just a "var".
+ * frame is NULL if the object is not seen from a frame. */
+void print_var_info(struct image *image, Dwarf_Die var_die,
+		    const struct var_frame *frame)
+{
+	Dwarf_Off var_type_offset;
+	const struct type_desc *leaf;
+	struct type_info type;
+	struct type_atom *pos;
+	bool print = false;
+
+	get_var_info(image, var_die, frame, &type, &var_type_offset);
+
+	/* print the repr list */
+	list_for_each_entry(pos, &type.repr, list) {
+		if (!print && pos == type.start) {
+			print = true;
+		}
+		if (print) {
+			printf("%s", pos->string);
+		}
+	}
+	free_type_atoms(image->dwarf, &type);
 	printf("\n");
 	printf("location: %s, repeat: %u, indir_nb: %u, format: %s, size: %" DW_PR_DUu "\n",
 	       location_names[type.loctype], type.repeat, type.indir_nb,
 	       format_names[type.format], type.size);
+	if (type.loctype == LOC_FRAME) {
+		printf("at: %s%+" DW_PR_DSd "\n",
+		       arch_column_name(arch_of_dwarf(image->dwarf),
+					type.value.udata), type.offset);
+	}
+
+	if (type.enum_type) {
+		char buf[256];
+
+		printf("enumerators: %u%s\n", type.enum_type->enums_nb,
+		       type.enum_type->flags ? " (flags)" : "");
+		if (type.loctype == LOC_IMM && type.indir_nb == 0) {
+			type_enum_format(type.enum_type, type.value.udata, buf,
+					 sizeof(buf));
+			printf("value: %s\n", buf);
+		}
+	}
+
+	/* expand structures and unions, including arrays of them */
+	leaf = type_strip(type_cache_get(image_type_cache(image),
+					 var_type_offset));
+	while (leaf && leaf->tag == DW_TAG_array_type) {
+		leaf = type_strip(leaf->target);
+	}
+	if (leaf && leaf->members_nb) {
+		type_print_layout(stdout, leaf, 3);
+	}
+
+	if (image->mem && type.loctype == LOC_MEM) {
+		struct value_printer vp;
+
+		value_printer_init(&vp, image->mem, stdout);
+		vp.data_index = image_data_index(image);
+		vp.types = image_type_cache(image);
+		value_print(&vp, "value", type_cache_get(vp.types,
+							 var_type_offset),
+			    type.value.udata);
+		value_printer_free(&vp);
+	}
+}
+
+
+/* C spelling of the structure or union behind the pointers and arrays of a
+ * type, NULL if there is none */
+static const char *dump_type(struct image *image, Dwarf_Off type_offset)
+{
+	const struct type_desc *type, *named = NULL;
+
+	type = type_cache_get(image_type_cache(image), type_offset);
+	for (; type && type->target; type = type->target) {
+		if (type->tag == DW_TAG_typedef) {
+			named = type;
+		} else if (type->tag == DW_TAG_pointer_type ||
+			   type->tag == DW_TAG_array_type) {
+			named = NULL;
+		} else if (type->tag != DW_TAG_const_type &&
+			   type->tag != DW_TAG_volatile_type &&
+			   type->tag != DW_TAG_restrict_type) {
+			break;
+		}
+	}
+	if (!type || !type->members_nb) {
+		return NULL;
+	} else if (strstr(type->name, "{...}")) {
+		/* anonymous, only known by its typedef if any */
+		return named ? named->name : NULL;
+	}
+	return type->name;
+}
+
+
+/* Add the parameters and variables of scope to script, and those of the
+ * lexical blocks and inlined subroutines that contain the pc of at.
+ * function names the subprogram or inlined subroutine of scope. */
+static void script_add_scope(struct image *image, struct script *script,
+			     unsigned int frame, const char *function,
+			     Dwarf_Die scope, Dwarf_Addr cu_base,
+			     const struct var_frame *at)
+{
+	Dwarf_Debug dwarf = image->dwarf;
+	Dwarf_Die child, sibling;
+	int retval;
+
+	foreach_child(dwarf, scope, child, sibling, retval) {
+		Dwarf_Die decl_die, origin_die;
+		struct script_var var;
+		struct type_info type;
+		Dwarf_Off type_offset;
+		Dwarf_Bool typed;
+		Dwarf_Half tag;
+		char *name = NULL;
+
+		dwarf_tag(child, &tag, NULL);
+		if ((tag == DW_TAG_lexical_block ||
+		     tag == DW_TAG_inlined_subroutine) &&
+		    die_has_pc(dwarf, child, cu_base, at->pc)) {
+			if (tag == DW_TAG_inlined_subroutine &&
+			    find_abstract_origin(dwarf, child,
+						 &origin_die) == 0) {
+				if (dwarf_diename(origin_die, &name, NULL) !=
+				    DW_DLV_OK) {
+					name = NULL;
+				}
+				dwarf_dealloc(dwarf, origin_die, DW_DLA_DIE);
+			}
+			script_add_scope(image, script, frame,
+					 name ? name : function, child,
+					 cu_base, at);
+			if (name) {
+				dwarf_dealloc(dwarf, name, DW_DLA_STRING);
+			}
+			continue;
+		}
+
+		if (tag != DW_TAG_formal_parameter && tag != DW_TAG_variable) {
+			continue;
+		}
+		/* concrete instances of inlined subprograms refer to their
+		 * abstract origin for names and types */
+		decl_die = get_decl_die(dwarf, child, &origin_die);
+		if (dwarf_hasattr(decl_die, DW_AT_type, &typed, NULL) ==
+		    DW_DLV_OK && typed &&
+		    dwarf_diename(decl_die, &name, NULL) == DW_DLV_OK) {
+			get_var_info(image, child, at, &type, &type_offset);
+			free_type_atoms(dwarf, &type);
+			var = (struct script_var) {
+				.frame = frame,
+				.function = function,
+				.name = name,
+				.loctype = type.loctype,
+				.where = type.value.udata,
+				.offset = type.offset,
+				.repeat = type.repeat,
+				.format = type.format,
+				.size = type.size,
+				.indir_nb = type.indir_nb,
+				.dump_type = dump_type(image, type_offset),
+			};
+			script_add(script, &var);
+			dwarf_dealloc(dwarf, name, DW_DLA_STRING);
+		}
+		if (origin_die) {
+			dwarf_dealloc(dwarf, origin_die, DW_DLA_DIE);
+		}
+	}
+}
+
+
+/* Add the parameters and variables of the subprogram of frame to script,
+ * where they are at the pc of call. Frames other than the innermost are at
+ * a return address, which may be past the end of the scope of the call:
+ * their locations are looked up at the address before. */
+void script_add_call(struct image *image, struct script *script,
+		     unsigned int frame, const struct call_entry *call,
+		     Dwarf_Die sp_die)
+{
+	Dwarf_Debug dwarf = image->dwarf;
+	struct var_frame at;
+
+	get_var_frame(dwarf, sp_die, frame ? call->pc - 1 : call->pc, &at);
+	script_add_scope(image, script, frame, call->symbol, sp_die,
+			 die_cu_base(dwarf, sp_die), &at);
+}
+
+
+/* Write the script of each kind that has a path */
+void write_scripts(const struct script *script, char * const *paths)
+{
+	enum script_kind kind;
+	FILE *stream;
+
+	for (kind = SCRIPT_GDB; kind <= SCRIPT_CRASH; kind++) {
+		if (!paths[kind]) {
+			continue;
+		}
+		if ((stream = fopen(paths[kind], "w")) == NULL) {
+			fprintf(stderr, "Error: open \"%s\" failed: %s\n",
+				paths[kind], strerror(errno));
+			continue;
+		}
+		script_write(script, kind, stream);
+		fclose(stream);
+	}
+}
+
+
+/* Follow DW_AT_abstract_origin, used by concrete instances of inlined
+ * subprograms and their parameters. result must be free'ed using
+ * dwarf_dealloc(dwarf, result, DW_DLA_DIE) */
+int find_abstract_origin(Dwarf_Debug dwarf, Dwarf_Die die, Dwarf_Die *result)
+{
+	Dwarf_Attribute attr;
+	Dwarf_Off offset;
+
+	if (dwarf_attr(die, DW_AT_abstract_origin, &attr, NULL) !=
+	    DW_DLV_OK) {
+		return -1;
+	}
+	dwarf_global_formref(attr, &offset, NULL);
+	dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+	if (dwarf_offdie(dwarf, offset, result, NULL) != DW_DLV_OK) {
+		return -1;
+	}
+	return 0;
+}
+
+
+/* From DWARF 4 on, DW_AT_high_pc is usually of class constant, an offset
+ * from DW_AT_low_pc, which dwarf_highpc() refuses. */
+int find_pc_range(Dwarf_Die die, Dwarf_Addr *low_pc, Dwarf_Addr *high_pc)
+{
+	enum Dwarf_Form_Class class;
+	Dwarf_Half form;
+
+	if (dwarf_lowpc(die, low_pc, NULL) != DW_DLV_OK ||
+	    dwarf_highpc_b(die, high_pc, &form, &class, NULL) != DW_DLV_OK) {
+		return -1;
+	}
+	if (class == DW_FORM_CLASS_CONSTANT) {
+		*high_pc += *low_pc;
+	}
+
+	return 0;
 }
 
 
@@ -1097,11 +2736,14 @@ int find_subprogram_by_pc(Dwarf_Debug dwarf, Dwarf_Die cu_die, Dwarf_Addr pc,
 			  Dwarf_Die *result)
 {
 	Dwarf_Die child, sibling;
+	Dwarf_Addr cu_base = 0;
 	int retval;
 
+	/* base address of DWARF 4 range lists */
+	dwarf_lowpc(cu_die, &cu_base, NULL);
 	foreach_child(dwarf, cu_die, child, sibling, retval) {
 		Dwarf_Half tag;
-		Dwarf_Addr retpc;
+		Dwarf_Addr low_pc, high_pc;
 
 		dwarf_tag(child, &tag, NULL);
 		if (tag != DW_TAG_subprogram) {
@@ -1109,25 +2751,20 @@ int find_subprogram_by_pc(Dwarf_Debug dwarf, Dwarf_Die cu_die, Dwarf_Addr pc,
 		}
 
 		/* low_pc/high_pc case */
-		retval = dwarf_lowpc(child, &retpc, NULL);
-		if (retval == DW_DLV_OK) {
-			if (pc < retpc) {
+		if (find_pc_range(child, &low_pc, &high_pc) == 0) {
+			if (pc < low_pc || pc > high_pc) {
 				continue;
 			}
 
-			retval = dwarf_highpc(child, &retpc, NULL);
-			if (retval == DW_DLV_OK) {
-				if (pc > retpc) {
-					continue;
-				}
-
-				*result = child;
-				return 0;
-			}
+			*result = child;
+			return 0;
 		}
 
 		/* ranges case */
-		// TODO
+		if (die_has_pc(dwarf, child, cu_base, pc)) {
+			*result = child;
+			return 0;
+		}
 
 		/* a subprogram entry may have been inlined (DW_AT_inline) or
 		 * may be external (DW_AT_external), in which case it will not
@@ -1165,16 +2802,9 @@ void print_line_info(Dwarf_Debug dwarf, Dwarf_Die cu_die, Dwarf_Die sp_die)
 	}
 
 	if (sp_die) {
-		retval = dwarf_lowpc(sp_die, &low_pc, NULL);
-		if (retval == DW_DLV_NO_ENTRY) {
-			fprintf(stderr,
-				"Error: expected subprogram DIE to have DW_AT_low_pc.\n");
-			abort();
-		}
-		retval = dwarf_highpc(sp_die, &high_pc, NULL);
-		if (retval == DW_DLV_NO_ENTRY) {
+		if (find_pc_range(sp_die, &low_pc, &high_pc) == -1) {
 			fprintf(stderr,
-				"Error: expected subprogram DIE to have DW_AT_high_pc.\n");
+				"Error: expected subprogram DIE to have DW_AT_low_pc and DW_AT_high_pc.\n");
 			abort();
 		}
 	} else {
@@ -0,0 +1,76 @@
+#ifndef _CORE_WALK_H
+#define _CORE_WALK_H
+
+#include <sys/types.h>
+
+#include <libdwarf/libdwarf.h>
+
+struct arch;
+struct image;
+struct loc_expr;
+struct script;
+struct var_frame;
+
+
+/* how print_var_info() shows a value, and where it is */
+enum formats {
+	FORMAT_X,
+	FORMAT_D,
+	FORMAT_U,
+	FORMAT_F,
+	FORMAT_P,
+	FORMAT_C,
+	FORMAT_S,
+	FORMAT_B,
+};
+
+enum locations {
+	LOC_NONE,
+	LOC_REG,
+	LOC_MEM,
+	LOC_IMM,
+	/* in memory, at a register of the frame plus an offset */
+	LOC_FRAME,
+};
+
+struct call_entry {
+	unsigned long pc;
+	char *symbol;
+	unsigned int offset;
+	unsigned int size;
+};
+
+int print_call_info(struct image *image, const struct call_entry *call,
+		    Dwarf_Die sp_die);
+void print_die_info(Dwarf_Debug dwarf, Dwarf_Die die);
+void print_attr_info(Dwarf_Debug dwarf, Dwarf_Attribute attr);
+void print_loc_expr(Dwarf_Debug dwarf, const struct loc_expr *expr);
+void print_cfi(Dwarf_Debug dwarf, const struct call_entry *call);
+void print_regtable_entry(const struct arch *arch, const char *regname,
+			  Dwarf_Regtable_Entry3 *entry);
+void print_var_info(struct image *image, Dwarf_Die var_die,
+		    const struct var_frame *frame);
+void script_add_call(struct image *image, struct script *script,
+		     unsigned int frame, const struct call_entry *call,
+		     Dwarf_Die sp_die);
+void write_scripts(const struct script *script, char * const *paths);
+void print_line_info(Dwarf_Debug dwarf, Dwarf_Die cu_die, Dwarf_Die sp_die);
+
+int find_cu_by_pc(Dwarf_Debug dwarf, Dwarf_Arange *aranges,
+		  Dwarf_Signed ar_cnt, Dwarf_Addr pc, Dwarf_Die *result);
+int find_abstract_origin(Dwarf_Debug dwarf, Dwarf_Die die, Dwarf_Die *result);
+int find_pc_range(Dwarf_Die die, Dwarf_Addr *low_pc, Dwarf_Addr *high_pc);
+int find_subprogram_by_pc(Dwarf_Debug dwarf, Dwarf_Die die, Dwarf_Addr pc,
+			  Dwarf_Die *result);
+int find_lineno_by_pc(Dwarf_Debug dwarf, Dwarf_Die cu_die, Dwarf_Addr pc,
+		      char **file, unsigned int *line);
+int find_symbol_by_pc(struct image *image, Dwarf_Addr pc, char *name,
+		      size_t len, Dwarf_Unsigned *offset, Dwarf_Unsigned *size);
+int get_fde_list(Dwarf_Debug dwarf, Dwarf_Cie **cie_list,
+		 Dwarf_Signed *cie_count, Dwarf_Fde **fde_list,
+		 Dwarf_Signed *fde_count);
+int find_regtable_by_pc(Dwarf_Debug dwarf, Dwarf_Addr pc,
+			Dwarf_Regtable3 *reg_table, Dwarf_Addr *lopc,
+			Dwarf_Addr *hipc, Dwarf_Addr *row_pc);
+
+#endif
@@ -0,0 +1,608 @@
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "emit.h"
+#include "image.h"
+#include "json.h"
+#include "list.h"
+#include "resolve.h"
+#include "strpool.h"
+#include "util.h"
+
+struct served_image {
+	/* most recently used first */
+	struct list_head lru;
+	struct image image;
+	char *path;
+	/* to recognize the file when it is requested again */
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	/* estimated memory footprint */
+	size_t cost;
+	/* requests using the image, it can not be evicted while > 0 */
+	unsigned int refs;
+	/* libdwarf is not thread-safe, requests on an image are
+	 * serialized */
+	pthread_mutex_t lock;
+};
+
+struct server {
+	pthread_mutex_t lock;
+	struct list_head images;
+	size_t memory;
+	size_t budget;
+	unsigned long requests;
+};
+
+struct connection {
+	struct server *server;
+	int fd;
+};
+
+
+static void served_image_close(struct served_image *si)
+{
+	image_close(&si->image);
+	pthread_mutex_destroy(&si->lock);
+	free(si->path);
+	free(si);
+}
+
+
+static bool same_build_id(struct served_image *a, struct served_image *b)
+{
+	const unsigned char *id_a, *id_b;
+	size_t len_a = image_build_id(&a->image, &id_a);
+	size_t len_b = image_build_id(&b->image, &id_b);
+
+	return len_a && len_a == len_b && memcmp(id_a, id_b, len_a) == 0;
+}
+
+
+/* Close the least recently used idle images until the budget is met.
+ * Called with the server lock held. */
+static void evict(struct server *server)
+{
+	struct served_image *si, *tmp;
+
+	list_for_each_entry_safe_reverse(si, tmp, &server->images, lru) {
+		if (server->memory <= server->budget) {
+			break;
+		}
+		if (si->refs) {
+			continue;
+		}
+		list_del(&si->lru);
+		server->memory -= si->cost;
+		served_image_close(si);
+	}
+}
+
+
+/* Returns the image at path, opened if needed, or NULL. The image must be
+ * given back by release(). */
+static struct served_image *acquire(struct server *server, const char *path)
+{
+	struct served_image *si, *new;
+	const unsigned char *id;
+	struct stat st;
+
+	if (stat(path, &st) == -1) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&server->lock);
+	list_for_each_entry(si, &server->images, lru) {
+		if (si->dev == st.st_dev && si->ino == st.st_ino &&
+		    si->mtime.tv_sec == st.st_mtim.tv_sec &&
+		    si->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+			list_move(&si->lru, &server->images);
+			si->refs++;
+			pthread_mutex_unlock(&server->lock);
+			return si;
+		}
+	}
+	pthread_mutex_unlock(&server->lock);
+
+	/* open without holding the server lock, this is the slow part */
+	new = calloc(1, sizeof(*new));
+	new->path = strdup(path);
+	if (image_try_open(&new->image, new->path) == -1) {
+		free(new->path);
+		free(new);
+		return NULL;
+	}
+	/* loaded now so that same_build_id() does not touch libelf while
+	 * another thread uses the image */
+	image_build_id(&new->image, &id);
+	new->dev = st.st_dev;
+	new->ino = st.st_ino;
+	new->mtime = st.st_mtim;
+	/* libelf reads the sections in memory, the indexes built later add
+	 * to this */
+	new->cost = st.st_size;
+	new->refs = 1;
+	pthread_mutex_init(&new->lock, NULL);
+
+	pthread_mutex_lock(&server->lock);
+	list_for_each_entry(si, &server->images, lru) {
+		/* another path, or another request, got there first */
+		if (same_build_id(si, new)) {
+			list_move(&si->lru, &server->images);
+			si->refs++;
+			pthread_mutex_unlock(&server->lock);
+			served_image_close(new);
+			return si;
+		}
+	}
+	list_add(&new->lru, &server->images);
+	server->memory += new->cost;
+	evict(server);
+	pthread_mutex_unlock(&server->lock);
+
+	/* unless a request got to it already */
+	pthread_mutex_lock(&new->lock);
+	image_index_background(&new->image);
+	pthread_mutex_unlock(&new->lock);
+
+	return new;
+}
+
+
+static void release(struct server *server, struct served_image *si)
+{
+	pthread_mutex_lock(&server->lock);
+	si->refs--;
+	evict(server);
+	pthread_mutex_unlock(&server->lock);
+}
+
+
+static void print_build_id(FILE *out, struct image *image)
+{
+	const unsigned char *id;
+	size_t i, len = image_build_id(image, &id);
+
+	fputc('"', out);
+	for (i = 0; i < len; i++) {
+		fprintf(out, "%02x", id[i]);
+	}
+	fputc('"', out);
+}
+
+
+static void print_frame_json(FILE *out, const struct resolved_frame *frame)
+{
+	struct emitter em;
+
+	emitter_init_stream(&em, out, EMIT_JSON, 0);
+	emit_json_frame(&em, frame);
+}
+
+
+static void print_error(FILE *out, const char *message)
+{
+	fprintf(out, "{\"error\":");
+	json_print_string(out, message);
+	fprintf(out, "}\n");
+}
+
+
+static void print_stats(FILE *out, struct server *server)
+{
+	struct served_image *si;
+	bool first = true;
+
+	pthread_mutex_lock(&server->lock);
+	fprintf(out, "{\"requests\":%lu,\"memory\":%zu,\"budget\":%zu,\"images\":[",
+		server->requests, server->memory, server->budget);
+	list_for_each_entry(si, &server->images, lru) {
+		fprintf(out, "%s{\"path\":", first ? "" : ",");
+		json_print_string(out, si->path);
+		fprintf(out, ",\"build_id\":");
+		print_build_id(out, &si->image);
+		fprintf(out, ",\"memory\":%zu,\"refs\":%u}", si->cost,
+			si->refs);
+		first = false;
+	}
+	fprintf(out, "]}\n");
+	pthread_mutex_unlock(&server->lock);
+}
+
+
+static int pc_cmp(const void *a, const void *b)
+{
+	uint64_t pa = *(const uint64_t *) a, pb = *(const uint64_t *) b;
+
+	return pa < pb ? -1 : pa > pb;
+}
+
+
+/* Resolve pcs, in any order, through a sorted sweep */
+static void resolve_request(struct image *image, const uint64_t *pcs,
+			    unsigned int nr, struct strpool *pool, FILE *out)
+{
+	struct resolved_frame *frames;
+	uint64_t *sorted;
+	unsigned int i, unique_nb = 0;
+
+	sorted = malloc(nr * sizeof(*sorted));
+	memcpy(sorted, pcs, nr * sizeof(*sorted));
+	qsort(sorted, nr, sizeof(*sorted), pc_cmp);
+	for (i = 0; i < nr; i++) {
+		if (!unique_nb || sorted[unique_nb - 1] != sorted[i]) {
+			sorted[unique_nb++] = sorted[i];
+		}
+	}
+	frames = calloc(unique_nb, sizeof(*frames));
+	image_prefetch(image, sorted, unique_nb);
+	resolve_sorted_pcs(image, sorted, unique_nb, pool, frames);
+
+	for (i = 0; i < nr; i++) {
+		uint64_t *found = bsearch(&pcs[i], sorted, unique_nb,
+					  sizeof(*sorted), pc_cmp);
+
+		fprintf(out, "%s", i ? "," : "");
+		print_frame_json(out, &frames[found - sorted]);
+	}
+
+	free(frames);
+	free(sorted);
+}
+
+
+static void handle_request(struct server *server, const char *line,
+			   FILE *out)
+{
+	const struct json_value *path, *pcs_value, *stats;
+	struct served_image *si;
+	struct json_value request;
+	struct strpool pool = {};
+	uint64_t *pcs;
+	int i;
+
+	if (json_parse(line, &request) == -1) {
+		print_error(out, "invalid request");
+		goto out;
+	}
+	pthread_mutex_lock(&server->lock);
+	server->requests++;
+	pthread_mutex_unlock(&server->lock);
+
+	if ((stats = json_get(&request, "stats")) != NULL) {
+		print_stats(out, server);
+		goto out;
+	}
+	path = json_get(&request, "image");
+	pcs_value = json_get(&request, "pcs");
+	if (!path || path->type != JSON_STRING || !pcs_value ||
+	    pcs_value->type != JSON_ARRAY) {
+		print_error(out, "expected \"image\" and \"pcs\"");
+		goto out;
+	}
+
+	pcs = malloc(pcs_value->nr * sizeof(*pcs));
+	for (i = 0; i < pcs_value->nr; i++) {
+		const struct json_value *pc = &pcs_value->items[i];
+
+		/* strings, as numbers lose precision above 2^53 */
+		if (pc->type == JSON_STRING) {
+			pcs[i] = strtoull(pc->string, NULL, 16);
+		} else {
+			pcs[i] = pc->number;
+		}
+	}
+
+	if ((si = acquire(server, path->string)) == NULL) {
+		print_error(out, "cannot open image");
+		free(pcs);
+		goto out;
+	}
+	pthread_mutex_lock(&si->lock);
+	fprintf(out, "{\"build_id\":");
+	print_build_id(out, &si->image);
+	fprintf(out, ",\"addr_size\":%d,\"frames\":[", si->image.addr_size);
+	resolve_request(&si->image, pcs, pcs_value->nr, &pool, out);
+	fprintf(out, "]}\n");
+	pthread_mutex_unlock(&si->lock);
+	release(server, si);
+
+	strpool_free(&pool);
+	free(pcs);
+out:
+	json_free(&request);
+}
+
+
+static void *serve_connection(void *arg)
+{
+	struct connection *conn = arg;
+	char *line = NULL;
+	size_t n = 0;
+	FILE *in, *out;
+
+	in = fdopen(conn->fd, "r");
+	out = fdopen(dup(conn->fd), "w");
+	while (getline(&line, &n, in) != -1) {
+		handle_request(conn->server, line, out);
+		if (fflush(out) == EOF) {
+			break;
+		}
+	}
+	free(line);
+	fclose(out);
+	fclose(in);
+	free(conn);
+
+	return NULL;
+}
+
+
+static int socket_address(const char *path, struct sockaddr_un *addr)
+{
+	*addr = (struct sockaddr_un) {
+		.sun_family = AF_UNIX,
+	};
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "Error: socket path \"%s\" is too long.\n",
+			path);
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+
+/* Remove the socket at path if it was left by a daemon that is gone, which
+ * is when connecting to it is refused. Returns -1 if a daemon still listens
+ * there or path is not a socket. */
+static int remove_stale_socket(const char *path,
+			       const struct sockaddr_un *addr)
+{
+	struct stat st;
+	int fd, retval;
+
+	if (lstat(path, &st) == -1) {
+		if (errno == ENOENT) {
+			return 0;
+		}
+		fprintf(stderr, "Error: stat \"%s\" failed: %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+	if (!S_ISSOCK(st.st_mode)) {
+		fprintf(stderr, "Error: \"%s\" exists and is not a socket.\n",
+			path);
+		return -1;
+	}
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		fprintf(stderr, "Error: socket failed: %s\n", strerror(errno));
+		return -1;
+	}
+	retval = connect(fd, (const struct sockaddr *) addr, sizeof(*addr));
+	if (retval == 0) {
+		fprintf(stderr,
+			"Error: a daemon is already listening on \"%s\".\n",
+			path);
+		retval = -1;
+	} else if (errno != ECONNREFUSED) {
+		fprintf(stderr, "Error: connect to \"%s\" failed: %s\n", path,
+			strerror(errno));
+	} else if (unlink(path) == -1 && errno != ENOENT) {
+		fprintf(stderr, "Error: unlink \"%s\" failed: %s\n", path,
+			strerror(errno));
+	} else {
+		retval = 0;
+	}
+	close(fd);
+	return retval;
+}
+
+
+/* Serve requests until killed. Returns -1 if the socket can not be set
+ * up. */
+int daemon_serve(const char *socket_path, unsigned long memory_mb)
+{
+	struct server server = {
+		.budget = (size_t) memory_mb << 20,
+	};
+	struct sockaddr_un addr;
+	pthread_attr_t attr;
+	int fd;
+
+	if (socket_address(socket_path, &addr) == -1 ||
+	    remove_stale_socket(socket_path, &addr) == -1) {
+		return -1;
+	}
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		fprintf(stderr, "Error: socket failed: %s\n", strerror(errno));
+		return -1;
+	}
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+	    listen(fd, SOMAXCONN) == -1) {
+		fprintf(stderr, "Error: listen on \"%s\" failed: %s\n",
+			socket_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	pthread_mutex_init(&server.lock, NULL);
+	INIT_LIST_HEAD(&server.images);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	while (true) {
+		struct connection *conn;
+		pthread_t thread;
+		int client;
+
+		if ((client = accept(fd, NULL, NULL)) == -1) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			fprintf(stderr, "Error: accept failed: %s\n",
+				strerror(errno));
+			break;
+		}
+		conn = malloc(sizeof(*conn));
+		*conn = (struct connection) {
+			.server = &server,
+			.fd = client,
+		};
+		if (pthread_create(&thread, &attr, serve_connection, conn) !=
+		    0) {
+			close(client);
+			free(conn);
+		}
+	}
+
+	close(fd);
+	return -1;
+}
+
+
+static void frame_from_json(const struct json_value *value,
+			    struct resolved_frame *frame)
+{
+	const struct json_value *field, *locs;
+	int i;
+
+	*frame = (struct resolved_frame) {};
+	if ((field = json_get(value, "pc")) && field->type == JSON_STRING) {
+		frame->pc = strtoull(field->string, NULL, 16);
+	}
+	if ((field = json_get(value, "symbol")) &&
+	    field->type == JSON_STRING) {
+		frame->symbol = field->string;
+	}
+	if ((field = json_get(value, "offset"))) {
+		frame->offset = field->number;
+	}
+	if ((field = json_get(value, "size"))) {
+		frame->size = field->number;
+	}
+	if ((field = json_get(value, "debug_info"))) {
+		frame->debug_info = field->boolean;
+	}
+	if (!(locs = json_get(value, "locs")) || locs->type != JSON_ARRAY) {
+		return;
+	}
+	for (i = 0; i < locs->nr && i < INLINE_DEPTH_MAX; i++) {
+		const struct json_value *loc = &locs->items[i];
+
+		if ((field = json_get(loc, "function")) &&
+		    field->type == JSON_STRING) {
+			frame->locs[i].function = field->string;
+		} else {
+			frame->locs[i].function = "??";
+		}
+		if ((field = json_get(loc, "file")) &&
+		    field->type == JSON_STRING) {
+			frame->locs[i].file = field->string;
+		}
+		if ((field = json_get(loc, "line"))) {
+			frame->locs[i].line = field->number;
+		}
+	}
+	frame->locs_nb = i;
+}
+
+
+/*
+ * Send pcs to the server and print the frames in the format of --address.
+ * Returns -1 if the server can not be reached or reports an error.
+ */
+int daemon_client(const char *socket_path, const char *image_path,
+		  const Dwarf_Addr *pcs, unsigned int nr)
+{
+	const struct json_value *frames, *error, *addr_size;
+	struct json_value response;
+	struct sockaddr_un addr;
+	char path[PATH_MAX];
+	char *line = NULL;
+	size_t n = 0;
+	FILE *in, *out;
+	int fd, i, retval = -1;
+
+	/* the server does not share our working directory */
+	if (realpath(image_path, path) == NULL) {
+		fprintf(stderr, "Error: \"%s\": %s\n", image_path,
+			strerror(errno));
+		return -1;
+	}
+	if (socket_address(socket_path, &addr) == -1) {
+		return -1;
+	}
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 ||
+	    connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "Error: connect to \"%s\" failed: %s\n",
+			socket_path, strerror(errno));
+		if (fd != -1) {
+			close(fd);
+		}
+		return -1;
+	}
+	in = fdopen(fd, "r");
+	out = fdopen(dup(fd), "w");
+
+	fprintf(out, "{\"image\":");
+	json_print_string(out, path);
+	fprintf(out, ",\"pcs\":[");
+	for (i = 0; i < nr; i++) {
+		fprintf(out, "%s\"0x%" DW_PR_DUx "\"", i ? "," : "", pcs[i]);
+	}
+	fprintf(out, "]}\n");
+	fflush(out);
+
+	if (getline(&line, &n, in) == -1) {
+		fprintf(stderr, "Error: no response from \"%s\".\n",
+			socket_path);
+		goto out;
+	}
+	if (json_parse(line, &response) == -1) {
+		fprintf(stderr, "Error: invalid response from \"%s\".\n",
+			socket_path);
+		goto out_json;
+	}
+	if ((error = json_get(&response, "error")) &&
+	    error->type == JSON_STRING) {
+		fprintf(stderr, "Error: server says: %s\n", error->string);
+		goto out_json;
+	}
+	frames = json_get(&response, "frames");
+	addr_size = json_get(&response, "addr_size");
+	if (!frames || frames->type != JSON_ARRAY || !addr_size) {
+		fprintf(stderr, "Error: invalid response from \"%s\".\n",
+			socket_path);
+		goto out_json;
+	}
+	for (i = 0; i < frames->nr; i++) {
+		struct resolved_frame frame;
+
+		frame_from_json(&frames->items[i], &frame);
+		resolved_frame_print(stdout, &frame, addr_size->number);
+	}
+	retval = 0;
+
+out_json:
+	json_free(&response);
+out:
+	free(line);
+	fclose(out);
+	fclose(in);
+	return retval;
+}
@@ -0,0 +1,28 @@
+#ifndef _DAEMON_H
+#define _DAEMON_H
+
+#include <libdwarf/libdwarf.h>
+
+/*
+ * Symbolization server: images stay loaded between requests, keyed by
+ * build-id, and the least recently used ones are closed when their total
+ * size goes over a memory budget.
+ *
+ * The protocol is JSON lines over a Unix stream socket. A request
+ *	{"image": "/abs/path/vmlinux", "pcs": ["0xffffffff8134e51d", ...]}
+ * is answered by
+ *	{"build_id": "...", "addr_size": 8, "frames": [{"pc": "0x...",
+ *	 "symbol": "sysrq_handle_crash", "offset": 13, "size": 32,
+ *	 "debug_info": true, "locs": [{"function": "...", "file": "...",
+ *	 "line": 137}, ...]}, ...]}
+ * or {"error": "..."}. {"stats": true} describes the loaded images.
+ */
+
+/* MB */
+#define DAEMON_MEMORY_DEFAULT 4096
+
+int daemon_serve(const char *socket_path, unsigned long memory_mb);
+int daemon_client(const char *socket_path, const char *image_path,
+		  const Dwarf_Addr *pcs, unsigned int nr);
+
+#endif
@@ -0,0 +1,486 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libelf.h>
+#include <gelf.h>
+#include <libdwarf/libdwarf.h>
+#include <libdwarf/dwarf.h>
+
+#include "datasym.h"
+#include "location.h"
+#include "types.h"
+#include "util.h"
+
+
+/* how far back to look for an object containing the address when the
+ * closest one does not, for example because it has no size */
+#define OVERLAP_LOOKBACK 8
+
+
+static void table_add(struct data_table *table, Dwarf_Addr start,
+		      Dwarf_Unsigned size, const char *name,
+		      Dwarf_Off type_offset)
+{
+	if (table->nr == table->alloc) {
+		table->alloc = table->alloc ? table->alloc * 2 : 1024;
+		table->syms = realloc(table->syms,
+				      table->alloc * sizeof(*table->syms));
+	}
+	table->syms[table->nr++] = (struct data_sym) {
+		.start = start,
+		.size = size,
+		.name = name,
+		.type_offset = type_offset,
+	};
+}
+
+
+static int data_sym_cmp(const void *a, const void *b)
+{
+	const struct data_sym *sa = a, *sb = b;
+
+	if (sa->start != sb->start) {
+		return sa->start < sb->start ? -1 : 1;
+	}
+	/* objects with type information first */
+	if (!sa->type_offset != !sb->type_offset) {
+		return sa->type_offset ? -1 : 1;
+	}
+	return 0;
+}
+
+
+/* sort, drop duplicates and build the search array */
+static void table_finish(struct data_table *table)
+{
+	unsigned int i, j;
+
+	qsort(table->syms, table->nr, sizeof(*table->syms), data_sym_cmp);
+
+	/* the same object usually appears both in DWARF and in .symtab */
+	for (i = 0, j = 0; i < table->nr; i++) {
+		if (j > 0 && table->syms[j - 1].start == table->syms[i].start &&
+		    table->syms[j - 1].size >= table->syms[i].size) {
+			continue;
+		}
+		table->syms[j++] = table->syms[i];
+	}
+	table->nr = j;
+	table->alloc = j;
+	table->syms = realloc(table->syms, j * sizeof(*table->syms));
+
+	table->starts = malloc(j * sizeof(*table->starts));
+	table->lo = -1;
+	table->hi = 0;
+	for (i = 0; i < j; i++) {
+		const struct data_sym *sym = &table->syms[i];
+
+		table->starts[i] = sym->start;
+		if (sym->start < table->lo) {
+			table->lo = sym->start;
+		}
+		if (sym->start + sym->size + 1 > table->hi) {
+			table->hi = sym->start + sym->size + 1;
+		}
+	}
+}
+
+
+static const struct data_sym *table_lookup(const struct data_table *table,
+					   Dwarf_Addr addr)
+{
+	unsigned int lo = 0, hi = table->nr, i;
+
+	/* most words of a stack dump are rejected here */
+	if (addr < table->lo || addr >= table->hi) {
+		return NULL;
+	}
+
+	/* first start > addr */
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (table->starts[mid] <= addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for (i = lo; i > 0 && lo - i < OVERLAP_LOOKBACK; i--) {
+		const struct data_sym *sym = &table->syms[i - 1];
+
+		if (addr < sym->start + sym->size ||
+		    (sym->size == 0 && addr == sym->start)) {
+			return sym;
+		}
+	}
+
+	return NULL;
+}
+
+
+/* Variables located at a fixed address have a single DW_OP_addr location
+ * expression. */
+static int get_static_address(Dwarf_Debug dwarf, Dwarf_Die var_die,
+			      Dwarf_Addr *addr)
+{
+	Dwarf_Attribute attr;
+	struct loc_list list;
+	int retval = -1;
+
+	if (dwarf_attr(var_die, DW_AT_location, &attr, NULL) != DW_DLV_OK) {
+		return -1;
+	}
+	if (loc_list_get(attr, &list) == -1) {
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		return -1;
+	}
+
+	if (list.nr == 1 && !list.exprs[0].from_list &&
+	    list.exprs[0].ops_nb == 1 &&
+	    list.exprs[0].ops[0].atom == DW_OP_addr) {
+		*addr = list.exprs[0].ops[0].number;
+		retval = 0;
+	}
+
+	loc_list_free(&list);
+	dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+
+	return retval;
+}
+
+
+static void add_variable(struct data_index *index, Dwarf_Debug dwarf,
+			 Dwarf_Die var_die)
+{
+	Dwarf_Die decl_die = NULL, type_die;
+	Dwarf_Attribute attr;
+	Dwarf_Addr addr;
+	Dwarf_Unsigned size;
+	Dwarf_Off type_offset;
+	char *name;
+
+	if (get_static_address(dwarf, var_die, &addr) == -1) {
+		return;
+	}
+
+	/* a definition that follows an extern declaration refers to it for
+	 * its name and type */
+	type_die = var_die;
+	if (dwarf_attr(var_die, DW_AT_specification, &attr, NULL) ==
+	    DW_DLV_OK) {
+		Dwarf_Off decl_offset;
+
+		dwarf_global_formref(attr, &decl_offset, NULL);
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		if (dwarf_offdie(dwarf, decl_offset, &decl_die, NULL) ==
+		    DW_DLV_OK) {
+			type_die = decl_die;
+		}
+	}
+
+	if (dwarf_diename(type_die, &name, NULL) != DW_DLV_OK) {
+		goto out;
+	}
+	if (dwarf_attr(type_die, DW_AT_type, &attr, NULL) != DW_DLV_OK) {
+		dwarf_dealloc(dwarf, name, DW_DLA_STRING);
+		goto out;
+	}
+	dwarf_global_formref(attr, &type_offset, NULL);
+	dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+	if (get_type_size(dwarf, type_die, &size) == -1) {
+		size = 0;
+	}
+
+	table_add(addr >= index->percpu_start && addr < index->percpu_end ?
+		  &index->percpu : &index->globals, addr, size,
+		  strpool_add(&index->pool, name), type_offset);
+	dwarf_dealloc(dwarf, name, DW_DLA_STRING);
+
+out:
+	if (decl_die) {
+		dwarf_dealloc(dwarf, decl_die, DW_DLA_DIE);
+	}
+}
+
+
+/* Static variables may also be defined in function scope. Types and other
+ * entries are not traversed. */
+static void add_scope(struct data_index *index, Dwarf_Debug dwarf,
+		      Dwarf_Die scope)
+{
+	Dwarf_Die child, sibling;
+	int retval;
+
+	foreach_child(dwarf, scope, child, sibling, retval) {
+		Dwarf_Half tag;
+
+		dwarf_tag(child, &tag, NULL);
+		switch (tag) {
+		case DW_TAG_variable:
+			add_variable(index, dwarf, child);
+			break;
+
+		case DW_TAG_subprogram:
+		case DW_TAG_lexical_block:
+			add_scope(index, dwarf, child);
+			break;
+		}
+	}
+}
+
+
+static void add_dwarf_variables(struct data_index *index, Dwarf_Debug dwarf)
+{
+	Dwarf_Unsigned next_cu;
+
+	while (dwarf_next_cu_header(dwarf, NULL, NULL, NULL, NULL, &next_cu,
+				    NULL) == DW_DLV_OK) {
+		Dwarf_Die cu_die;
+
+		if (dwarf_siblingof(dwarf, NULL, &cu_die, NULL) !=
+		    DW_DLV_OK) {
+			continue;
+		}
+		add_scope(index, dwarf, cu_die);
+		dwarf_dealloc(dwarf, cu_die, DW_DLA_DIE);
+	}
+}
+
+
+static void add_elf_symbols(struct data_index *index, Elf *elf,
+			    size_t percpu_ndx)
+{
+	Elf_Scn *scn = NULL;
+
+	while ((scn = elf_nextscn(elf, scn)) != NULL) {
+		GElf_Shdr shdr;
+		Elf_Data *data;
+		int i;
+
+		gelf_getshdr(scn, &shdr);
+		if (shdr.sh_type != SHT_SYMTAB) {
+			continue;
+		}
+
+		data = elf_getdata(scn, NULL);
+		for (i = 0; i < shdr.sh_size / shdr.sh_entsize; i++) {
+			GElf_Sym sym;
+			const char *name;
+
+			gelf_getsym(data, i, &sym);
+			if (GELF_ST_TYPE(sym.st_info) != STT_OBJECT ||
+			    sym.st_shndx == SHN_UNDEF) {
+				continue;
+			}
+			name = elf_strptr(elf, shdr.sh_link, sym.st_name);
+			if (!name || !*name) {
+				continue;
+			}
+
+			table_add(percpu_ndx && sym.st_shndx == percpu_ndx ?
+				  &index->percpu : &index->globals,
+				  sym.st_value, sym.st_size,
+				  strpool_add(&index->pool, name), 0);
+		}
+	}
+}
+
+
+struct data_index *data_index_build(Elf *elf, Dwarf_Debug dwarf)
+{
+	struct data_index *index;
+	Elf_Scn *scn = NULL;
+	size_t shstrndx, percpu_ndx = 0;
+
+	index = calloc(1, sizeof(*index));
+
+	elf_getshdrstrndx(elf, &shstrndx);
+	while ((scn = elf_nextscn(elf, scn)) != NULL) {
+		GElf_Shdr shdr;
+		const char *name;
+
+		gelf_getshdr(scn, &shdr);
+		name = elf_strptr(elf, shstrndx, shdr.sh_name);
+		if (name && strcmp(name, ".data..percpu") == 0) {
+			percpu_ndx = elf_ndxscn(scn);
+			index->percpu_start = shdr.sh_addr;
+			index->percpu_end = shdr.sh_addr + shdr.sh_size;
+			break;
+		}
+	}
+
+	add_dwarf_variables(index, dwarf);
+	add_elf_symbols(index, elf, percpu_ndx);
+	table_finish(&index->globals);
+	table_finish(&index->percpu);
+
+	return index;
+}
+
+
+static int percpu_area_cmp(const void *a, const void *b)
+{
+	const struct percpu_area *pa = a, *pb = b;
+
+	if (pa->base != pb->base) {
+		return pa->base < pb->base ? -1 : 1;
+	}
+	return 0;
+}
+
+
+/* offsets is the content of __per_cpu_offset[] read from a dump */
+void data_index_set_percpu_offsets(struct data_index *index,
+				   const Dwarf_Addr *offsets,
+				   unsigned int nr)
+{
+	int i;
+
+	free(index->areas);
+	index->areas = malloc(nr * sizeof(*index->areas));
+	for (i = 0; i < nr; i++) {
+		index->areas[i] = (struct percpu_area) {
+			.base = offsets[i] + index->percpu_start,
+			.cpu = i,
+		};
+	}
+	qsort(index->areas, nr, sizeof(*index->areas), percpu_area_cmp);
+	index->areas_nb = nr;
+}
+
+
+/* Returns -1 if addr does not point into a known data object. flags are
+ * DATA_LOOKUP_*. */
+int data_index_lookup(const struct data_index *index, Dwarf_Addr addr,
+		      int flags, struct data_ref *ref)
+{
+	const struct data_sym *sym;
+	Dwarf_Addr percpu_size = index->percpu_end - index->percpu_start;
+
+	if ((sym = table_lookup(&index->globals, addr)) != NULL) {
+		ref->cpu = DATA_REF_GLOBAL;
+	} else if (flags & DATA_LOOKUP_PERCPU_OFFSET &&
+		   addr >= index->percpu_start && addr < index->percpu_end) {
+		sym = table_lookup(&index->percpu, addr);
+		ref->cpu = DATA_REF_PERCPU_OFFSET;
+	} else if (index->areas_nb && percpu_size) {
+		unsigned int lo = 0, hi = index->areas_nb;
+
+		/* last area with base <= addr */
+		while (lo < hi) {
+			unsigned int mid = lo + (hi - lo) / 2;
+
+			if (index->areas[mid].base <= addr) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		if (lo > 0 && addr - index->areas[lo - 1].base < percpu_size) {
+			const struct percpu_area *area = &index->areas[lo - 1];
+
+			addr = addr - area->base + index->percpu_start;
+			sym = table_lookup(&index->percpu, addr);
+			ref->cpu = area->cpu;
+		}
+	}
+
+	if (!sym) {
+		return -1;
+	}
+	ref->sym = sym;
+	ref->offset = addr - sym->start;
+	return 0;
+}
+
+
+static const struct data_sym *table_find(const struct data_table *table,
+					 const char *name)
+{
+	const struct data_sym *found = NULL;
+	int i;
+
+	for (i = 0; i < table->nr; i++) {
+		const struct data_sym *sym = &table->syms[i];
+
+		if (strcmp(sym->name, name) == 0) {
+			found = sym;
+			if (sym->type_offset) {
+				break;
+			}
+		}
+	}
+
+	return found;
+}
+
+
+/* Linear, for the occasional lookup of a variable by name. Prefers objects
+ * with a DWARF type. The start of per-cpu variables is within
+ * [percpu_start, percpu_end[. */
+const struct data_sym *data_index_find(const struct data_index *index,
+				       const char *name)
+{
+	const struct data_sym *found;
+
+	if ((found = table_find(&index->globals, name)) == NULL) {
+		found = table_find(&index->percpu, name);
+	}
+	return found;
+}
+
+
+/* Address of sym in a kernel relocated by slide. Per-cpu variables are
+ * offsets in the per-cpu areas, which KASLR does not move. */
+Dwarf_Addr data_sym_address(const struct data_index *index,
+			    const struct data_sym *sym, uint64_t slide)
+{
+	if (sym >= index->percpu.syms &&
+	    sym < index->percpu.syms + index->percpu.nr) {
+		return sym->start;
+	}
+	return sym->start + slide;
+}
+
+
+/* "name+0xoff (.member.path) [cpu N]" */
+int data_ref_format(struct type_cache *types, const struct data_ref *ref,
+		    char *buf, size_t len)
+{
+	size_t pos;
+
+	pos = snprintf(buf, len, "%s+0x%" DW_PR_DUx, ref->sym->name,
+		       ref->offset);
+	if (ref->sym->type_offset && pos + 4 < len) {
+		char path[128];
+
+		if (type_member_path(type_cache_get(types,
+						    ref->sym->type_offset),
+				     ref->offset, path, sizeof(path)) > 0) {
+			pos += snprintf(buf + pos, len - pos, " (%s)", path);
+		}
+	}
+	if (ref->cpu == DATA_REF_PERCPU_OFFSET && pos < len) {
+		pos += snprintf(buf + pos, len - pos, " [percpu]");
+	} else if (ref->cpu >= 0 && pos < len) {
+		pos += snprintf(buf + pos, len - pos, " [cpu %d]", ref->cpu);
+	}
+
+	return pos < len ? pos : len - 1;
+}
+
+
+void data_index_free(struct data_index *index)
+{
+	free(index->globals.starts);
+	free(index->globals.syms);
+	free(index->percpu.starts);
+	free(index->percpu.syms);
+	free(index->areas);
+	strpool_free(&index->pool);
+	free(index);
+}
@@ -0,0 +1,87 @@
+#ifndef _DATASYM_H
+#define _DATASYM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <libelf.h>
+#include <libdwarf/libdwarf.h>
+
+#include "strpool.h"
+
+/*
+ * Address interval index over the data objects of an image: variables with a
+ * static DW_OP_addr location and STT_OBJECT symbols from .symtab. Per-cpu
+ * variables are kept apart since their address is an offset in the per-cpu
+ * section that is relative to the per-cpu area of each cpu.
+ */
+
+struct data_sym {
+	Dwarf_Addr start;
+	Dwarf_Unsigned size;
+	const char *name;
+	/* global offset of the DW_TAG_*_type DIE, 0 if the object only
+	 * comes from .symtab */
+	Dwarf_Off type_offset;
+};
+
+struct data_table {
+	/* starts[i] == syms[i].start, kept apart for a denser search */
+	Dwarf_Addr *starts;
+	struct data_sym *syms;
+	unsigned int nr;
+	unsigned int alloc;
+	/* [lo, hi[ covers all the objects of the table */
+	Dwarf_Addr lo;
+	Dwarf_Addr hi;
+};
+
+struct percpu_area {
+	Dwarf_Addr base;
+	int cpu;
+};
+
+struct data_index {
+	struct data_table globals;
+	struct data_table percpu;
+	/* address range of the .data..percpu section */
+	Dwarf_Addr percpu_start;
+	Dwarf_Addr percpu_end;
+	/* sorted by base */
+	struct percpu_area *areas;
+	unsigned int areas_nb;
+	struct strpool pool;
+};
+
+/* data_index_lookup() flags: addr may be an offset in the per-cpu section,
+ * as __percpu pointers hold. Those are small, and would catch any small
+ * value otherwise. */
+#define DATA_LOOKUP_PERCPU_OFFSET 0x1
+
+/* data_ref.cpu values that are not cpu numbers */
+#define DATA_REF_GLOBAL -1
+#define DATA_REF_PERCPU_OFFSET -2
+
+struct data_ref {
+	const struct data_sym *sym;
+	Dwarf_Unsigned offset;
+	int cpu;
+};
+
+struct data_index *data_index_build(Elf *elf, Dwarf_Debug dwarf);
+void data_index_set_percpu_offsets(struct data_index *index,
+				   const Dwarf_Addr *offsets,
+				   unsigned int nr);
+int data_index_lookup(const struct data_index *index, Dwarf_Addr addr,
+		      int flags, struct data_ref *ref);
+const struct data_sym *data_index_find(const struct data_index *index,
+				       const char *name);
+Dwarf_Addr data_sym_address(const struct data_index *index,
+			    const struct data_sym *sym, uint64_t slide);
+struct type_cache;
+
+int data_ref_format(struct type_cache *types, const struct data_ref *ref,
+		    char *buf, size_t len);
+void data_index_free(struct data_index *index);
+
+#endif
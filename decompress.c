@@ -0,0 +1,441 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <libelf.h>
+#include <gelf.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#include "decompress.h"
+
+#ifndef ELFCOMPRESS_ZSTD
+#define ELFCOMPRESS_ZSTD 2
+#endif
+
+/* "ZLIB" and the size, big-endian */
+#define ZDEBUG_HEADER_SIZE 12
+
+struct section_job {
+	size_t index;
+	int type;
+	const unsigned char *src;
+	size_t src_size;
+	/* anonymous mapping */
+	unsigned char *dst;
+	size_t dst_size;
+	size_t align;
+	/* .zdebug_* sections are renamed .debug_* */
+	bool rename;
+	int failed;
+};
+
+struct decompress_set {
+	struct section_job *jobs;
+	unsigned int nr;
+	/* next job to run, shared by the workers */
+	unsigned int next;
+};
+
+static const char *cache_dir;
+
+
+void decompress_set_cache_dir(const char *dir)
+{
+	cache_dir = dir;
+}
+
+
+/* Fill job if scn is compressed. Returns false otherwise. */
+static bool section_job_init(Elf *elf, Elf_Scn *scn, const char *name,
+			     struct section_job *job)
+{
+	GElf_Shdr shdr;
+	Elf_Data *data;
+
+	gelf_getshdr(scn, &shdr);
+	if (shdr.sh_type == SHT_NOBITS ||
+	    (data = elf_rawdata(scn, NULL)) == NULL) {
+		return false;
+	}
+
+	*job = (struct section_job) {
+		.index = elf_ndxscn(scn),
+		.align = shdr.sh_addralign,
+	};
+	if (shdr.sh_flags & SHF_COMPRESSED) {
+		size_t header = gelf_getclass(elf) == ELFCLASS32 ?
+			sizeof(Elf32_Chdr) : sizeof(Elf64_Chdr);
+		GElf_Chdr chdr;
+
+		if (gelf_getchdr(scn, &chdr) == NULL ||
+		    data->d_size < header) {
+			return false;
+		}
+		job->type = chdr.ch_type;
+		job->src = (const unsigned char *) data->d_buf + header;
+		job->src_size = data->d_size - header;
+		job->dst_size = chdr.ch_size;
+		job->align = chdr.ch_addralign;
+		return true;
+	} else if (name && strncmp(name, ".zdebug_", 8) == 0 &&
+		   data->d_size >= ZDEBUG_HEADER_SIZE &&
+		   memcmp(data->d_buf, "ZLIB", 4) == 0) {
+		const unsigned char *p = data->d_buf;
+		int i;
+
+		job->type = ELFCOMPRESS_ZLIB;
+		for (i = 4; i < ZDEBUG_HEADER_SIZE; i++) {
+			job->dst_size = job->dst_size << 8 | p[i];
+		}
+		job->src = p + ZDEBUG_HEADER_SIZE;
+		job->src_size = data->d_size - ZDEBUG_HEADER_SIZE;
+		job->rename = true;
+		return true;
+	}
+	return false;
+}
+
+
+bool decompress_needed(Elf *elf)
+{
+	Elf_Scn *scn = NULL;
+	size_t shstrndx;
+
+	if (elf_getshdrstrndx(elf, &shstrndx) != 0) {
+		return false;
+	}
+	while ((scn = elf_nextscn(elf, scn)) != NULL) {
+		struct section_job job;
+		GElf_Shdr shdr;
+
+		gelf_getshdr(scn, &shdr);
+		if (section_job_init(elf, scn, elf_strptr(elf, shstrndx,
+							  shdr.sh_name),
+				     &job)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+static void section_job_run(struct section_job *job)
+{
+	job->dst = mmap(NULL, job->dst_size ? job->dst_size : 1,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+			-1, 0);
+	if (job->dst == MAP_FAILED) {
+		job->dst = NULL;
+		job->failed = 1;
+		return;
+	}
+
+	if (job->type == ELFCOMPRESS_ZLIB) {
+		uLongf size = job->dst_size;
+
+		job->failed = uncompress(job->dst, &size, job->src,
+					 job->src_size) != Z_OK ||
+			size != job->dst_size;
+	} else if (job->type == ELFCOMPRESS_ZSTD) {
+		size_t size = ZSTD_decompress(job->dst, job->dst_size,
+					      job->src, job->src_size);
+
+		job->failed = ZSTD_isError(size) || size != job->dst_size;
+	} else {
+		job->failed = 1;
+	}
+}
+
+
+static void *decompress_worker(void *arg)
+{
+	struct decompress_set *set = arg;
+	unsigned int i;
+
+	while ((i = __atomic_fetch_add(&set->next, 1, __ATOMIC_RELAXED)) <
+	       set->nr) {
+		section_job_run(&set->jobs[i]);
+	}
+
+	return NULL;
+}
+
+
+/* largest first, so that the workers finish together */
+static int job_size_cmp(const void *a, const void *b)
+{
+	const struct section_job *ja = a, *jb = b;
+
+	if (ja->dst_size != jb->dst_size) {
+		return ja->dst_size < jb->dst_size ? 1 : -1;
+	}
+	return ja->index < jb->index ? -1 : ja->index > jb->index;
+}
+
+
+static struct section_job *find_job(struct decompress_set *set, size_t index)
+{
+	unsigned int i;
+
+	for (i = 0; i < set->nr; i++) {
+		if (set->jobs[i].index == index) {
+			return &set->jobs[i];
+		}
+	}
+	return NULL;
+}
+
+
+/*
+ * Write elf to fd with the sections of set replaced by their decompressed
+ * contents. Program headers are left out, nothing reads them from an image.
+ */
+static int write_elf(Elf *elf, struct decompress_set *set, int fd)
+{
+	Elf *out;
+	Elf_Scn *scn = NULL;
+	GElf_Ehdr ehdr;
+	size_t shstrndx, names_size;
+	char *names = NULL;
+	Elf_Data *data;
+	int retval = -1;
+
+	if ((out = elf_begin(fd, ELF_C_WRITE, NULL)) == NULL ||
+	    gelf_getehdr(elf, &ehdr) == NULL ||
+	    gelf_newehdr(out, gelf_getclass(elf)) == NULL ||
+	    elf_getshdrstrndx(elf, &shstrndx) != 0) {
+		goto out;
+	}
+	ehdr.e_phoff = 0;
+	ehdr.e_phnum = 0;
+	if (gelf_update_ehdr(out, &ehdr) == 0) {
+		goto out;
+	}
+
+	/* section names, with room for the renamed .zdebug_* ones, which are
+	 * shorter */
+	if ((data = elf_getdata(elf_getscn(elf, shstrndx), NULL)) == NULL) {
+		goto out;
+	}
+	names_size = data->d_size;
+	names = malloc(2 * data->d_size);
+	memcpy(names, data->d_buf, data->d_size);
+
+	while ((scn = elf_nextscn(elf, scn)) != NULL) {
+		struct section_job *job = find_job(set, elf_ndxscn(scn));
+		Elf_Scn *out_scn = elf_newscn(out);
+		Elf_Data *out_data;
+		GElf_Shdr shdr;
+
+		gelf_getshdr(scn, &shdr);
+		if (job && job->rename) {
+			const char *name = names + shdr.sh_name;
+
+			/* ".zdebug_info" -> ".debug_info" */
+			shdr.sh_name = names_size;
+			names_size += sprintf(names + names_size, ".%s",
+					      name + 2) + 1;
+		}
+		if (job) {
+			shdr.sh_flags &= ~SHF_COMPRESSED;
+			shdr.sh_size = job->dst_size;
+			shdr.sh_addralign = job->align;
+		}
+		if (out_scn == NULL || gelf_update_shdr(out_scn, &shdr) == 0) {
+			goto out;
+		}
+		if (shdr.sh_type == SHT_NOBITS) {
+			continue;
+		}
+
+		out_data = elf_newdata(out_scn);
+		if (job) {
+			*out_data = (Elf_Data) {
+				.d_buf = job->dst,
+				.d_type = ELF_T_BYTE,
+				.d_version = EV_CURRENT,
+				.d_size = job->dst_size,
+				.d_align = job->align,
+			};
+		} else if ((data = elf_getdata(scn, NULL)) != NULL) {
+			*out_data = *data;
+			out_data->d_off = 0;
+		}
+	}
+
+	/* the names go in last, once all the renamed sections are known */
+	if ((scn = elf_getscn(out, shstrndx)) != NULL &&
+	    (data = elf_getdata(scn, NULL)) != NULL) {
+		GElf_Shdr shdr;
+
+		data->d_buf = names;
+		data->d_size = names_size;
+		gelf_getshdr(scn, &shdr);
+		shdr.sh_size = names_size;
+		gelf_update_shdr(scn, &shdr);
+	}
+
+	if (elf_update(out, ELF_C_WRITE) != -1) {
+		retval = 0;
+	}
+
+out:
+	if (retval == -1) {
+		fprintf(stderr,
+			"Error: writing the decompressed image failed, libelf says: %s\n",
+			elf_errmsg(-1));
+	}
+	if (out) {
+		elf_end(out);
+	}
+	free(names);
+	return retval;
+}
+
+
+static char *cache_path(const unsigned char *id, size_t id_len,
+			const char *suffix)
+{
+	size_t i, len = strlen(cache_dir) + 2 * id_len + strlen(suffix) + 2;
+	char *path = malloc(len), *p;
+
+	p = path + sprintf(path, "%s/", cache_dir);
+	for (i = 0; i < id_len; i++) {
+		p += sprintf(p, "%02x", id[i]);
+	}
+	strcpy(p, suffix);
+
+	return path;
+}
+
+
+/* Decompress the sections of elf and write the result to fd */
+static int decompress_to(Elf *elf, int fd)
+{
+	struct decompress_set set = {};
+	Elf_Scn *scn = NULL;
+	size_t shstrndx;
+	unsigned int i, alloc = 0, jobs;
+	pthread_t *threads;
+	int retval = 0;
+
+	elf_getshdrstrndx(elf, &shstrndx);
+	while ((scn = elf_nextscn(elf, scn)) != NULL) {
+		GElf_Shdr shdr;
+
+		if (set.nr == alloc) {
+			alloc = alloc ? alloc * 2 : 16;
+			set.jobs = realloc(set.jobs, alloc * sizeof(*set.jobs));
+		}
+		gelf_getshdr(scn, &shdr);
+		if (section_job_init(elf, scn, elf_strptr(elf, shstrndx,
+							  shdr.sh_name),
+				     &set.jobs[set.nr])) {
+			set.nr++;
+		}
+	}
+	qsort(set.jobs, set.nr, sizeof(*set.jobs), job_size_cmp);
+
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs > set.nr) {
+		jobs = set.nr;
+	}
+	threads = malloc(jobs * sizeof(*threads));
+	for (i = 0; i < jobs; i++) {
+		if (pthread_create(&threads[i], NULL, decompress_worker,
+				   &set) != 0) {
+			break;
+		}
+	}
+	/* whatever the threads that could not be created would have done */
+	decompress_worker(&set);
+	jobs = i;
+	for (i = 0; i < jobs; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	for (i = 0; i < set.nr; i++) {
+		if (set.jobs[i].failed) {
+			fprintf(stderr,
+				"Error: decompressing section %zu failed.\n",
+				set.jobs[i].index);
+			retval = -1;
+		}
+	}
+	if (retval == 0) {
+		retval = write_elf(elf, &set, fd);
+	}
+
+	for (i = 0; i < set.nr; i++) {
+		if (set.jobs[i].dst) {
+			munmap(set.jobs[i].dst, set.jobs[i].dst_size ?
+			       set.jobs[i].dst_size : 1);
+		}
+	}
+	free(set.jobs);
+
+	return retval;
+}
+
+
+/*
+ * Open a decompressed copy of elf. Returns its file descriptor, and in path
+ * a name to open it again under, or -1. id is the build-id of elf, without
+ * one the copy is not cached.
+ */
+int decompress_open(Elf *elf, const unsigned char *id, size_t id_len,
+		    char **path)
+{
+	char *tmp_path;
+	int fd;
+
+	if (cache_dir && id_len) {
+		*path = cache_path(id, id_len, ".debug");
+		if ((fd = open(*path, O_RDONLY)) != -1) {
+			return fd;
+		}
+
+		/* another process may be writing it too, the last rename
+		 * wins */
+		tmp_path = cache_path(id, id_len, ".XXXXXX");
+		if ((fd = mkstemp(tmp_path)) == -1) {
+			fprintf(stderr, "Error: creating \"%s\" failed: %s\n",
+				tmp_path, strerror(errno));
+		} else if (decompress_to(elf, fd) == -1 ||
+			   rename(tmp_path, *path) == -1) {
+			unlink(tmp_path);
+			close(fd);
+			fd = -1;
+		}
+		free(tmp_path);
+		if (fd != -1) {
+			return fd;
+		}
+		free(*path);
+		return -1;
+	}
+
+	if ((fd = memfd_create("core_walk", 0)) == -1) {
+		fprintf(stderr, "Error: memfd_create failed: %s\n",
+			strerror(errno));
+		return -1;
+	}
+	if (decompress_to(elf, fd) == -1) {
+		close(fd);
+		return -1;
+	}
+	/* the memory file can be opened again only through /proc */
+	*path = malloc(32);
+	sprintf(*path, "/proc/self/fd/%d", fd);
+
+	return fd;
+}
@@ -0,0 +1,21 @@
+#ifndef _DECOMPRESS_H
+#define _DECOMPRESS_H
+
+#include <stdbool.h>
+
+#include <libelf.h>
+
+/*
+ * libdwarf does not read compressed debug sections, SHF_COMPRESSED (zlib or
+ * zstd) or .zdebug_*. Images with such sections are opened through a copy
+ * with every section decompressed, in parallel. The copy is kept in memory,
+ * or in a cache directory keyed by build-id so that later runs open it
+ * directly.
+ */
+
+void decompress_set_cache_dir(const char *dir);
+bool decompress_needed(Elf *elf);
+int decompress_open(Elf *elf, const unsigned char *id, size_t id_len,
+		    char **path);
+
+#endif
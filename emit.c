@@ -0,0 +1,462 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "emit.h"
+#include "resolve.h"
+#include "util.h"
+
+/* records are rarely longer, larger ones are formatted in a malloc() buffer */
+#define EMIT_PRINTF_MAX 1024
+
+
+int emit_format_parse(const char *name, enum emit_format *format)
+{
+	if (strcmp(name, "text") == 0) {
+		*format = EMIT_TEXT;
+	} else if (strcmp(name, "json") == 0) {
+		*format = EMIT_JSON;
+	} else if (strcmp(name, "binary") == 0) {
+		*format = EMIT_BINARY;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Write the batch, resuming after short writes. Chunks are kept for the next
+ * one. */
+int emitter_flush(struct emitter *em)
+{
+	struct iovec *iov = em->iov;
+	int i, nr = em->chunk + 1;
+
+	if (em->stream) {
+		return fflush(em->stream) == 0 ? 0 : -1;
+	}
+
+	while (!em->error && nr && (iov->iov_len || nr > 1)) {
+		ssize_t written = writev(em->fd, iov, nr);
+
+		if (written == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			em->error = errno;
+			fprintf(stderr, "Error: write failed: %s\n",
+				strerror(errno));
+			break;
+		}
+		em->writes++;
+		for (; nr && written >= iov->iov_len; iov++, nr--) {
+			written -= iov->iov_len;
+		}
+		if (nr) {
+			iov->iov_base = (char *) iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+
+	for (i = 0; i <= em->chunk; i++) {
+		em->iov[i].iov_base = em->chunks[i];
+		em->iov[i].iov_len = 0;
+	}
+	em->chunk = 0;
+
+	return em->error ? -1 : 0;
+}
+
+
+static void emit_append(struct emitter *em, const void *buf, size_t len)
+{
+	while (len) {
+		struct iovec *iov = &em->iov[em->chunk];
+		size_t room = EMIT_CHUNK_SIZE - iov->iov_len, n;
+
+		if (!room) {
+			if (em->chunk + 1 == EMIT_CHUNKS_NB) {
+				emitter_flush(em);
+			} else {
+				em->chunk++;
+			}
+			iov = &em->iov[em->chunk];
+			if (!em->chunks[em->chunk]) {
+				em->chunks[em->chunk] = malloc(EMIT_CHUNK_SIZE);
+				iov->iov_base = em->chunks[em->chunk];
+			}
+			continue;
+		}
+		n = len < room ? len : room;
+		memcpy((char *) iov->iov_base + iov->iov_len, buf, n);
+		iov->iov_len += n;
+		buf = (const char *) buf + n;
+		len -= n;
+	}
+}
+
+
+void emit_write(struct emitter *em, const void *buf, size_t len)
+{
+	if (em->stream) {
+		fwrite(buf, 1, len, em->stream);
+	} else if (!em->error) {
+		emit_append(em, buf, len);
+	}
+}
+
+
+void emit_printf(struct emitter *em, const char *format, ...)
+{
+	char small[EMIT_PRINTF_MAX], *buf = small;
+	va_list ap;
+	int len;
+
+	va_start(ap, format);
+	if (em->stream) {
+		vfprintf(em->stream, format, ap);
+		va_end(ap);
+		return;
+	}
+	len = vsnprintf(small, sizeof(small), format, ap);
+	va_end(ap);
+	if (len < 0) {
+		return;
+	}
+
+	if (len >= sizeof(small)) {
+		buf = malloc(len + 1);
+		va_start(ap, format);
+		vsnprintf(buf, len + 1, format, ap);
+		va_end(ap);
+	}
+	emit_write(em, buf, len);
+	if (buf != small) {
+		free(buf);
+	}
+}
+
+
+/* The characters that need no escaping are written in runs */
+void emit_json_string(struct emitter *em, const char *string)
+{
+	const unsigned char *p, *run;
+
+	emit_write(em, "\"", 1);
+	for (p = run = (const unsigned char *) string; *p; p++) {
+		if (*p >= 0x20 && *p != '"' && *p != '\\') {
+			continue;
+		}
+		emit_write(em, run, p - run);
+		run = p + 1;
+		switch (*p) {
+		case '"':
+			emit_write(em, "\\\"", 2);
+			break;
+		case '\\':
+			emit_write(em, "\\\\", 2);
+			break;
+		case '\n':
+			emit_write(em, "\\n", 2);
+			break;
+		case '\t':
+			emit_write(em, "\\t", 2);
+			break;
+		default:
+			emit_printf(em, "\\u%04x", *p);
+		}
+	}
+	emit_write(em, run, p - run);
+	emit_write(em, "\"", 1);
+}
+
+
+static void text_loc(struct emitter *em, const struct resolved_loc *loc)
+{
+	if (loc->file) {
+		emit_printf(em, "%s:%u", loc->file, loc->line);
+	} else {
+		emit_write(em, "??", 2);
+	}
+}
+
+
+/*
+ * "0xADDR: symbol+0x1d/0x20 (file.c:137)", followed by one line per
+ * function, innermost first, when the address is in inlined code. On one
+ * line, the inline chain is "inner (file:line) < caller (file:line) < ...".
+ */
+static void text_frame(struct emitter *em, const struct resolved_frame *frame,
+		       bool one_line)
+{
+	int i;
+
+	emit_printf(em, "0x%0*" PRIx64 ": ", 2 * em->addr_size, frame->pc);
+	if (one_line && frame->locs_nb > 1) {
+		if (frame->symbol) {
+			emit_printf(em, "%s+0x%" PRIx64 "/0x%" PRIx64 " ",
+				    frame->symbol, frame->offset, frame->size);
+		}
+		for (i = 0; i < frame->locs_nb; i++) {
+			emit_printf(em, "%s%s (", i ? " < " : "",
+				    frame->locs[i].function);
+			text_loc(em, &frame->locs[i]);
+			emit_write(em, ")", 1);
+		}
+		emit_write(em, "\n", 1);
+		return;
+	}
+
+	if (!frame->locs_nb) {
+		emit_write(em, "?\n", 2);
+		return;
+	} else if (frame->symbol) {
+		emit_printf(em, "%s+0x%" PRIx64 "/0x%" PRIx64, frame->symbol,
+			    frame->offset, frame->size);
+	} else {
+		emit_printf(em, "%s", frame->locs[0].function);
+	}
+
+	if (!frame->debug_info) {
+		emit_printf(em, " (no debug info)\n");
+	} else if (frame->locs_nb == 1) {
+		emit_write(em, " (", 2);
+		text_loc(em, &frame->locs[0]);
+		emit_write(em, ")\n", 2);
+	} else {
+		emit_write(em, "\n", 1);
+		for (i = 0; i < frame->locs_nb; i++) {
+			emit_printf(em, "    %s%s (", i ? "inlined into " : "",
+				    frame->locs[i].function);
+			text_loc(em, &frame->locs[i]);
+			emit_write(em, ")\n", 2);
+		}
+	}
+}
+
+
+static void text_data(struct emitter *em, uint64_t addr,
+		      const char *description)
+{
+	emit_printf(em, "0x%0*" PRIx64 ": %s\n", 2 * em->addr_size, addr,
+		    description);
+}
+
+
+void emit_json_frame(struct emitter *em, const struct resolved_frame *frame)
+{
+	int i;
+
+	emit_printf(em, "{\"pc\":\"0x%" PRIx64 "\"", frame->pc);
+	if (!frame->locs_nb) {
+		emit_write(em, "}", 1);
+		return;
+	}
+	if (frame->symbol) {
+		emit_printf(em, ",\"symbol\":");
+		emit_json_string(em, frame->symbol);
+		emit_printf(em, ",\"offset\":%" PRIu64 ",\"size\":%" PRIu64,
+			    frame->offset, frame->size);
+	}
+	emit_printf(em, ",\"debug_info\":%s,\"locs\":[",
+		    frame->debug_info ? "true" : "false");
+	for (i = 0; i < frame->locs_nb; i++) {
+		const struct resolved_loc *loc = &frame->locs[i];
+
+		emit_printf(em, "%s{\"function\":", i ? "," : "");
+		emit_json_string(em, loc->function);
+		if (loc->file) {
+			emit_printf(em, ",\"file\":");
+			emit_json_string(em, loc->file);
+			emit_printf(em, ",\"line\":%u", loc->line);
+		}
+		emit_write(em, "}", 1);
+	}
+	emit_write(em, "]}", 2);
+}
+
+
+static void json_frame(struct emitter *em, const struct resolved_frame *frame,
+		       bool one_line)
+{
+	emit_json_frame(em, frame);
+	emit_write(em, "\n", 1);
+}
+
+
+static void json_data(struct emitter *em, uint64_t addr,
+		      const char *description)
+{
+	emit_printf(em, "{\"pc\":\"0x%" PRIx64 "\",\"data\":", addr);
+	emit_json_string(em, description);
+	emit_write(em, "}\n", 2);
+}
+
+
+static void put_u16(struct emitter *em, uint16_t value)
+{
+	unsigned char buf[2] = {value, value >> 8};
+
+	emit_write(em, buf, sizeof(buf));
+}
+
+
+static void put_u32(struct emitter *em, uint32_t value)
+{
+	unsigned char buf[4];
+	int i;
+
+	for (i = 0; i < sizeof(buf); i++) {
+		buf[i] = value >> (8 * i);
+	}
+	emit_write(em, buf, sizeof(buf));
+}
+
+
+static void put_u64(struct emitter *em, uint64_t value)
+{
+	unsigned char buf[8];
+	int i;
+
+	for (i = 0; i < sizeof(buf); i++) {
+		buf[i] = value >> (8 * i);
+	}
+	emit_write(em, buf, sizeof(buf));
+}
+
+
+/* longer strings are truncated */
+static size_t str_len(const char *string)
+{
+	size_t len = string ? strlen(string) : 0;
+
+	return len < EMIT_STR_NONE ? len : EMIT_STR_NONE - 1;
+}
+
+
+static void put_str(struct emitter *em, const char *string)
+{
+	size_t len = str_len(string);
+
+	if (!string) {
+		put_u16(em, EMIT_STR_NONE);
+		return;
+	}
+	put_u16(em, len);
+	emit_write(em, string, len);
+}
+
+
+/* type, flags, locs_nb, reserved and pc */
+static void put_header(struct emitter *em, uint32_t size, unsigned char type,
+		       unsigned char flags, unsigned char locs_nb,
+		       uint64_t pc)
+{
+	unsigned char buf[4] = {type, flags, locs_nb, 0};
+
+	put_u32(em, size + sizeof(buf) + 8);
+	emit_write(em, buf, sizeof(buf));
+	put_u64(em, pc);
+}
+
+
+static void binary_frame(struct emitter *em,
+			 const struct resolved_frame *frame, bool one_line)
+{
+	unsigned char flags = 0;
+	uint32_t size = 0;
+	int i;
+
+	if (frame->debug_info) {
+		flags |= EMIT_FLAG_DEBUG_INFO;
+	}
+	if (frame->symbol) {
+		flags |= EMIT_FLAG_SYMBOL;
+		size += 8 + 8 + 2 + str_len(frame->symbol);
+	}
+	for (i = 0; i < frame->locs_nb; i++) {
+		size += 2 + str_len(frame->locs[i].function) +
+			2 + str_len(frame->locs[i].file) + 4;
+	}
+
+	put_header(em, size, EMIT_RECORD_FRAME, flags, frame->locs_nb,
+		   frame->pc);
+	if (frame->symbol) {
+		put_u64(em, frame->offset);
+		put_u64(em, frame->size);
+		put_str(em, frame->symbol);
+	}
+	for (i = 0; i < frame->locs_nb; i++) {
+		put_str(em, frame->locs[i].function);
+		put_str(em, frame->locs[i].file);
+		put_u32(em, frame->locs[i].line);
+	}
+}
+
+
+static void binary_data(struct emitter *em, uint64_t addr,
+			const char *description)
+{
+	put_header(em, 2 + str_len(description), EMIT_RECORD_DATA, 0, 0,
+		   addr);
+	put_str(em, description);
+}
+
+
+static const struct emit_ops emit_ops[] = {
+	[EMIT_TEXT] = {
+		.frame = text_frame,
+		.data = text_data,
+	},
+	[EMIT_JSON] = {
+		.frame = json_frame,
+		.data = json_data,
+	},
+	[EMIT_BINARY] = {
+		.frame = binary_frame,
+		.data = binary_data,
+	},
+};
+
+
+void emitter_init(struct emitter *em, int fd, enum emit_format format,
+		  int addr_size)
+{
+	*em = (struct emitter) {
+		.ops = &emit_ops[format],
+		.addr_size = addr_size,
+		.fd = fd,
+	};
+	em->chunks[0] = malloc(EMIT_CHUNK_SIZE);
+	em->iov[0].iov_base = em->chunks[0];
+}
+
+
+void emitter_init_stream(struct emitter *em, FILE *stream,
+			 enum emit_format format, int addr_size)
+{
+	*em = (struct emitter) {
+		.ops = &emit_ops[format],
+		.addr_size = addr_size,
+		.stream = stream,
+		.fd = -1,
+	};
+}
+
+
+/* Flushes what is left */
+void emitter_close(struct emitter *em)
+{
+	int i;
+
+	emitter_flush(em);
+	for (i = 0; i < ARRAY_SIZE(em->chunks); i++) {
+		free(em->chunks[i]);
+	}
+}
@@ -0,0 +1,117 @@
+#ifndef _EMIT_H
+#define _EMIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/uio.h>
+
+struct resolved_frame;
+
+/*
+ * Output of symbolization results, one record per address, in one of three
+ * formats:
+ *
+ * - text: what --address has always printed, or one line per address.
+ * - json: one object per line, like the "frames" of the daemon replies.
+ * - binary: length-prefixed records, little-endian:
+ *
+ *	u32 size		of the record, this field excluded
+ *	u8 type			EMIT_RECORD_FRAME or EMIT_RECORD_DATA
+ *	u8 flags		EMIT_FLAG_*
+ *	u8 locs_nb
+ *	u8 reserved
+ *	u64 pc
+ *   frames:
+ *	u64 offset, u64 size	in the symbol, if EMIT_FLAG_SYMBOL
+ *	str symbol		if EMIT_FLAG_SYMBOL
+ *	then locs_nb times, innermost first:
+ *	str function
+ *	str file		length EMIT_STR_NONE if unknown
+ *	u32 line
+ *   data:
+ *	str description
+ *
+ *   where str is a u16 length followed by as many bytes, no terminating
+ *   null.
+ *
+ * An emitter on a file descriptor collects the records of a batch in large
+ * chunks that are reused from one batch to the next, and writes them all
+ * with a single writev(). One on a stream goes through stdio: it is for the
+ * odd frame printed along other output.
+ */
+
+#define EMIT_RECORD_FRAME 1
+#define EMIT_RECORD_DATA 2
+
+#define EMIT_FLAG_DEBUG_INFO 0x1
+#define EMIT_FLAG_SYMBOL 0x2
+
+#define EMIT_STR_NONE 0xffff
+
+#define EMIT_CHUNK_SIZE (64 * 1024)
+#define EMIT_CHUNKS_NB 16
+
+enum emit_format {
+	EMIT_TEXT,
+	EMIT_JSON,
+	EMIT_BINARY,
+};
+
+struct emitter;
+
+struct emit_ops {
+	/* one_line: keep inline chains on the line of the address */
+	void (*frame)(struct emitter *em, const struct resolved_frame *frame,
+		      bool one_line);
+	void (*data)(struct emitter *em, uint64_t addr,
+		     const char *description);
+};
+
+struct emitter {
+	const struct emit_ops *ops;
+	int addr_size;
+	/* NULL for buffered output to fd */
+	FILE *stream;
+	int fd;
+	/* iov[i] covers what is used of chunks[i], chunk is being filled */
+	char *chunks[EMIT_CHUNKS_NB];
+	struct iovec iov[EMIT_CHUNKS_NB];
+	unsigned int chunk;
+	/* errno of the first failed write, output is dropped after it */
+	int error;
+	/* statistics */
+	unsigned long records;
+	unsigned long writes;
+};
+
+int emit_format_parse(const char *name, enum emit_format *format);
+void emitter_init(struct emitter *em, int fd, enum emit_format format,
+		  int addr_size);
+void emitter_init_stream(struct emitter *em, FILE *stream,
+			 enum emit_format format, int addr_size);
+int emitter_flush(struct emitter *em);
+void emitter_close(struct emitter *em);
+
+void emit_write(struct emitter *em, const void *buf, size_t len);
+void emit_printf(struct emitter *em, const char *format, ...)
+	__attribute__((format(printf, 2, 3)));
+void emit_json_string(struct emitter *em, const char *string);
+void emit_json_frame(struct emitter *em, const struct resolved_frame *frame);
+
+static inline void emit_frame(struct emitter *em,
+			      const struct resolved_frame *frame,
+			      bool one_line)
+{
+	em->ops->frame(em, frame, one_line);
+	em->records++;
+}
+
+static inline void emit_data(struct emitter *em, uint64_t addr,
+			     const char *description)
+{
+	em->ops->data(em, addr, description);
+	em->records++;
+}
+
+#endif
@@ -0,0 +1,895 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <libelf.h>
+#include <gelf.h>
+#include <libdwarf/libdwarf.h>
+#include <libdwarf/dwarf.h>
+
+#include "arch.h"
+#include "core_walk.h"
+#include "datasym.h"
+#include "decompress.h"
+#include "image.h"
+#include "lineidx.h"
+#include "resolve.h"
+#include "split.h"
+#include "stackscan.h"
+#include "symtab.h"
+#include "types.h"
+#include "unwind.h"
+#include "util.h"
+
+/* read ahead of the start of a CU or line program, before its length is
+ * known */
+#define PREFETCH_WINDOW (64 * 1024)
+/* more pcs than this wait for the CU index rather than going through the
+ * linear search of libdwarf */
+#define PREFETCH_LINEAR_MAX 64
+
+/*
+ * The indexes needed before a first frame can be printed are built by a
+ * thread of its own, on separate libelf and libdwarf handles since libdwarf
+ * is not thread safe. The CFI cache keeps using the thread's Dwarf_Debug once
+ * published, under its own lock.
+ */
+struct image_indexer {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int fd;
+	Elf *elf;
+	Dwarf_Debug dwarf;
+	/* protected by lock */
+	bool symtab_done;
+	bool cu_index_done;
+	bool cfi_done;
+	bool stop;
+};
+
+
+/* Map the file rather than reading its sections in the heap, so that the
+ * page cache is shared by every process using the image. Relocatable
+ * objects are still read, libdwarf applies their relocations in place. */
+static Elf *elf_begin_mapped(int fd, bool *mapped)
+{
+	GElf_Ehdr ehdr;
+	Elf *elf;
+
+	*mapped = false;
+	if ((elf = elf_begin(fd, ELF_C_READ_MMAP, NULL)) == NULL) {
+		return elf_begin(fd, ELF_C_READ, NULL);
+	}
+	if (elf_kind(elf) == ELF_K_ELF && gelf_getehdr(elf, &ehdr) &&
+	    ehdr.e_type == ET_REL) {
+		elf_end(elf);
+		return elf_begin(fd, ELF_C_READ, NULL);
+	}
+	*mapped = true;
+	return elf;
+}
+
+
+static void advise_section(struct image *image,
+			   const struct image_section *section,
+			   Dwarf_Unsigned offset, Dwarf_Unsigned size)
+{
+	uintptr_t start, end;
+
+	if (offset >= section->size) {
+		return;
+	}
+	if (size > section->size - offset) {
+		size = section->size - offset;
+	}
+	start = (uintptr_t) image->map + section->offset + offset;
+	end = start + size;
+	start &= ~((uintptr_t) sysconf(_SC_PAGESIZE) - 1);
+	madvise((void *) start, end - start, MADV_WILLNEED);
+}
+
+
+/* Find the sections image_prefetch() reads from, and start reading those
+ * every lookup goes through */
+static void map_sections(struct image *image)
+{
+	static const char *const indexes[] = {
+		".debug_aranges",
+		".debug_abbrev",
+		".symtab",
+		".strtab",
+	};
+	Elf_Scn *scn = NULL;
+	size_t shstrndx;
+	int i;
+
+	image->map = elf_rawfile(image->elf, &image->map_size);
+	if (!image->map || elf_getshdrstrndx(image->elf, &shstrndx) != 0) {
+		image->map = NULL;
+		return;
+	}
+	while ((scn = elf_nextscn(image->elf, scn)) != NULL) {
+		struct image_section section;
+		GElf_Shdr shdr;
+		const char *name;
+
+		gelf_getshdr(scn, &shdr);
+		name = elf_strptr(image->elf, shstrndx, shdr.sh_name);
+		/* offsets in compressed sections are not file offsets */
+		if (!name || shdr.sh_type == SHT_NOBITS ||
+		    shdr.sh_flags & SHF_COMPRESSED ||
+		    shdr.sh_offset + shdr.sh_size > image->map_size) {
+			continue;
+		}
+		section = (struct image_section) {
+			.offset = shdr.sh_offset,
+			.size = shdr.sh_size,
+		};
+		if (strcmp(name, ".debug_info") == 0) {
+			image->debug_info = section;
+		} else if (strcmp(name, ".debug_line") == 0) {
+			image->debug_line = section;
+		}
+		for (i = 0; i < ARRAY_SIZE(indexes); i++) {
+			if (strcmp(name, indexes[i]) == 0) {
+				advise_section(image, &section, 0,
+					       section.size);
+			}
+		}
+	}
+}
+
+
+/* Replace the ELF handle of image by one on a copy with its debug sections
+ * decompressed */
+static int open_decompressed(struct image *image, bool *mapped)
+{
+	const unsigned char *id;
+	size_t id_len = image_build_id(image, &id);
+	char *path;
+	Elf *elf;
+	int fd;
+
+	if ((fd = decompress_open(image->elf, id, id_len, &path)) == -1) {
+		return -1;
+	}
+	if ((elf = elf_begin_mapped(fd, mapped)) == NULL) {
+		fprintf(stderr, "Error: at line %d, libelf says: %s\n",
+			__LINE__, elf_errmsg(-1));
+		free(path);
+		close(fd);
+		return -1;
+	}
+
+	elf_end(image->elf);
+	close(image->fd);
+	image->elf = elf;
+	image->fd = fd;
+	image->debug_path = path;
+	return 0;
+}
+
+
+/* Same as image_open(), but returns -1 instead of aborting, for long-running
+ * processes. */
+int image_try_open(struct image *image, const char *path)
+{
+	GElf_Ehdr ehdr;
+	bool mapped;
+	int retval;
+
+	*image = (struct image) {
+		.path = path,
+	};
+
+	if ((image->fd = open(path, O_RDONLY, 0)) == -1) {
+		fprintf(stderr, "Error: open \"%s\" failed: %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+
+	if ((image->elf = elf_begin_mapped(image->fd, &mapped)) == NULL) {
+		fprintf(stderr, "Error: at line %d, libelf says: %s\n",
+			__LINE__, elf_errmsg(-1));
+		goto err_close;
+	}
+
+	if (elf_kind(image->elf) != ELF_K_ELF ||
+	    gelf_getehdr(image->elf, &ehdr) == NULL) {
+		fprintf(stderr, "Error: \"%s\" is not an ELF object.\n",
+			path);
+		goto err_elf;
+	}
+	image->arch = arch_find(ehdr.e_machine);
+
+	if (decompress_needed(image->elf)) {
+		if (open_decompressed(image, &mapped) == -1) {
+			goto err_elf;
+		}
+	} else {
+		image->debug_path = strdup(path);
+	}
+
+	retval = dwarf_elf_init(image->elf, DW_DLC_READ, NULL, NULL,
+				&image->dwarf, NULL);
+	if (retval != DW_DLV_OK) {
+		fprintf(stderr,
+			"Error: \"%s\" does not contain debug information.\n",
+			path);
+		goto err_elf;
+	}
+
+	dwarf_get_address_size(image->dwarf, &image->addr_size, NULL);
+
+	/* without .debug_aranges, the CUs are indexed from their DIEs */
+	if (dwarf_get_aranges(image->dwarf, &image->aranges, &image->ar_cnt,
+			      NULL) != DW_DLV_OK) {
+		image->aranges = NULL;
+		image->ar_cnt = 0;
+	}
+
+	if (mapped) {
+		map_sections(image);
+	}
+
+	return 0;
+
+err_elf:
+	free(image->debug_path);
+	free(image->build_id);
+	elf_end(image->elf);
+err_close:
+	close(image->fd);
+	return -1;
+}
+
+
+void image_open(struct image *image, const char *path)
+{
+	if (image_try_open(image, path) == -1) {
+		abort();
+	}
+}
+
+
+void image_close(struct image *image)
+{
+	struct image_indexer *ix = image->indexer;
+	int i;
+
+	if (ix) {
+		pthread_mutex_lock(&ix->lock);
+		ix->stop = true;
+		pthread_mutex_unlock(&ix->lock);
+		pthread_join(ix->thread, NULL);
+	}
+	if (image->data_index) {
+		data_index_free(image->data_index);
+	}
+	if (image->symtab) {
+		symtab_free(image->symtab);
+	}
+	if (image->line_index) {
+		line_index_free(image->line_index);
+	}
+	if (image->text_filter) {
+		text_filter_free(image->text_filter);
+	}
+	if (image->types) {
+		type_cache_free(image->types);
+	}
+	if (image->cfi) {
+		cfi_cache_free(image->cfi);
+	}
+	free(image->build_id);
+	free(image->debug_path);
+	if (image->split) {
+		split_units_free(image->split);
+	}
+	if (image->cu_index) {
+		free(image->cu_index->ranges);
+		free(image->cu_index);
+	}
+	if (ix) {
+		dwarf_finish(ix->dwarf, NULL);
+		elf_end(ix->elf);
+		close(ix->fd);
+		pthread_cond_destroy(&ix->cond);
+		pthread_mutex_destroy(&ix->lock);
+		free(ix);
+	}
+
+	for (i = 0; i < image->ar_cnt; i++) {
+		dwarf_dealloc(image->dwarf, image->aranges[i], DW_DLA_ARANGE);
+	}
+	if (image->aranges) {
+		dwarf_dealloc(image->dwarf, image->aranges, DW_DLA_LIST);
+	}
+	dwarf_finish(image->dwarf, NULL);
+	elf_end(image->elf);
+	close(image->fd);
+}
+
+
+struct data_index *image_data_index(struct image *image)
+{
+	if (!image->data_index) {
+		image->data_index = data_index_build(image->elf,
+						     image->dwarf);
+	}
+	return image->data_index;
+}
+
+
+struct line_index *image_line_index(struct image *image)
+{
+	if (!image->line_index) {
+		image->line_index = line_index_build(image->dwarf);
+	}
+	return image->line_index;
+}
+
+
+/* NULL if the image is not x86_64 */
+struct text_filter *image_text_filter(struct image *image)
+{
+	if (!image->text_filter_loaded) {
+		image->text_filter = text_filter_new(image->elf);
+		image->text_filter_loaded = true;
+	}
+	return image->text_filter;
+}
+
+
+/* Wait for the indexing thread to be done with *done */
+static void indexer_wait(struct image_indexer *ix, const bool *done)
+{
+	pthread_mutex_lock(&ix->lock);
+	while (!*done) {
+		pthread_cond_wait(&ix->cond, &ix->lock);
+	}
+	pthread_mutex_unlock(&ix->lock);
+}
+
+
+static struct symtab *symtab_load(struct image *image, Elf *elf)
+{
+	if (image->kallsyms_path) {
+		return symtab_from_kallsyms(image->kallsyms_path);
+	} else {
+		return symtab_from_elf(elf);
+	}
+}
+
+
+/* Returns NULL if no function symbols are available */
+struct symtab *image_symtab(struct image *image)
+{
+	if (image->indexer) {
+		indexer_wait(image->indexer, &image->indexer->symtab_done);
+	}
+	if (!image->symtab_loaded) {
+		image->symtab = symtab_load(image, image->elf);
+		image->symtab_loaded = true;
+	}
+	return image->symtab;
+}
+
+
+/* Whether image_symtab() would return without waiting for the indexing
+ * thread */
+bool image_symtab_ready(struct image *image)
+{
+	struct image_indexer *ix = image->indexer;
+	bool ready;
+
+	if (!ix) {
+		return true;
+	}
+	pthread_mutex_lock(&ix->lock);
+	ready = ix->symtab_done;
+	pthread_mutex_unlock(&ix->lock);
+	return ready;
+}
+
+
+struct type_cache *image_type_cache(struct image *image)
+{
+	if (!image->types) {
+		image->types = type_cache_new(image->dwarf);
+	}
+	return image->types;
+}
+
+
+struct cfi_cache *image_cfi(struct image *image)
+{
+	if (image->indexer) {
+		indexer_wait(image->indexer, &image->indexer->cfi_done);
+	}
+	if (!image->cfi) {
+		image->cfi = cfi_cache_new(image->dwarf, image->arch);
+	}
+	return image->cfi;
+}
+
+
+static int cu_range_cmp(const void *a, const void *b)
+{
+	const struct cu_range *ra = a, *rb = b;
+
+	return ra->lo < rb->lo ? -1 : ra->lo > rb->lo;
+}
+
+
+struct cu_ranges_add {
+	struct cu_index *index;
+	unsigned long alloc;
+	Dwarf_Off cu_offset;
+};
+
+
+static bool add_cu_range(void *arg, Dwarf_Addr lo, Dwarf_Addr hi)
+{
+	struct cu_ranges_add *add = arg;
+	struct cu_index *index = add->index;
+
+	if (lo >= hi) {
+		return false;
+	}
+	if (index->nr == add->alloc) {
+		add->alloc = add->alloc ? add->alloc * 2 : 64;
+		index->ranges = realloc(index->ranges, add->alloc *
+					sizeof(*index->ranges));
+	}
+	index->ranges[index->nr++] = (struct cu_range) {
+		.lo = lo,
+		.hi = hi,
+		.cu_offset = add->cu_offset,
+	};
+	return false;
+}
+
+
+static int offset_cmp(const void *a, const void *b)
+{
+	const Dwarf_Off *oa = a, *ob = b;
+
+	return *oa < *ob ? -1 : *oa > *ob;
+}
+
+
+/* Index the CUs that have no .debug_aranges entry, all of them if the section
+ * is missing, from the low_pc/high_pc or DW_AT_ranges of their DIE. Assembly
+ * sources are often left out of .debug_aranges. */
+static void cu_index_add_dies(struct cu_index *index, Dwarf_Debug dwarf)
+{
+	struct cu_ranges_add add = {
+		.index = index,
+		.alloc = index->nr,
+	};
+	Dwarf_Unsigned next_cu;
+	Dwarf_Off *known;
+	unsigned long i, known_nb = index->nr;
+
+	known = malloc(known_nb * sizeof(*known));
+	for (i = 0; i < known_nb; i++) {
+		known[i] = index->ranges[i].cu_offset;
+	}
+	qsort(known, known_nb, sizeof(*known), offset_cmp);
+
+	while (dwarf_next_cu_header(dwarf, NULL, NULL, NULL, NULL, &next_cu,
+				    NULL) == DW_DLV_OK) {
+		Dwarf_Addr cu_base = 0;
+		Dwarf_Die cu_die;
+
+		if (dwarf_siblingof(dwarf, NULL, &cu_die, NULL) !=
+		    DW_DLV_OK) {
+			continue;
+		}
+		dwarf_dieoffset(cu_die, &add.cu_offset, NULL);
+		if (!bsearch(&add.cu_offset, known, known_nb, sizeof(*known),
+			     offset_cmp)) {
+			dwarf_lowpc(cu_die, &cu_base, NULL);
+			die_foreach_range(dwarf, cu_die, cu_base, add_cu_range,
+					  &add);
+		}
+		dwarf_dealloc(dwarf, cu_die, DW_DLA_DIE);
+	}
+	free(known);
+}
+
+
+static struct cu_index *cu_index_build(Dwarf_Debug dwarf,
+				       Dwarf_Arange *aranges,
+				       Dwarf_Signed ar_cnt)
+{
+	struct cu_index *index;
+	Dwarf_Signed i;
+
+	index = malloc(sizeof(*index));
+	index->ranges = malloc(ar_cnt * sizeof(*index->ranges));
+	index->nr = 0;
+	for (i = 0; i < ar_cnt; i++) {
+		struct cu_range *range = &index->ranges[index->nr];
+		Dwarf_Unsigned length = 0;
+
+		if (dwarf_get_arange_info(aranges[i], &range->lo, &length,
+					  &range->cu_offset, NULL) !=
+		    DW_DLV_OK || !length) {
+			continue;
+		}
+		range->hi = range->lo + length;
+		index->nr++;
+	}
+	cu_index_add_dies(index, dwarf);
+	qsort(index->ranges, index->nr, sizeof(*index->ranges),
+	      cu_range_cmp);
+
+	return index;
+}
+
+
+/* Returns NULL if pc is not covered by any CU */
+static const struct cu_range *cu_index_find(const struct cu_index *index,
+					    Dwarf_Addr pc)
+{
+	unsigned long lo = 0, hi = index->nr;
+
+	/* last range starting at or below pc */
+	while (lo < hi) {
+		unsigned long mid = lo + (hi - lo) / 2;
+
+		if (index->ranges[mid].lo <= pc) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == 0 || index->ranges[lo - 1].hi <= pc) {
+		return NULL;
+	}
+	return &index->ranges[lo - 1];
+}
+
+
+struct cu_index *image_cu_index(struct image *image)
+{
+	if (image->indexer) {
+		indexer_wait(image->indexer, &image->indexer->cu_index_done);
+	}
+	if (!image->cu_index) {
+		image->cu_index = cu_index_build(image->dwarf, image->aranges,
+						 image->ar_cnt);
+	}
+	return image->cu_index;
+}
+
+
+/* Offset of the CU DIE of pc, through the sorted index when it is available.
+ * While the indexing thread has not gotten to it, the linear search of
+ * libdwarf is used instead of waiting. */
+static int find_cu_offset(struct image *image, Dwarf_Addr pc,
+			  Dwarf_Off *offset)
+{
+	struct image_indexer *ix = image->indexer;
+	const struct cu_range *range;
+	Dwarf_Arange arange;
+	bool ready = true;
+
+	if (ix) {
+		pthread_mutex_lock(&ix->lock);
+		ready = ix->cu_index_done;
+		pthread_mutex_unlock(&ix->lock);
+	}
+	/* without .debug_aranges, only the index knows */
+	if (!ready && image->aranges) {
+		if (dwarf_get_arange(image->aranges, image->ar_cnt, pc,
+				     &arange, NULL) != DW_DLV_OK ||
+		    dwarf_get_cu_die_offset(arange, offset, NULL) !=
+		    DW_DLV_OK) {
+			return -1;
+		}
+		return 0;
+	}
+
+	if ((range = cu_index_find(image_cu_index(image), pc)) == NULL) {
+		return -1;
+	}
+	*offset = range->cu_offset;
+	return 0;
+}
+
+
+/* Same as find_cu_by_pc() */
+int image_find_cu(struct image *image, Dwarf_Addr pc, Dwarf_Die *result)
+{
+	Dwarf_Off offset;
+
+	if (find_cu_offset(image, pc, &offset) == -1 ||
+	    dwarf_offdie(image->dwarf, offset, result, NULL) != DW_DLV_OK) {
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Length of the line program at offset, including its unit_length */
+static Dwarf_Unsigned line_program_length(struct image *image,
+					  Dwarf_Unsigned offset)
+{
+	const char *p = image->map + image->debug_line.offset + offset;
+	uint32_t length32;
+	uint64_t length64;
+
+	if (offset + 12 > image->debug_line.size) {
+		return 0;
+	}
+	memcpy(&length32, p, sizeof(length32));
+	if (length32 != 0xffffffff) {
+		return length32 + 4;
+	}
+	memcpy(&length64, p + 4, sizeof(length64));
+	return length64 + 12;
+}
+
+
+/*
+ * Ask the kernel to read the compilation units of pcs, and their line
+ * programs, before they are resolved. Each pass only touches pages that the
+ * previous one asked for so that the reads are issued together instead of
+ * being faulted in one at a time.
+ */
+void image_prefetch(struct image *image, const uint64_t *pcs,
+		    unsigned long nr)
+{
+	Dwarf_Off *cus;
+	Dwarf_Unsigned *lines;
+	unsigned long i, cus_nb = 0, unique_nb = 0;
+
+	if (!image->map || !image->debug_info.size) {
+		return;
+	}
+	if (nr > PREFETCH_LINEAR_MAX) {
+		image_cu_index(image);
+	}
+
+	cus = malloc(nr * sizeof(*cus));
+	for (i = 0; i < nr; i++) {
+		if (find_cu_offset(image, pcs[i], &cus[cus_nb]) == 0) {
+			cus_nb++;
+		}
+	}
+	qsort(cus, cus_nb, sizeof(*cus), offset_cmp);
+	for (i = 0; i < cus_nb; i++) {
+		if (!unique_nb || cus[unique_nb - 1] != cus[i]) {
+			cus[unique_nb++] = cus[i];
+		}
+	}
+
+	/* the CU headers and first DIEs */
+	for (i = 0; i < unique_nb; i++) {
+		advise_section(image, &image->debug_info, cus[i],
+			       PREFETCH_WINDOW);
+	}
+
+	/* the rest of the CUs, and the start of their line programs */
+	lines = malloc(unique_nb * sizeof(*lines));
+	for (i = 0; i < unique_nb; i++) {
+		Dwarf_Off header, length, ref;
+		Dwarf_Attribute attr;
+		Dwarf_Die cu_die;
+
+		lines[i] = -1;
+		if (dwarf_offdie(image->dwarf, cus[i], &cu_die, NULL) !=
+		    DW_DLV_OK) {
+			continue;
+		}
+		if (dwarf_die_CU_offset_range(cu_die, &header, &length,
+					      NULL) == DW_DLV_OK) {
+			advise_section(image, &image->debug_info, header,
+				       length);
+		}
+		if (dwarf_attr(cu_die, DW_AT_stmt_list, &attr, NULL) ==
+		    DW_DLV_OK) {
+			if (dwarf_global_formref(attr, &ref, NULL) ==
+			    DW_DLV_OK) {
+				lines[i] = ref;
+			} else {
+				dwarf_formudata(attr, &lines[i], NULL);
+			}
+			dwarf_dealloc(image->dwarf, attr, DW_DLA_ATTR);
+		}
+		dwarf_dealloc(image->dwarf, cu_die, DW_DLA_DIE);
+
+		if (lines[i] != (Dwarf_Unsigned) -1) {
+			advise_section(image, &image->debug_line, lines[i],
+				       PREFETCH_WINDOW);
+		}
+	}
+
+	/* the rest of the line programs */
+	for (i = 0; i < unique_nb; i++) {
+		if (lines[i] != (Dwarf_Unsigned) -1) {
+			advise_section(image, &image->debug_line, lines[i],
+				       line_program_length(image, lines[i]));
+		}
+	}
+
+	free(lines);
+	free(cus);
+}
+
+
+/* Publish an index built by the indexing thread. Returns false if the image
+ * is being closed. */
+static bool indexer_publish(struct image_indexer *ix, bool *done)
+{
+	bool stop;
+
+	pthread_mutex_lock(&ix->lock);
+	*done = true;
+	stop = ix->stop;
+	pthread_cond_broadcast(&ix->cond);
+	pthread_mutex_unlock(&ix->lock);
+
+	return !stop;
+}
+
+
+/* Built in the order they are needed: symbols for the first frame, then
+ * CUs, then FDEs for unwinding */
+static void *indexer_main(void *arg)
+{
+	struct image *image = arg;
+	struct image_indexer *ix = image->indexer;
+	Dwarf_Arange *aranges;
+	Dwarf_Signed ar_cnt, i;
+
+	image->symtab = symtab_load(image, ix->elf);
+	image->symtab_loaded = true;
+	if (!indexer_publish(ix, &ix->symtab_done)) {
+		goto out;
+	}
+
+	if (dwarf_get_aranges(ix->dwarf, &aranges, &ar_cnt, NULL) !=
+	    DW_DLV_OK) {
+		aranges = NULL;
+		ar_cnt = 0;
+	}
+	image->cu_index = cu_index_build(ix->dwarf, aranges, ar_cnt);
+	if (aranges) {
+		for (i = 0; i < ar_cnt; i++) {
+			dwarf_dealloc(ix->dwarf, aranges[i], DW_DLA_ARANGE);
+		}
+		dwarf_dealloc(ix->dwarf, aranges, DW_DLA_LIST);
+	}
+	if (!indexer_publish(ix, &ix->cu_index_done)) {
+		goto out;
+	}
+
+	image->cfi = cfi_cache_new(ix->dwarf, image->arch);
+
+out:
+	/* whatever was not built is built by the getters, on the image's own
+	 * handles */
+	pthread_mutex_lock(&ix->lock);
+	ix->symtab_done = ix->cu_index_done = ix->cfi_done = true;
+	pthread_cond_broadcast(&ix->cond);
+	pthread_mutex_unlock(&ix->lock);
+
+	return NULL;
+}
+
+
+/*
+ * Build the symbol table, the PC to CU index and the CFI cache in the
+ * background so that the first frames can be resolved while they are being
+ * built. The getters wait for the indexes they return; the data and type
+ * indexes stay built on demand. Falls back to building everything on demand
+ * if the image cannot be opened a second time.
+ */
+void image_index_background(struct image *image)
+{
+	struct image_indexer *ix;
+	bool mapped;
+
+	if (image->indexer || image->symtab_loaded || image->cu_index ||
+	    image->cfi) {
+		return;
+	}
+
+	ix = calloc(1, sizeof(*ix));
+	if ((ix->fd = open(image->debug_path, O_RDONLY, 0)) == -1) {
+		goto err_free;
+	}
+	if ((ix->elf = elf_begin_mapped(ix->fd, &mapped)) == NULL) {
+		goto err_close;
+	}
+	if (dwarf_elf_init(ix->elf, DW_DLC_READ, NULL, NULL, &ix->dwarf,
+			   NULL) != DW_DLV_OK) {
+		goto err_elf;
+	}
+	pthread_mutex_init(&ix->lock, NULL);
+	pthread_cond_init(&ix->cond, NULL);
+
+	image->indexer = ix;
+	if (pthread_create(&ix->thread, NULL, indexer_main, image) != 0) {
+		image->indexer = NULL;
+		pthread_cond_destroy(&ix->cond);
+		pthread_mutex_destroy(&ix->lock);
+		dwarf_finish(ix->dwarf, NULL);
+		goto err_elf;
+	}
+	return;
+
+err_elf:
+	elf_end(ix->elf);
+err_close:
+	close(ix->fd);
+err_free:
+	free(ix);
+}
+
+
+/*
+ * The unit holding the DIEs of cu_die, a CU DIE of image->dwarf, if it is a
+ * skeleton unit of split DWARF. Returns -1 otherwise: the DIEs are in cu_die
+ * itself.
+ */
+int image_split_cu(struct image *image, Dwarf_Die cu_die, Dwarf_Debug *dwarf,
+		   Dwarf_Die *result)
+{
+	if (!image->split) {
+		image->split = split_units_new(image->path, image->dwarf);
+	}
+	return split_unit_find(image->split, cu_die, dwarf, result);
+}
+
+
+/* Read the NT_GNU_BUILD_ID note. Returns 0 if the image has none. */
+size_t image_build_id(struct image *image, const unsigned char **id)
+{
+	Elf_Scn *scn = NULL;
+
+	while (!image->build_id_loaded &&
+	       (scn = elf_nextscn(image->elf, scn)) != NULL) {
+		GElf_Shdr shdr;
+		GElf_Nhdr nhdr;
+		Elf_Data *data;
+		size_t offset = 0, name_offset, desc_offset;
+
+		if (gelf_getshdr(scn, &shdr) == NULL ||
+		    shdr.sh_type != SHT_NOTE ||
+		    (data = elf_getdata(scn, NULL)) == NULL) {
+			continue;
+		}
+		while ((offset = gelf_getnote(data, offset, &nhdr, &name_offset,
+					      &desc_offset)) != 0) {
+			if (nhdr.n_type == NT_GNU_BUILD_ID &&
+			    nhdr.n_namesz == sizeof(ELF_NOTE_GNU) &&
+			    memcmp((char *) data->d_buf + name_offset,
+				   ELF_NOTE_GNU, sizeof(ELF_NOTE_GNU)) == 0) {
+				image->build_id = malloc(nhdr.n_descsz);
+				memcpy(image->build_id,
+				       (char *) data->d_buf + desc_offset,
+				       nhdr.n_descsz);
+				image->build_id_len = nhdr.n_descsz;
+				break;
+			}
+		}
+		if (image->build_id) {
+			break;
+		}
+	}
+	image->build_id_loaded = true;
+
+	*id = image->build_id;
+	return image->build_id_len;
+}
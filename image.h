@@ -0,0 +1,102 @@
+#ifndef _IMAGE_H
+#define _IMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libelf.h>
+#include <libdwarf/libdwarf.h>
+
+struct arch;
+struct mem_source;
+struct image_indexer;
+
+/* .debug_aranges, or the DIE ranges of the CUs it lacks, sorted by address,
+ * for binary searches */
+struct cu_range {
+	Dwarf_Addr lo;
+	Dwarf_Addr hi;
+	Dwarf_Off cu_offset;
+};
+
+/* where a section is in the file */
+struct image_section {
+	size_t offset;
+	size_t size;
+};
+
+struct cu_index {
+	struct cu_range *ranges;
+	unsigned long nr;
+};
+
+/*
+ * An opened vmlinux (or any ELF object with debugging information) and the
+ * indexes built from it.
+ */
+struct image {
+	const char *path;
+	/* the file opened: path, or a copy of it with decompressed debug
+	 * sections */
+	char *debug_path;
+	int fd;
+	Elf *elf;
+	Dwarf_Debug dwarf;
+	Dwarf_Half addr_size;
+	/* NULL if the architecture cannot be unwound */
+	const struct arch *arch;
+	/* NULL if there is no .debug_aranges */
+	Dwarf_Arange *aranges;
+	Dwarf_Signed ar_cnt;
+	/* the file as mapped by libelf, NULL if its sections were read
+	 * instead, and the sections prefetched for traces */
+	const char *map;
+	size_t map_size;
+	struct image_section debug_info;
+	struct image_section debug_line;
+	/* if set, function symbols are read from this kallsyms listing
+	 * instead of .symtab */
+	const char *kallsyms_path;
+	/* if set, memory of the system that ran the image, from a dump. Not
+	 * owned by the image. */
+	struct mem_source *mem;
+
+	/* built on demand */
+	struct data_index *data_index;
+	struct line_index *line_index;
+	struct text_filter *text_filter;
+	bool text_filter_loaded;
+	struct symtab *symtab;
+	bool symtab_loaded;
+	struct type_cache *types;
+	struct cfi_cache *cfi;
+	unsigned char *build_id;
+	size_t build_id_len;
+	bool build_id_loaded;
+	struct cu_index *cu_index;
+	struct split_units *split;
+	/* if set, the symbol, PC to CU and FDE indexes are being built by
+	 * another thread, see image_index_background() */
+	struct image_indexer *indexer;
+};
+
+void image_open(struct image *image, const char *path);
+int image_try_open(struct image *image, const char *path);
+void image_close(struct image *image);
+struct data_index *image_data_index(struct image *image);
+struct line_index *image_line_index(struct image *image);
+struct text_filter *image_text_filter(struct image *image);
+struct symtab *image_symtab(struct image *image);
+struct type_cache *image_type_cache(struct image *image);
+struct cfi_cache *image_cfi(struct image *image);
+size_t image_build_id(struct image *image, const unsigned char **id);
+void image_index_background(struct image *image);
+bool image_symtab_ready(struct image *image);
+struct cu_index *image_cu_index(struct image *image);
+int image_find_cu(struct image *image, Dwarf_Addr pc, Dwarf_Die *result);
+int image_split_cu(struct image *image, Dwarf_Die cu_die, Dwarf_Debug *dwarf,
+		   Dwarf_Die *result);
+void image_prefetch(struct image *image, const uint64_t *pcs,
+		    unsigned long nr);
+
+#endif
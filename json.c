@@ -0,0 +1,283 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "emit.h"
+#include "json.h"
+
+/* nesting deeper than this is rejected rather than risking the stack */
+#define JSON_DEPTH_MAX 32
+
+
+static const char *skip_space(const char *p)
+{
+	while (isspace(*p)) {
+		p++;
+	}
+	return p;
+}
+
+
+/* Parse the 4 hex digits of a \u escape, each checked before the next is
+ * read */
+static const char *parse_hex4(const char *p, unsigned int *cp)
+{
+	int i;
+
+	*cp = 0;
+	for (i = 0; i < 4; i++, p++) {
+		if (!isxdigit((unsigned char) *p)) {
+			return NULL;
+		}
+		*cp = *cp * 16 + (isdigit((unsigned char) *p) ? *p - '0' :
+				  tolower((unsigned char) *p) - 'a' + 10);
+	}
+	return p;
+}
+
+
+/* Parse a \u escape, and the low surrogate following a high one, into the
+ * UTF-8 encoding of its code point. Unpaired surrogates and U+0000, which
+ * would end the C string, are rejected. */
+static const char *parse_unicode(const char *p, char *utf8, size_t *len)
+{
+	unsigned int cp, low;
+
+	if ((p = parse_hex4(p, &cp)) == NULL ||
+	    cp == 0 || (cp >= 0xdc00 && cp < 0xe000)) {
+		return NULL;
+	}
+	if (cp >= 0xd800 && cp < 0xdc00) {
+		if (p[0] != '\\' || p[1] != 'u' ||
+		    (p = parse_hex4(p + 2, &low)) == NULL ||
+		    low < 0xdc00 || low >= 0xe000) {
+			return NULL;
+		}
+		cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+	}
+
+	if (cp < 0x80) {
+		utf8[0] = cp;
+		*len = 1;
+	} else if (cp < 0x800) {
+		utf8[0] = 0xc0 | cp >> 6;
+		utf8[1] = 0x80 | (cp & 0x3f);
+		*len = 2;
+	} else if (cp < 0x10000) {
+		utf8[0] = 0xe0 | cp >> 12;
+		utf8[1] = 0x80 | (cp >> 6 & 0x3f);
+		utf8[2] = 0x80 | (cp & 0x3f);
+		*len = 3;
+	} else {
+		utf8[0] = 0xf0 | cp >> 18;
+		utf8[1] = 0x80 | (cp >> 12 & 0x3f);
+		utf8[2] = 0x80 | (cp >> 6 & 0x3f);
+		utf8[3] = 0x80 | (cp & 0x3f);
+		*len = 4;
+	}
+	return p;
+}
+
+
+/* Parse a string starting after its opening quote. \u escapes are decoded
+ * to UTF-8. */
+static const char *parse_string(const char *p, char **result)
+{
+	size_t len = 0, alloc = 32;
+	char *s = malloc(alloc);
+
+	while (*p != '"') {
+		char utf8[4];
+		size_t n = 1;
+
+		utf8[0] = *p++;
+		if (utf8[0] == '\0') {
+			free(s);
+			return NULL;
+		} else if (utf8[0] == '\\') {
+			switch (*p++) {
+			case '"': utf8[0] = '"'; break;
+			case '\\': utf8[0] = '\\'; break;
+			case '/': utf8[0] = '/'; break;
+			case 'b': utf8[0] = '\b'; break;
+			case 'f': utf8[0] = '\f'; break;
+			case 'n': utf8[0] = '\n'; break;
+			case 'r': utf8[0] = '\r'; break;
+			case 't': utf8[0] = '\t'; break;
+			case 'u':
+				if ((p = parse_unicode(p, utf8, &n)) == NULL) {
+					free(s);
+					return NULL;
+				}
+				break;
+			default:
+				free(s);
+				return NULL;
+			}
+		}
+		if (len + n + 1 > alloc) {
+			alloc *= 2;
+			s = realloc(s, alloc);
+		}
+		memcpy(s + len, utf8, n);
+		len += n;
+	}
+	s[len] = '\0';
+	*result = s;
+
+	return p + 1;
+}
+
+
+static const char *parse_value(const char *p, struct json_value *value,
+			       int depth);
+
+
+static const char *parse_list(const char *p, struct json_value *value,
+			      char close, int depth)
+{
+	unsigned int alloc = 0;
+
+	p = skip_space(p);
+	if (*p == close) {
+		return p + 1;
+	}
+	while (true) {
+		char *key = NULL;
+
+		if (value->nr == alloc) {
+			alloc = alloc ? alloc * 2 : 8;
+			value->items = realloc(value->items, alloc *
+					       sizeof(*value->items));
+			value->keys = realloc(value->keys, alloc *
+					      sizeof(*value->keys));
+		}
+		if (close == '}') {
+			p = skip_space(p);
+			if (*p != '"' || (p = parse_string(p + 1, &key)) ==
+			    NULL) {
+				return NULL;
+			}
+			p = skip_space(p);
+			if (*p++ != ':') {
+				free(key);
+				return NULL;
+			}
+		}
+		value->keys[value->nr] = key;
+		value->items[value->nr] = (struct json_value) {};
+		value->nr++;
+		if ((p = parse_value(p, &value->items[value->nr - 1],
+				     depth + 1)) == NULL) {
+			return NULL;
+		}
+
+		p = skip_space(p);
+		if (*p == close) {
+			return p + 1;
+		} else if (*p++ != ',') {
+			return NULL;
+		}
+	}
+}
+
+
+static const char *parse_value(const char *p, struct json_value *value,
+			       int depth)
+{
+	char *end;
+
+	if (depth > JSON_DEPTH_MAX) {
+		return NULL;
+	}
+	p = skip_space(p);
+	switch (*p) {
+	case '{':
+		value->type = JSON_OBJECT;
+		return parse_list(p + 1, value, '}', depth);
+
+	case '[':
+		value->type = JSON_ARRAY;
+		return parse_list(p + 1, value, ']', depth);
+
+	case '"':
+		value->type = JSON_STRING;
+		return parse_string(p + 1, &value->string);
+
+	case 't':
+	case 'f':
+		value->type = JSON_BOOL;
+		value->boolean = *p == 't';
+		if (strncmp(p, value->boolean ? "true" : "false",
+			    value->boolean ? 4 : 5) != 0) {
+			return NULL;
+		}
+		return p + (value->boolean ? 4 : 5);
+
+	case 'n':
+		value->type = JSON_NULL;
+		return strncmp(p, "null", 4) == 0 ? p + 4 : NULL;
+
+	default:
+		value->type = JSON_NUMBER;
+		value->number = strtod(p, &end);
+		return end == p ? NULL : end;
+	}
+}
+
+
+/* Returns -1 on syntax errors. value must be released by json_free() in
+ * both cases. */
+int json_parse(const char *text, struct json_value *value)
+{
+	const char *end;
+
+	*value = (struct json_value) {};
+	if ((end = parse_value(text, value, 0)) == NULL) {
+		return -1;
+	}
+	return *skip_space(end) == '\0' ? 0 : -1;
+}
+
+
+/* NULL if object is not an object or has no member key */
+const struct json_value *json_get(const struct json_value *object,
+				  const char *key)
+{
+	int i;
+
+	if (object->type != JSON_OBJECT) {
+		return NULL;
+	}
+	for (i = 0; i < object->nr; i++) {
+		if (strcmp(object->keys[i], key) == 0) {
+			return &object->items[i];
+		}
+	}
+	return NULL;
+}
+
+
+void json_free(struct json_value *value)
+{
+	int i;
+
+	for (i = 0; i < value->nr; i++) {
+		json_free(&value->items[i]);
+		free(value->keys[i]);
+	}
+	free(value->items);
+	free(value->keys);
+	free(value->string);
+	*value = (struct json_value) {};
+}
+
+
+void json_print_string(FILE *stream, const char *string)
+{
+	struct emitter em;
+
+	emitter_init_stream(&em, stream, EMIT_JSON, 0);
+	emit_json_string(&em, string);
+}
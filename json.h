@@ -0,0 +1,38 @@
+#ifndef _JSON_H
+#define _JSON_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Just enough JSON for line-oriented protocols: a parser into a tree of
+ * values, and escaping of strings on output.
+ */
+
+enum json_type {
+	JSON_NULL,
+	JSON_BOOL,
+	JSON_NUMBER,
+	JSON_STRING,
+	JSON_ARRAY,
+	JSON_OBJECT,
+};
+
+struct json_value {
+	enum json_type type;
+	bool boolean;
+	double number;
+	char *string;
+	/* members of arrays and objects, keys are NULL for arrays */
+	struct json_value *items;
+	char **keys;
+	unsigned int nr;
+};
+
+int json_parse(const char *text, struct json_value *value);
+const struct json_value *json_get(const struct json_value *object,
+				  const char *key);
+void json_free(struct json_value *value);
+void json_print_string(FILE *stream, const char *string);
+
+#endif
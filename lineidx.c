@@ -0,0 +1,358 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdwarf/libdwarf.h>
+#include <libdwarf/dwarf.h>
+
+#include "lineidx.h"
+#include "resolve.h"
+
+/* state while the index is built */
+struct line_builder {
+	struct line_index *index;
+	unsigned int files_alloc;
+	unsigned long ranges_alloc;
+	/* open addressing on file names, file numbers + 1, 0 if free */
+	unsigned int *table;
+	unsigned int table_size;
+};
+
+
+/* FNV-1a */
+static uint64_t hash_string(const char *s)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	while (*s) {
+		hash ^= (unsigned char) *s++;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+
+static unsigned int *table_slot(unsigned int *table, unsigned int size,
+				const struct line_file *files,
+				const char *name)
+{
+	unsigned int mask = size - 1;
+	unsigned int i;
+
+	for (i = hash_string(name) & mask; table[i] &&
+	     strcmp(files[table[i] - 1].name, name) != 0; i = (i + 1) & mask) {
+	}
+	return &table[i];
+}
+
+
+static void table_grow(struct line_builder *b)
+{
+	unsigned int size = b->table_size ? b->table_size * 2 : 1024;
+	unsigned int *table = calloc(size, sizeof(*table));
+	unsigned int i;
+
+	for (i = 0; i < b->index->files_nb; i++) {
+		*table_slot(table, size, b->index->files,
+			    b->index->files[i].name) = i + 1;
+	}
+	free(b->table);
+	b->table = table;
+	b->table_size = size;
+}
+
+
+/* Each header shows up in the line programs of thousands of CUs: names are
+ * stored once. */
+static unsigned int intern_file(struct line_builder *b, const char *name)
+{
+	struct line_index *index = b->index;
+	struct line_file *file;
+	unsigned int *slot;
+	const char *base;
+
+	if (2 * (index->files_nb + 1) > b->table_size) {
+		table_grow(b);
+	}
+	slot = table_slot(b->table, b->table_size, index->files, name);
+	if (*slot) {
+		return *slot - 1;
+	}
+
+	if (index->files_nb == b->files_alloc) {
+		b->files_alloc = b->files_alloc ? b->files_alloc * 2 : 1024;
+		index->files = realloc(index->files, b->files_alloc *
+				       sizeof(*index->files));
+	}
+	file = &index->files[index->files_nb];
+	file->name = strpool_add(&index->pool, name);
+	base = strrchr(file->name, '/');
+	file->base_name = base ? base + 1 : file->name;
+	file->first = 0;
+	file->nr = 0;
+	*slot = ++index->files_nb;
+
+	return index->files_nb - 1;
+}
+
+
+static void add_range(struct line_builder *b, unsigned int file,
+		      unsigned int line, Dwarf_Addr lo, Dwarf_Addr hi)
+{
+	struct line_index *index = b->index;
+	struct line_range *last = index->ranges_nb ?
+		&index->ranges[index->ranges_nb - 1] : NULL;
+
+	/* consecutive rows of a statement, ex. is_stmt changes */
+	if (last && last->file == file && last->line == line &&
+	    last->hi == lo) {
+		last->hi = hi;
+		return;
+	}
+	if (index->ranges_nb == b->ranges_alloc) {
+		b->ranges_alloc = b->ranges_alloc ? b->ranges_alloc * 2 :
+			64 * 1024;
+		index->ranges = realloc(index->ranges, b->ranges_alloc *
+					sizeof(*index->ranges));
+	}
+	index->ranges[index->ranges_nb++] = (struct line_range) {
+		.lo = lo,
+		.hi = hi,
+		.line = line,
+		.file = file,
+	};
+}
+
+
+/* A row covers the addresses up to the next row of its sequence */
+static void add_cu(struct line_builder *b, Dwarf_Debug dwarf,
+		   Dwarf_Die cu_die)
+{
+	Dwarf_Line *lines;
+	Dwarf_Signed lines_nb, i;
+	Dwarf_Attribute attr;
+	char *comp_dir = NULL;
+	/* file numbers of the line program to index file numbers + 1 */
+	unsigned int *files = NULL;
+	Dwarf_Unsigned files_nb = 0;
+
+	if (dwarf_srclines(cu_die, &lines, &lines_nb, NULL) != DW_DLV_OK) {
+		return;
+	}
+	if (dwarf_attr(cu_die, DW_AT_comp_dir, &attr, NULL) == DW_DLV_OK) {
+		dwarf_formstring(attr, &comp_dir, NULL);
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+	}
+
+	for (i = 0; i + 1 < lines_nb; i++) {
+		Dwarf_Unsigned lineno = 0, fileno = 0;
+		Dwarf_Bool end = false;
+		Dwarf_Addr lo, hi;
+
+		dwarf_lineendsequence(lines[i], &end, NULL);
+		dwarf_lineno(lines[i], &lineno, NULL);
+		dwarf_lineaddr(lines[i], &lo, NULL);
+		dwarf_lineaddr(lines[i + 1], &hi, NULL);
+		if (end || lineno == 0 || hi <= lo) {
+			continue;
+		}
+
+		dwarf_line_srcfileno(lines[i], &fileno, NULL);
+		if (fileno >= files_nb) {
+			files = realloc(files, (fileno + 1) * sizeof(*files));
+			memset(&files[files_nb], 0, (fileno + 1 - files_nb) *
+			       sizeof(*files));
+			files_nb = fileno + 1;
+		}
+		if (!files[fileno]) {
+			char *name;
+
+			if (dwarf_linesrc(lines[i], &name, NULL) != DW_DLV_OK) {
+				continue;
+			}
+			files[fileno] = intern_file(
+				b, strip_comp_dir(name, comp_dir)) + 1;
+			dwarf_dealloc(dwarf, name, DW_DLA_STRING);
+		}
+		add_range(b, files[fileno] - 1, lineno, lo, hi);
+	}
+
+	free(files);
+	dwarf_srclines_dealloc(dwarf, lines, lines_nb);
+}
+
+
+static int line_file_cmp(const void *a, const void *b)
+{
+	const struct line_file *fa = a, *fb = b;
+	int retval = strcmp(fa->base_name, fb->base_name);
+
+	return retval ? retval : strcmp(fa->name, fb->name);
+}
+
+
+static int line_range_cmp(const void *a, const void *b)
+{
+	const struct line_range *ra = a, *rb = b;
+
+	if (ra->file != rb->file) {
+		return ra->file < rb->file ? -1 : 1;
+	} else if (ra->line != rb->line) {
+		return ra->line < rb->line ? -1 : 1;
+	}
+	return ra->lo < rb->lo ? -1 : ra->lo > rb->lo;
+}
+
+
+/* Sort the files by base name, and the ranges by file, line and address,
+ * merging the ones that touch. */
+static void line_index_sort(struct line_index *index)
+{
+	unsigned int *rank = malloc(index->files_nb * sizeof(*rank));
+	unsigned long i, nr = 0;
+
+	/* first holds the number the ranges refer to until sorted */
+	for (i = 0; i < index->files_nb; i++) {
+		index->files[i].first = i;
+	}
+	qsort(index->files, index->files_nb, sizeof(*index->files),
+	      line_file_cmp);
+	for (i = 0; i < index->files_nb; i++) {
+		rank[index->files[i].first] = i;
+		index->files[i].first = 0;
+	}
+	for (i = 0; i < index->ranges_nb; i++) {
+		index->ranges[i].file = rank[index->ranges[i].file];
+	}
+	free(rank);
+
+	qsort(index->ranges, index->ranges_nb, sizeof(*index->ranges),
+	      line_range_cmp);
+	for (i = 0; i < index->ranges_nb; i++) {
+		struct line_range *range = &index->ranges[i];
+		struct line_range *last = nr ? &index->ranges[nr - 1] : NULL;
+
+		if (last && last->file == range->file &&
+		    last->line == range->line && range->lo <= last->hi) {
+			if (range->hi > last->hi) {
+				last->hi = range->hi;
+			}
+			continue;
+		}
+		if (!last || last->file != range->file) {
+			index->files[range->file].first = nr;
+		}
+		index->files[range->file].nr++;
+		index->ranges[nr++] = *range;
+	}
+	index->ranges_nb = nr;
+	index->ranges = realloc(index->ranges, nr * sizeof(*index->ranges));
+}
+
+
+struct line_index *line_index_build(Dwarf_Debug dwarf)
+{
+	struct line_builder b = {};
+	Dwarf_Unsigned next_cu;
+
+	b.index = calloc(1, sizeof(*b.index));
+	while (dwarf_next_cu_header(dwarf, NULL, NULL, NULL, NULL, &next_cu,
+				    NULL) == DW_DLV_OK) {
+		Dwarf_Die cu_die;
+
+		if (dwarf_siblingof(dwarf, NULL, &cu_die, NULL) !=
+		    DW_DLV_OK) {
+			continue;
+		}
+		add_cu(&b, dwarf, cu_die);
+		dwarf_dealloc(dwarf, cu_die, DW_DLA_DIE);
+	}
+	free(b.table);
+	line_index_sort(b.index);
+
+	return b.index;
+}
+
+
+/* path is a suffix of name made of whole components */
+static bool path_matches(const char *name, const char *path)
+{
+	size_t name_len = strlen(name), path_len = strlen(path);
+
+	return name_len >= path_len &&
+		strcmp(name + name_len - path_len, path) == 0 &&
+		(name_len == path_len || path[0] == '/' ||
+		 name[name_len - path_len - 1] == '/');
+}
+
+
+/* Files whose name ends with path, ex. "sysrq.c" or "tty/sysrq.c", one after
+ * the other starting with prev == NULL. NULL once there are no more. */
+const struct line_file *line_index_next_file(const struct line_index *index,
+					     const char *path,
+					     const struct line_file *prev)
+{
+	const struct line_file *file, *end = index->files + index->files_nb;
+	const char *base = strrchr(path, '/');
+
+	base = base ? base + 1 : path;
+	if (prev) {
+		file = prev + 1;
+	} else {
+		unsigned int lo = 0, hi = index->files_nb;
+
+		while (lo < hi) {
+			unsigned int mid = lo + (hi - lo) / 2;
+
+			if (strcmp(index->files[mid].base_name, base) < 0) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		file = &index->files[lo];
+	}
+
+	for (; file < end && strcmp(file->base_name, base) == 0; file++) {
+		if (path_matches(file->name, path)) {
+			return file;
+		}
+	}
+	return NULL;
+}
+
+
+/* The ranges of line in file, sorted by address. NULL if there is no code
+ * for it. */
+const struct line_range *line_file_find(const struct line_index *index,
+					const struct line_file *file,
+					unsigned int line, unsigned long *nr)
+{
+	const struct line_range *ranges = &index->ranges[file->first];
+	unsigned long lo = 0, hi = file->nr, end;
+
+	while (lo < hi) {
+		unsigned long mid = lo + (hi - lo) / 2;
+
+		if (ranges[mid].line < line) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	for (end = lo; end < file->nr && ranges[end].line == line; end++) {
+	}
+
+	*nr = end - lo;
+	return *nr ? &ranges[lo] : NULL;
+}
+
+
+void line_index_free(struct line_index *index)
+{
+	free(index->files);
+	free(index->ranges);
+	strpool_free(&index->pool);
+	free(index);
+}
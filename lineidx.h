@@ -0,0 +1,48 @@
+#ifndef _LINEIDX_H
+#define _LINEIDX_H
+
+#include <libdwarf/libdwarf.h>
+
+#include "strpool.h"
+
+/*
+ * The line tables of an image, inverted: for each source file and line, the
+ * address ranges it compiled to. Inlined copies are included since the line
+ * program attributes their code to the file and line they were inlined from.
+ */
+
+struct line_range {
+	Dwarf_Addr lo;
+	Dwarf_Addr hi;
+	unsigned int line;
+	unsigned int file;
+};
+
+struct line_file {
+	/* relative to the compilation directory when under it */
+	const char *name;
+	const char *base_name;
+	/* ranges of the file, sorted by line then address */
+	unsigned long first;
+	unsigned long nr;
+};
+
+struct line_index {
+	/* sorted by base name, for lookups by path suffix */
+	struct line_file *files;
+	unsigned int files_nb;
+	struct line_range *ranges;
+	unsigned long ranges_nb;
+	struct strpool pool;
+};
+
+struct line_index *line_index_build(Dwarf_Debug dwarf);
+const struct line_file *line_index_next_file(const struct line_index *index,
+					     const char *path,
+					     const struct line_file *prev);
+const struct line_range *line_file_find(const struct line_index *index,
+					const struct line_file *file,
+					unsigned int line, unsigned long *nr);
+void line_index_free(struct line_index *index);
+
+#endif
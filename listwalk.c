@@ -0,0 +1,292 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdwarf/libdwarf.h>
+#include <libdwarf/dwarf.h>
+
+#include "listwalk.h"
+#include "memsrc.h"
+#include "types.h"
+
+/*
+ * Node layouts, in pointers:
+ * struct list_head { next, prev }
+ * struct hlist_node { next, pprev }, also hlist_nulls_node
+ * struct rb_node { __rb_parent_color, rb_right, rb_left }
+ */
+#define PTR(walk, n) ((n) * (walk)->addr_size)
+
+/* more than the height of any red-black tree that fits in memory */
+#define RB_MAX_DEPTH 128
+
+const char *walk_status_names[] = {
+	[WALK_RUNNING] = "running",
+	[WALK_END] = "end",
+	[WALK_CYCLE] = "cycle",
+	[WALK_CAP] = "cap",
+	[WALK_FAULT] = "fault",
+};
+
+
+static int read_ptr(struct list_walk *walk, uint64_t addr, uint64_t *value)
+{
+	*value = 0;
+	return mem_cache_read(walk->cache, addr, value, walk->addr_size);
+}
+
+
+/* Returns -1 on read error or if the tree is too deep to be sane */
+static int rb_leftmost(struct list_walk *walk, uint64_t node,
+		       uint64_t *result)
+{
+	int depth;
+
+	for (depth = 0; node && depth < RB_MAX_DEPTH; depth++) {
+		uint64_t left;
+
+		if (read_ptr(walk, node + PTR(walk, 2), &left) != 0) {
+			return -1;
+		}
+		if (!left) {
+			*result = node;
+			return 0;
+		}
+		node = left;
+	}
+
+	if (node) {
+		return -1;
+	}
+	*result = 0;
+	return 0;
+}
+
+
+static int rb_next(struct list_walk *walk, uint64_t node, uint64_t *next)
+{
+	uint64_t right;
+	int depth;
+
+	if (read_ptr(walk, node + PTR(walk, 1), &right) != 0) {
+		return -1;
+	}
+	if (right) {
+		return rb_leftmost(walk, right, next);
+	}
+
+	/* go up until we come from a left child */
+	for (depth = 0; depth < RB_MAX_DEPTH; depth++) {
+		uint64_t parent;
+
+		if (read_ptr(walk, node, &parent) != 0) {
+			return -1;
+		}
+		parent &= ~3ULL;
+		if (!parent) {
+			*next = 0;
+			return 0;
+		}
+		if (read_ptr(walk, parent + PTR(walk, 1), &right) != 0) {
+			return -1;
+		}
+		if (right != node) {
+			*next = parent;
+			return 0;
+		}
+		node = parent;
+	}
+
+	return -1;
+}
+
+
+/* Move to the node after cur. Sets the status if there is none. */
+static void advance(struct list_walk *walk, uint64_t cur)
+{
+	uint64_t next;
+	int retval;
+
+	switch (walk->kind) {
+	case WALK_LIST:
+		retval = read_ptr(walk, cur, &next);
+		if (retval == 0 && !next) {
+			retval = -1;
+		}
+		if (retval == 0 && next == walk->head) {
+			walk->status = WALK_END;
+			next = 0;
+		}
+		break;
+
+	case WALK_HLIST:
+		retval = read_ptr(walk, cur, &next);
+		/* hlist_nulls lists end with an odd marker */
+		if (retval == 0 && (!next || next & 1)) {
+			walk->status = WALK_END;
+			next = 0;
+		}
+		break;
+
+	case WALK_RBTREE:
+		retval = rb_next(walk, cur, &next);
+		if (retval == 0 && !next) {
+			walk->status = WALK_END;
+		}
+		break;
+
+	default:
+		fprintf(stderr, "Error: unhandled walk kind \"%u\".\n",
+			walk->kind);
+		abort();
+	}
+
+	if (retval != 0) {
+		walk->status = WALK_FAULT;
+		next = 0;
+	}
+	walk->node = next;
+
+	/* the caller is likely to look at the current object while the page
+	 * of the next one is read */
+	if (next) {
+		struct mem_source *src = walk->cache->src;
+
+		mem_prefetch(src, next & ~((uint64_t) src->page_size - 1),
+			     src->page_size);
+	}
+}
+
+
+/* Guess the kind of walk from the type of the head, -1 if it is none of
+ * the supported heads */
+int walk_kind_from_type(const struct type_desc *head_type,
+			enum walk_kind *kind)
+{
+	const char *name;
+
+	head_type = type_strip(head_type);
+	if (!head_type || !head_type->name) {
+		return -1;
+	}
+	name = head_type->name;
+
+	if (strcmp(name, "struct list_head") == 0) {
+		*kind = WALK_LIST;
+	} else if (strcmp(name, "struct hlist_head") == 0 ||
+		   strcmp(name, "struct hlist_nulls_head") == 0) {
+		*kind = WALK_HLIST;
+	} else if (strcmp(name, "struct rb_root") == 0 ||
+		   strcmp(name, "struct rb_root_cached") == 0) {
+		*kind = WALK_RBTREE;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Prepare to walk the structure at head, whose nodes are member (a path like
+ * "node" or "se.run_node") of container objects. Returns -1 if member is not
+ * found in container.
+ */
+int list_walk_init(struct list_walk *walk, struct mem_cache *cache,
+		   Dwarf_Half addr_size, enum walk_kind kind, uint64_t head,
+		   const struct type_desc *container, const char *member,
+		   unsigned long max)
+{
+	const struct type_desc *member_type;
+	Dwarf_Unsigned offset;
+	uint64_t first;
+	int retval;
+
+	if (type_resolve_path(container, member, &offset, &member_type) !=
+	    0) {
+		return -1;
+	}
+
+	*walk = (struct list_walk) {
+		.cache = cache,
+		.kind = kind,
+		.addr_size = addr_size,
+		.head = head,
+		.node_offset = offset,
+		.max = max,
+		.status = WALK_RUNNING,
+		.power = 1,
+		.lambda = 1,
+	};
+
+	/* list_head.next, hlist_head.first, rb_root.rb_node */
+	if (read_ptr(walk, head, &first) != 0) {
+		walk->status = WALK_FAULT;
+		return 0;
+	}
+	switch (kind) {
+	case WALK_LIST:
+		if (!first) {
+			walk->status = WALK_FAULT;
+		} else if (first == head) {
+			walk->status = WALK_END;
+		}
+		break;
+
+	case WALK_HLIST:
+		if (!first || first & 1) {
+			walk->status = WALK_END;
+		}
+		break;
+
+	case WALK_RBTREE:
+		retval = rb_leftmost(walk, first, &first);
+		if (retval != 0) {
+			walk->status = WALK_FAULT;
+		} else if (!first) {
+			walk->status = WALK_END;
+		}
+		break;
+	}
+
+	if (walk->status == WALK_RUNNING) {
+		walk->node = first;
+	}
+	return 0;
+}
+
+
+/* Returns 1 and sets obj to the address of the next container object, 0 at
+ * the end of the walk. walk->status then tells why it ended. */
+int list_walk_next(struct list_walk *walk, uint64_t *obj)
+{
+	uint64_t cur = walk->node;
+
+	if (!cur) {
+		return 0;
+	}
+	if (walk->max && walk->nr == walk->max) {
+		walk->status = WALK_CAP;
+		walk->node = 0;
+		return 0;
+	}
+	if (cur == walk->saved) {
+		walk->status = WALK_CYCLE;
+		walk->node = 0;
+		return 0;
+	}
+	if (walk->lambda == walk->power) {
+		walk->saved = cur;
+		walk->power *= 2;
+		walk->lambda = 0;
+	}
+	walk->lambda++;
+
+	advance(walk, cur);
+
+	walk->nr++;
+	*obj = cur - walk->node_offset;
+	return 1;
+}
+
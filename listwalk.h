@@ -0,0 +1,74 @@
+#ifndef _LISTWALK_H
+#define _LISTWALK_H
+
+#include <stdint.h>
+
+#include <libdwarf/libdwarf.h>
+
+#include "memsrc.h"
+
+struct type_desc;
+
+/*
+ * Walk kernel linked structures in a dump and yield the address of each
+ * container object, ex. every task_struct on init_task.tasks.
+ */
+
+enum walk_kind {
+	/* struct list_head, circular */
+	WALK_LIST,
+	/* struct hlist_head, NULL terminated (or nulls marker) */
+	WALK_HLIST,
+	/* struct rb_root, in order */
+	WALK_RBTREE,
+};
+
+enum walk_status {
+	WALK_RUNNING,
+	WALK_END,
+	/* the walk entered a loop that does not go through the head */
+	WALK_CYCLE,
+	/* max objects yielded */
+	WALK_CAP,
+	/* a node could not be read, or a list_head pointer was NULL */
+	WALK_FAULT,
+};
+
+struct list_walk {
+	/* may be shared by several walks, not by threads */
+	struct mem_cache *cache;
+	enum walk_kind kind;
+	Dwarf_Half addr_size;
+	uint64_t head;
+	/* offset of the node in the container */
+	Dwarf_Unsigned node_offset;
+	/* 0 for no limit */
+	unsigned long max;
+	unsigned long nr;
+	enum walk_status status;
+	/* next node to yield, 0 if none */
+	uint64_t node;
+	/* cycle detection, Brent's algorithm */
+	uint64_t saved;
+	unsigned long power;
+	unsigned long lambda;
+};
+
+/* suggested size of the cache used by walks, and pages read at once */
+#define WALK_CACHE_PAGES 256
+#define WALK_READAHEAD 4
+
+/* default cap of command line walks */
+#define WALK_MAX_DEFAULT 100000UL
+
+extern const char *walk_status_names[];
+
+int walk_kind_from_type(const struct type_desc *head_type,
+			enum walk_kind *kind);
+int list_walk_init(struct list_walk *walk, struct mem_cache *cache,
+		   Dwarf_Half addr_size, enum walk_kind kind, uint64_t head,
+		   const struct type_desc *container, const char *member,
+		   unsigned long max);
+int list_walk_next(struct list_walk *walk, uint64_t *obj);
+
+#endif
@@ -0,0 +1,128 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <libdwarf/libdwarf.h>
+#include <libdwarf/dwarf.h>
+
+#include "location.h"
+
+
+/* Copy the operations of desc. Cooked operands have the .debug_addr entries
+ * of the address indexes read already. */
+static int get_ops(Dwarf_Locdesc_c desc, Dwarf_Unsigned ops_nb,
+		   struct loc_expr *expr)
+{
+	Dwarf_Unsigned i;
+
+	expr->ops = calloc(ops_nb, sizeof(*expr->ops));
+	expr->ops_nb = ops_nb;
+	for (i = 0; i < ops_nb; i++) {
+		struct loc_op *op = &expr->ops[i];
+		Dwarf_Unsigned number3, raw1, raw2, raw3, branch;
+
+		if (dwarf_get_location_op_value_d(desc, i, &op->atom,
+						  &op->number, &op->number2,
+						  &number3, &raw1, &raw2,
+						  &raw3, &branch, NULL) !=
+		    DW_DLV_OK) {
+			return -1;
+		}
+		if (op->atom == DW_OP_addrx ||
+		    op->atom == DW_OP_GNU_addr_index) {
+			op->atom = DW_OP_addr;
+		}
+	}
+	return 0;
+}
+
+
+/* Returns -1 if attr is not a location description. list must be released
+ * with loc_list_free() otherwise. */
+int loc_list_get(Dwarf_Attribute attr, struct loc_list *list)
+{
+	Dwarf_Loc_Head_c head;
+	Dwarf_Unsigned count, i;
+
+	*list = (struct loc_list) {};
+	if (dwarf_get_loclist_c(attr, &head, &count, NULL) != DW_DLV_OK) {
+		return -1;
+	}
+
+	list->exprs = calloc(count, sizeof(*list->exprs));
+	for (i = 0; i < count; i++) {
+		struct loc_expr *expr = &list->exprs[list->nr];
+		Dwarf_Unsigned raw_lo, raw_hi, ops_nb, expr_offset, offset;
+		Dwarf_Small lle, source;
+		Dwarf_Bool unavailable;
+		Dwarf_Locdesc_c desc;
+
+		*expr = (struct loc_expr) {};
+		if (dwarf_get_locdesc_entry_d(head, i, &lle, &raw_lo, &raw_hi,
+					      &unavailable, &expr->lopc,
+					      &expr->hipc, &ops_nb, &desc,
+					      &source, &expr_offset, &offset,
+					      NULL) != DW_DLV_OK) {
+			break;
+		}
+		expr->from_list = source != 0;
+		if (expr->from_list) {
+			/* base address, view and end of list entries carry
+			 * no location, nor do those whose bounds are in a
+			 * missing .debug_addr */
+			if (lle == DW_LLE_end_of_list ||
+			    lle == DW_LLE_base_addressx ||
+			    lle == DW_LLE_base_address ||
+			    lle == DW_LLE_GNU_view_pair || unavailable ||
+			    !ops_nb) {
+				continue;
+			}
+			expr->fallback = lle == DW_LLE_default_location;
+		}
+		if (get_ops(desc, ops_nb, expr) == -1) {
+			free(expr->ops);
+			continue;
+		}
+		list->nr++;
+	}
+	dwarf_loc_head_c_dealloc(head);
+
+	if (!list->nr) {
+		loc_list_free(list);
+		return -1;
+	}
+	return 0;
+}
+
+
+/* The expression valid at pc, NULL if the object has no location there */
+const struct loc_expr *loc_list_find(const struct loc_list *list,
+				     Dwarf_Addr pc)
+{
+	const struct loc_expr *fallback = NULL;
+	int i;
+
+	for (i = 0; i < list->nr; i++) {
+		const struct loc_expr *expr = &list->exprs[i];
+
+		if (!expr->from_list) {
+			return expr;
+		} else if (expr->fallback) {
+			fallback = expr;
+		} else if (expr->lopc <= pc && pc < expr->hipc) {
+			return expr;
+		}
+	}
+	return fallback;
+}
+
+
+void loc_list_free(struct loc_list *list)
+{
+	int i;
+
+	for (i = 0; i < list->nr; i++) {
+		free(list->exprs[i].ops);
+	}
+	free(list->exprs);
+	*list = (struct loc_list) {};
+}
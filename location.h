@@ -0,0 +1,45 @@
+#ifndef _LOCATION_H
+#define _LOCATION_H
+
+#include <stdbool.h>
+
+#include <libdwarf/libdwarf.h>
+
+/*
+ * Location descriptions of DW_AT_location, DW_AT_frame_base and
+ * DW_AT_data_member_location, whatever their form: a single expression, a
+ * DWARF 2-4 list in .debug_loc, or a DWARF 5 list in .debug_loclists,
+ * DW_FORM_loclistx included. List bounds are final addresses, libdwarf
+ * applies the base address entries. DW_OP_addrx and DW_OP_GNU_addr_index
+ * are read from .debug_addr and turned into DW_OP_addr.
+ */
+
+struct loc_op {
+	Dwarf_Small atom;
+	Dwarf_Unsigned number;
+	Dwarf_Unsigned number2;
+};
+
+struct loc_expr {
+	/* false for a single expression, valid at any pc */
+	bool from_list;
+	/* DW_LLE_default_location, valid where no other entry is */
+	bool fallback;
+	/* [lopc, hipc[ if from_list */
+	Dwarf_Addr lopc;
+	Dwarf_Addr hipc;
+	struct loc_op *ops;
+	unsigned int ops_nb;
+};
+
+struct loc_list {
+	struct loc_expr *exprs;
+	unsigned int nr;
+};
+
+int loc_list_get(Dwarf_Attribute attr, struct loc_list *list);
+const struct loc_expr *loc_list_find(const struct loc_list *list,
+				     Dwarf_Addr pc);
+void loc_list_free(struct loc_list *list);
+
+#endif
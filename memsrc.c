@@ -0,0 +1,716 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libelf.h>
+#include <gelf.h>
+
+#include "memsrc.h"
+#include "util.h"
+
+
+/*
+ * ELF core files, as written by kdump from /proc/vmcore. Their segments
+ * cover the direct mapping and the kernel image; other addresses, such as
+ * vmalloc space, are translated through the x86_64 page tables once they
+ * are known.
+ */
+
+#define PTE_PRESENT 0x1ULL
+#define PTE_HUGE 0x80ULL
+#define PTE_ADDR_MASK 0x000ffffffffff000ULL
+#define PT_SHIFT 12
+#define PT_INDEX_BITS 9
+
+struct elfcore_segment {
+	uint64_t vaddr;
+	uint64_t paddr;
+	uint64_t filesz;
+	off_t offset;
+};
+
+struct elfcore_source {
+	struct mem_source src;
+	int fd;
+	/* sorted by vaddr */
+	struct elfcore_segment *segments;
+	/* the same, sorted by paddr */
+	struct elfcore_segment *phys;
+	unsigned int segments_nb;
+	/* physical address of the top level page table, 0 if unknown */
+	uint64_t pgd;
+	unsigned int levels;
+};
+
+
+static int segment_cmp(const void *a, const void *b)
+{
+	const struct elfcore_segment *sa = a, *sb = b;
+
+	if (sa->vaddr != sb->vaddr) {
+		return sa->vaddr < sb->vaddr ? -1 : 1;
+	}
+	return 0;
+}
+
+
+static int segment_paddr_cmp(const void *a, const void *b)
+{
+	const struct elfcore_segment *sa = a, *sb = b;
+
+	if (sa->paddr != sb->paddr) {
+		return sa->paddr < sb->paddr ? -1 : 1;
+	}
+	return 0;
+}
+
+
+/* The segment of segments, sorted by vaddr if phys is false, by paddr
+ * otherwise, that holds addr */
+static const struct elfcore_segment *
+lookup_segment(const struct elfcore_segment *segments, unsigned int nr,
+	       uint64_t addr, bool phys)
+{
+	const struct elfcore_segment *seg;
+	unsigned int lo = 0, hi = nr;
+
+	/* first start > addr */
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if ((phys ? segments[mid].paddr : segments[mid].vaddr) <=
+		    addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == 0) {
+		return NULL;
+	}
+	seg = &segments[lo - 1];
+	if (addr - (phys ? seg->paddr : seg->vaddr) >= seg->filesz) {
+		return NULL;
+	}
+	return seg;
+}
+
+
+static const struct elfcore_segment *
+find_segment(const struct elfcore_source *core, uint64_t addr)
+{
+	return lookup_segment(core->segments, core->segments_nb, addr, false);
+}
+
+
+static int read_phys(const struct elfcore_source *core, uint64_t paddr,
+		     void *buf, size_t len)
+{
+	const struct elfcore_segment *seg;
+
+	seg = lookup_segment(core->phys, core->segments_nb, paddr, true);
+	if (!seg || len > seg->filesz - (paddr - seg->paddr) ||
+	    pread(core->fd, buf, len, seg->offset + (paddr - seg->paddr)) !=
+	    len) {
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Physical address of addr from the page tables. *size is set to the
+ * number of bytes left in its page, which may be a huge page. */
+static int translate(const struct elfcore_source *core, uint64_t addr,
+		     uint64_t *paddr, uint64_t *size)
+{
+	uint64_t table = core->pgd, entry = 0;
+	int level;
+
+	for (level = core->levels - 1; level >= 0; level--) {
+		unsigned int shift = PT_SHIFT + level * PT_INDEX_BITS;
+		uint64_t index = (addr >> shift) &
+			((1ULL << PT_INDEX_BITS) - 1);
+		uint64_t page_size = 1ULL << shift;
+
+		if (read_phys(core, table + index * sizeof(entry), &entry,
+			      sizeof(entry)) != 0 ||
+		    !(entry & PTE_PRESENT)) {
+			return -1;
+		}
+		/* 1 GiB pages in PUDs and 2 MiB pages in PMDs */
+		if (level == 0 || ((level == 1 || level == 2) &&
+				   (entry & PTE_HUGE))) {
+			*paddr = (entry & PTE_ADDR_MASK & ~(page_size - 1)) +
+				(addr & (page_size - 1));
+			*size = page_size - (addr & (page_size - 1));
+			return 0;
+		}
+		table = entry & PTE_ADDR_MASK;
+	}
+	return -1;
+}
+
+
+static int elfcore_read(struct mem_source *src, uint64_t addr, void *buf,
+			size_t len)
+{
+	struct elfcore_source *core = container_of(src, struct elfcore_source,
+						   src);
+
+	while (len) {
+		const struct elfcore_segment *seg = find_segment(core, addr);
+		uint64_t paddr, size;
+		size_t chunk;
+		ssize_t retval;
+
+		if (!seg) {
+			if (!core->pgd ||
+			    translate(core, addr, &paddr, &size) != 0) {
+				return -1;
+			}
+			chunk = size < len ? size : len;
+			if (read_phys(core, paddr, buf, chunk) != 0) {
+				return -1;
+			}
+			addr += chunk;
+			buf += chunk;
+			len -= chunk;
+			continue;
+		}
+		chunk = seg->vaddr + seg->filesz - addr;
+		if (chunk > len) {
+			chunk = len;
+		}
+		retval = pread(core->fd, buf, chunk,
+			       seg->offset + (addr - seg->vaddr));
+		if (retval != chunk) {
+			return -1;
+		}
+		addr += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+
+/* pgd is the kernel virtual address of the page table, in the kernel
+ * image segment */
+static int elfcore_set_page_table(struct mem_source *src, uint64_t pgd,
+				  unsigned int levels)
+{
+	struct elfcore_source *core = container_of(src, struct elfcore_source,
+						   src);
+	const struct elfcore_segment *seg = find_segment(core, pgd);
+
+	if (!seg || !seg->paddr || (levels != 4 && levels != 5)) {
+		return -1;
+	}
+	core->pgd = seg->paddr + (pgd - seg->vaddr);
+	core->levels = levels;
+	return 0;
+}
+
+
+static void elfcore_prefetch(struct mem_source *src, uint64_t addr,
+			     size_t len)
+{
+	struct elfcore_source *core = container_of(src, struct elfcore_source,
+						   src);
+	const struct elfcore_segment *seg = find_segment(core, addr);
+
+	if (!seg) {
+		return;
+	}
+	if (len > seg->vaddr + seg->filesz - addr) {
+		len = seg->vaddr + seg->filesz - addr;
+	}
+	posix_fadvise(core->fd, seg->offset + (addr - seg->vaddr), len,
+		      POSIX_FADV_WILLNEED);
+}
+
+
+static void elfcore_close(struct mem_source *src)
+{
+	struct elfcore_source *core = container_of(src, struct elfcore_source,
+						   src);
+
+	close(core->fd);
+	free(core->segments);
+	free(core->phys);
+	free(core);
+}
+
+
+static const struct mem_source_ops elfcore_ops = {
+	.read = elfcore_read,
+	.prefetch = elfcore_prefetch,
+	.set_page_table = elfcore_set_page_table,
+	.close = elfcore_close,
+};
+
+
+struct mem_source *mem_source_open_elfcore(const char *path)
+{
+	struct elfcore_source *core;
+	GElf_Ehdr ehdr;
+	size_t phnum;
+	Elf *elf;
+	int i;
+
+	core = calloc(1, sizeof(*core));
+	core->src.ops = &elfcore_ops;
+	core->src.page_size = sysconf(_SC_PAGESIZE);
+
+	if ((core->fd = open(path, O_RDONLY, 0)) == -1) {
+		fprintf(stderr, "Error: open \"%s\" failed: %s\n", path,
+			strerror(errno));
+		abort();
+	}
+	if ((elf = elf_begin(core->fd, ELF_C_READ, NULL)) == NULL ||
+	    gelf_getehdr(elf, &ehdr) == NULL || ehdr.e_type != ET_CORE) {
+		fprintf(stderr, "Error: \"%s\" is not an ELF core file.\n",
+			path);
+		abort();
+	}
+
+	elf_getphdrnum(elf, &phnum);
+	core->segments = malloc(phnum * sizeof(*core->segments));
+	for (i = 0; i < phnum; i++) {
+		GElf_Phdr phdr;
+
+		gelf_getphdr(elf, i, &phdr);
+		if (phdr.p_type != PT_LOAD || !phdr.p_filesz) {
+			continue;
+		}
+		core->segments[core->segments_nb++] = (struct elfcore_segment) {
+			.vaddr = phdr.p_vaddr,
+			.paddr = phdr.p_paddr,
+			.filesz = phdr.p_filesz,
+			.offset = phdr.p_offset,
+		};
+	}
+	elf_end(elf);
+
+	qsort(core->segments, core->segments_nb, sizeof(*core->segments),
+	      segment_cmp);
+	core->phys = malloc(core->segments_nb * sizeof(*core->phys));
+	memcpy(core->phys, core->segments,
+	       core->segments_nb * sizeof(*core->phys));
+	qsort(core->phys, core->segments_nb, sizeof(*core->phys),
+	      segment_paddr_cmp);
+
+	return &core->src;
+}
+
+
+/* Words known from elsewhere, ex. the stack dump of a kernel report */
+
+struct words_source {
+	struct mem_source src;
+	uint64_t start;
+	const uint64_t *words;
+	unsigned int nr;
+};
+
+
+static int words_read(struct mem_source *src, uint64_t addr, void *buf,
+		      size_t len)
+{
+	struct words_source *ws = container_of(src, struct words_source,
+					       src);
+	uint64_t size = ws->nr * sizeof(*ws->words);
+
+	if (addr < ws->start || addr - ws->start > size ||
+	    len > size - (addr - ws->start)) {
+		return -1;
+	}
+	memcpy(buf, (const char *) ws->words + (addr - ws->start), len);
+
+	return 0;
+}
+
+
+static void words_close(struct mem_source *src)
+{
+	free(container_of(src, struct words_source, src));
+}
+
+
+static const struct mem_source_ops words_ops = {
+	.read = words_read,
+	.close = words_close,
+};
+
+
+/* words are not copied and must outlive the source. Pages are one word long
+ * so that caches over the source only read what is there. */
+struct mem_source *mem_source_open_words(uint64_t start,
+					 const uint64_t *words,
+					 unsigned int nr)
+{
+	struct words_source *ws;
+
+	ws = calloc(1, sizeof(*ws));
+	ws->src.ops = &words_ops;
+	ws->src.page_size = sizeof(*words);
+	ws->start = start;
+	ws->words = words;
+	ws->nr = nr;
+
+	return &ws->src;
+}
+
+
+int mem_read(struct mem_source *src, uint64_t addr, void *buf, size_t len)
+{
+	/* sources may be shared by threads */
+	__atomic_fetch_add(&src->reads, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&src->bytes_read, len, __ATOMIC_RELAXED);
+	return src->ops->read(src, addr, buf, len);
+}
+
+
+void mem_prefetch(struct mem_source *src, uint64_t addr, size_t len)
+{
+	if (src->ops->prefetch) {
+		src->ops->prefetch(src, addr, len);
+	}
+}
+
+
+/* Translate the addresses that the dump does not map directly through the
+ * x86_64 page tables of levels levels at pgd, a kernel virtual address.
+ * Returns -1 if the source cannot. */
+int mem_source_set_page_table(struct mem_source *src, uint64_t pgd,
+			      unsigned int levels)
+{
+	if (!src->ops->set_page_table) {
+		return -1;
+	}
+	return src->ops->set_page_table(src, pgd, levels);
+}
+
+
+void mem_source_close(struct mem_source *src)
+{
+	src->ops->close(src);
+}
+
+
+void mem_cache_init(struct mem_cache *cache, struct mem_source *src,
+		    unsigned int pages_nb, unsigned int readahead)
+{
+	int i;
+
+	if (readahead > pages_nb) {
+		readahead = pages_nb;
+	}
+	*cache = (struct mem_cache) {
+		.src = src,
+		.pages = calloc(pages_nb, sizeof(*cache->pages)),
+		.pages_nb = pages_nb,
+		.readahead = readahead ? readahead : 1,
+	};
+	cache->buf = malloc(cache->readahead * src->page_size);
+	for (i = 0; i < pages_nb; i++) {
+		cache->pages[i].data = malloc(src->page_size);
+	}
+}
+
+
+static struct mem_cache_page *cache_slot(struct mem_cache *cache,
+					 uint64_t page)
+{
+	return &cache->pages[(page / cache->src->page_size) &
+			     (cache->pages_nb - 1)];
+}
+
+
+static const unsigned char *cache_page(struct mem_cache *cache, uint64_t page)
+{
+	struct mem_cache_page *slot = cache_slot(cache, page);
+	unsigned long page_size = cache->src->page_size;
+	unsigned int i, nr;
+
+	if (slot->valid && slot->addr == page) {
+		cache->hits++;
+		return slot->data;
+	}
+	cache->misses++;
+
+	/* consecutive pages map to distinct slots, since readahead is at
+	 * most pages_nb */
+	nr = cache->readahead;
+	if (nr > 1 && mem_read(cache->src, page, cache->buf,
+			       nr * page_size) == 0) {
+		for (i = 0; i < nr; i++) {
+			struct mem_cache_page *ra = cache_slot(cache, page +
+							       i * page_size);
+
+			memcpy(ra->data, cache->buf + i * page_size,
+			       page_size);
+			ra->addr = page + i * page_size;
+			ra->valid = true;
+		}
+		return slot->data;
+	}
+	if (mem_read(cache->src, page, slot->data, page_size) != 0) {
+		slot->valid = false;
+		return NULL;
+	}
+	slot->addr = page;
+	slot->valid = true;
+	return slot->data;
+}
+
+
+int mem_cache_read(struct mem_cache *cache, uint64_t addr, void *buf,
+		   size_t len)
+{
+	unsigned long page_size = cache->src->page_size;
+
+	while (len) {
+		uint64_t page = addr & ~((uint64_t) page_size - 1);
+		const unsigned char *data;
+		size_t chunk;
+
+		if ((data = cache_page(cache, page)) == NULL) {
+			return -1;
+		}
+		chunk = page + page_size - addr;
+		if (chunk > len) {
+			chunk = len;
+		}
+		memcpy(buf, data + (addr - page), chunk);
+		addr += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+
+void mem_cache_free(struct mem_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < cache->pages_nb; i++) {
+		free(cache->pages[i].data);
+	}
+	free(cache->pages);
+	free(cache->buf);
+}
+
+
+void read_plan_add(struct read_plan *plan, uint64_t addr, size_t len)
+{
+	if (!len || read_plan_get(plan, addr, len)) {
+		return;
+	}
+	if (plan->reqs_nb == plan->reqs_alloc) {
+		plan->reqs_alloc = plan->reqs_alloc ? plan->reqs_alloc * 2 :
+			64;
+		plan->reqs = realloc(plan->reqs, plan->reqs_alloc *
+				     sizeof(*plan->reqs));
+	}
+	plan->reqs[plan->reqs_nb++] = (struct read_req) {
+		.addr = addr,
+		.len = len,
+	};
+}
+
+
+static int req_cmp(const void *a, const void *b)
+{
+	const struct read_req *ra = a, *rb = b;
+
+	if (ra->addr != rb->addr) {
+		return ra->addr < rb->addr ? -1 : 1;
+	}
+	return 0;
+}
+
+
+static int extent_cmp(const void *a, const void *b)
+{
+	const struct read_extent *ea = a, *eb = b;
+
+	if (ea->addr != eb->addr) {
+		return ea->addr < eb->addr ? -1 : 1;
+	}
+	return 0;
+}
+
+
+static void add_extent(struct read_plan *plan, uint64_t addr, size_t len,
+		       unsigned char *data)
+{
+	if (plan->extents_nb == plan->extents_alloc) {
+		plan->extents_alloc = plan->extents_alloc ?
+			plan->extents_alloc * 2 : 16;
+		plan->extents = realloc(plan->extents, plan->extents_alloc *
+					sizeof(*plan->extents));
+	}
+	plan->extents[plan->extents_nb++] = (struct read_extent) {
+		.addr = addr,
+		.len = len,
+		.data = data,
+	};
+}
+
+
+/* Read [start, end[, one page at a time if the whole range fails, to keep
+ * what is available around holes in the dump. */
+static void fetch_range(struct read_plan *plan, struct mem_source *src,
+			uint64_t start, uint64_t end)
+{
+	unsigned char *data = malloc(end - start);
+	uint64_t page;
+
+	if (mem_read(src, start, data, end - start) == 0) {
+		add_extent(plan, start, end - start, data);
+		return;
+	}
+	free(data);
+
+	for (page = start; page < end; page += src->page_size) {
+		data = malloc(src->page_size);
+		if (mem_read(src, page, data, src->page_size) == 0) {
+			add_extent(plan, page, src->page_size, data);
+		} else {
+			free(data);
+		}
+	}
+}
+
+
+/* Join the extents that touch: the per-page fallback of fetch_range(), and
+ * rounds that skip pages already fetched, leave neighbours that a read of
+ * an object may straddle. Extents must be sorted. */
+static void merge_extents(struct read_plan *plan)
+{
+	unsigned int i, nr = 0;
+
+	for (i = 0; i < plan->extents_nb; i++) {
+		struct read_extent *extent = &plan->extents[i];
+		struct read_extent *last = nr ? &plan->extents[nr - 1] : NULL;
+
+		if (last && last->addr + last->len == extent->addr) {
+			last->data = realloc(last->data,
+					     last->len + extent->len);
+			memcpy(last->data + last->len, extent->data,
+			       extent->len);
+			last->len += extent->len;
+			free(extent->data);
+			continue;
+		}
+		plan->extents[nr++] = *extent;
+	}
+	plan->extents_nb = nr;
+}
+
+
+/* Issue the pending requests, merged into page-aligned ranges that do not
+ * overlap data already fetched. */
+void read_plan_execute(struct read_plan *plan, struct mem_source *src)
+{
+	uint64_t mask = src->page_size - 1;
+	uint64_t start = 0, end = 0;
+	bool open = false;
+	unsigned int old_nb = plan->extents_nb;
+	int i;
+
+	qsort(plan->reqs, plan->reqs_nb, sizeof(*plan->reqs), req_cmp);
+	for (i = 0; i < plan->reqs_nb; i++) {
+		uint64_t req_start = plan->reqs[i].addr & ~mask;
+		uint64_t req_end = (plan->reqs[i].addr + plan->reqs[i].len +
+				    mask) & ~mask;
+		uint64_t page;
+
+		/* do not read pages fetched by a previous round again */
+		while (req_start < req_end &&
+		       read_plan_get(plan, req_start, src->page_size)) {
+			req_start += src->page_size;
+		}
+		for (page = req_start; page < req_end; page += src->page_size) {
+			if (read_plan_get(plan, page, src->page_size)) {
+				req_end = page;
+				break;
+			}
+		}
+		if (req_start >= req_end) {
+			continue;
+		}
+
+		if (open && req_start <= end) {
+			if (req_end > end) {
+				end = req_end;
+			}
+			continue;
+		}
+		if (open) {
+			fetch_range(plan, src, start, end);
+		}
+		start = req_start;
+		end = req_end;
+		open = true;
+	}
+	if (open) {
+		fetch_range(plan, src, start, end);
+	}
+	plan->reqs_nb = 0;
+
+	if (plan->extents_nb != old_nb) {
+		qsort(plan->extents, plan->extents_nb, sizeof(*plan->extents),
+		      extent_cmp);
+		merge_extents(plan);
+	}
+}
+
+
+/* Returns NULL if [addr, addr + len[ was not fetched */
+const void *read_plan_get(const struct read_plan *plan, uint64_t addr,
+			  size_t len)
+{
+	unsigned int lo = 0, hi = plan->extents_nb;
+	const struct read_extent *extent;
+
+	/* first extent starting after addr */
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (plan->extents[mid].addr <= addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == 0) {
+		return NULL;
+	}
+	extent = &plan->extents[lo - 1];
+	if (addr + len > extent->addr + extent->len) {
+		return NULL;
+	}
+	return extent->data + (addr - extent->addr);
+}
+
+
+void read_plan_free(struct read_plan *plan)
+{
+	int i;
+
+	for (i = 0; i < plan->extents_nb; i++) {
+		free(plan->extents[i].data);
+	}
+	free(plan->extents);
+	free(plan->reqs);
+	*plan = (struct read_plan) {};
+}
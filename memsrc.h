@@ -0,0 +1,109 @@
+#ifndef _MEMSRC_H
+#define _MEMSRC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Memory of the crashed system, addressed by kernel virtual address.
+ * Different dump formats provide their own read operation.
+ */
+
+struct mem_source;
+
+struct mem_source_ops {
+	/* returns 0 if all of [addr, addr + len[ could be read */
+	int (*read)(struct mem_source *src, uint64_t addr, void *buf,
+		    size_t len);
+	/* optional, start fetching [addr, addr + len[ without waiting */
+	void (*prefetch)(struct mem_source *src, uint64_t addr, size_t len);
+	/* optional, see mem_source_set_page_table() */
+	int (*set_page_table)(struct mem_source *src, uint64_t pgd,
+			      unsigned int levels);
+	void (*close)(struct mem_source *src);
+};
+
+struct mem_source {
+	const struct mem_source_ops *ops;
+	unsigned long page_size;
+	/* statistics */
+	unsigned long reads;
+	unsigned long long bytes_read;
+};
+
+struct mem_source *mem_source_open_elfcore(const char *path);
+struct mem_source *mem_source_open_words(uint64_t start,
+					 const uint64_t *words,
+					 unsigned int nr);
+int mem_read(struct mem_source *src, uint64_t addr, void *buf, size_t len);
+void mem_prefetch(struct mem_source *src, uint64_t addr, size_t len);
+int mem_source_set_page_table(struct mem_source *src, uint64_t pgd,
+			      unsigned int levels);
+void mem_source_close(struct mem_source *src);
+
+/*
+ * Direct-mapped page cache for small dependent reads, such as the pointers
+ * chased when walking lists. Misses read ahead a few pages at once, since
+ * objects of a slab are next to each other.
+ */
+
+struct mem_cache_page {
+	uint64_t addr;
+	bool valid;
+	unsigned char *data;
+};
+
+struct mem_cache {
+	struct mem_source *src;
+	struct mem_cache_page *pages;
+	/* power of two */
+	unsigned int pages_nb;
+	unsigned int readahead;
+	unsigned char *buf;
+	/* statistics */
+	unsigned long hits;
+	unsigned long misses;
+};
+
+void mem_cache_init(struct mem_cache *cache, struct mem_source *src,
+		    unsigned int pages_nb, unsigned int readahead);
+int mem_cache_read(struct mem_cache *cache, uint64_t addr, void *buf,
+		   size_t len);
+void mem_cache_free(struct mem_cache *cache);
+
+/*
+ * A read plan collects all the reads needed by an operation before issuing
+ * them, so that they can be merged into as few page-aligned reads as
+ * possible. Plans may be executed several times, for example once per level
+ * of pointers followed; data fetched by earlier rounds is kept.
+ */
+
+struct read_req {
+	uint64_t addr;
+	size_t len;
+};
+
+struct read_extent {
+	uint64_t addr;
+	size_t len;
+	unsigned char *data;
+};
+
+struct read_plan {
+	struct read_req *reqs;
+	unsigned int reqs_nb;
+	unsigned int reqs_alloc;
+	/* sorted by address, non overlapping */
+	struct read_extent *extents;
+	unsigned int extents_nb;
+	unsigned int extents_alloc;
+};
+
+void read_plan_add(struct read_plan *plan, uint64_t addr, size_t len);
+void read_plan_execute(struct read_plan *plan, struct mem_source *src);
+const void *read_plan_get(const struct read_plan *plan, uint64_t addr,
+			  size_t len);
+void read_plan_free(struct read_plan *plan);
+
+#endif
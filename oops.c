@@ -0,0 +1,504 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "oops.h"
+#include "strpool.h"
+
+/* only look for a syslog "kernel: " tag at the start of lines */
+#define SYSLOG_PREFIX_MAX 128
+
+static const char *title_prefixes[] = {
+	"BUG: ",
+	"Oops: ",
+	"Oops[",
+	"kernel BUG at ",
+	"general protection fault",
+	"WARNING: ",
+	"Kernel panic",
+	"Unable to handle kernel",
+	"INFO: task ",
+	"watchdog: BUG: ",
+	"NMI watchdog: ",
+};
+
+
+/* x86_64 registers of register dumps, by DWARF number */
+static const struct {
+	const char *name;
+	int reg;
+} dump_regs[] = {
+	{"RAX", 0},
+	{"RDX", 1},
+	{"RCX", 2},
+	{"RBX", 3},
+	{"RSI", 4},
+	{"RDI", 5},
+	{"RBP", REG_BP},
+	{"RSP", REG_SP},
+	{"R08", 8},
+	{"R8", 8},
+	{"R09", 9},
+	{"R9", 9},
+	{"R10", 10},
+	{"R11", 11},
+	{"R12", 12},
+	{"R13", 13},
+	{"R14", 14},
+	{"R15", 15},
+	{"RIP", REG_RA},
+};
+
+/* digits of the words of stack dumps */
+#define STACK_WORD_DIGITS 16
+
+
+void oops_reader_init(struct oops_reader *reader, FILE *stream)
+{
+	*reader = (struct oops_reader) {
+		.stream = stream,
+		.timestamp = -1,
+	};
+}
+
+
+/* Skip the syslog and printk prefixes of line and return the message.
+ * timestamp is set if the line has one. */
+static char *strip_prefix(char *line, double *timestamp, bool *wall_clock)
+{
+	struct tm tm = {};
+	char *p = line, *end, *tag;
+
+	/* "2024-01-31T12:34:56.123456+00:00 host kernel: " */
+	if ((end = strptime(p, "%Y-%m-%dT%H:%M:%S", &tm)) != NULL) {
+		double frac = 0;
+
+		if (*end == '.') {
+			frac = strtod(end, &end);
+		}
+		*timestamp = timegm(&tm) + frac;
+		*wall_clock = true;
+		p = end;
+	}
+	tag = memmem(line, strnlen(line, SYSLOG_PREFIX_MAX), "kernel: ", 8);
+	if (tag) {
+		p = tag + 8;
+	}
+
+	/* "[ 1234.567890] " */
+	if (*p == '[') {
+		double t = strtod(p + 1, &end);
+
+		if (end != p + 1 && *end == ']') {
+			if (!*wall_clock) {
+				*timestamp = t;
+			}
+			p = end + 1;
+			if (*p == ' ') {
+				p++;
+			}
+		}
+	}
+	/* caller id, "[    T123] " */
+	if (*p == '[') {
+		char *q = p + 1;
+
+		while (*q == ' ') {
+			q++;
+		}
+		if ((*q == 'T' || *q == 'C') && isdigit(q[1])) {
+			strtoul(q + 1, &end, 10);
+			if (*end == ']') {
+				p = end + 1;
+				if (*p == ' ') {
+					p++;
+				}
+			}
+		}
+	}
+
+	return p;
+}
+
+
+static bool is_title(const char *msg)
+{
+	int i;
+
+	for (i = 0; i < sizeof(title_prefixes) / sizeof(title_prefixes[0]);
+	     i++) {
+		if (strncmp(msg, title_prefixes[i],
+			    strlen(title_prefixes[i])) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/* "<IRQ>", "</TASK>", "<EOI>"... */
+static bool is_marker(const char *msg)
+{
+	size_t len;
+
+	while (isspace(*msg)) {
+		msg++;
+	}
+	len = strlen(msg);
+	return len > 2 && msg[0] == '<' && msg[len - 1] == '>' &&
+		msg[1] != '[';
+}
+
+
+/*
+ * Parse one of:
+ *  [<ffffffff8134e51d>] sysrq_handle_crash+0xd/0x20
+ *  [<ffffffff8134e51d>] ? sysrq_handle_crash+0xd/0x20
+ *  ? sysrq_handle_crash+0xd/0x20 [module]
+ *  sysrq_handle_crash+0xd/0x20
+ */
+static int parse_frame(char *s, struct oops_frame *frame,
+		       struct strpool *pool)
+{
+	char *end, *plus;
+
+	*frame = (struct oops_frame) {
+		.reliable = true,
+	};
+
+	while (isspace(*s)) {
+		s++;
+	}
+	if (s[0] == '?' && s[1] == ' ') {
+		frame->reliable = false;
+		s += 2;
+	}
+	if (s[0] == '[' && s[1] == '<') {
+		frame->pc = strtoull(s + 2, &end, 16);
+		if (end == s + 2 || strncmp(end, ">]", 2) != 0) {
+			return -1;
+		}
+		s = end + 2;
+		while (*s == ' ') {
+			s++;
+		}
+		if (s[0] == '?' && s[1] == ' ') {
+			frame->reliable = false;
+			s += 2;
+		}
+		if (*s == '\0' || strncmp(s, "0x", 2) == 0) {
+			/* not symbolized */
+			return 0;
+		}
+	}
+
+	plus = strchr(s, '+');
+	if (!plus || plus == s || memchr(s, ' ', plus - s)) {
+		return -1;
+	}
+	frame->offset = strtoull(plus + 1, &end, 16);
+	if (end == plus + 1 || *end != '/') {
+		return -1;
+	}
+	frame->size = strtoull(end + 1, &end, 16);
+	frame->symbol = strpool_add_len(pool, s, plus - s);
+
+	s = end;
+	while (*s == ' ') {
+		s++;
+	}
+	if (*s == '[') {
+		char *close = strchr(s, ']');
+
+		if (close) {
+			frame->module = strpool_add_len(pool, s + 1,
+							close - s - 1);
+		}
+	}
+
+	return 0;
+}
+
+
+/* Register number of the "NAME:" at the start of s, -1 if it is not one of
+ * a register. */
+static int dump_reg(const char *s, size_t *len)
+{
+	int i;
+
+	*len = strspn(s, "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789");
+	if (!*len || s[*len] != ':') {
+		return -1;
+	}
+	for (i = 0; i < sizeof(dump_regs) / sizeof(dump_regs[0]); i++) {
+		if (strlen(dump_regs[i].name) == *len &&
+		    strncmp(s, dump_regs[i].name, *len) == 0) {
+			return dump_regs[i].reg;
+		}
+	}
+	return -1;
+}
+
+
+/*
+ * Parse the value of reg at s, one of:
+ *  ffff88003fc03e58
+ *  0018:ffff88003fc03e58
+ *  0010:[<ffffffff8134e51d>]
+ *  0010:sysrq_handle_crash+0x16/0x20
+ * and return the end of it.
+ */
+static const char *parse_reg_value(struct oops_reader *reader, int reg,
+				   const char *s)
+{
+	uint64_t value;
+	char *end;
+
+	/* segment selector */
+	if (strspn(s, "0123456789abcdef") == 4 && s[4] == ':') {
+		s += 5;
+	}
+	if (s[0] == '[' && s[1] == '<') {
+		s += 2;
+	}
+	value = strtoull(s, &end, 16);
+	if (end - s >= 8 && (*end == '\0' || *end == ' ' || *end == '>')) {
+		reader->regs.regs[reg] = value;
+		reader->regs.valid |= 1ULL << reg;
+	} else if (reg == REG_RA) {
+		const char *plus = strchr(s, '+');
+
+		if (plus && plus > s && !memchr(s, ' ', plus - s)) {
+			free(reader->rip_symbol);
+			reader->rip_symbol = strndup(s, plus - s);
+			reader->rip_offset = strtoull(plus + 1, &end, 16);
+		}
+	}
+
+	return s + strcspn(s, " ");
+}
+
+
+/* Returns false if msg is not a line of a register dump, ex.
+ *  RAX: 0000000000000010 RBX: 0000000000000063 RCX: 0000000000000000 */
+static bool parse_regs(struct oops_reader *reader, const char *msg)
+{
+	const char *p = msg;
+	size_t len;
+
+	while (*p == ' ') {
+		p++;
+	}
+	if (dump_reg(p, &len) == -1) {
+		return false;
+	}
+
+	while (*p) {
+		int reg = dump_reg(p, &len);
+
+		if (len && p[len] == ':') {
+			p += len + 1;
+			while (*p == ' ') {
+				p++;
+			}
+			if (reg != -1) {
+				p = parse_reg_value(reader, reg, p);
+			}
+		} else {
+			p += strcspn(p, " ");
+		}
+		while (*p == ' ') {
+			p++;
+		}
+	}
+
+	return true;
+}
+
+
+/* Returns false if msg is not a line of words of a stack dump, ex.
+ *  ffff88003fc03e88 ffffffff8134eaa4 ffff88003fc03ed8 ffff880037aa1e00
+ * in which case nothing is added. */
+static bool parse_stack(struct oops_reader *reader, const char *msg)
+{
+	unsigned int nr = reader->stack_nb;
+	const char *p = msg;
+
+	while (true) {
+		uint64_t word;
+		char *end;
+
+		while (*p == ' ') {
+			p++;
+		}
+		if (!*p) {
+			break;
+		}
+		if (strspn(p, "0123456789abcdef") != STACK_WORD_DIGITS) {
+			reader->stack_nb = nr;
+			return false;
+		}
+		word = strtoull(p, &end, 16);
+		if (*end != '\0' && *end != ' ') {
+			reader->stack_nb = nr;
+			return false;
+		}
+		if (reader->stack_nb == reader->stack_alloc) {
+			reader->stack_alloc = reader->stack_alloc ?
+				reader->stack_alloc * 2 : 64;
+			reader->stack = realloc(reader->stack,
+						reader->stack_alloc *
+						sizeof(*reader->stack));
+		}
+		reader->stack[reader->stack_nb++] = word;
+		p = end;
+	}
+
+	return reader->stack_nb > nr;
+}
+
+
+static void dump_reset(struct oops_reader *reader)
+{
+	reader->regs = (struct unwind_regs) {};
+	free(reader->rip_symbol);
+	reader->rip_symbol = NULL;
+	reader->stack_nb = 0;
+	reader->in_stack = false;
+}
+
+
+/* Hand the registers and stack read so far over to oops. The stack buffers
+ * are swapped so that both keep being reused. */
+static void dump_take(struct oops_reader *reader, struct oops *oops)
+{
+	uint64_t *stack = oops->stack;
+	unsigned int alloc = oops->stack_alloc;
+
+	oops->regs = reader->regs;
+	oops->rip_symbol = reader->rip_symbol ?
+		strpool_add(&oops->pool, reader->rip_symbol) : NULL;
+	oops->rip_offset = reader->rip_offset;
+	oops->stack = reader->stack;
+	oops->stack_nb = reader->stack_nb;
+	oops->stack_alloc = reader->stack_alloc;
+	reader->stack = stack;
+	reader->stack_alloc = alloc;
+	dump_reset(reader);
+}
+
+
+static void add_frame(struct oops *oops, const struct oops_frame *frame)
+{
+	if (oops->frames_nb == oops->frames_alloc) {
+		oops->frames_alloc = oops->frames_alloc ?
+			oops->frames_alloc * 2 : 32;
+		oops->frames = realloc(oops->frames, oops->frames_alloc *
+				       sizeof(*oops->frames));
+	}
+	oops->frames[oops->frames_nb++] = *frame;
+}
+
+
+/* Read the next call trace. Returns 1 if oops was filled, 0 at the end of
+ * the stream. */
+int oops_read(struct oops_reader *reader, struct oops *oops)
+{
+	while (reader->replay ||
+	       getline(&reader->line, &reader->n, reader->stream) != -1) {
+		double timestamp = -1;
+		bool wall_clock = false;
+		struct oops_frame frame;
+		char *msg;
+
+		reader->replay = false;
+		msg = strip_prefix(reader->line, &timestamp, &wall_clock);
+		msg[strcspn(msg, "\r\n")] = '\0';
+
+		if (reader->in_stack) {
+			if (parse_stack(reader, msg)) {
+				continue;
+			}
+			/* the words after "<EOI>" and such are on another
+			 * stack, at an unknown address */
+			reader->in_stack = false;
+			if (is_marker(msg)) {
+				continue;
+			}
+		}
+
+		if (reader->in_trace) {
+			if (is_marker(msg)) {
+				continue;
+			}
+			if (parse_frame(msg, &frame, &oops->pool) == 0) {
+				add_frame(oops, &frame);
+				continue;
+			}
+			reader->in_trace = false;
+			if (oops->frames_nb) {
+				reader->replay = true;
+				return 1;
+			}
+		}
+
+		if (is_title(msg)) {
+			free(reader->title);
+			reader->title = strdup(msg);
+			reader->timestamp = timestamp;
+			reader->wall_clock = wall_clock;
+			dump_reset(reader);
+		} else if (parse_regs(reader, msg)) {
+			continue;
+		} else if (strncmp(msg, "Stack:", 6) == 0) {
+			reader->stack_nb = 0;
+			reader->in_stack = true;
+			/* some architectures start on the same line */
+			parse_stack(reader, msg + 6);
+		} else if (strstr(msg, "Call Trace:")) {
+			strpool_free(&oops->pool);
+			oops->frames_nb = 0;
+			oops->title = strpool_add(&oops->pool, reader->title ?
+						  reader->title : "");
+			if (reader->title && reader->timestamp != -1) {
+				oops->timestamp = reader->timestamp;
+				oops->wall_clock = reader->wall_clock;
+			} else {
+				oops->timestamp = timestamp;
+				oops->wall_clock = wall_clock;
+			}
+			dump_take(reader, oops);
+			reader->in_trace = true;
+		}
+	}
+
+	if (reader->in_trace) {
+		reader->in_trace = false;
+		if (oops->frames_nb) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+void oops_reader_free(struct oops_reader *reader)
+{
+	free(reader->line);
+	free(reader->title);
+	free(reader->rip_symbol);
+	free(reader->stack);
+}
+
+
+void oops_free(struct oops *oops)
+{
+	free(oops->frames);
+	free(oops->stack);
+	strpool_free(&oops->pool);
+	*oops = (struct oops) {};
+}
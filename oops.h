@@ -0,0 +1,84 @@
+#ifndef _OOPS_H
+#define _OOPS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "strpool.h"
+#include "unwind.h"
+
+/*
+ * Kernel reports (oopses, BUGs, warnings) parsed from logs, as printed by
+ * dmesg, netconsole or syslog. Reports are read one at a time so that large
+ * batches are processed in bounded memory.
+ */
+
+/* frames unwound from the register dump of a report */
+#define OOPS_FRAMES_MAX 64
+
+struct oops_frame {
+	/* 0 if the trace only shows the symbol */
+	uint64_t pc;
+	/* NULL if the address is not symbolized */
+	const char *symbol;
+	uint64_t offset;
+	uint64_t size;
+	/* NULL for the core kernel */
+	const char *module;
+	/* false for "?" entries, found on the stack but not unwound */
+	bool reliable;
+};
+
+struct oops {
+	/* first line of the report, ex. "BUG: unable to handle ..." */
+	const char *title;
+	/* seconds since the epoch if wall_clock, since boot otherwise. -1 if
+	 * the log has no timestamps */
+	double timestamp;
+	bool wall_clock;
+	struct oops_frame *frames;
+	unsigned int frames_nb;
+	unsigned int frames_alloc;
+	/* x86_64 register dump ("RIP:", "RSP:", "RAX: ... RBX: ..."), RIP
+	 * in REG_RA. Newer kernels only print RIP as symbol+offset, then
+	 * rip_symbol is set instead. */
+	struct unwind_regs regs;
+	const char *rip_symbol;
+	uint64_t rip_offset;
+	/* "Stack:" hex dump, stack[0] is at the address in RSP */
+	uint64_t *stack;
+	unsigned int stack_nb;
+	unsigned int stack_alloc;
+	/* strings of the current report */
+	struct strpool pool;
+};
+
+struct oops_reader {
+	FILE *stream;
+	char *line;
+	size_t n;
+	/* the line ending a trace is processed again by the next read */
+	bool replay;
+	bool in_trace;
+	bool in_stack;
+	/* registers and stack seen since the title, moved to the oops by
+	 * the trace that follows them */
+	struct unwind_regs regs;
+	char *rip_symbol;
+	uint64_t rip_offset;
+	uint64_t *stack;
+	unsigned int stack_nb;
+	unsigned int stack_alloc;
+	/* last title line seen, and its timestamp */
+	char *title;
+	double timestamp;
+	bool wall_clock;
+};
+
+void oops_reader_init(struct oops_reader *reader, FILE *stream);
+int oops_read(struct oops_reader *reader, struct oops *oops);
+void oops_reader_free(struct oops_reader *reader);
+void oops_free(struct oops *oops);
+
+#endif
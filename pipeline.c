@@ -0,0 +1,199 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "image.h"
+#include "pipeline.h"
+#include "resolve.h"
+#include "strpool.h"
+
+struct pipeline_helper {
+	struct resolve_pipeline *pipe;
+	pthread_t thread;
+	struct image image;
+	bool opened;
+	struct strpool pool;
+};
+
+struct resolve_pipeline {
+	struct image *image;
+	const uint64_t *pcs;
+	unsigned long nr;
+	struct resolved_frame *frames;
+	bool *done;
+	/* for the frames the consumer resolves itself */
+	struct strpool pool;
+	struct pipeline_helper *helpers;
+	unsigned int helpers_nb;
+
+	/* protects the fields below and done */
+	pthread_mutex_t lock;
+	/* signaled when a frame is done or the consumer moves on */
+	pthread_cond_t cond;
+	/* next frame to claim */
+	unsigned long next;
+	/* next frame to return to the consumer */
+	unsigned long consumed;
+	bool stop;
+};
+
+
+/* Claim the next frame to resolve unless it is more than PIPELINE_DEPTH
+ * frames ahead of the consumer. Returns -1 when there is nothing left to
+ * do. */
+static long claim(struct resolve_pipeline *pipe)
+{
+	long i = -1;
+
+	pthread_mutex_lock(&pipe->lock);
+	while (!pipe->stop && pipe->next < pipe->nr &&
+	       pipe->next >= pipe->consumed + PIPELINE_DEPTH) {
+		pthread_cond_wait(&pipe->cond, &pipe->lock);
+	}
+	if (!pipe->stop && pipe->next < pipe->nr) {
+		i = pipe->next++;
+	}
+	pthread_mutex_unlock(&pipe->lock);
+
+	return i;
+}
+
+
+static void *pipeline_helper_main(void *arg)
+{
+	struct pipeline_helper *helper = arg;
+	struct resolve_pipeline *pipe = helper->pipe;
+	long i;
+
+	if (image_try_open(&helper->image, pipe->image->debug_path) == -1) {
+		return NULL;
+	}
+	helper->opened = true;
+	/* shared, the helper images do not own it */
+	helper->image.kallsyms_path = pipe->image->kallsyms_path;
+	helper->image.symtab = image_symtab(pipe->image);
+	helper->image.symtab_loaded = true;
+
+	while ((i = claim(pipe)) != -1) {
+		resolve_pc(&helper->image, pipe->pcs[i], &helper->pool,
+			   &pipe->frames[i]);
+
+		pthread_mutex_lock(&pipe->lock);
+		pipe->done[i] = true;
+		pthread_cond_broadcast(&pipe->cond);
+		pthread_mutex_unlock(&pipe->lock);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Start resolving pcs with up to helpers threads. The frames are returned in
+ * order by resolve_pipeline_next(). The consumer resolves the frames no
+ * helper got to yet itself, so that the first ones do not wait for the
+ * helpers to open the image.
+ */
+struct resolve_pipeline *resolve_pipeline_start(struct image *image,
+						const uint64_t *pcs,
+						unsigned long nr,
+						unsigned int helpers)
+{
+	struct resolve_pipeline *pipe;
+	unsigned int i;
+
+	pipe = calloc(1, sizeof(*pipe));
+	pipe->image = image;
+	pipe->pcs = pcs;
+	pipe->nr = nr;
+	pipe->frames = calloc(nr, sizeof(*pipe->frames));
+	pipe->done = calloc(nr, sizeof(*pipe->done));
+	pthread_mutex_init(&pipe->lock, NULL);
+	pthread_cond_init(&pipe->cond, NULL);
+
+	/* the helpers share the symbol table; unless the indexing thread
+	 * builds it, it must be there before they start */
+	if (!image->indexer) {
+		image_symtab(image);
+	}
+
+	if (helpers > PIPELINE_HELPERS_MAX) {
+		helpers = PIPELINE_HELPERS_MAX;
+	}
+	pipe->helpers = calloc(helpers, sizeof(*pipe->helpers));
+	for (i = 0; i < helpers; i++) {
+		struct pipeline_helper *helper =
+			&pipe->helpers[pipe->helpers_nb];
+
+		helper->pipe = pipe;
+		if (pthread_create(&helper->thread, NULL, pipeline_helper_main,
+				   helper) != 0) {
+			break;
+		}
+		pipe->helpers_nb++;
+	}
+
+	return pipe;
+}
+
+
+/* The next frame in the order of pcs, NULL after the last one. The frame
+ * stays valid until resolve_pipeline_finish(). locs_nb is 0 if nothing is
+ * known about the pc. */
+const struct resolved_frame *resolve_pipeline_next(
+	struct resolve_pipeline *pipe)
+{
+	unsigned long i = pipe->consumed;
+
+	if (i == pipe->nr) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&pipe->lock);
+	if (pipe->next == i) {
+		pipe->next++;
+		pthread_mutex_unlock(&pipe->lock);
+		resolve_pc(pipe->image, pipe->pcs[i], &pipe->pool,
+			   &pipe->frames[i]);
+		pthread_mutex_lock(&pipe->lock);
+	} else {
+		while (!pipe->done[i]) {
+			pthread_cond_wait(&pipe->cond, &pipe->lock);
+		}
+	}
+	pipe->consumed++;
+	pthread_cond_broadcast(&pipe->cond);
+	pthread_mutex_unlock(&pipe->lock);
+
+	return &pipe->frames[i];
+}
+
+
+void resolve_pipeline_finish(struct resolve_pipeline *pipe)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&pipe->lock);
+	pipe->stop = true;
+	pthread_cond_broadcast(&pipe->cond);
+	pthread_mutex_unlock(&pipe->lock);
+
+	for (i = 0; i < pipe->helpers_nb; i++) {
+		struct pipeline_helper *helper = &pipe->helpers[i];
+
+		pthread_join(helper->thread, NULL);
+		if (helper->opened) {
+			helper->image.symtab = NULL;
+			image_close(&helper->image);
+		}
+		strpool_free(&helper->pool);
+	}
+
+	pthread_cond_destroy(&pipe->cond);
+	pthread_mutex_destroy(&pipe->lock);
+	strpool_free(&pipe->pool);
+	free(pipe->helpers);
+	free(pipe->done);
+	free(pipe->frames);
+	free(pipe);
+}
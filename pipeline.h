@@ -0,0 +1,30 @@
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#include <stdint.h>
+
+#include "resolve.h"
+
+struct image;
+struct resolve_pipeline;
+
+/*
+ * Resolution of a sequence of code addresses ahead of the one being printed:
+ * helper threads, each on its own handles to the image, resolve the next
+ * frames while the consumer prints the current one.
+ */
+
+/* frames resolved ahead of the consumer */
+#define PIPELINE_DEPTH 16
+/* each helper reads the debugging information a second time, in memory */
+#define PIPELINE_HELPERS_MAX 4
+
+struct resolve_pipeline *resolve_pipeline_start(struct image *image,
+						const uint64_t *pcs,
+						unsigned long nr,
+						unsigned int helpers);
+const struct resolved_frame *resolve_pipeline_next(
+	struct resolve_pipeline *pipe);
+void resolve_pipeline_finish(struct resolve_pipeline *pipe);
+
+#endif
@@ -0,0 +1,592 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rescache.h"
+#include "resolve.h"
+
+
+static uint64_t fnv1a(const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+
+uint64_t rescache_build_id(const unsigned char *id, size_t len)
+{
+	return fnv1a(id, len);
+}
+
+
+static uint32_t record_checksum(const struct rescache_record *record)
+{
+	struct rescache_record head = *record;
+	uint64_t hash;
+
+	head.checksum = 0;
+	hash = fnv1a(&head, sizeof(head));
+	hash ^= fnv1a((const char *) record + sizeof(head),
+		      record->size - sizeof(head));
+	return hash ^ (hash >> 32);
+}
+
+
+/* Buckets of a new cache, about 32 KiB of index */
+#define RESCACHE_BUCKETS_MIN 4096
+/* Larger records are neither written nor read */
+#define RESCACHE_RECORD_MAX (1 << 20)
+
+
+static unsigned int key_hash(uint64_t build_id, uint64_t pc)
+{
+	uint64_t key = (build_id ^ pc) * 0x9e3779b97f4a7c15ULL;
+
+	return key >> 32;
+}
+
+
+static size_t records_start(unsigned int buckets_nb)
+{
+	return sizeof(struct rescache_header) + buckets_nb * sizeof(uint64_t);
+}
+
+
+/* A string offset must be past the fixed fields and its NUL within the
+ * record */
+static bool string_valid(const struct rescache_record *record,
+			 uint32_t offset)
+{
+	size_t start = sizeof(*record) +
+		record->locs_nb * sizeof(record->locs[0]);
+
+	return offset == 0 ||
+		(offset >= start && offset < record->size &&
+		 memchr((const char *) record + offset, '\0',
+			record->size - offset) != NULL);
+}
+
+
+/* Whether the avail bytes at record are a complete and intact record */
+static bool record_valid(const struct rescache_record *record, size_t avail)
+{
+	int i;
+
+	if (avail < sizeof(*record) || record->size < sizeof(*record) ||
+	    record->size % 8 || record->size > avail ||
+	    record->size > RESCACHE_RECORD_MAX ||
+	    record->locs_nb > INLINE_DEPTH_MAX ||
+	    record->size < sizeof(*record) + record->locs_nb *
+	    sizeof(record->locs[0]) ||
+	    record_checksum(record) != record->checksum ||
+	    !string_valid(record, record->symbol)) {
+		return false;
+	}
+	for (i = 0; i < record->locs_nb; i++) {
+		if (!string_valid(record, record->locs[i].function) ||
+		    !string_valid(record, record->locs[i].file)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static const struct rescache_record **table_slot(struct rescache *cache,
+						 uint64_t build_id,
+						 uint64_t pc)
+{
+	unsigned int mask = cache->table_size - 1;
+	unsigned int i = key_hash(build_id, pc) & mask;
+
+	while (cache->table[i] && (cache->table[i]->build_id != build_id ||
+				   cache->table[i]->pc != pc)) {
+		i = (i + 1) & mask;
+	}
+	return &cache->table[i];
+}
+
+
+/* Keep record, allocated, until the cache is closed and index it in memory */
+static void table_insert(struct rescache *cache,
+			 struct rescache_record *record)
+{
+	if ((cache->added_nb + 1) * 2 > cache->table_size) {
+		const struct rescache_record **old = cache->table;
+		unsigned int i, old_size = cache->table_size;
+
+		cache->table_size = old_size ? old_size * 2 : 64;
+		cache->table = calloc(cache->table_size,
+				      sizeof(*cache->table));
+		for (i = 0; i < old_size; i++) {
+			if (old[i]) {
+				*table_slot(cache, old[i]->build_id,
+					    old[i]->pc) = old[i];
+			}
+		}
+		free(old);
+	}
+
+	cache->added = realloc(cache->added, (cache->added_nb + 1) *
+			       sizeof(*cache->added));
+	cache->added[cache->added_nb++] = record;
+	*table_slot(cache, record->build_id, record->pc) = record;
+}
+
+
+/* Copy the fixed fields of the record at file offset off, which may have
+ * been appended by another process after the file was mapped. */
+static int read_head(struct rescache *cache, uint64_t off,
+		     struct rescache_record *head)
+{
+	if (off < records_start(cache->buckets_nb) || off % 8) {
+		return -1;
+	}
+	if (off + sizeof(*head) <= cache->map_size) {
+		memcpy(head, (char *) cache->map + off, sizeof(*head));
+		return 0;
+	}
+	return pread(cache->fd, head, sizeof(*head), off) == sizeof(*head) ?
+		0 : -1;
+}
+
+
+/* Returns the record at off, in the mapping or read past it, NULL if it is
+ * not valid */
+static const struct rescache_record *load_record(struct rescache *cache,
+						 uint64_t off,
+						 uint32_t size)
+{
+	struct rescache_record *record;
+
+	if (off + size <= cache->map_size) {
+		record = (void *) ((char *) cache->map + off);
+		return record_valid(record, cache->map_size - off) ?
+			record : NULL;
+	}
+
+	if (size < sizeof(*record) || size > RESCACHE_RECORD_MAX) {
+		return NULL;
+	}
+	record = malloc(size);
+	if (pread(cache->fd, record, size, off) != size ||
+	    !record_valid(record, size)) {
+		free(record);
+		return NULL;
+	}
+	table_insert(cache, record);
+	return record;
+}
+
+
+/*
+ * Probe the index of the file for (build_id, pc). Returns 1 and sets *bucket
+ * and *head if it is there, 0 and sets *bucket to the first empty one if it
+ * is not, -1 if the index is full.
+ */
+static int index_find(struct rescache *cache, uint64_t build_id, uint64_t pc,
+		      unsigned int *bucket, struct rescache_record *head)
+{
+	unsigned int mask = cache->buckets_nb - 1;
+	unsigned int i = key_hash(build_id, pc) & mask;
+	unsigned int n;
+
+	for (n = 0; n < cache->buckets_nb; n++, i = (i + 1) & mask) {
+		/* other writers update the buckets through the page cache */
+		uint64_t off = cache->buckets[i];
+
+		*bucket = i;
+		if (!off) {
+			return 0;
+		}
+		if (read_head(cache, off, head) == 0 &&
+		    head->build_id == build_id && head->pc == pc) {
+			return 1;
+		}
+	}
+	return -1;
+}
+
+
+static int write_header(int fd, unsigned int buckets_nb, uint64_t records_nb)
+{
+	struct rescache_header header = {
+		.version = RESCACHE_VERSION,
+		.buckets_nb = buckets_nb,
+		.records_nb = records_nb,
+	};
+
+	memcpy(header.magic, RESCACHE_MAGIC, sizeof(header.magic));
+	return pwrite(fd, &header, sizeof(header), 0) == sizeof(header) ?
+		0 : -1;
+}
+
+
+/*
+ * Copy the valid records of the mapped cache to a new file with an index for
+ * 4 times as many and rename it over path. Processes that still have the old
+ * file open stop writing to it. The cost is that of reading the whole cache,
+ * once each time it doubles.
+ */
+static int rebuild(struct rescache *cache, const char *path)
+{
+	const struct rescache_header *header = cache->map;
+	unsigned int buckets_nb = RESCACHE_BUCKETS_MIN;
+	unsigned int i, mask;
+	uint64_t *buckets, records_nb = 0;
+	size_t pos;
+	char *tmp;
+	int fd;
+
+	while (buckets_nb < header->records_nb * 4) {
+		buckets_nb *= 2;
+	}
+	mask = buckets_nb - 1;
+
+	tmp = malloc(strlen(path) + sizeof(".tmp"));
+	sprintf(tmp, "%s.tmp", path);
+	if ((fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1) {
+		fprintf(stderr, "Warning: open \"%s\" failed: %s\n", tmp,
+			strerror(errno));
+		free(tmp);
+		return -1;
+	}
+	buckets = calloc(buckets_nb, sizeof(*buckets));
+
+	pos = records_start(buckets_nb);
+	for (i = 0; i < cache->buckets_nb; i++) {
+		const struct rescache_record *record;
+		uint64_t off = cache->buckets[i];
+		unsigned int j;
+
+		/* records appended after the mapping are left out */
+		if (!off || off < records_start(cache->buckets_nb) ||
+		    off % 8 || off >= cache->map_size ||
+		    !record_valid(record = (void *) ((char *) cache->map +
+						      off),
+				  cache->map_size - off)) {
+			continue;
+		}
+		if (pwrite(fd, record, record->size, pos) != record->size) {
+			goto err;
+		}
+		/* keys are unique in the old index */
+		j = key_hash(record->build_id, record->pc) & mask;
+		while (buckets[j]) {
+			j = (j + 1) & mask;
+		}
+		buckets[j] = pos;
+		pos += record->size;
+		records_nb++;
+	}
+
+	if (pwrite(fd, buckets, buckets_nb * sizeof(*buckets),
+		   sizeof(struct rescache_header)) !=
+	    buckets_nb * sizeof(*buckets) ||
+	    write_header(fd, buckets_nb, records_nb) != 0 ||
+	    rename(tmp, path) != 0) {
+		goto err;
+	}
+	close(fd);
+	free(buckets);
+	free(tmp);
+	return 0;
+
+err:
+	fprintf(stderr, "Warning: rebuilding the result cache failed: %s\n",
+		strerror(errno));
+	close(fd);
+	unlink(tmp);
+	free(buckets);
+	free(tmp);
+	return -1;
+}
+
+
+/* Returns NULL if the file can not be opened or is not a cache. */
+struct rescache *rescache_open(const char *path)
+{
+	const struct rescache_header *header;
+	struct rescache *cache;
+	struct stat st;
+
+	cache = calloc(1, sizeof(*cache));
+	for (;;) {
+		cache->writable = true;
+		if ((cache->fd = open(path, O_RDWR | O_CREAT, 0644)) == -1) {
+			cache->writable = false;
+			cache->fd = open(path, O_RDONLY);
+		}
+		if (cache->fd == -1) {
+			fprintf(stderr, "Error: open \"%s\" failed: %s\n",
+				path, strerror(errno));
+			free(cache);
+			return NULL;
+		}
+
+		/* writers hold the lock while appending and updating the
+		 * index */
+		flock(cache->fd, LOCK_EX);
+		fstat(cache->fd, &st);
+		if (st.st_nlink == 0) {
+			/* replaced by a rebuild while waiting for the lock */
+			flock(cache->fd, LOCK_UN);
+			close(cache->fd);
+			continue;
+		}
+		if (st.st_size == 0 && cache->writable) {
+			st.st_size = records_start(RESCACHE_BUCKETS_MIN);
+			if (write_header(cache->fd, RESCACHE_BUCKETS_MIN,
+					 0) != 0 ||
+			    ftruncate(cache->fd, st.st_size) != 0) {
+				fprintf(stderr,
+					"Error: write \"%s\" failed: %s\n",
+					path, strerror(errno));
+				goto err;
+			}
+		}
+
+		cache->map_size = st.st_size;
+		if (cache->map_size < sizeof(*header) ||
+		    (cache->map = mmap(NULL, cache->map_size, PROT_READ,
+				       MAP_SHARED, cache->fd, 0)) ==
+		    MAP_FAILED) {
+			cache->map = NULL;
+			fprintf(stderr, "Error: \"%s\" is not a result cache.\n",
+				path);
+			goto err;
+		}
+		header = cache->map;
+		if (memcmp(header->magic, RESCACHE_MAGIC,
+			   sizeof(header->magic)) != 0 ||
+		    header->version != RESCACHE_VERSION ||
+		    !header->buckets_nb ||
+		    header->buckets_nb & (header->buckets_nb - 1) ||
+		    records_start(header->buckets_nb) > cache->map_size) {
+			fprintf(stderr,
+				"Error: \"%s\" is not a result cache of this version.\n",
+				path);
+			goto err;
+		}
+		cache->buckets = (const void *) (header + 1);
+		cache->buckets_nb = header->buckets_nb;
+
+		if (cache->writable &&
+		    header->records_nb * 2 > header->buckets_nb &&
+		    rebuild(cache, path) == 0) {
+			flock(cache->fd, LOCK_UN);
+			munmap(cache->map, cache->map_size);
+			cache->map = NULL;
+			close(cache->fd);
+			continue;
+		}
+		break;
+	}
+	flock(cache->fd, LOCK_UN);
+
+	return cache;
+
+err:
+	flock(cache->fd, LOCK_UN);
+	rescache_close(cache);
+	return NULL;
+}
+
+
+static const char *record_string(const struct rescache_record *record,
+				 uint32_t offset)
+{
+	/* checked by record_valid() */
+	return offset ? (const char *) record + offset : NULL;
+}
+
+
+/* Returns -1 on miss. Strings of frame point into the cache. */
+int rescache_get(struct rescache *cache, uint64_t build_id, uint64_t pc,
+		 struct resolved_frame *frame)
+{
+	const struct rescache_record *record = NULL;
+	struct rescache_record head;
+	unsigned int bucket;
+	int i;
+
+	if (cache->table_size) {
+		record = *table_slot(cache, build_id, pc);
+	}
+	if (!record &&
+	    index_find(cache, build_id, pc, &bucket, &head) == 1) {
+		record = load_record(cache, cache->buckets[bucket], head.size);
+	}
+	if (!record) {
+		cache->misses++;
+		return -1;
+	}
+
+	*frame = (struct resolved_frame) {
+		.pc = pc,
+		.symbol = record_string(record, record->symbol),
+		.offset = record->offset,
+		.size = record->sym_size,
+		.debug_info = record->flags & RESCACHE_DEBUG_INFO,
+		.locs_nb = record->locs_nb,
+	};
+	for (i = 0; i < record->locs_nb; i++) {
+		frame->locs[i] = (struct resolved_loc) {
+			.function = record_string(record,
+						  record->locs[i].function),
+			.file = record_string(record, record->locs[i].file),
+			.line = record->locs[i].line,
+		};
+	}
+	cache->hits++;
+
+	return 0;
+}
+
+
+static uint32_t add_string(char *buf, size_t *pos, const char *string)
+{
+	uint32_t offset = *pos;
+
+	if (!string) {
+		return 0;
+	}
+	strcpy(buf + *pos, string);
+	*pos += strlen(string) + 1;
+	return offset;
+}
+
+
+/* Append record to the file and add it to the index, unless the index is
+ * 3/4 full: it is rebuilt by the next rescache_open(). */
+static void write_record(struct rescache *cache,
+			 const struct rescache_record *record)
+{
+	const struct rescache_header *header = cache->map;
+	struct rescache_record head;
+	unsigned int bucket;
+	struct stat st;
+	uint64_t off;
+	int found;
+
+	flock(cache->fd, LOCK_EX);
+	fstat(cache->fd, &st);
+	if (st.st_nlink == 0) {
+		/* another process rebuilt the cache */
+		cache->writable = false;
+		goto out;
+	}
+	if (header->records_nb * 4 >= cache->buckets_nb * 3 ||
+	    (found = index_find(cache, record->build_id, record->pc, &bucket,
+				&head)) < 0) {
+		goto out;
+	}
+
+	/* after a partial record left by a crashed writer, if any */
+	off = (st.st_size + 7) & ~7UL;
+	if (pwrite(cache->fd, record, record->size, off) != record->size ||
+	    pwrite(cache->fd, &off, sizeof(off),
+		   sizeof(*header) + bucket * sizeof(off)) != sizeof(off)) {
+		goto err;
+	}
+	if (!found) {
+		uint64_t records_nb = header->records_nb + 1;
+
+		if (pwrite(cache->fd, &records_nb, sizeof(records_nb),
+			   offsetof(struct rescache_header, records_nb)) !=
+		    sizeof(records_nb)) {
+			goto err;
+		}
+	}
+out:
+	flock(cache->fd, LOCK_UN);
+	return;
+
+err:
+	fprintf(stderr, "Warning: result cache write failed: %s\n",
+		strerror(errno));
+	cache->writable = false;
+	flock(cache->fd, LOCK_UN);
+}
+
+
+/* Add frame to the file and the index. Provisional frames are not kept: the
+ * next run may name them from the symbol table. */
+void rescache_put(struct rescache *cache, uint64_t build_id,
+		  const struct resolved_frame *frame)
+{
+	struct rescache_record *record;
+	size_t size, pos;
+	int i;
+
+	if (frame->provisional) {
+		return;
+	}
+	pos = sizeof(*record) + frame->locs_nb * sizeof(record->locs[0]);
+	size = pos + (frame->symbol ? strlen(frame->symbol) + 1 : 0);
+	for (i = 0; i < frame->locs_nb; i++) {
+		const struct resolved_loc *loc = &frame->locs[i];
+
+		size += (loc->function ? strlen(loc->function) + 1 : 0) +
+			(loc->file ? strlen(loc->file) + 1 : 0);
+	}
+	size = (size + 7) & ~7UL;
+
+	record = calloc(1, size);
+	*record = (struct rescache_record) {
+		.size = size,
+		.build_id = build_id,
+		.pc = frame->pc,
+		.offset = frame->offset,
+		.sym_size = frame->size,
+		.flags = frame->debug_info ? RESCACHE_DEBUG_INFO : 0,
+		.locs_nb = frame->locs_nb,
+	};
+	record->symbol = add_string((char *) record, &pos, frame->symbol);
+	for (i = 0; i < frame->locs_nb; i++) {
+		const struct resolved_loc *loc = &frame->locs[i];
+
+		record->locs[i] = (struct rescache_loc) {
+			.function = add_string((char *) record, &pos,
+					       loc->function),
+			.file = add_string((char *) record, &pos, loc->file),
+			.line = loc->line,
+		};
+	}
+	record->checksum = record_checksum(record);
+
+	if (cache->writable && size <= RESCACHE_RECORD_MAX) {
+		write_record(cache, record);
+	}
+	table_insert(cache, record);
+}
+
+
+void rescache_close(struct rescache *cache)
+{
+	int i;
+
+	for (i = 0; i < cache->added_nb; i++) {
+		free(cache->added[i]);
+	}
+	free(cache->added);
+	free(cache->table);
+	if (cache->map) {
+		munmap(cache->map, cache->map_size);
+	}
+	close(cache->fd);
+	free(cache);
+}
@@ -0,0 +1,86 @@
+#ifndef _RESCACHE_H
+#define _RESCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct resolved_frame;
+
+/*
+ * Persistent cache of resolved frames keyed by (build-id, pc), shared by the
+ * runs of core_walk on the same machine.
+ *
+ * The file is a header, an open addressing index of the records by
+ * (build-id, pc) and the records, appended by any number of processes under
+ * an exclusive flock(). It is mapped read-only when opened: a lookup probes
+ * the index and returns pointers into the mapping, without reading the rest
+ * of the file. An index more than half full is rebuilt twice as large when
+ * the cache is opened.
+ */
+
+#define RESCACHE_MAGIC "CWRCACHE"
+#define RESCACHE_VERSION 2
+
+struct rescache_header {
+	char magic[8];
+	uint32_t version;
+	/* a power of 2 */
+	uint32_t buckets_nb;
+	uint64_t records_nb;
+	/* followed by uint64_t buckets[buckets_nb], the file offsets of the
+	 * records, 0 for an empty bucket */
+};
+
+/* string fields are offsets from the start of the record, 0 for NULL */
+struct rescache_loc {
+	uint32_t function;
+	uint32_t file;
+	uint32_t line;
+};
+
+struct rescache_record {
+	/* of the record and its strings, a multiple of 8 */
+	uint32_t size;
+	/* FNV-1a of the record, with this field set to 0 */
+	uint32_t checksum;
+	/* FNV-1a of the build-id */
+	uint64_t build_id;
+	uint64_t pc;
+	uint64_t offset;
+	uint64_t sym_size;
+	uint32_t symbol;
+	uint16_t flags;
+	uint16_t locs_nb;
+	struct rescache_loc locs[];
+};
+
+#define RESCACHE_DEBUG_INFO 0x1
+
+struct rescache {
+	int fd;
+	bool writable;
+	void *map;
+	size_t map_size;
+	/* in the mapping */
+	const uint64_t *buckets;
+	unsigned int buckets_nb;
+	/* records added by this process or read past the mapping, indexed
+	 * in memory */
+	struct rescache_record **added;
+	unsigned int added_nb;
+	const struct rescache_record **table;
+	unsigned int table_size;
+	/* statistics */
+	unsigned long hits;
+	unsigned long misses;
+};
+
+uint64_t rescache_build_id(const unsigned char *id, size_t len);
+struct rescache *rescache_open(const char *path);
+int rescache_get(struct rescache *cache, uint64_t build_id, uint64_t pc,
+		 struct resolved_frame *frame);
+void rescache_put(struct rescache *cache, uint64_t build_id,
+		  const struct resolved_frame *frame);
+void rescache_close(struct rescache *cache);
+
+#endif
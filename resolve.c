@@ -0,0 +1,897 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdwarf/libdwarf.h>
+#include <libdwarf/dwarf.h>
+
+#include "core_walk.h"
+#include "emit.h"
+#include "image.h"
+#include "resolve.h"
+#include "strpool.h"
+#include "util.h"
+
+
+/* DWARF 5 range list, value is a DW_FORM_rnglistx index or an offset in
+ * .debug_rnglists. libdwarf reads the unit's DW_AT_rnglists_base and
+ * DW_AT_addr_base once and applies the base address entries, the cooked
+ * bounds are final addresses. */
+static bool rnglist_foreach(Dwarf_Attribute attr, Dwarf_Half form,
+			    Dwarf_Unsigned value, die_range_fn *fn, void *arg)
+{
+	Dwarf_Rnglists_Head head;
+	Dwarf_Unsigned count, offset, i;
+	bool found = false;
+
+	if (dwarf_rnglists_get_rle_head(attr, form, value, &head, &count,
+					&offset, NULL) != DW_DLV_OK) {
+		return false;
+	}
+	for (i = 0; i < count && !found; i++) {
+		Dwarf_Unsigned raw1, raw2, lo, hi;
+		unsigned int len, code;
+		Dwarf_Bool unavailable;
+
+		if (dwarf_get_rnglists_entry_fields_a(head, i, &len, &code,
+						      &raw1, &raw2,
+						      &unavailable, &lo, &hi,
+						      NULL) != DW_DLV_OK) {
+			break;
+		}
+		switch (code) {
+		case DW_RLE_offset_pair:
+		case DW_RLE_startx_endx:
+		case DW_RLE_startx_length:
+		case DW_RLE_start_end:
+		case DW_RLE_start_length:
+			found = !unavailable && fn(arg, lo, hi);
+			break;
+		}
+	}
+	dwarf_dealloc_rnglists_head(head);
+
+	return found;
+}
+
+
+/* Call fn on the [lo, hi[ ranges of die, its low_pc/high_pc or its
+ * DW_AT_ranges, until it returns true. cu_base is the base address of DWARF 4
+ * range lists. Returns true if fn did. */
+bool die_foreach_range(Dwarf_Debug dwarf, Dwarf_Die die, Dwarf_Addr cu_base,
+		       die_range_fn *fn, void *arg)
+{
+	Dwarf_Addr low_pc, high_pc, base = cu_base;
+	Dwarf_Half form, version, offset_size;
+	Dwarf_Attribute attr;
+	Dwarf_Ranges *ranges;
+	Dwarf_Signed count;
+	Dwarf_Off offset;
+	bool found = false;
+	int i;
+
+	if (find_pc_range(die, &low_pc, &high_pc) == 0) {
+		return fn(arg, low_pc, high_pc);
+	}
+
+	if (dwarf_attr(die, DW_AT_ranges, &attr, NULL) != DW_DLV_OK) {
+		return false;
+	}
+	if (dwarf_global_formref(attr, &offset, NULL) != DW_DLV_OK) {
+		Dwarf_Unsigned udata;
+
+		if (dwarf_formudata(attr, &udata, NULL) != DW_DLV_OK) {
+			dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+			return false;
+		}
+		offset = udata;
+	}
+	dwarf_whatform(attr, &form, NULL);
+	if (form == DW_FORM_rnglistx ||
+	    (dwarf_get_version_of_die(die, &version, &offset_size) ==
+	     DW_DLV_OK && version >= 5)) {
+		found = rnglist_foreach(attr, form, offset, fn, arg);
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		return found;
+	}
+	dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+
+	if (dwarf_get_ranges(dwarf, offset, &ranges, &count, NULL, NULL) !=
+	    DW_DLV_OK) {
+		return false;
+	}
+	for (i = 0; i < count && !found; i++) {
+		switch (ranges[i].dwr_type) {
+		case DW_RANGES_ENTRY:
+			found = fn(arg, base + ranges[i].dwr_addr1,
+				   base + ranges[i].dwr_addr2);
+			break;
+
+		case DW_RANGES_ADDRESS_SELECTION:
+			base = ranges[i].dwr_addr2;
+			break;
+
+		case DW_RANGES_END:
+			i = count;
+			break;
+		}
+	}
+	dwarf_ranges_dealloc(dwarf, ranges, count);
+
+	return found;
+}
+
+
+static bool range_has_pc(void *arg, Dwarf_Addr lo, Dwarf_Addr hi)
+{
+	Dwarf_Addr pc = *(const Dwarf_Addr *) arg;
+
+	return lo <= pc && pc < hi;
+}
+
+
+/* Check low_pc/high_pc, or DW_AT_ranges, of die against pc */
+bool die_has_pc(Dwarf_Debug dwarf, Dwarf_Die die, Dwarf_Addr cu_base,
+		Dwarf_Addr pc)
+{
+	return die_foreach_range(dwarf, die, cu_base, range_has_pc, &pc);
+}
+
+
+/* Find the lexical block or inlined subroutine child of scope covering pc.
+ * result must be free'ed using dwarf_dealloc(dwarf, result, DW_DLA_DIE) */
+static int find_inner_scope(Dwarf_Debug dwarf, Dwarf_Die scope,
+			    Dwarf_Addr cu_base, Dwarf_Addr pc,
+			    Dwarf_Die *result)
+{
+	Dwarf_Die child, sibling;
+	int retval;
+
+	foreach_child(dwarf, scope, child, sibling, retval) {
+		Dwarf_Half tag;
+
+		dwarf_tag(child, &tag, NULL);
+		if ((tag == DW_TAG_lexical_block ||
+		     tag == DW_TAG_inlined_subroutine) &&
+		    die_has_pc(dwarf, child, cu_base, pc)) {
+			*result = child;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+
+/* DW_AT_linkage_name of die, or its pre-DWARF 4 spelling */
+static const char *die_linkage_name(Dwarf_Debug dwarf, Dwarf_Die die)
+{
+	static const Dwarf_Half attrs[] = {
+		DW_AT_linkage_name,
+		DW_AT_MIPS_linkage_name,
+	};
+	Dwarf_Attribute attr;
+	char *name;
+	int i, retval;
+
+	for (i = 0; i < ARRAY_SIZE(attrs); i++) {
+		if (dwarf_attr(die, attrs[i], &attr, NULL) != DW_DLV_OK) {
+			continue;
+		}
+		retval = dwarf_formstring(attr, &name, NULL);
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		if (retval == DW_DLV_OK) {
+			return name;
+		}
+	}
+	return NULL;
+}
+
+
+/* Name of a subprogram or inlined subroutine, following the abstract
+ * origin and specification of concrete instances. With linkage, the linkage
+ * name is looked for instead of DW_AT_name. */
+static const char *function_name(Dwarf_Debug dwarf, Dwarf_Die die,
+				 bool linkage, struct strpool *pool)
+{
+	static const Dwarf_Half refs[] = {
+		DW_AT_abstract_origin,
+		DW_AT_specification,
+	};
+	const char *result = NULL;
+	Dwarf_Die origin = NULL;
+	int depth, i;
+	char *name;
+
+	for (depth = 0; depth < 4 && !result; depth++) {
+		Dwarf_Die cur = origin ? origin : die;
+		Dwarf_Die next = NULL;
+
+		if (linkage) {
+			if ((result = die_linkage_name(dwarf, cur)) != NULL) {
+				result = strpool_add(pool, result);
+				break;
+			}
+		} else if (dwarf_diename(cur, &name, NULL) == DW_DLV_OK) {
+			result = strpool_add(pool, name);
+			dwarf_dealloc(dwarf, name, DW_DLA_STRING);
+			break;
+		}
+		for (i = 0; i < ARRAY_SIZE(refs) && !next; i++) {
+			Dwarf_Attribute attr;
+			Dwarf_Off offset;
+
+			if (dwarf_attr(cur, refs[i], &attr, NULL) != DW_DLV_OK) {
+				continue;
+			}
+			if (dwarf_global_formref(attr, &offset, NULL) ==
+			    DW_DLV_OK) {
+				dwarf_offdie(dwarf, offset, &next, NULL);
+			}
+			dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		}
+		if (origin) {
+			dwarf_dealloc(dwarf, origin, DW_DLA_DIE);
+		}
+		if (!(origin = next)) {
+			break;
+		}
+	}
+	if (origin) {
+		dwarf_dealloc(dwarf, origin, DW_DLA_DIE);
+	}
+
+	return result;
+}
+
+
+/* file relative to comp_dir when under it */
+const char *strip_comp_dir(const char *file, const char *comp_dir)
+{
+	size_t len;
+
+	if (!comp_dir) {
+		return file;
+	}
+	len = strlen(comp_dir);
+	if (strncmp(file, comp_dir, len) == 0) {
+		file += len;
+		if (*file == '/') {
+			file++;
+		}
+	}
+	return file;
+}
+
+
+/* File names of the line program of a CU, loaded on first use */
+struct src_files {
+	bool loaded;
+	char **names;
+	Dwarf_Signed nr;
+	char *comp_dir;
+};
+
+
+static void src_files_load(Dwarf_Debug dwarf, Dwarf_Die cu_die,
+			   struct src_files *files)
+{
+	Dwarf_Attribute attr;
+
+	if (files->loaded) {
+		return;
+	}
+	dwarf_srcfiles(cu_die, &files->names, &files->nr, NULL);
+	if (dwarf_attr(cu_die, DW_AT_comp_dir, &attr, NULL) == DW_DLV_OK) {
+		dwarf_formstring(attr, &files->comp_dir, NULL);
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+	}
+	files->loaded = true;
+}
+
+
+static void src_files_free(Dwarf_Debug dwarf, struct src_files *files)
+{
+	int i;
+
+	for (i = 0; i < files->nr; i++) {
+		dwarf_dealloc(dwarf, files->names[i], DW_DLA_STRING);
+	}
+	if (files->names) {
+		dwarf_dealloc(dwarf, files->names, DW_DLA_LIST);
+	}
+	*files = (struct src_files) {};
+}
+
+
+/* Set loc to the call site of an inlined subroutine */
+static void get_call_site(Dwarf_Debug dwarf, Dwarf_Die inlined,
+			  const struct src_files *files, struct strpool *pool,
+			  struct resolved_loc *loc)
+{
+	Dwarf_Attribute attr;
+	Dwarf_Unsigned value;
+
+	if (dwarf_attr(inlined, DW_AT_call_file, &attr, NULL) == DW_DLV_OK) {
+		/* 1-based index in the file names of the line program */
+		if (dwarf_formudata(attr, &value, NULL) == DW_DLV_OK &&
+		    value >= 1 && value <= files->nr) {
+			loc->file = strpool_add(pool, strip_comp_dir(
+					files->names[value - 1],
+					files->comp_dir));
+		}
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+	}
+	if (dwarf_attr(inlined, DW_AT_call_line, &attr, NULL) == DW_DLV_OK) {
+		if (dwarf_formudata(attr, &value, NULL) == DW_DLV_OK) {
+			loc->line = value;
+		}
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+	}
+}
+
+
+/* Fill in the locations of frame from the subprogram and the inlined
+ * subroutines containing pc. The line of locs[0] is already set. */
+static void resolve_inlines(Dwarf_Debug dwarf, Dwarf_Die cu_die,
+			    Dwarf_Addr cu_base, Dwarf_Die sp_die,
+			    Dwarf_Addr pc, struct src_files *files,
+			    struct strpool *pool, struct resolved_frame *frame)
+{
+	/* outermost first */
+	Dwarf_Die chain[INLINE_DEPTH_MAX];
+	unsigned int chain_nb = 1, i;
+	Dwarf_Die scope = sp_die, inner;
+	bool scope_kept = true;
+
+	chain[0] = sp_die;
+	while (find_inner_scope(dwarf, scope, cu_base, pc, &inner) == 0) {
+		Dwarf_Half tag;
+
+		if (!scope_kept) {
+			dwarf_dealloc(dwarf, scope, DW_DLA_DIE);
+		}
+		scope = inner;
+		dwarf_tag(inner, &tag, NULL);
+		if (tag == DW_TAG_inlined_subroutine) {
+			if (chain_nb == INLINE_DEPTH_MAX) {
+				/* keep the innermost levels */
+				dwarf_dealloc(dwarf, chain[1], DW_DLA_DIE);
+				memmove(&chain[1], &chain[2],
+					(chain_nb - 2) * sizeof(*chain));
+				chain_nb--;
+			}
+			chain[chain_nb++] = inner;
+			scope_kept = true;
+		} else {
+			scope_kept = false;
+		}
+	}
+	if (!scope_kept) {
+		dwarf_dealloc(dwarf, scope, DW_DLA_DIE);
+	}
+
+	if (chain_nb > 1) {
+		src_files_load(dwarf, cu_die, files);
+	}
+	frame->locs_nb = chain_nb;
+	for (i = 0; i < chain_nb; i++) {
+		Dwarf_Die die = chain[chain_nb - 1 - i];
+		struct resolved_loc *loc = &frame->locs[i];
+
+		loc->function = function_name(dwarf, die, false, pool);
+		if (!loc->function) {
+			loc->function = frame->symbol ? frame->symbol : "??";
+		}
+		if (i > 0) {
+			get_call_site(dwarf, chain[chain_nb - i], files, pool,
+				      loc);
+		}
+	}
+
+	for (i = 1; i < chain_nb; i++) {
+		dwarf_dealloc(dwarf, chain[i], DW_DLA_DIE);
+	}
+}
+
+
+/* Symbol of pc, and the frame without debugging information */
+static int resolve_symbol(struct image *image, uint64_t pc,
+			  struct strpool *pool, struct resolved_frame *frame)
+{
+	Dwarf_Unsigned offset, size;
+	char name[256];
+
+	if (find_symbol_by_pc(image, pc, name, sizeof(name), &offset,
+			      &size) == -1) {
+		return -1;
+	}
+	frame->symbol = strpool_add(pool, name);
+	frame->offset = offset;
+	frame->size = size;
+	frame->locs[0].function = frame->symbol;
+	frame->locs_nb = 1;
+	return 0;
+}
+
+
+struct pc_range {
+	Dwarf_Addr pc;
+	Dwarf_Addr lo;
+	Dwarf_Addr hi;
+};
+
+
+static bool range_of_pc(void *arg, Dwarf_Addr lo, Dwarf_Addr hi)
+{
+	struct pc_range *range = arg;
+
+	if (lo <= range->pc && range->pc < hi) {
+		range->lo = lo;
+		range->hi = hi;
+		return true;
+	}
+	return false;
+}
+
+
+/* Symbol of pc from the subprogram containing it, for when the symbol table
+ * is not loaded yet: its linkage name, which is the symbol's, or else its
+ * name, and the range of the subprogram holding pc. Suffixes of the symbol
+ * table such as ".isra.0" are missing, the frame is provisional. */
+static int subprogram_symbol(Dwarf_Debug dwarf, Dwarf_Die sp_die,
+			     Dwarf_Addr cu_base, uint64_t pc,
+			     struct strpool *pool,
+			     struct resolved_frame *frame)
+{
+	struct pc_range range = {
+		.pc = pc,
+	};
+	const char *name;
+
+	if (!die_foreach_range(dwarf, sp_die, cu_base, range_of_pc, &range) ||
+	    ((name = function_name(dwarf, sp_die, true, pool)) == NULL &&
+	     (name = function_name(dwarf, sp_die, false, pool)) == NULL)) {
+		return -1;
+	}
+	frame->symbol = name;
+	frame->offset = pc - range.lo;
+	frame->size = range.hi - range.lo;
+	frame->provisional = true;
+	return 0;
+}
+
+
+/*
+ * Resolve a code address to its symbol, source position and inline chain.
+ * Strings are allocated from pool. Returns -1 if nothing is known about pc.
+ *
+ * While the symbol table is being built in the background, the symbol is
+ * taken from the subprogram rather than waiting, unless pc has no
+ * subprogram DIE: early frames are answered from the DWARF alone.
+ */
+int resolve_pc(struct image *image, uint64_t pc, struct strpool *pool,
+	       struct resolved_frame *frame)
+{
+	Dwarf_Debug dwarf = image->dwarf, unit_dwarf = dwarf;
+	struct src_files files = {};
+	Dwarf_Die cu_die, unit_die, split_die = NULL, sp_die = NULL;
+	Dwarf_Addr cu_base = 0;
+	unsigned int line;
+	bool deferred;
+	char *file;
+
+	*frame = (struct resolved_frame) {
+		.pc = pc,
+	};
+	deferred = !image_symtab_ready(image);
+	if (image_find_cu(image, pc, &cu_die) == -1) {
+		resolve_symbol(image, pc, pool, frame);
+		return frame->locs_nb ? 0 : -1;
+	}
+	/* with split DWARF, lines are in the skeleton and DIEs in the split
+	 * unit */
+	unit_die = cu_die;
+	if (image_split_cu(image, cu_die, &unit_dwarf, &split_die) == 0) {
+		unit_die = split_die;
+	}
+
+	if (find_subprogram_by_pc(unit_dwarf, unit_die, pc, &sp_die) == -1) {
+		sp_die = NULL;
+	}
+	dwarf_lowpc(cu_die, &cu_base, NULL);
+	if (!deferred || !sp_die ||
+	    subprogram_symbol(unit_dwarf, sp_die, cu_base, pc, pool,
+			      frame) == -1) {
+		resolve_symbol(image, pc, pool, frame);
+	}
+	frame->debug_info = true;
+	frame->locs[0].function = frame->symbol ? frame->symbol : "??";
+	frame->locs_nb = 1;
+
+	if (find_lineno_by_pc(dwarf, cu_die, pc, &file, &line) == 0) {
+		frame->locs[0].file = strpool_add(pool, file);
+		frame->locs[0].line = line;
+	}
+	if (sp_die) {
+		resolve_inlines(unit_dwarf, unit_die, cu_base, sp_die, pc,
+				&files, pool, frame);
+		src_files_free(unit_dwarf, &files);
+		dwarf_dealloc(unit_dwarf, sp_die, DW_DLA_DIE);
+	}
+	if (split_die) {
+		dwarf_dealloc(unit_dwarf, split_die, DW_DLA_DIE);
+	}
+	dwarf_dealloc(dwarf, cu_die, DW_DLA_DIE);
+
+	return 0;
+}
+
+
+/* resolve_pc() for a return address, as the pcs of all the frames but the
+ * innermost one are: the call is the instruction before pc, which is the
+ * last one of its function if the callee does not return. frame keeps pc
+ * and its offset in the symbol. */
+int resolve_return_pc(struct image *image, uint64_t pc, struct strpool *pool,
+		      struct resolved_frame *frame)
+{
+	int retval = resolve_pc(image, pc - 1, pool, frame);
+
+	frame->pc = pc;
+	if (frame->symbol) {
+		frame->offset++;
+	}
+	return retval;
+}
+
+
+struct line_row {
+	Dwarf_Addr addr;
+	unsigned int line;
+	bool end_sequence;
+	Dwarf_Unsigned fileno;
+	Dwarf_Line handle;
+};
+
+struct sp_entry {
+	Dwarf_Addr lo;
+	Dwarf_Addr hi;
+	Dwarf_Off offset;
+};
+
+/* the tables of the CU being swept */
+struct cu_sweep {
+	Dwarf_Off offset;
+	Dwarf_Die cu_die;
+	Dwarf_Addr cu_base;
+	/* where the DIEs are: the CU itself, or its split unit */
+	Dwarf_Debug unit_dwarf;
+	Dwarf_Die unit_die;
+	Dwarf_Die split_die;
+	Dwarf_Line *lines;
+	Dwarf_Signed lines_nb;
+	struct line_row *rows;
+	unsigned long rows_nb;
+	unsigned long row;
+	struct sp_entry *sps;
+	unsigned long sps_nb;
+	unsigned long sp;
+	/* subprograms with DW_AT_ranges, ex. with a .cold part, checked when
+	 * no contiguous one covers the pc */
+	Dwarf_Die *ranged;
+	unsigned long ranged_nb;
+	/* the subprogram at sp, if loaded */
+	Dwarf_Die sp_die;
+	Dwarf_Off sp_offset;
+	/* interned line table file names, by file number */
+	const char **names;
+	Dwarf_Unsigned names_nb;
+	struct src_files files;
+};
+
+
+/* by address, end of sequence markers first so that the last row at or
+ * below an address belongs to the sequence covering it */
+static int line_row_cmp(const void *a, const void *b)
+{
+	const struct line_row *ra = a, *rb = b;
+
+	if (ra->addr != rb->addr) {
+		return ra->addr < rb->addr ? -1 : 1;
+	}
+	return rb->end_sequence - ra->end_sequence;
+}
+
+
+static int sp_entry_cmp(const void *a, const void *b)
+{
+	const struct sp_entry *ea = a, *eb = b;
+
+	return ea->lo < eb->lo ? -1 : ea->lo > eb->lo;
+}
+
+
+static void cu_sweep_load(struct image *image, Dwarf_Off offset,
+			  struct cu_sweep *cu)
+{
+	Dwarf_Debug dwarf = image->dwarf;
+	Dwarf_Die child, sibling;
+	unsigned long sps_alloc = 0, ranged_alloc = 0;
+	int retval, i;
+
+	*cu = (struct cu_sweep) {
+		.offset = offset,
+	};
+	if (dwarf_offdie(dwarf, offset, &cu->cu_die, NULL) != DW_DLV_OK) {
+		cu->cu_die = NULL;
+		return;
+	}
+	dwarf_lowpc(cu->cu_die, &cu->cu_base, NULL);
+	cu->unit_dwarf = dwarf;
+	cu->unit_die = cu->cu_die;
+	if (image_split_cu(image, cu->cu_die, &cu->unit_dwarf,
+			   &cu->split_die) == 0) {
+		cu->unit_die = cu->split_die;
+	} else {
+		cu->split_die = NULL;
+	}
+
+	if (dwarf_srclines(cu->cu_die, &cu->lines, &cu->lines_nb, NULL) ==
+	    DW_DLV_OK) {
+		cu->rows = malloc(cu->lines_nb * sizeof(*cu->rows));
+		for (i = 0; i < cu->lines_nb; i++) {
+			struct line_row *row = &cu->rows[i];
+			Dwarf_Unsigned lineno = 0;
+			Dwarf_Bool end = false;
+
+			dwarf_lineaddr(cu->lines[i], &row->addr, NULL);
+			dwarf_lineno(cu->lines[i], &lineno, NULL);
+			dwarf_lineendsequence(cu->lines[i], &end, NULL);
+			row->fileno = 0;
+			dwarf_line_srcfileno(cu->lines[i], &row->fileno, NULL);
+			row->line = lineno;
+			row->end_sequence = end;
+			row->handle = cu->lines[i];
+			if (row->fileno >= cu->names_nb) {
+				cu->names_nb = row->fileno + 1;
+			}
+		}
+		cu->rows_nb = cu->lines_nb;
+		qsort(cu->rows, cu->rows_nb, sizeof(*cu->rows), line_row_cmp);
+		cu->names = calloc(cu->names_nb, sizeof(*cu->names));
+	} else {
+		cu->lines = NULL;
+		cu->lines_nb = 0;
+	}
+
+	foreach_child(cu->unit_dwarf, cu->unit_die, child, sibling, retval) {
+		Dwarf_Addr lo, hi;
+		Dwarf_Bool ranges;
+		Dwarf_Off die_offset;
+		Dwarf_Half tag;
+
+		dwarf_tag(child, &tag, NULL);
+		if (tag != DW_TAG_subprogram) {
+			continue;
+		}
+		if (find_pc_range(child, &lo, &hi) == -1) {
+			if (dwarf_hasattr(child, DW_AT_ranges, &ranges, NULL) !=
+			    DW_DLV_OK || !ranges) {
+				continue;
+			}
+			if (cu->ranged_nb == ranged_alloc) {
+				ranged_alloc = ranged_alloc ?
+					ranged_alloc * 2 : 8;
+				cu->ranged = realloc(cu->ranged, ranged_alloc *
+						     sizeof(*cu->ranged));
+			}
+			dwarf_dieoffset(child, &die_offset, NULL);
+			if (dwarf_offdie(cu->unit_dwarf, die_offset,
+					 &cu->ranged[cu->ranged_nb], NULL) ==
+			    DW_DLV_OK) {
+				cu->ranged_nb++;
+			}
+			continue;
+		}
+		if (cu->sps_nb == sps_alloc) {
+			sps_alloc = sps_alloc ? sps_alloc * 2 : 64;
+			cu->sps = realloc(cu->sps, sps_alloc *
+					  sizeof(*cu->sps));
+		}
+		cu->sps[cu->sps_nb] = (struct sp_entry) {
+			.lo = lo,
+			.hi = hi,
+		};
+		dwarf_dieoffset(child, &cu->sps[cu->sps_nb].offset, NULL);
+		cu->sps_nb++;
+	}
+	qsort(cu->sps, cu->sps_nb, sizeof(*cu->sps), sp_entry_cmp);
+}
+
+
+static void cu_sweep_free(Dwarf_Debug dwarf, struct cu_sweep *cu)
+{
+	Dwarf_Debug unit_dwarf = cu->split_die ? cu->unit_dwarf : dwarf;
+	unsigned long i;
+
+	if (cu->sp_die) {
+		dwarf_dealloc(unit_dwarf, cu->sp_die, DW_DLA_DIE);
+	}
+	for (i = 0; i < cu->ranged_nb; i++) {
+		dwarf_dealloc(unit_dwarf, cu->ranged[i], DW_DLA_DIE);
+	}
+	if (cu->lines) {
+		dwarf_srclines_dealloc(dwarf, cu->lines, cu->lines_nb);
+	}
+	if (cu->split_die) {
+		dwarf_dealloc(unit_dwarf, cu->split_die, DW_DLA_DIE);
+	}
+	if (cu->cu_die) {
+		dwarf_dealloc(dwarf, cu->cu_die, DW_DLA_DIE);
+	}
+	src_files_free(unit_dwarf, &cu->files);
+	free(cu->rows);
+	free(cu->sps);
+	free(cu->ranged);
+	free(cu->names);
+	*cu = (struct cu_sweep) {};
+}
+
+
+/* Line of pc, rows are swept forward as pcs increase */
+static void sweep_line(Dwarf_Debug dwarf, struct cu_sweep *cu, Dwarf_Addr pc,
+		       struct strpool *pool, struct resolved_loc *loc)
+{
+	const struct line_row *row;
+
+	while (cu->row + 1 < cu->rows_nb && cu->rows[cu->row + 1].addr <= pc) {
+		cu->row++;
+	}
+	if (cu->row >= cu->rows_nb) {
+		return;
+	}
+	row = &cu->rows[cu->row];
+	if (row->addr > pc || row->end_sequence) {
+		return;
+	}
+
+	if (!cu->names[row->fileno]) {
+		char *file;
+
+		if (dwarf_linesrc(row->handle, &file, NULL) != DW_DLV_OK) {
+			return;
+		}
+		/* shared with resolve_inlines(), which needs the file table
+		 * of the unit holding the DIEs */
+		src_files_load(cu->unit_dwarf, cu->unit_die, &cu->files);
+		cu->names[row->fileno] = strpool_add(
+			pool, strip_comp_dir(file, cu->files.comp_dir));
+		dwarf_dealloc(dwarf, file, DW_DLA_STRING);
+	}
+	loc->file = cu->names[row->fileno];
+	loc->line = row->line;
+}
+
+
+/* Subprogram containing pc, NULL if none */
+static Dwarf_Die sweep_subprogram(struct cu_sweep *cu, Dwarf_Addr pc)
+{
+	Dwarf_Debug dwarf = cu->unit_dwarf;
+	const struct sp_entry *sp;
+	unsigned long i;
+
+	while (cu->sp < cu->sps_nb && cu->sps[cu->sp].hi <= pc) {
+		cu->sp++;
+	}
+	if (cu->sp == cu->sps_nb || cu->sps[cu->sp].lo > pc) {
+		for (i = 0; i < cu->ranged_nb; i++) {
+			if (die_has_pc(dwarf, cu->ranged[i], cu->cu_base,
+				       pc)) {
+				return cu->ranged[i];
+			}
+		}
+		return NULL;
+	}
+	sp = &cu->sps[cu->sp];
+
+	if (!cu->sp_die || cu->sp_offset != sp->offset) {
+		if (cu->sp_die) {
+			dwarf_dealloc(dwarf, cu->sp_die, DW_DLA_DIE);
+			cu->sp_die = NULL;
+		}
+		if (dwarf_offdie(dwarf, sp->offset, &cu->sp_die, NULL) !=
+		    DW_DLV_OK) {
+			cu->sp_die = NULL;
+			return NULL;
+		}
+		cu->sp_offset = sp->offset;
+	}
+	return cu->sp_die;
+}
+
+
+/*
+ * Resolve pcs, sorted and without duplicates, to frames. The aranges, line
+ * rows and subprograms of each CU are swept once in address order instead of
+ * being searched for each pc. Returns the number of pcs resolved.
+ */
+unsigned long resolve_sorted_pcs(struct image *image, const uint64_t *pcs,
+				 unsigned long nr, struct strpool *pool,
+				 struct resolved_frame *frames)
+{
+	Dwarf_Debug dwarf = image->dwarf;
+	struct cu_index *index = image_cu_index(image);
+	const struct cu_range *ranges = index->ranges;
+	struct cu_sweep cu = {};
+	unsigned long i, r = 0, resolved = 0;
+
+	for (i = 0; i < nr; i++) {
+		struct resolved_frame *frame = &frames[i];
+		Dwarf_Addr pc = pcs[i];
+		bool symbol;
+		Dwarf_Die sp_die;
+
+		*frame = (struct resolved_frame) {
+			.pc = pc,
+		};
+		symbol = resolve_symbol(image, pc, pool, frame) == 0;
+		while (r < index->nr && ranges[r].hi <= pc) {
+			r++;
+		}
+		if (r == index->nr || ranges[r].lo > pc) {
+			resolved += symbol;
+			continue;
+		}
+
+		if (!cu.cu_die || cu.offset != ranges[r].cu_offset) {
+			cu_sweep_free(dwarf, &cu);
+			cu_sweep_load(image, ranges[r].cu_offset, &cu);
+			if (!cu.cu_die) {
+				resolved += symbol;
+				continue;
+			}
+		}
+		frame->debug_info = true;
+		frame->locs[0].function = frame->symbol ? frame->symbol : "??";
+		frame->locs_nb = 1;
+
+		sweep_line(dwarf, &cu, pc, pool, &frame->locs[0]);
+		if ((sp_die = sweep_subprogram(&cu, pc)) != NULL) {
+			resolve_inlines(cu.unit_dwarf, cu.unit_die, cu.cu_base,
+					sp_die, pc, &cu.files, pool, frame);
+		}
+		resolved++;
+	}
+
+	cu_sweep_free(dwarf, &cu);
+
+	return resolved;
+}
+
+
+/*
+ * "0xADDR: symbol+0x1d/0x20 (file.c:137)", followed by one line per
+ * function, innermost first, when the address is in inlined code.
+ */
+void resolved_frame_print(FILE *stream, const struct resolved_frame *frame,
+			  int addr_size)
+{
+	struct emitter em;
+
+	emitter_init_stream(&em, stream, EMIT_TEXT, addr_size);
+	emit_frame(&em, frame, false);
+}
+
+
+/* Same as resolved_frame_print() on a single line, the inline chain being
+ * "inner (file:line) < caller (file:line) < ..." */
+void resolved_frame_print_line(FILE *stream,
+			       const struct resolved_frame *frame,
+			       int addr_size)
+{
+	struct emitter em;
+
+	emitter_init_stream(&em, stream, EMIT_TEXT, addr_size);
+	emit_frame(&em, frame, true);
+}
@@ -0,0 +1,67 @@
+#ifndef _RESOLVE_H
+#define _RESOLVE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <libdwarf/libdwarf.h>
+
+#include "strpool.h"
+
+struct image;
+
+/* deeper inline chains are cut at the outermost levels */
+#define INLINE_DEPTH_MAX 8
+
+/* a function and the source position reached in it */
+struct resolved_loc {
+	const char *function;
+	/* NULL if unknown */
+	const char *file;
+	unsigned int line;
+};
+
+/*
+ * What a code address stands for: the symbol containing it and the chain of
+ * functions inlined at that point.
+ */
+struct resolved_frame {
+	uint64_t pc;
+	/* NULL if no symbol contains pc */
+	const char *symbol;
+	uint64_t offset;
+	uint64_t size;
+	/* false if pc is only known from the symbol table */
+	bool debug_info;
+	/* symbol named from the DWARF before the symbol table was loaded */
+	bool provisional;
+	/* innermost first: locs[0] is where pc is, locs[i + 1] is the call
+	 * site of locs[i] in its caller, locs[locs_nb - 1] is in the
+	 * subprogram of the symbol */
+	struct resolved_loc locs[INLINE_DEPTH_MAX];
+	unsigned int locs_nb;
+};
+
+int resolve_pc(struct image *image, uint64_t pc, struct strpool *pool,
+	       struct resolved_frame *frame);
+int resolve_return_pc(struct image *image, uint64_t pc, struct strpool *pool,
+		      struct resolved_frame *frame);
+unsigned long resolve_sorted_pcs(struct image *image, const uint64_t *pcs,
+				 unsigned long nr, struct strpool *pool,
+				 struct resolved_frame *frames);
+/* called on each address range of a DIE, returns true to stop the walk */
+typedef bool die_range_fn(void *arg, Dwarf_Addr lo, Dwarf_Addr hi);
+
+bool die_foreach_range(Dwarf_Debug dwarf, Dwarf_Die die, Dwarf_Addr cu_base,
+		       die_range_fn *fn, void *arg);
+bool die_has_pc(Dwarf_Debug dwarf, Dwarf_Die die, Dwarf_Addr cu_base,
+		Dwarf_Addr pc);
+const char *strip_comp_dir(const char *file, const char *comp_dir);
+void resolved_frame_print(FILE *stream, const struct resolved_frame *frame,
+			  int addr_size);
+void resolved_frame_print_line(FILE *stream,
+			       const struct resolved_frame *frame,
+			       int addr_size);
+
+#endif
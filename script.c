@@ -0,0 +1,450 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arch.h"
+#include "core_walk.h"
+#include "script.h"
+#include "strpool.h"
+#include "util.h"
+
+/* a memory read of count elements of unit bytes */
+struct script_read {
+	uint64_t addr;
+	unsigned int unit;
+	uint64_t count;
+	enum formats format;
+	const struct script_var *var;
+};
+
+/* x and print format letters of gdb */
+static const char gdb_formats[] = {
+	[FORMAT_X] = 'x',
+	[FORMAT_D] = 'd',
+	[FORMAT_U] = 'u',
+	[FORMAT_F] = 'f',
+	[FORMAT_P] = 'a',
+	[FORMAT_C] = 'c',
+	[FORMAT_S] = 'c',
+	[FORMAT_B] = 'u',
+};
+
+/* rd options of crash, hexadecimal is the default */
+static const char *const crash_formats[] = {
+	[FORMAT_X] = "",
+	[FORMAT_D] = " -d",
+	[FORMAT_U] = " -D",
+	[FORMAT_F] = "",
+	[FORMAT_P] = " -s",
+	[FORMAT_C] = "",
+	[FORMAT_S] = "",
+	[FORMAT_B] = " -D",
+};
+
+
+void script_init(struct script *script, const struct arch *arch,
+		 int addr_size)
+{
+	*script = (struct script) {
+		.arch = arch,
+		.addr_size = addr_size,
+	};
+}
+
+
+/* The strings of var are copied */
+void script_add(struct script *script, const struct script_var *var)
+{
+	struct script_var *copy;
+
+	if (var->loctype != LOC_MEM && var->loctype != LOC_REG &&
+	    var->loctype != LOC_FRAME) {
+		return;
+	}
+	if (script->nr == script->alloc) {
+		script->alloc = script->alloc ? script->alloc * 2 : 64;
+		script->vars = realloc(script->vars, script->alloc *
+				       sizeof(*script->vars));
+	}
+	copy = &script->vars[script->nr++];
+	*copy = *var;
+	copy->function = strpool_add(&script->pool, var->function);
+	copy->name = strpool_add(&script->pool, var->name);
+	if (var->dump_type) {
+		copy->dump_type = strpool_add(&script->pool, var->dump_type);
+	}
+}
+
+
+/* Elements that x and rd can read: pointers, scalars, or else bytes. false
+ * if there is nothing to read. */
+static bool read_shape(const struct script *script,
+		       const struct script_var *var, bool pointers,
+		       unsigned int *unit, uint64_t *count,
+		       enum formats *format)
+{
+	if (pointers) {
+		*unit = script->addr_size;
+		*count = var->repeat;
+		*format = FORMAT_P;
+	} else if (var->size == 1 || var->size == 2 || var->size == 4 ||
+		   var->size == 8) {
+		*unit = var->size;
+		*count = var->repeat;
+		*format = var->format;
+	} else {
+		*unit = 1;
+		*count = var->size * var->repeat;
+		*format = FORMAT_X;
+	}
+	return *count != 0;
+}
+
+
+static char gdb_size(unsigned int unit)
+{
+	switch (unit) {
+	case 1:
+		return 'b';
+	case 2:
+		return 'h';
+	case 4:
+		return 'w';
+	default:
+		return 'g';
+	}
+}
+
+
+static void print_read(FILE *stream, enum script_kind kind, uint64_t addr,
+		       unsigned int unit, uint64_t count, enum formats format)
+{
+	if (kind == SCRIPT_GDB) {
+		fprintf(stream, "x/%" PRIu64 "%c%c 0x%" PRIx64 "\n", count,
+			gdb_formats[format], gdb_size(unit), addr);
+	} else {
+		fprintf(stream, "rd -%u%s %" PRIx64 " %" PRIu64 "\n", 8 * unit,
+			crash_formats[format], addr, count);
+	}
+}
+
+
+/* "*(unsigned long *)" indir_nb times, then base */
+static void print_deref(FILE *stream, unsigned int indir_nb,
+			const char *base)
+{
+	for (; indir_nb; indir_nb--) {
+		fprintf(stream, "*(unsigned long *)");
+	}
+	fprintf(stream, "%s\n", base);
+}
+
+
+static int script_read_cmp(const void *a, const void *b)
+{
+	const struct script_read *ra = a, *rb = b;
+
+	if (ra->addr != rb->addr) {
+		return ra->addr < rb->addr ? -1 : 1;
+	}
+	return ra->unit < rb->unit ? -1 : ra->unit > rb->unit;
+}
+
+
+/* Whether first, extended up to end, can take r in the same command */
+static bool read_merges(const struct script_read *first, uint64_t end,
+			const struct script_read *r)
+{
+	return r->unit == first->unit && r->addr <= end + SCRIPT_GAP_MAX &&
+		(r->addr - first->addr) % first->unit == 0;
+}
+
+
+/* Merged reads of the variables in memory, structures are dumped rather
+ * than read */
+static void write_reads(const struct script *script, enum script_kind kind,
+			FILE *stream)
+{
+	struct script_read *reads = malloc(script->nr * sizeof(*reads));
+	unsigned int i, j, k, nr = 0, commands = 0;
+
+	for (i = 0; i < script->nr; i++) {
+		const struct script_var *var = &script->vars[i];
+		struct script_read *r = &reads[nr];
+
+		if (var->loctype == LOC_MEM &&
+		    (var->indir_nb || !var->dump_type) &&
+		    read_shape(script, var, var->indir_nb, &r->unit,
+			       &r->count, &r->format)) {
+			r->addr = var->where;
+			r->var = var;
+			nr++;
+		}
+	}
+	qsort(reads, nr, sizeof(*reads), script_read_cmp);
+
+	for (i = 0; i < nr; i = j) {
+		uint64_t end = reads[i].addr + reads[i].unit * reads[i].count;
+		enum formats format = reads[i].format;
+
+		for (j = i + 1; j < nr && read_merges(&reads[i], end,
+						      &reads[j]); j++) {
+			uint64_t r_end = reads[j].addr +
+				reads[j].unit * reads[j].count;
+
+			if (reads[j].format != format) {
+				format = FORMAT_X;
+			}
+			if (r_end > end) {
+				end = r_end;
+			}
+		}
+
+		fprintf(stream, "# ");
+		for (k = i; k < j; k++) {
+			/* the same variable in several frames */
+			if (k > i && reads[k].addr == reads[k - 1].addr &&
+			    strcmp(reads[k].var->name,
+				   reads[k - 1].var->name) == 0) {
+				continue;
+			}
+			fprintf(stream, "%s%s", k > i ? ", " : "",
+				reads[k].var->name);
+		}
+		fprintf(stream, "\n");
+		print_read(stream, kind, reads[i].addr, reads[i].unit,
+			   (end - reads[i].addr) / reads[i].unit, format);
+		commands++;
+	}
+	fprintf(stream, "# %u commands for %u reads\n", commands, nr);
+
+	free(reads);
+}
+
+
+/* Whether an earlier variable covers the same memory */
+static bool mem_var_seen(const struct script *script, unsigned int index)
+{
+	const struct script_var *var = &script->vars[index];
+	unsigned int i;
+
+	for (i = 0; i < index; i++) {
+		const struct script_var *prev = &script->vars[i];
+
+		if (prev->loctype == LOC_MEM && prev->where == var->where &&
+		    prev->indir_nb == var->indir_nb &&
+		    prev->repeat == var->repeat) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/* crash has struct and union commands taking the bare tag */
+static const char *crash_dump_command(const char *type, const char **tag)
+{
+	if (strncmp(type, "struct ", 7) == 0) {
+		*tag = type + 7;
+		return "struct";
+	} else if (strncmp(type, "union ", 6) == 0) {
+		*tag = type + 6;
+		return "union";
+	}
+	return NULL;
+}
+
+
+/*
+ * What is behind the pointers of var, or its structure, starting from base:
+ * the address of the variable, or the register that holds it. indir_nb is
+ * the number of pointers to follow from base.
+ */
+static void write_target(const struct script *script, enum script_kind kind,
+			 FILE *stream, const struct script_var *var,
+			 const char *base, unsigned int indir_nb)
+{
+	const char *cmd = kind == SCRIPT_GDB ? "" : "gdb ";
+	unsigned int unit;
+	uint64_t count;
+	enum formats format;
+
+	if (var->dump_type) {
+		const char *dump, *tag;
+
+		if (kind == SCRIPT_CRASH && !indir_nb &&
+		    (dump = crash_dump_command(var->dump_type, &tag))) {
+			fprintf(stream, "%s %s %s", dump, tag, base);
+			if (var->repeat > 1) {
+				fprintf(stream, " %u", var->repeat);
+			}
+			fprintf(stream, "\n");
+			return;
+		}
+		fprintf(stream, "p *(%s *)", var->dump_type);
+		if (!indir_nb && var->repeat > 1) {
+			fprintf(stream, "%s@%u\n", base, var->repeat);
+		} else {
+			print_deref(stream, indir_nb, base);
+		}
+		return;
+	}
+
+	if (read_shape(script, var, false, &unit, &count, &format)) {
+		fprintf(stream, "%sx/%" PRIu64 "%c%c ", cmd, count,
+			gdb_formats[format], gdb_size(unit));
+		print_deref(stream, indir_nb, base);
+	}
+}
+
+
+static void write_mem_targets(const struct script *script,
+			      enum script_kind kind, FILE *stream)
+{
+	unsigned int i;
+	char base[32];
+
+	for (i = 0; i < script->nr; i++) {
+		const struct script_var *var = &script->vars[i];
+
+		/* arrays of pointers are not followed */
+		if (var->loctype != LOC_MEM ||
+		    (var->indir_nb ? var->repeat != 1 : !var->dump_type) ||
+		    mem_var_seen(script, i)) {
+			continue;
+		}
+		fprintf(stream, "# %s\n", var->name);
+		snprintf(base, sizeof(base), "0x%" PRIx64, var->where);
+		write_target(script, kind, stream, var, base, var->indir_nb);
+	}
+}
+
+
+/* gdb name of a DWARF register in a convenience variable, NULL if unknown */
+static const char *gdb_register(const struct script *script,
+				uint64_t column)
+{
+	const char *reg = arch_column_name(script->arch, column);
+
+	if (strcmp(reg, "?") == 0) {
+		return NULL;
+	}
+	return reg[0] == '%' ? reg + 1 : reg;
+}
+
+
+static void write_registers(const struct script *script,
+			    enum script_kind kind, FILE *stream)
+{
+	unsigned int i, frame = -1;
+	char base[32];
+
+	for (i = 0; i < script->nr; i++) {
+		const struct script_var *var = &script->vars[i];
+		const char *reg = gdb_register(script, var->where);
+
+		if (var->loctype != LOC_REG) {
+			continue;
+		}
+		if (kind == SCRIPT_CRASH || !reg) {
+			fprintf(stream,
+				"# %s: %s is in register %s of frame %u\n",
+				var->function, var->name,
+				arch_column_name(script->arch, var->where),
+				var->frame);
+			continue;
+		}
+
+		if (var->frame != frame) {
+			frame = var->frame;
+			fprintf(stream, "frame %u\n", frame);
+		}
+		fprintf(stream, "# %s: %s\n", var->function, var->name);
+		snprintf(base, sizeof(base), "$%s", reg);
+		fprintf(stream, "p/%c %s\n",
+			gdb_formats[var->indir_nb ? FORMAT_P : var->format],
+			base);
+		if (var->indir_nb && var->repeat == 1) {
+			write_target(script, kind, stream, var, base,
+				     var->indir_nb - 1);
+		}
+	}
+}
+
+
+/* The variables at a register of their frame plus an offset. The frame is
+ * selected first so that gdb unwinds the register. */
+static void write_frame_vars(const struct script *script,
+			     enum script_kind kind, FILE *stream)
+{
+	unsigned int i, frame = -1;
+	unsigned int unit;
+	uint64_t count;
+	enum formats format;
+	char base[48];
+
+	for (i = 0; i < script->nr; i++) {
+		const struct script_var *var = &script->vars[i];
+		const char *reg = gdb_register(script, var->where);
+
+		if (var->loctype != LOC_FRAME) {
+			continue;
+		}
+		if (kind == SCRIPT_CRASH || !reg) {
+			fprintf(stream,
+				"# %s: %s is at %s%+" PRId64 " in frame %u\n",
+				var->function, var->name,
+				arch_column_name(script->arch, var->where),
+				var->offset, var->frame);
+			continue;
+		}
+
+		if (var->frame != frame) {
+			frame = var->frame;
+			fprintf(stream, "frame %u\n", frame);
+		}
+		fprintf(stream, "# %s: %s\n", var->function, var->name);
+		snprintf(base, sizeof(base), "($%s%+" PRId64 ")", reg,
+			 var->offset);
+		if ((var->indir_nb || !var->dump_type) &&
+		    read_shape(script, var, var->indir_nb, &unit, &count,
+			       &format)) {
+			fprintf(stream, "x/%" PRIu64 "%c%c %s\n", count,
+				gdb_formats[format], gdb_size(unit), base);
+		}
+		/* arrays of pointers are not followed */
+		if (var->indir_nb ? var->repeat == 1 : var->dump_type != NULL) {
+			write_target(script, kind, stream, var, base,
+				     var->indir_nb);
+		}
+	}
+}
+
+
+void script_write(const struct script *script, enum script_kind kind,
+		  FILE *stream)
+{
+	fprintf(stream, "# variables of the trace, for %s\n",
+		kind == SCRIPT_GDB ? "gdb" : "crash");
+	if (kind == SCRIPT_GDB) {
+		fprintf(stream, "set pagination off\n");
+	}
+	fprintf(stream, "\n# memory\n");
+	write_reads(script, kind, stream);
+	fprintf(stream, "\n# structures and pointers\n");
+	write_mem_targets(script, kind, stream);
+	fprintf(stream, "\n# registers\n");
+	write_registers(script, kind, stream);
+	fprintf(stream, "\n# stack frames\n");
+	write_frame_vars(script, kind, stream);
+}
+
+
+void script_free(struct script *script)
+{
+	free(script->vars);
+	strpool_free(&script->pool);
+}
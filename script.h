@@ -0,0 +1,71 @@
+#ifndef _SCRIPT_H
+#define _SCRIPT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "core_walk.h"
+#include "strpool.h"
+
+struct arch;
+
+/*
+ * Command scripts that fetch the variables of a trace from a dump, for gdb
+ * or for the crash utility: x (or rd) reads of variables in memory, prints
+ * of those in registers, and struct dumps of structures and unions,
+ * following the pointers to them. Variables in a stack frame are read at a
+ * register of the frame plus an offset after selecting the frame, which
+ * only gdb can do.
+ *
+ * Variables are added frame by frame. The memory reads are sorted when the
+ * script is written, and those of neighbouring objects of the same unit
+ * size are merged into a single command, bytes between them included if
+ * there are at most SCRIPT_GAP_MAX of them.
+ */
+
+#define SCRIPT_GAP_MAX 64
+
+enum script_kind {
+	SCRIPT_GDB,
+	SCRIPT_CRASH,
+};
+
+struct script_var {
+	/* index in the trace, innermost first */
+	unsigned int frame;
+	const char *function;
+	const char *name;
+	/* LOC_MEM, LOC_REG or LOC_FRAME, others are not fetched */
+	enum locations loctype;
+	/* address, or DWARF register number */
+	uint64_t where;
+	/* LOC_FRAME: the variable is at register where plus offset */
+	int64_t offset;
+	/* as print_var_info() finds them: elements of arrays, the format and
+	 * size of the leaf type, pointers to follow */
+	unsigned int repeat;
+	enum formats format;
+	uint64_t size;
+	unsigned int indir_nb;
+	/* C spelling of the structure or union at the end of the pointers,
+	 * to dump. NULL if none. */
+	const char *dump_type;
+};
+
+struct script {
+	const struct arch *arch;
+	int addr_size;
+	struct script_var *vars;
+	unsigned int nr;
+	unsigned int alloc;
+	struct strpool pool;
+};
+
+void script_init(struct script *script, const struct arch *arch,
+		 int addr_size);
+void script_add(struct script *script, const struct script_var *var);
+void script_write(const struct script *script, enum script_kind kind,
+		  FILE *stream);
+void script_free(struct script *script);
+
+#endif
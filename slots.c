@@ -0,0 +1,435 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdwarf/libdwarf.h>
+#include <libdwarf/dwarf.h>
+
+#include "arch.h"
+#include "core_walk.h"
+#include "location.h"
+#include "resolve.h"
+#include "slots.h"
+#include "types.h"
+#include "util.h"
+
+
+/* value of the DW_AT_frame_base expression at a given pc */
+struct frame_base {
+	bool valid;
+	/* true: base = CFA + offset, false: base = reg + offset */
+	bool cfa;
+	Dwarf_Half reg;
+	Dwarf_Signed offset;
+};
+
+static const char *slot_kind_names[] = {
+	[SLOT_RETADDR] = "retaddr",
+	[SLOT_SAVED_REG] = "saved",
+	[SLOT_PARAM] = "param",
+	[SLOT_VAR] = "var",
+};
+
+
+static void add_slot(struct slot_map *map, Dwarf_Signed lo,
+		     Dwarf_Unsigned size, enum slot_kind kind,
+		     const char *name, Dwarf_Unsigned obj_offset,
+		     const struct type_desc *type)
+{
+	struct slot *slot;
+	char path[256];
+
+	if (map->nr == map->alloc) {
+		map->alloc = map->alloc ? map->alloc * 2 : 16;
+		map->slots = realloc(map->slots,
+				     map->alloc * sizeof(*map->slots));
+	}
+	slot = &map->slots[map->nr++];
+	slot->lo = lo;
+	slot->hi = lo + size;
+	slot->kind = kind;
+	slot->name = strdup(name);
+	slot->member = NULL;
+	slot->obj_offset = obj_offset;
+	if (obj_offset && type &&
+	    type_member_path(type, obj_offset, path, sizeof(path)) > 0) {
+		slot->member = strdup(path);
+	}
+}
+
+
+static int slot_cmp(const void *a, const void *b)
+{
+	const struct slot *sa = a, *sb = b;
+
+	if (sa->lo != sb->lo) {
+		return sa->lo < sb->lo ? -1 : 1;
+	}
+	/* larger object first */
+	if (sa->hi != sb->hi) {
+		return sa->hi > sb->hi ? -1 : 1;
+	}
+	return 0;
+}
+
+
+/* Express reg + offset relative to the CFA. Only possible when reg is the
+ * register the CFA rule is based on at this pc. */
+static int reg_to_cfa(const struct slot_map *map, Dwarf_Half reg,
+		      Dwarf_Signed offset, Dwarf_Signed *result)
+{
+	if (reg != map->cfa_reg) {
+		return -1;
+	}
+	*result = offset - map->cfa_offset;
+	return 0;
+}
+
+
+static void get_frame_base(Dwarf_Debug dwarf, Dwarf_Die sp_die,
+			   Dwarf_Addr pc, struct frame_base *fb)
+{
+	Dwarf_Attribute attr;
+	const struct loc_expr *expr;
+	struct loc_list list;
+
+	fb->valid = false;
+	if (dwarf_attr(sp_die, DW_AT_frame_base, &attr, NULL) != DW_DLV_OK) {
+		return;
+	}
+	if (loc_list_get(attr, &list) == -1) {
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		return;
+	}
+
+	expr = loc_list_find(&list, pc);
+	if (expr && expr->ops_nb == 1) {
+		const struct loc_op *op = &expr->ops[0];
+
+		if (op->atom == DW_OP_call_frame_cfa) {
+			fb->valid = true;
+			fb->cfa = true;
+			fb->offset = 0;
+		} else if (op->atom >= DW_OP_breg0 &&
+			   op->atom <= DW_OP_breg15) {
+			fb->valid = true;
+			fb->cfa = false;
+			fb->reg = op->atom - DW_OP_breg0;
+			fb->offset = op->number;
+		}
+	}
+
+	loc_list_free(&list);
+	dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+}
+
+
+/* The type of data object die in types, NULL if unknown */
+static const struct type_desc *get_object_type(Dwarf_Debug dwarf,
+					       struct type_cache *types,
+					       Dwarf_Die die)
+{
+	Dwarf_Attribute attr;
+	Dwarf_Off offset;
+
+	if (!types || dwarf_attr(die, DW_AT_type, &attr, NULL) != DW_DLV_OK) {
+		return NULL;
+	}
+	if (dwarf_global_formref(attr, &offset, NULL) != DW_DLV_OK) {
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		return NULL;
+	}
+	dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+
+	return type_cache_get(types, offset);
+}
+
+
+static void add_data_object(Dwarf_Debug dwarf, struct type_cache *types,
+			    Dwarf_Die die, enum slot_kind kind,
+			    const struct frame_base *fb, struct slot_map *map)
+{
+	const struct type_desc *type;
+	Dwarf_Attribute attr;
+	const struct loc_expr *expr;
+	struct loc_list list;
+	Dwarf_Die origin_die = NULL;
+	Dwarf_Unsigned size, piece_offset = 0;
+	Dwarf_Signed cfa_offset = 0;
+	bool in_slot = false, added = false;
+	char *name;
+
+	if (dwarf_attr(die, DW_AT_location, &attr, NULL) != DW_DLV_OK) {
+		/* optimized out or constant */
+		return;
+	}
+	if (loc_list_get(attr, &list) == -1) {
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		return;
+	}
+	dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+
+	if (dwarf_diename(die, &name, NULL) != DW_DLV_OK) {
+		if (find_abstract_origin(dwarf, die, &origin_die) == -1 ||
+		    dwarf_diename(origin_die, &name, NULL) != DW_DLV_OK) {
+			fprintf(stderr,
+				"Error: expected data object DIE to have a name.\n");
+			print_die_info(dwarf, die);
+			abort();
+		}
+	}
+	if (get_type_size(dwarf, origin_die ? origin_die : die, &size) == -1) {
+		size = map->addr_size;
+	}
+	type = get_object_type(dwarf, types, origin_die ? origin_die : die);
+
+	expr = loc_list_find(&list, map->pc);
+	if (expr) {
+		int j;
+
+		for (j = 0; j < expr->ops_nb; j++) {
+			Dwarf_Small op = expr->ops[j].atom;
+			Dwarf_Signed arg1 = expr->ops[j].number;
+
+			if (op == DW_OP_fbreg && fb->valid) {
+				if (fb->cfa) {
+					cfa_offset = fb->offset + arg1;
+					in_slot = true;
+				} else {
+					in_slot = reg_to_cfa(map, fb->reg,
+							     fb->offset + arg1,
+							     &cfa_offset) == 0;
+				}
+			} else if (op >= DW_OP_breg0 && op <= DW_OP_breg15) {
+				in_slot = reg_to_cfa(map, op - DW_OP_breg0,
+						     arg1, &cfa_offset) == 0;
+			} else if (op == DW_OP_call_frame_cfa) {
+				cfa_offset = 0;
+				in_slot = true;
+			} else if (op == DW_OP_piece) {
+				if (in_slot) {
+					add_slot(map, cfa_offset, arg1, kind,
+						 name, piece_offset, type);
+					added = true;
+				}
+				piece_offset += arg1;
+				in_slot = false;
+			} else {
+				/* registers, computed values, pointers
+				 * stored in the frame, ... */
+				in_slot = false;
+			}
+		}
+		/* a location without pieces covers the whole object */
+		if (in_slot && piece_offset == 0) {
+			add_slot(map, cfa_offset, size, kind, name, 0,
+				 type);
+			added = true;
+		}
+	}
+	if (!added) {
+		map->unresolved++;
+	}
+
+	dwarf_dealloc(dwarf, name, DW_DLA_STRING);
+	if (origin_die) {
+		dwarf_dealloc(dwarf, origin_die, DW_DLA_DIE);
+	}
+	loc_list_free(&list);
+}
+
+
+/* cu_base is the base address of the DWARF 4 range lists of the blocks */
+static void add_scope(Dwarf_Debug dwarf, struct type_cache *types,
+		      Dwarf_Die scope, Dwarf_Addr cu_base,
+		      const struct frame_base *fb, struct slot_map *map)
+{
+	Dwarf_Die child, sibling;
+	int retval;
+
+	foreach_child(dwarf, scope, child, sibling, retval) {
+		Dwarf_Half tag;
+
+		dwarf_tag(child, &tag, NULL);
+		switch (tag) {
+		case DW_TAG_formal_parameter:
+			add_data_object(dwarf, types, child, SLOT_PARAM, fb,
+					map);
+			break;
+
+		case DW_TAG_variable:
+			add_data_object(dwarf, types, child, SLOT_VAR, fb,
+					map);
+			break;
+
+		case DW_TAG_lexical_block:
+		case DW_TAG_inlined_subroutine:
+			if (die_has_pc(dwarf, child, cu_base, map->pc)) {
+				add_scope(dwarf, types, child, cu_base, fb,
+					  map);
+			}
+			break;
+		}
+	}
+}
+
+
+/*
+ * Compute the slot map of the frame of sp_die at pc by combining the CFA rule
+ * from the FDE, the frame base of the subprogram and the location of each
+ * parameter and variable in scope. The slots of pieces of objects are named
+ * after their members if types is not NULL. cu_base is the base address of
+ * the CU of sp_die.
+ * Returns -1 if there is no CFA rule for this pc.
+ */
+int slot_map_build(Dwarf_Debug dwarf, struct type_cache *types,
+		   Dwarf_Die sp_die, Dwarf_Addr cu_base, Dwarf_Addr pc,
+		   struct slot_map *map)
+{
+	Dwarf_Addr lopc, hipc, row_pc;
+	Dwarf_Regtable3 reg_table;
+	struct frame_base fb;
+	Dwarf_Regtable_Entry3 *cfa_rule;
+	int i;
+
+	*map = (struct slot_map) {
+		.pc = pc,
+		.arch = arch_of_dwarf(dwarf),
+	};
+	dwarf_get_address_size(dwarf, &map->addr_size, NULL);
+	if (!map->arch) {
+		return -1;
+	}
+
+	reg_table.rt3_reg_table_size = map->arch->columns_nb;
+	reg_table.rt3_rules = malloc(sizeof(Dwarf_Regtable_Entry3) *
+				     reg_table.rt3_reg_table_size);
+	if (find_regtable_by_pc(dwarf, pc, &reg_table, &lopc, &hipc,
+				&row_pc) == -1) {
+		free(reg_table.rt3_rules);
+		return -1;
+	}
+	cfa_rule = &reg_table.rt3_cfa_rule;
+	if (cfa_rule->dw_value_type != DW_EXPR_OFFSET ||
+	    !cfa_rule->dw_offset_relevant ||
+	    cfa_rule->dw_regnum >= map->arch->gprs_nb) {
+		free(reg_table.rt3_rules);
+		return -1;
+	}
+	map->cfa_reg = cfa_rule->dw_regnum;
+	map->cfa_offset = cfa_rule->dw_offset_or_block_len;
+
+	/* registers saved in the frame, including the return address */
+	for (i = 0; i < reg_table.rt3_reg_table_size; i++) {
+		Dwarf_Regtable_Entry3 *entry = &reg_table.rt3_rules[i];
+
+		if (entry->dw_value_type != DW_EXPR_OFFSET ||
+		    !entry->dw_offset_relevant ||
+		    entry->dw_regnum != DW_FRAME_CFA_COL3 ||
+		    arch_column_slot(map->arch, i) == -1) {
+			continue;
+		}
+		add_slot(map, entry->dw_offset_or_block_len, map->addr_size,
+			 i == map->arch->ra_column ?
+			 SLOT_RETADDR : SLOT_SAVED_REG,
+			 arch_column_name(map->arch, i), 0, NULL);
+	}
+	free(reg_table.rt3_rules);
+
+	get_frame_base(dwarf, sp_die, pc, &fb);
+	add_scope(dwarf, types, sp_die, cu_base, &fb, map);
+
+	qsort(map->slots, map->nr, sizeof(*map->slots), slot_cmp);
+	return 0;
+}
+
+
+static void print_slot_name(const struct slot *slot)
+{
+	printf("%s %s", slot_kind_names[slot->kind], slot->name);
+	if (slot->member) {
+		printf("%s", slot->member);
+	} else if (slot->obj_offset) {
+		printf("+0x%" DW_PR_DUx, slot->obj_offset);
+	}
+}
+
+
+void slot_map_print(const struct slot_map *map)
+{
+	const char *cfa_reg = arch_column_name(map->arch, map->cfa_reg);
+	int i;
+
+	printf("    CFA = %s%+" DW_PR_DSd "\n", cfa_reg, map->cfa_offset);
+	for (i = 0; i < map->nr; i++) {
+		const struct slot *slot = &map->slots[i];
+
+		printf("        [CFA%+4" DW_PR_DSd ", CFA%+4" DW_PR_DSd "[ "
+		       "%s%+-5" DW_PR_DSd " ", slot->lo, slot->hi, cfa_reg,
+		       map->cfa_offset + slot->lo);
+		print_slot_name(slot);
+		printf(" (%" DW_PR_DSd " bytes)\n", slot->hi - slot->lo);
+	}
+	if (map->unresolved) {
+		printf("    %u data objects not in a stack slot at this pc\n",
+		       map->unresolved);
+	}
+}
+
+
+/*
+ * Print nr stack words starting at address start, each one followed by the
+ * slots it overlaps. cfa is the CFA of the frame. Both the words and the
+ * slots are sorted by address, so this is a single merge pass.
+ */
+void slot_map_annotate(const struct slot_map *map, Dwarf_Addr cfa,
+		       Dwarf_Addr start, const uint64_t *words,
+		       unsigned int nr)
+{
+	unsigned int first = 0;
+	int width = 2 * (int) map->addr_size;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		Dwarf_Signed lo = start + i * map->addr_size - cfa;
+		Dwarf_Signed hi = lo + map->addr_size;
+		unsigned int j;
+
+		printf("    %0*" DW_PR_DUx ": %0*" PRIx64 "  CFA%+" DW_PR_DSd,
+		       width, start + i * map->addr_size, width, words[i],
+		       lo);
+
+		/* slots entirely below this word will not match any of the
+		 * following words either */
+		while (first < map->nr && map->slots[first].hi <= lo) {
+			first++;
+		}
+		for (j = first; j < map->nr && map->slots[j].lo < hi; j++) {
+			const struct slot *slot = &map->slots[j];
+
+			if (slot->hi <= lo) {
+				continue;
+			}
+			printf("  ");
+			print_slot_name(slot);
+			if (slot->lo < lo) {
+				printf("[+%" DW_PR_DSd "]", lo - slot->lo);
+			}
+		}
+		printf("\n");
+	}
+}
+
+
+void slot_map_free(struct slot_map *map)
+{
+	int i;
+
+	for (i = 0; i < map->nr; i++) {
+		free(map->slots[i].name);
+		free(map->slots[i].member);
+	}
+	free(map->slots);
+}
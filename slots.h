@@ -0,0 +1,63 @@
+#ifndef _SLOTS_H
+#define _SLOTS_H
+
+#include <stdint.h>
+
+#include <libdwarf/libdwarf.h>
+
+struct arch;
+struct type_cache;
+
+/*
+ * A slot map describes, for one pc, which stack bytes of the frame hold which
+ * object. Offsets are relative to the CFA of the frame, which is the value of
+ * the stack pointer before the call instruction that created it.
+ */
+
+enum slot_kind {
+	SLOT_RETADDR,
+	SLOT_SAVED_REG,
+	SLOT_PARAM,
+	SLOT_VAR,
+};
+
+struct slot {
+	/* [lo, hi[ relative to the CFA */
+	Dwarf_Signed lo;
+	Dwarf_Signed hi;
+	enum slot_kind kind;
+	char *name;
+	/* NULL for whole objects, else the path of the member the piece
+	 * held in the slot starts in, ex. ".a.b[3]". NULL too if the type
+	 * of the object is not known. */
+	char *member;
+	/* offset of the slot within the object */
+	Dwarf_Unsigned obj_offset;
+};
+
+struct slot_map {
+	Dwarf_Addr pc;
+	Dwarf_Half addr_size;
+	const struct arch *arch;
+	/* CFA = cfa_reg + cfa_offset, cfa_reg is a DWARF register number */
+	Dwarf_Half cfa_reg;
+	Dwarf_Signed cfa_offset;
+	/* sorted by lo, then by decreasing size */
+	struct slot *slots;
+	unsigned int nr;
+	unsigned int alloc;
+	/* data objects whose location could not be expressed relative to
+	 * the CFA at this pc, for information */
+	unsigned int unresolved;
+};
+
+int slot_map_build(Dwarf_Debug dwarf, struct type_cache *types,
+		   Dwarf_Die sp_die, Dwarf_Addr cu_base, Dwarf_Addr pc,
+		   struct slot_map *map);
+void slot_map_print(const struct slot_map *map);
+void slot_map_annotate(const struct slot_map *map, Dwarf_Addr cfa,
+		       Dwarf_Addr start, const uint64_t *words,
+		       unsigned int nr);
+void slot_map_free(struct slot_map *map);
+
+#endif
@@ -0,0 +1,316 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libelf.h>
+#include <libdwarf/libdwarf.h>
+#include <libdwarf/dwarf.h>
+
+#include "split.h"
+
+/* an opened .dwo, or a package */
+struct split_file {
+	bool used;
+	uint64_t dwo_id;
+	int fd;
+	Elf *elf;
+	/* NULL if the file could not be opened, it is not tried again */
+	Dwarf_Debug dwarf;
+	Dwarf_Off cu_offset;
+};
+
+struct split_units {
+	char *image_path;
+	/* the image's, which holds .debug_addr for the split units */
+	Dwarf_Debug dwarf;
+	/* opened on first use */
+	bool dwp_loaded;
+	struct split_file dwp;
+	/* .dwo files by dwo_id, open addressing */
+	struct split_file *files;
+	unsigned int files_size;
+	unsigned int files_nb;
+};
+
+
+struct split_units *split_units_new(const char *image_path,
+				    Dwarf_Debug dwarf)
+{
+	struct split_units *units;
+
+	units = calloc(1, sizeof(*units));
+	units->image_path = strdup(image_path);
+	units->dwarf = dwarf;
+	units->files_size = 64;
+	units->files = calloc(units->files_size, sizeof(*units->files));
+
+	return units;
+}
+
+
+/* Split files have no relocations, they can always be mapped */
+static int split_file_open(struct split_units *units, const char *path,
+			   struct split_file *file)
+{
+	if ((file->fd = open(path, O_RDONLY, 0)) == -1) {
+		return -1;
+	}
+	if ((file->elf = elf_begin(file->fd, ELF_C_READ_MMAP, NULL)) == NULL) {
+		goto err_close;
+	}
+	if (dwarf_elf_init(file->elf, DW_DLC_READ, NULL, NULL, &file->dwarf,
+			   NULL) != DW_DLV_OK) {
+		goto err_elf;
+	}
+	/* for the addresses, in the skeleton's .debug_addr */
+	dwarf_set_tied_dbg(file->dwarf, units->dwarf, NULL);
+	return 0;
+
+err_elf:
+	elf_end(file->elf);
+err_close:
+	close(file->fd);
+	file->dwarf = NULL;
+	return -1;
+}
+
+
+static void split_file_close(struct split_file *file)
+{
+	if (!file->dwarf) {
+		return;
+	}
+	dwarf_finish(file->dwarf, NULL);
+	elf_end(file->elf);
+	close(file->fd);
+}
+
+
+/* Offset of the CU DIE of a .dwo, which has a single unit */
+static int dwo_cu_offset(struct split_file *file)
+{
+	Dwarf_Unsigned next_cu;
+	Dwarf_Die cu_die;
+	int retval;
+
+	if (dwarf_next_cu_header_d(file->dwarf, true, NULL, NULL, NULL, NULL,
+				   NULL, NULL, NULL, NULL, &next_cu, NULL,
+				   NULL) != DW_DLV_OK ||
+	    dwarf_siblingof_b(file->dwarf, NULL, true, &cu_die, NULL) !=
+	    DW_DLV_OK) {
+		return -1;
+	}
+	retval = dwarf_dieoffset(cu_die, &file->cu_offset, NULL);
+	dwarf_dealloc(file->dwarf, cu_die, DW_DLA_DIE);
+
+	return retval == DW_DLV_OK ? 0 : -1;
+}
+
+
+/* Returns NULL if cu_die is not a skeleton unit. The result must be freed
+ * using dwarf_dealloc(dwarf, result, DW_DLA_STRING). */
+static char *dwo_name(Dwarf_Debug dwarf, Dwarf_Die cu_die)
+{
+	static const Dwarf_Half names[] = {
+		DW_AT_dwo_name,
+		DW_AT_GNU_dwo_name,
+	};
+	Dwarf_Attribute attr;
+	char *name = NULL;
+	int i;
+
+	for (i = 0; i < 2 && !name; i++) {
+		if (dwarf_attr(cu_die, names[i], &attr, NULL) != DW_DLV_OK) {
+			continue;
+		}
+		if (dwarf_formstring(attr, &name, NULL) != DW_DLV_OK) {
+			name = NULL;
+		}
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+	}
+	return name;
+}
+
+
+static int dwo_id(Dwarf_Debug dwarf, Dwarf_Die cu_die, Dwarf_Sig8 *id)
+{
+	Dwarf_Half version, offset_size, address_size, extension_size;
+	Dwarf_Bool is_info, is_dwo;
+	Dwarf_Sig8 *signature = NULL;
+	Dwarf_Unsigned length;
+	Dwarf_Attribute attr;
+	Dwarf_Off offset;
+	int retval;
+
+	/* DWARF 4 GNU extension */
+	if (dwarf_attr(cu_die, DW_AT_GNU_dwo_id, &attr, NULL) == DW_DLV_OK) {
+		retval = dwarf_formsig8_const(attr, id, NULL);
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		return retval == DW_DLV_OK ? 0 : -1;
+	}
+
+	/* DWARF 5, in the unit header */
+	if (dwarf_cu_header_basics(cu_die, &version, &is_info, &is_dwo,
+				   &offset_size, &address_size,
+				   &extension_size, &signature, &offset,
+				   &length, NULL) != DW_DLV_OK || !signature) {
+		return -1;
+	}
+	*id = *signature;
+	return 0;
+}
+
+
+static struct split_file *file_slot(struct split_units *units, uint64_t id)
+{
+	unsigned int mask = units->files_size - 1;
+	unsigned int i = (id * 0x9e3779b97f4a7c15ULL) >> 32 & mask;
+
+	while (units->files[i].used && units->files[i].dwo_id != id) {
+		i = (i + 1) & mask;
+	}
+	return &units->files[i];
+}
+
+
+static void files_grow(struct split_units *units)
+{
+	struct split_file *old = units->files;
+	unsigned int i, old_size = units->files_size;
+
+	units->files_size *= 2;
+	units->files = calloc(units->files_size, sizeof(*units->files));
+	for (i = 0; i < old_size; i++) {
+		if (old[i].used) {
+			*file_slot(units, old[i].dwo_id) = old[i];
+		}
+	}
+	free(old);
+}
+
+
+/* name is relative to the compilation directory, or failing that, to the
+ * directory of the image */
+static void dwo_open(struct split_units *units, Dwarf_Die cu_die,
+		     const char *name, struct split_file *file)
+{
+	Dwarf_Attribute attr;
+	char *comp_dir = NULL, *path;
+	const char *slash;
+	size_t len;
+
+	if (name[0] == '/') {
+		split_file_open(units, name, file);
+		goto out;
+	}
+
+	if (dwarf_attr(cu_die, DW_AT_comp_dir, &attr, NULL) == DW_DLV_OK) {
+		if (dwarf_formstring(attr, &comp_dir, NULL) != DW_DLV_OK) {
+			comp_dir = NULL;
+		}
+		dwarf_dealloc(units->dwarf, attr, DW_DLA_ATTR);
+	}
+	len = (comp_dir ? strlen(comp_dir) : 0) +
+		strlen(units->image_path) + strlen(name) + 2;
+	path = malloc(len);
+	if (comp_dir) {
+		sprintf(path, "%s/%s", comp_dir, name);
+		dwarf_dealloc(units->dwarf, comp_dir, DW_DLA_STRING);
+	}
+	if (!comp_dir || split_file_open(units, path, file) == -1) {
+		slash = strrchr(units->image_path, '/');
+		sprintf(path, "%.*s%s", slash ?
+			(int) (slash - units->image_path + 1) : 0,
+			units->image_path, name);
+		split_file_open(units, path, file);
+	}
+	free(path);
+
+out:
+	if (file->dwarf && dwo_cu_offset(file) == -1) {
+		split_file_close(file);
+		file->dwarf = NULL;
+	}
+}
+
+
+/*
+ * Find the split unit of the skeleton unit cu_die, of the image's Dwarf_Debug.
+ * Returns -1 if cu_die is not a skeleton or its split unit is not found. The
+ * result must be freed using dwarf_dealloc(*dwarf, result, DW_DLA_DIE).
+ */
+int split_unit_find(struct split_units *units, Dwarf_Die cu_die,
+		    Dwarf_Debug *dwarf, Dwarf_Die *result)
+{
+	struct split_file *file;
+	Dwarf_Sig8 id;
+	uint64_t key;
+	char *name;
+	int retval = -1;
+
+	if ((name = dwo_name(units->dwarf, cu_die)) == NULL) {
+		return -1;
+	}
+	if (dwo_id(units->dwarf, cu_die, &id) == -1) {
+		goto out;
+	}
+
+	/* a package has every unit */
+	if (!units->dwp_loaded) {
+		char *path = malloc(strlen(units->image_path) + 5);
+
+		sprintf(path, "%s.dwp", units->image_path);
+		split_file_open(units, path, &units->dwp);
+		free(path);
+		units->dwp_loaded = true;
+	}
+	if (units->dwp.dwarf &&
+	    dwarf_die_from_hash_signature(units->dwp.dwarf, &id, "cu",
+					  result, NULL) == DW_DLV_OK) {
+		*dwarf = units->dwp.dwarf;
+		retval = 0;
+		goto out;
+	}
+
+	memcpy(&key, id.signature, sizeof(key));
+	file = file_slot(units, key);
+	if (!file->used) {
+		if ((units->files_nb + 1) * 4 > units->files_size * 3) {
+			files_grow(units);
+			file = file_slot(units, key);
+		}
+		file->used = true;
+		file->dwo_id = key;
+		units->files_nb++;
+		dwo_open(units, cu_die, name, file);
+	}
+	if (file->dwarf && dwarf_offdie(file->dwarf, file->cu_offset, result,
+					NULL) == DW_DLV_OK) {
+		*dwarf = file->dwarf;
+		retval = 0;
+	}
+
+out:
+	dwarf_dealloc(units->dwarf, name, DW_DLA_STRING);
+	return retval;
+}
+
+
+void split_units_free(struct split_units *units)
+{
+	unsigned int i;
+
+	for (i = 0; i < units->files_size; i++) {
+		if (units->files[i].used) {
+			split_file_close(&units->files[i]);
+		}
+	}
+	split_file_close(&units->dwp);
+	free(units->files);
+	free(units->image_path);
+	free(units);
+}
@@ -0,0 +1,21 @@
+#ifndef _SPLIT_H
+#define _SPLIT_H
+
+#include <libdwarf/libdwarf.h>
+
+/*
+ * Split DWARF (-gsplit-dwarf): the image keeps skeleton units, with the line
+ * tables and address ranges, and the DIEs are in a .dwp package next to it or
+ * in one .dwo file per unit. Units are looked up in the package through its
+ * hash index, .dwo files are opened the first time one of their units is
+ * needed.
+ */
+struct split_units;
+
+struct split_units *split_units_new(const char *image_path,
+				    Dwarf_Debug dwarf);
+int split_unit_find(struct split_units *units, Dwarf_Die cu_die,
+		    Dwarf_Debug *dwarf, Dwarf_Die *result);
+void split_units_free(struct split_units *units);
+
+#endif
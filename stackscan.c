@@ -0,0 +1,239 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libelf.h>
+#include <gelf.h>
+
+#include "stackscan.h"
+
+/* the bitmap is kept under 2 MB, coarser granules are used for sparse
+ * layouts */
+#define BITMAP_BITS_MAX (1UL << 24)
+#define GRANULE_SHIFT_MIN 12
+
+/* words compared at once, GCC lowers the vector operations to whatever the
+ * target has */
+#define SCAN_LANES 4
+
+typedef uint64_t scan_words __attribute__((vector_size(8 * SCAN_LANES)));
+typedef int64_t scan_mask __attribute__((vector_size(8 * SCAN_LANES)));
+
+
+static int text_section_cmp(const void *a, const void *b)
+{
+	const struct text_section *sa = a, *sb = b;
+
+	if (sa->lo != sb->lo) {
+		return sa->lo < sb->lo ? -1 : 1;
+	}
+	return 0;
+}
+
+
+/* NULL if elf is not x86_64 or has no code */
+struct text_filter *text_filter_new(Elf *elf)
+{
+	struct text_filter *filter;
+	Elf_Scn *scn = NULL;
+	GElf_Ehdr ehdr;
+	unsigned int alloc = 0, i;
+	uint64_t granules, g;
+
+	if (gelf_getehdr(elf, &ehdr) == NULL || ehdr.e_machine != EM_X86_64) {
+		return NULL;
+	}
+
+	filter = calloc(1, sizeof(*filter));
+	while ((scn = elf_nextscn(elf, scn)) != NULL) {
+		GElf_Shdr shdr;
+		Elf_Data *data;
+
+		gelf_getshdr(scn, &shdr);
+		if (shdr.sh_type != SHT_PROGBITS || !shdr.sh_size ||
+		    (shdr.sh_flags & (SHF_ALLOC | SHF_EXECINSTR)) !=
+		    (SHF_ALLOC | SHF_EXECINSTR) ||
+		    (data = elf_getdata(scn, NULL)) == NULL ||
+		    data->d_size != shdr.sh_size) {
+			continue;
+		}
+		if (filter->nr == alloc) {
+			alloc = alloc ? alloc * 2 : 16;
+			filter->sections = realloc(filter->sections, alloc *
+						   sizeof(*filter->sections));
+		}
+		filter->sections[filter->nr++] = (struct text_section) {
+			.lo = shdr.sh_addr,
+			.hi = shdr.sh_addr + shdr.sh_size,
+			.data = data->d_buf,
+		};
+	}
+	if (!filter->nr) {
+		text_filter_free(filter);
+		return NULL;
+	}
+	qsort(filter->sections, filter->nr, sizeof(*filter->sections),
+	      text_section_cmp);
+
+	filter->lo = filter->sections[0].lo;
+	for (i = 0; i < filter->nr; i++) {
+		if (filter->sections[i].hi > filter->hi) {
+			filter->hi = filter->sections[i].hi;
+		}
+	}
+	filter->shift = GRANULE_SHIFT_MIN;
+	while (((filter->hi - filter->lo) >> filter->shift) >=
+	       BITMAP_BITS_MAX) {
+		filter->shift++;
+	}
+	granules = ((filter->hi - filter->lo) >> filter->shift) + 1;
+	filter->bitmap = calloc((granules + 63) / 64,
+				sizeof(*filter->bitmap));
+	for (i = 0; i < filter->nr; i++) {
+		const struct text_section *sec = &filter->sections[i];
+
+		for (g = (sec->lo - filter->lo) >> filter->shift;
+		     g <= (sec->hi - 1 - filter->lo) >> filter->shift; g++) {
+			filter->bitmap[g / 64] |= 1ULL << (g % 64);
+		}
+	}
+
+	return filter;
+}
+
+
+static const struct text_section *find_section(
+	const struct text_filter *filter, uint64_t addr)
+{
+	unsigned int lo = 0, hi = filter->nr;
+
+	/* first section starting after addr */
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (filter->sections[mid].lo <= addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == 0 || addr >= filter->sections[lo - 1].hi) {
+		return NULL;
+	}
+	return &filter->sections[lo - 1];
+}
+
+
+/*
+ * Whether a call instruction ends right before addr: e8 rel32, or ff /2
+ * with any addressing mode. A REX prefix does not change where the
+ * instruction ends.
+ */
+static bool follows_call(const struct text_section *sec, uint64_t addr)
+{
+	const unsigned char *p = sec->data + (addr - sec->lo);
+	uint64_t before = addr - sec->lo;
+
+	/* call rel32 */
+	if (before >= 5 && p[-5] == 0xe8) {
+		return true;
+	}
+	/* call *%reg, call *(%reg) */
+	if (before >= 2 && p[-2] == 0xff &&
+	    ((p[-1] & 0xf8) == 0xd0 ||
+	     ((p[-1] & 0xf8) == 0x10 && (p[-1] & 7) != 4 &&
+	      (p[-1] & 7) != 5))) {
+		return true;
+	}
+	/* call *(%reg,%reg,n), call *disp8(%reg) */
+	if (before >= 3 && p[-3] == 0xff &&
+	    (p[-2] == 0x14 || ((p[-2] & 0xf8) == 0x50 && (p[-2] & 7) != 4))) {
+		return true;
+	}
+	/* call *disp8(%reg,%reg,n) */
+	if (before >= 4 && p[-4] == 0xff && p[-3] == 0x54) {
+		return true;
+	}
+	/* call *disp32(%rip), call *disp32(%reg) */
+	if (before >= 6 && p[-6] == 0xff &&
+	    (p[-5] == 0x15 || ((p[-5] & 0xf8) == 0x90 && (p[-5] & 7) != 4))) {
+		return true;
+	}
+	/* call *disp32(%reg,%reg,n) */
+	return before >= 7 && p[-7] == 0xff && p[-6] == 0x94;
+}
+
+
+/* Whether addr may be a return address. Called on words already known to be
+ * in [filter->lo, filter->hi[. */
+static bool check_word(const struct text_filter *filter, uint64_t addr)
+{
+	const struct text_section *sec;
+	uint64_t g = (addr - filter->lo) >> filter->shift;
+
+	if (!(filter->bitmap[g / 64] & (1ULL << (g % 64))) ||
+	    (sec = find_section(filter, addr)) == NULL) {
+		return false;
+	}
+	return follows_call(sec, addr);
+}
+
+
+bool text_filter_ret_addr(const struct text_filter *filter, uint64_t addr)
+{
+	return addr - filter->lo < filter->hi - filter->lo &&
+		check_word(filter, addr);
+}
+
+
+/*
+ * Store in found the indexes of the words that look like return addresses,
+ * in stack order, and return their number, at most max. Nothing is
+ * allocated.
+ */
+unsigned int stack_scan(const struct text_filter *filter, uint64_t slide,
+			const uint64_t *words, unsigned int nr,
+			unsigned int *found, unsigned int max)
+{
+	uint64_t lo = filter->lo + slide, span = filter->hi - filter->lo;
+	unsigned int i = 0, j, found_nb = 0;
+
+	/* most words are data: reject them SCAN_LANES at a time with one
+	 * unsigned range comparison per lane */
+	for (; i + SCAN_LANES <= nr && found_nb < max; i += SCAN_LANES) {
+		scan_words block;
+		scan_mask in;
+		int64_t any = 0;
+
+		memcpy(&block, &words[i], sizeof(block));
+		in = (block - lo) < span;
+		for (j = 0; j < SCAN_LANES; j++) {
+			any |= in[j];
+		}
+		if (!any) {
+			continue;
+		}
+		for (j = 0; j < SCAN_LANES && found_nb < max; j++) {
+			if (in[j] && check_word(filter,
+						   words[i + j] - slide)) {
+				found[found_nb++] = i + j;
+			}
+		}
+	}
+	for (; i < nr && found_nb < max; i++) {
+		if (text_filter_ret_addr(filter, words[i] - slide)) {
+			found[found_nb++] = i;
+		}
+	}
+
+	return found_nb;
+}
+
+
+void text_filter_free(struct text_filter *filter)
+{
+	free(filter->sections);
+	free(filter->bitmap);
+	free(filter);
+}
@@ -0,0 +1,47 @@
+#ifndef _STACKSCAN_H
+#define _STACKSCAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libelf.h>
+
+/*
+ * Return addresses found by scanning raw stack words, like the "?" entries
+ * of kernel traces, for when unwinding stops early. Words are checked against
+ * the bounds of the executable sections several at a time, then against a
+ * bitmap of the pages holding code, and only the remaining ones are decoded:
+ * a return address must follow a call instruction. x86_64 only.
+ *
+ * The words are runtime addresses of code relocated by KASLR: they are
+ * rebased by the slide, the runtime address minus the link address, before
+ * they are checked.
+ */
+
+struct text_section {
+	uint64_t lo;
+	uint64_t hi;
+	/* contents of [lo, hi[ */
+	const unsigned char *data;
+};
+
+struct text_filter {
+	/* bounds of all the sections */
+	uint64_t lo;
+	uint64_t hi;
+	/* one bit per 1 << shift bytes of [lo, hi[ holding code */
+	uint64_t *bitmap;
+	unsigned int shift;
+	/* sorted by address */
+	struct text_section *sections;
+	unsigned int nr;
+};
+
+struct text_filter *text_filter_new(Elf *elf);
+bool text_filter_ret_addr(const struct text_filter *filter, uint64_t addr);
+unsigned int stack_scan(const struct text_filter *filter, uint64_t slide,
+			const uint64_t *words, unsigned int nr,
+			unsigned int *found, unsigned int max);
+void text_filter_free(struct text_filter *filter);
+
+#endif
@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "strpool.h"
+
+
+#define CHUNK_SIZE (64 * 1024)
+
+struct strpool_chunk {
+	struct strpool_chunk *next;
+	char data[];
+};
+
+
+const char *strpool_add_len(struct strpool *pool, const char *string,
+			    unsigned long len)
+{
+	char *result;
+
+	if (len + 1 > pool->left) {
+		unsigned long size = len + 1 > CHUNK_SIZE ? len + 1 :
+			CHUNK_SIZE;
+		struct strpool_chunk *chunk;
+
+		chunk = malloc(sizeof(*chunk) + size);
+		chunk->next = pool->chunks;
+		pool->chunks = chunk;
+		pool->pos = chunk->data;
+		pool->left = size;
+	}
+
+	result = pool->pos;
+	memcpy(result, string, len);
+	result[len] = '\0';
+	pool->pos += len + 1;
+	pool->left -= len + 1;
+
+	return result;
+}
+
+
+const char *strpool_add(struct strpool *pool, const char *string)
+{
+	return strpool_add_len(pool, string, strlen(string));
+}
+
+
+void strpool_free(struct strpool *pool)
+{
+	struct strpool_chunk *chunk, *next;
+
+	for (chunk = pool->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	pool->chunks = NULL;
+	pool->pos = NULL;
+	pool->left = 0;
+}
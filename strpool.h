@@ -0,0 +1,19 @@
+#ifndef _STRPOOL_H
+#define _STRPOOL_H
+
+/*
+ * Append-only string storage. Strings are packed in large chunks which are
+ * all released at once by strpool_free().
+ */
+struct strpool {
+	struct strpool_chunk *chunks;
+	char *pos;
+	unsigned long left;
+};
+
+const char *strpool_add(struct strpool *pool, const char *string);
+const char *strpool_add_len(struct strpool *pool, const char *string,
+			    unsigned long len);
+void strpool_free(struct strpool *pool);
+
+#endif
@@ -0,0 +1,384 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libelf.h>
+#include <gelf.h>
+
+#include "strpool.h"
+#include "symtab.h"
+
+
+/* symbol as read from the source, before indexing */
+struct raw_sym {
+	uint64_t start;
+	uint64_t size;
+	const char *name;
+	/* lower is preferred among aliases */
+	int rank;
+};
+
+struct raw_syms {
+	struct raw_sym *syms;
+	unsigned int nr;
+	unsigned int alloc;
+};
+
+
+static void raw_add(struct raw_syms *raw, uint64_t start, uint64_t size,
+		    const char *name, int rank)
+{
+	if (raw->nr == raw->alloc) {
+		raw->alloc = raw->alloc ? raw->alloc * 2 : 4096;
+		raw->syms = realloc(raw->syms,
+				    raw->alloc * sizeof(*raw->syms));
+	}
+	raw->syms[raw->nr++] = (struct raw_sym) {
+		.start = start,
+		.size = size,
+		.name = name,
+		.rank = rank,
+	};
+}
+
+
+static int raw_sym_cmp(const void *a, const void *b)
+{
+	const struct raw_sym *sa = a, *sb = b;
+
+	if (sa->start != sb->start) {
+		return sa->start < sb->start ? -1 : 1;
+	}
+	return sa->rank - sb->rank;
+}
+
+
+static void names_append(struct symtab *symtab, size_t *alloc,
+			 const void *data, size_t len)
+{
+	if (symtab->names_len + len > *alloc) {
+		while (symtab->names_len + len > *alloc) {
+			*alloc = *alloc ? *alloc * 2 : 64 * 1024;
+		}
+		symtab->names = realloc(symtab->names, *alloc);
+	}
+	memcpy(symtab->names + symtab->names_len, data, len);
+	symtab->names_len += len;
+}
+
+
+static struct symtab *symtab_build(struct raw_syms *raw)
+{
+	struct symtab *symtab;
+	const char *prev = NULL;
+	size_t alloc = 0;
+	unsigned int i, nr;
+
+	if (raw->nr == 0) {
+		return NULL;
+	}
+
+	qsort(raw->syms, raw->nr, sizeof(*raw->syms), raw_sym_cmp);
+	/* keep only the preferred alias at each address */
+	for (i = 1, nr = 1; i < raw->nr; i++) {
+		if (raw->syms[i].start != raw->syms[nr - 1].start) {
+			raw->syms[nr++] = raw->syms[i];
+		}
+	}
+
+	symtab = calloc(1, sizeof(*symtab));
+	symtab->nr = nr;
+	symtab->starts = malloc(nr * sizeof(*symtab->starts));
+	symtab->sizes = malloc(nr * sizeof(*symtab->sizes));
+	symtab->blocks = malloc((nr + SYMTAB_BLOCK - 1) / SYMTAB_BLOCK *
+				sizeof(*symtab->blocks));
+
+	for (i = 0; i < nr; i++) {
+		const struct raw_sym *sym = &raw->syms[i];
+		uint64_t size = sym->size;
+
+		/* kallsyms and some assembly symbols have no size, they
+		 * extend up to the next symbol */
+		if (size == 0 && i + 1 < nr) {
+			size = raw->syms[i + 1].start - sym->start;
+		}
+		symtab->starts[i] = sym->start;
+		symtab->sizes[i] = size > UINT32_MAX ? UINT32_MAX : size;
+
+		if (i % SYMTAB_BLOCK == 0) {
+			symtab->blocks[i / SYMTAB_BLOCK] = symtab->names_len;
+			names_append(symtab, &alloc, sym->name,
+				     strlen(sym->name) + 1);
+		} else {
+			size_t prefix = 0;
+			uint8_t byte;
+
+			while (prefix < UINT8_MAX && prev[prefix] &&
+			       prev[prefix] == sym->name[prefix]) {
+				prefix++;
+			}
+			byte = prefix;
+			names_append(symtab, &alloc, &byte, 1);
+			names_append(symtab, &alloc, sym->name + prefix,
+				     strlen(sym->name + prefix) + 1);
+		}
+		prev = sym->name;
+	}
+	symtab->names = realloc(symtab->names, symtab->names_len);
+
+	return symtab;
+}
+
+
+/* Returns NULL if the object has no function symbols, ie. it is stripped */
+struct symtab *symtab_from_elf(Elf *elf)
+{
+	struct raw_syms raw = {};
+	struct symtab *symtab;
+	Elf_Scn *scn = NULL;
+	size_t shnum;
+	bool *exec;
+
+	/* which sections contain code */
+	elf_getshdrnum(elf, &shnum);
+	exec = calloc(shnum, sizeof(*exec));
+	while ((scn = elf_nextscn(elf, scn)) != NULL) {
+		GElf_Shdr shdr;
+
+		gelf_getshdr(scn, &shdr);
+		exec[elf_ndxscn(scn)] = shdr.sh_flags & SHF_EXECINSTR;
+	}
+
+	while ((scn = elf_nextscn(elf, scn)) != NULL) {
+		GElf_Shdr shdr;
+		Elf_Data *data;
+		int i;
+
+		gelf_getshdr(scn, &shdr);
+		if (shdr.sh_type != SHT_SYMTAB) {
+			continue;
+		}
+
+		data = elf_getdata(scn, NULL);
+		for (i = 0; i < shdr.sh_size / shdr.sh_entsize; i++) {
+			GElf_Sym sym;
+			const char *name;
+			int type, rank;
+
+			gelf_getsym(data, i, &sym);
+			type = GELF_ST_TYPE(sym.st_info);
+			if (sym.st_shndx == SHN_UNDEF ||
+			    sym.st_shndx >= shnum || !exec[sym.st_shndx]) {
+				continue;
+			}
+			if (type == STT_FUNC) {
+				rank = 0;
+			} else if (type == STT_NOTYPE) {
+				/* assembly labels */
+				rank = 2;
+			} else {
+				continue;
+			}
+			if (GELF_ST_BIND(sym.st_info) == STB_LOCAL) {
+				rank++;
+			}
+
+			/* points into the ELF string table, valid until
+			 * the symtab is built */
+			name = elf_strptr(elf, shdr.sh_link, sym.st_name);
+			if (!name || !*name) {
+				continue;
+			}
+			raw_add(&raw, sym.st_value, sym.st_size, name, rank);
+		}
+	}
+	free(exec);
+
+	symtab = symtab_build(&raw);
+	free(raw.syms);
+	return symtab;
+}
+
+
+/* Read a "<address> <type> <name> [module]" listing, as found in
+ * /proc/kallsyms. Only core kernel text symbols are kept. */
+struct symtab *symtab_from_kallsyms(const char *path)
+{
+	struct raw_syms raw = {};
+	struct strpool pool = {};
+	struct symtab *symtab;
+	char *line = NULL;
+	size_t n = 0;
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "Error: open \"%s\" failed: %s\n", path,
+			strerror(errno));
+		abort();
+	}
+
+	while (getline(&line, &n, f) != -1) {
+		unsigned long long start;
+		char type, *name, *end;
+
+		start = strtoull(line, &end, 16);
+		if (end == line || end[0] != ' ' || end[1] == '\0' ||
+		    end[2] != ' ') {
+			continue;
+		}
+		type = end[1];
+		if (type != 'T' && type != 't' && type != 'W' &&
+		    type != 'w') {
+			continue;
+		}
+		name = end + 3;
+		end = name + strcspn(name, " \t\n");
+		if (*end == '\t') {
+			/* module symbol */
+			continue;
+		}
+		*end = '\0';
+
+		raw_add(&raw, start, 0, strpool_add(&pool, name),
+			type == 'T' ? 0 : 1);
+	}
+	free(line);
+	fclose(f);
+
+	symtab = symtab_build(&raw);
+	free(raw.syms);
+	strpool_free(&pool);
+	return symtab;
+}
+
+
+/* Returns the index of the symbol containing addr, -1 if there is none */
+int symtab_lookup(const struct symtab *symtab, uint64_t addr)
+{
+	unsigned int lo = 0, hi = symtab->nr;
+
+	/* first start > addr */
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (symtab->starts[mid] <= addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == 0) {
+		return -1;
+	}
+	lo--;
+
+	if (addr - symtab->starts[lo] >= symtab->sizes[lo] &&
+	    addr != symtab->starts[lo]) {
+		return -1;
+	}
+	return lo;
+}
+
+
+/* Decode the name of symbol index into buf, which is returned */
+const char *symtab_name(const struct symtab *symtab, unsigned int index,
+			char *buf, size_t len)
+{
+	const char *p = (const char *) symtab->names +
+		symtab->blocks[index / SYMTAB_BLOCK];
+	size_t name_len;
+	int i;
+
+	name_len = strlen(p);
+	if (name_len >= len) {
+		name_len = len - 1;
+	}
+	memcpy(buf, p, name_len);
+	buf[name_len] = '\0';
+	p += strlen(p) + 1;
+
+	for (i = 0; i < index % SYMTAB_BLOCK; i++) {
+		size_t prefix = *(const uint8_t *) p++;
+		size_t suffix_len = strlen(p);
+
+		if (prefix > name_len) {
+			/* truncated by len */
+			prefix = name_len;
+		}
+		if (prefix + suffix_len >= len) {
+			suffix_len = len - 1 - prefix;
+		}
+		memcpy(buf + prefix, p, suffix_len);
+		name_len = prefix + suffix_len;
+		buf[name_len] = '\0';
+		p += strlen(p) + 1;
+	}
+
+	return buf;
+}
+
+
+static uint32_t name_hash(const char *name)
+{
+	uint32_t hash = 0x811c9dc5;
+
+	while (*name) {
+		hash ^= (unsigned char) *name++;
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
+
+/* Returns the index of the symbol called name, -1 if there is none */
+int symtab_find(struct symtab *symtab, const char *name)
+{
+	char buf[256];
+	uint32_t i, mask;
+
+	if (!symtab->by_name) {
+		symtab->by_name_size = 1;
+		while (symtab->by_name_size < symtab->nr * 2) {
+			symtab->by_name_size *= 2;
+		}
+		symtab->by_name = calloc(symtab->by_name_size,
+					 sizeof(*symtab->by_name));
+		mask = symtab->by_name_size - 1;
+		for (i = 0; i < symtab->nr; i++) {
+			uint32_t slot;
+
+			symtab_name(symtab, i, buf, sizeof(buf));
+			for (slot = name_hash(buf) & mask;
+			     symtab->by_name[slot];
+			     slot = (slot + 1) & mask) {
+			}
+			symtab->by_name[slot] = i + 1;
+		}
+	}
+
+	mask = symtab->by_name_size - 1;
+	for (i = name_hash(name) & mask; symtab->by_name[i];
+	     i = (i + 1) & mask) {
+		unsigned int index = symtab->by_name[i] - 1;
+
+		if (strcmp(symtab_name(symtab, index, buf, sizeof(buf)),
+			   name) == 0) {
+			return index;
+		}
+	}
+
+	return -1;
+}
+
+
+void symtab_free(struct symtab *symtab)
+{
+	free(symtab->by_name);
+	free(symtab->starts);
+	free(symtab->sizes);
+	free(symtab->blocks);
+	free(symtab->names);
+	free(symtab);
+}
@@ -0,0 +1,44 @@
+#ifndef _SYMTAB_H
+#define _SYMTAB_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <libelf.h>
+
+/*
+ * Sorted index of the function symbols of an image, built from the ELF
+ * .symtab or from a /proc/kallsyms listing. It covers code that has no DWARF
+ * subprogram entries, like assembly.
+ *
+ * Names are front coded in address order: each block of SYMTAB_BLOCK names
+ * starts with a full name and every following name is stored as the length
+ * of the prefix it shares with the previous one plus the remaining suffix.
+ */
+
+#define SYMTAB_BLOCK 16
+
+struct symtab {
+	/* starts[i], sizes[i] describe symbol i */
+	uint64_t *starts;
+	uint32_t *sizes;
+	unsigned int nr;
+	/* offset in names of the first name of each block */
+	uint32_t *blocks;
+	uint8_t *names;
+	size_t names_len;
+	/* open addressing, index + 1 of each symbol keyed by the hash of its
+	 * name, built by the first symtab_find() */
+	uint32_t *by_name;
+	unsigned int by_name_size;
+};
+
+struct symtab *symtab_from_elf(Elf *elf);
+struct symtab *symtab_from_kallsyms(const char *path);
+int symtab_lookup(const struct symtab *symtab, uint64_t addr);
+int symtab_find(struct symtab *symtab, const char *name);
+const char *symtab_name(const struct symtab *symtab, unsigned int index,
+			char *buf, size_t len);
+void symtab_free(struct symtab *symtab);
+
+#endif
@@ -0,0 +1,855 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libelf.h>
+#include <libdwarf/libdwarf.h>
+
+#include "arch.h"
+#include "core_walk.h"
+#include "datasym.h"
+#include "image.h"
+#include "listwalk.h"
+#include "memsrc.h"
+#include "resolve.h"
+#include "stackscan.h"
+#include "strpool.h"
+#include "tasks.h"
+#include "types.h"
+#include "unwind.h"
+#include "util.h"
+
+/* used when union thread_union is not described */
+#define DEFAULT_THREAD_SIZE 16384
+/* pid_max can not be larger */
+#define MAX_TASKS (4 * 1024 * 1024)
+/* tasks named in the header of each group of identical stacks */
+#define GROUP_EXAMPLES 4
+/* frame_regs[].reg of the saved pc, which has no register slot */
+#define FRAME_REG_PC (-1)
+
+/* offsets of the members used, from the cached layouts */
+struct task_layout {
+	const struct type_desc *task_type;
+	Dwarf_Unsigned tasks;
+	Dwarf_Unsigned pid;
+	Dwarf_Unsigned comm;
+	Dwarf_Unsigned stack;
+	Dwarf_Unsigned thread_sp;
+	Dwarf_Unsigned thread_size;
+	/* threads are on signal->thread_head through thread_node, or on the
+	 * older thread_group list */
+	bool have_thread_node;
+	Dwarf_Unsigned signal;
+	Dwarf_Unsigned signal_thread_head;
+	Dwarf_Unsigned thread_node;
+	bool have_thread_group;
+	Dwarf_Unsigned thread_group;
+	/* registers saved by the context switch: pushed by __switch_to_asm
+	 * at thread.sp on x86_64, in thread.cpu_context of the task on arm64,
+	 * where frame_in_task is set */
+	bool have_frame;
+	bool frame_in_task;
+	Dwarf_Unsigned frame_size;
+	unsigned int frame_regs_nb;
+	struct {
+		int reg;
+		Dwarf_Unsigned offset;
+	} frame_regs[ARCH_REGS_MAX];
+	/* older kernels save the pc in thread.ip */
+	bool have_thread_ip;
+	Dwarf_Unsigned thread_ip;
+	/* CONFIG_VMAP_STACK: stacks are in vmalloc space */
+	bool vmap_stack;
+	/* struct rq */
+	bool have_rq;
+	Dwarf_Unsigned rq_curr;
+	Dwarf_Unsigned rq_idle;
+};
+
+struct task_set {
+	struct task *tasks;
+	unsigned int nr;
+	unsigned int alloc;
+};
+
+struct bt_job {
+	struct image *image;
+	struct cfi_cache *cfi;
+	const struct task_layout *layout;
+	/* NULL unless stacks are scanned when unwinding stops early */
+	const struct text_filter *text;
+	/* -1 to unwind through CFI only, else check of unwind_stack_fp */
+	int fp_check;
+	/* KASLR slide of the dumped kernel */
+	uint64_t slide;
+	/* summed by the workers */
+	struct unwind_fp_stats fp_stats;
+	struct task *tasks;
+	unsigned int nr;
+	/* next task to unwind, shared by the workers */
+	unsigned int next;
+};
+
+struct task_group {
+	struct task **tasks;
+	unsigned int nr;
+};
+
+
+static int member_offset(const struct type_desc *type, const char *path,
+			 Dwarf_Unsigned *offset)
+{
+	const struct type_desc *result;
+
+	if (!type) {
+		return -1;
+	}
+	return type_resolve_path(type, path, offset, &result);
+}
+
+
+struct frame_member {
+	const char *name;
+	int reg;
+};
+
+static void add_frame_regs(struct task_layout *layout,
+			   const struct type_desc *type,
+			   const struct frame_member *members, unsigned int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		Dwarf_Unsigned offset;
+
+		if (member_offset(type, members[i].name, &offset) == 0) {
+			layout->frame_regs[layout->frame_regs_nb].reg =
+				members[i].reg;
+			layout->frame_regs[layout->frame_regs_nb].offset =
+				offset;
+			layout->frame_regs_nb++;
+		}
+	}
+}
+
+
+static int get_x86_64_layout(struct type_cache *types,
+			     struct task_layout *layout)
+{
+	static const struct frame_member frame_members[] = {
+		{"bx", REG_BX},
+		{"bp", REG_BP},
+		{"r12", 12},
+		{"r13", 13},
+		{"r14", 14},
+		{"r15", 15},
+		{"ret_addr", FRAME_REG_PC},
+	};
+	const struct type_desc *type;
+
+	if (member_offset(layout->task_type, "thread.sp",
+			  &layout->thread_sp)) {
+		return -1;
+	}
+	type = type_cache_find(types, "struct inactive_task_frame");
+	if (type && type->size) {
+		layout->have_frame = true;
+		layout->frame_size = type->size;
+		add_frame_regs(layout, type, frame_members,
+			       ARRAY_SIZE(frame_members));
+	}
+	layout->have_thread_ip = member_offset(layout->task_type, "thread.ip",
+					       &layout->thread_ip) == 0;
+	return 0;
+}
+
+
+/* cpu_switch_to saves the callee-saved registers, sp and lr as pc */
+static int get_arm64_layout(struct task_layout *layout)
+{
+	static const struct frame_member context_members[] = {
+		{"thread.cpu_context.x19", 19},
+		{"thread.cpu_context.x20", 20},
+		{"thread.cpu_context.x21", 21},
+		{"thread.cpu_context.x22", 22},
+		{"thread.cpu_context.x23", 23},
+		{"thread.cpu_context.x24", 24},
+		{"thread.cpu_context.x25", 25},
+		{"thread.cpu_context.x26", 26},
+		{"thread.cpu_context.x27", 27},
+		{"thread.cpu_context.x28", 28},
+		{"thread.cpu_context.fp", ARCH_ARM64_FP},
+		{"thread.cpu_context.sp", ARCH_ARM64_SP},
+		{"thread.cpu_context.pc", FRAME_REG_PC},
+	};
+	int i;
+
+	add_frame_regs(layout, layout->task_type, context_members,
+		       ARRAY_SIZE(context_members));
+	for (i = 0; i < layout->frame_regs_nb; i++) {
+		if (layout->frame_regs[i].reg == ARCH_ARM64_SP) {
+			layout->have_frame = true;
+			layout->frame_in_task = true;
+		}
+	}
+	return layout->have_frame ? 0 : -1;
+}
+
+
+static int get_layout(struct image *image, struct task_layout *layout)
+{
+	struct type_cache *types = image_type_cache(image);
+	const struct type_desc *type;
+	Dwarf_Unsigned offset;
+	int retval;
+
+	if (!image->arch) {
+		fprintf(stderr,
+			"Error: unwinding is not supported on this architecture.\n");
+		return -1;
+	}
+	*layout = (struct task_layout) {
+		.task_type = type_cache_find(types, "struct task_struct"),
+	};
+	switch (image->arch->machine) {
+	case EM_X86_64:
+		retval = get_x86_64_layout(types, layout);
+		break;
+	case EM_AARCH64:
+		retval = get_arm64_layout(layout);
+		break;
+	default:
+		fprintf(stderr,
+			"Error: the registers of sleeping tasks are not known on %s.\n",
+			image->arch->name);
+		return -1;
+	}
+	if (retval ||
+	    member_offset(layout->task_type, "tasks", &layout->tasks) ||
+	    member_offset(layout->task_type, "pid", &layout->pid) ||
+	    member_offset(layout->task_type, "comm", &layout->comm) ||
+	    member_offset(layout->task_type, "stack", &layout->stack)) {
+		fprintf(stderr,
+			"Error: no usable struct task_struct in the debugging information.\n");
+		return -1;
+	}
+
+	type = type_cache_find(types, "union thread_union");
+	layout->thread_size = type && type->size ? type->size :
+		DEFAULT_THREAD_SIZE;
+
+	layout->have_thread_node =
+		member_offset(layout->task_type, "signal",
+			      &layout->signal) == 0 &&
+		member_offset(type_cache_find(types, "struct signal_struct"),
+			      "thread_head",
+			      &layout->signal_thread_head) == 0 &&
+		member_offset(layout->task_type, "thread_node",
+			      &layout->thread_node) == 0;
+	layout->have_thread_group =
+		member_offset(layout->task_type, "thread_group",
+			      &layout->thread_group) == 0;
+
+	layout->vmap_stack = member_offset(layout->task_type, "stack_vm_area",
+					   &offset) == 0;
+
+	type = type_cache_find(types, "struct rq");
+	layout->have_rq = member_offset(type, "curr", &layout->rq_curr) == 0 &&
+		member_offset(type, "idle", &layout->rq_idle) == 0;
+
+	return 0;
+}
+
+
+static void add_task(struct task_set *set, uint64_t addr, int cpu)
+{
+	if (!addr || set->nr == MAX_TASKS) {
+		return;
+	}
+	if (set->nr == set->alloc) {
+		set->alloc = set->alloc ? set->alloc * 2 : 1024;
+		set->tasks = realloc(set->tasks, set->alloc *
+				     sizeof(*set->tasks));
+	}
+	set->tasks[set->nr++] = (struct task) {
+		.addr = addr,
+		.cpu = cpu,
+	};
+}
+
+
+static int read_ptr(struct mem_cache *cache, Dwarf_Half addr_size,
+		    uint64_t addr, uint64_t *value)
+{
+	*value = 0;
+	return mem_cache_read(cache, addr, value, addr_size);
+}
+
+
+static void add_list(struct task_set *set, struct mem_cache *cache,
+		     struct image *image, const struct task_layout *layout,
+		     uint64_t head, const char *member)
+{
+	struct list_walk walk;
+	uint64_t task;
+
+	if (list_walk_init(&walk, cache, image->addr_size, WALK_LIST, head,
+			   layout->task_type, member, MAX_TASKS) != 0) {
+		return;
+	}
+	while (list_walk_next(&walk, &task)) {
+		add_task(set, task, -1);
+	}
+}
+
+
+/* the current and idle tasks of each cpu, slide is the KASLR slide */
+static void add_runqueues(struct task_set *set, struct mem_cache *cache,
+			  struct image *image,
+			  const struct task_layout *layout, uint64_t slide)
+{
+	struct data_index *index = image_data_index(image);
+	const struct data_sym *sym;
+	Dwarf_Addr *offsets, runqueues, per_cpu_offset;
+	uint64_t offset;
+	uint32_t nr_cpus = 0;
+	int cpu;
+
+	if (!layout->have_rq ||
+	    (sym = data_index_find(index, "runqueues")) == NULL) {
+		return;
+	}
+	/* an offset in the per-cpu areas */
+	runqueues = data_sym_address(index, sym, slide);
+	if ((sym = data_index_find(index, "nr_cpu_ids")) == NULL ||
+	    mem_cache_read(cache, data_sym_address(index, sym, slide),
+			   &nr_cpus, sizeof(nr_cpus)) != 0 ||
+	    (sym = data_index_find(index, "__per_cpu_offset")) == NULL) {
+		return;
+	}
+	if (nr_cpus > sym->size / image->addr_size) {
+		nr_cpus = sym->size / image->addr_size;
+	}
+	per_cpu_offset = data_sym_address(index, sym, slide);
+
+	offsets = malloc(nr_cpus * sizeof(*offsets));
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		uint64_t rq, curr, idle;
+
+		if (read_ptr(cache, image->addr_size,
+			     per_cpu_offset + cpu * image->addr_size,
+			     &offset) != 0) {
+			break;
+		}
+		offsets[cpu] = offset;
+		rq = runqueues + offset;
+		if (read_ptr(cache, image->addr_size, rq + layout->rq_curr,
+			     &curr) == 0) {
+			add_task(set, curr, cpu);
+		}
+		if (read_ptr(cache, image->addr_size, rq + layout->rq_idle,
+			     &idle) == 0) {
+			add_task(set, idle, -1);
+		}
+	}
+	/* pointers into per-cpu areas are now annotated with their cpu */
+	data_index_set_percpu_offsets(index, offsets, cpu);
+	free(offsets);
+}
+
+
+/*
+ * ELF dumps do not map vmalloc space, where the stacks are under
+ * CONFIG_VMAP_STACK: reads there go through the kernel page tables, found
+ * on x86_64 only. slide is the KASLR slide.
+ */
+static int map_page_tables(struct image *image,
+			   const struct task_layout *layout, uint64_t slide)
+{
+	struct data_index *index = image_data_index(image);
+	const struct data_sym *sym = NULL;
+	uint32_t l5_enabled = 0;
+
+	if (image->arch->machine == EM_X86_64) {
+		if ((sym = data_index_find(index, "init_top_pgt")) == NULL) {
+			/* before 4.13 */
+			sym = data_index_find(index, "init_level4_pgt");
+		}
+	}
+	if (sym) {
+		const struct data_sym *l5;
+
+		l5 = data_index_find(index, "__pgtable_l5_enabled");
+		if (l5) {
+			mem_read(image->mem, data_sym_address(index, l5, slide),
+				 &l5_enabled, sizeof(l5_enabled));
+		}
+		if (mem_source_set_page_table(image->mem,
+					      data_sym_address(index, sym,
+							       slide),
+					      l5_enabled ? 5 : 4) == 0) {
+			return 0;
+		}
+	}
+	if (layout->vmap_stack) {
+		fprintf(stderr,
+			"Error: task stacks are in vmalloc space (CONFIG_VMAP_STACK), whose page tables are not readable in this dump.\n");
+		return -1;
+	}
+	return 0;
+}
+
+
+static int task_addr_cmp(const void *a, const void *b)
+{
+	const struct task *ta = a, *tb = b;
+
+	if (ta->addr != tb->addr) {
+		return ta->addr < tb->addr ? -1 : 1;
+	}
+	/* running first */
+	return tb->cpu - ta->cpu;
+}
+
+
+/* The data symbols are read at their link address moved by slide */
+static int find_tasks(struct image *image, const struct task_layout *layout,
+		      uint64_t slide, struct task_set *set)
+{
+	struct data_index *index = image_data_index(image);
+	const struct data_sym *sym;
+	struct mem_cache cache;
+	struct list_walk walk;
+	uint64_t init_task, process;
+	unsigned int i, nr;
+
+	if ((sym = data_index_find(index, "init_task")) == NULL) {
+		fprintf(stderr, "Error: init_task not found.\n");
+		return -1;
+	}
+	init_task = data_sym_address(index, sym, slide);
+
+	mem_cache_init(&cache, image->mem, WALK_CACHE_PAGES, WALK_READAHEAD);
+	add_task(set, init_task, -1);
+	list_walk_init(&walk, &cache, image->addr_size, WALK_LIST,
+		       init_task + layout->tasks,
+		       layout->task_type, "tasks", MAX_TASKS);
+	while (list_walk_next(&walk, &process)) {
+		uint64_t signal;
+
+		add_task(set, process, -1);
+		if (layout->have_thread_node &&
+		    read_ptr(&cache, image->addr_size,
+			     process + layout->signal, &signal) == 0 &&
+		    signal) {
+			/* the leader is on the list too, it is deduplicated
+			 * below */
+			add_list(set, &cache, image, layout,
+				 signal + layout->signal_thread_head,
+				 "thread_node");
+		} else if (layout->have_thread_group) {
+			add_list(set, &cache, image, layout,
+				 process + layout->thread_group,
+				 "thread_group");
+		}
+	}
+	if (walk.status != WALK_END) {
+		fprintf(stderr, "Warning: task list walk stopped: %s\n",
+			walk_status_names[walk.status]);
+	}
+	add_runqueues(set, &cache, image, layout, slide);
+	mem_cache_free(&cache);
+
+	qsort(set->tasks, set->nr, sizeof(*set->tasks), task_addr_cmp);
+	for (i = 0, nr = 0; i < set->nr; i++) {
+		if (nr && set->tasks[nr - 1].addr == set->tasks[i].addr) {
+			continue;
+		}
+		set->tasks[nr++] = set->tasks[i];
+	}
+	set->nr = nr;
+
+	return 0;
+}
+
+
+static int read_frame_regs(struct mem_cache *cache, Dwarf_Half addr_size,
+			   const struct task_layout *layout, uint64_t base,
+			   struct unwind_regs *regs)
+{
+	int i;
+
+	for (i = 0; i < layout->frame_regs_nb; i++) {
+		int reg = layout->frame_regs[i].reg;
+		uint64_t *value = reg == FRAME_REG_PC ? &regs->pc :
+			&regs->regs[reg];
+
+		if (read_ptr(cache, addr_size,
+			     base + layout->frame_regs[i].offset,
+			     value) != 0) {
+			return -1;
+		}
+		if (reg != FRAME_REG_PC) {
+			regs->valid |= 1ULL << reg;
+		}
+	}
+	return 0;
+}
+
+
+/* Complete the backtrace of task with the words of [sp, end of the stack[
+ * that look like return addresses. words holds a whole stack. */
+static void scan_task(struct bt_job *job, struct mem_cache *cache,
+		      struct task *task, uint64_t stack, uint64_t sp,
+		      uint64_t *words)
+{
+	uint64_t end = stack + job->layout->thread_size;
+	unsigned int found[TASK_MAX_FRAMES];
+	unsigned int i, nr;
+
+	if (sp < stack || sp >= end) {
+		sp = stack;
+	}
+	sp &= ~(uint64_t) (sizeof(*words) - 1);
+	if (mem_cache_read(cache, sp, words, end - sp) != 0) {
+		return;
+	}
+	nr = stack_scan(job->text, job->slide, words,
+			(end - sp) / sizeof(*words), found,
+			TASK_MAX_FRAMES - task->frames_nb);
+	for (i = 0; i < nr; i++) {
+		task->pcs[task->frames_nb++] = words[found[i]] - job->slide;
+	}
+}
+
+
+static void backtrace_task(struct bt_job *job, struct mem_cache *cache,
+			   struct task *task, uint64_t *words,
+			   struct unwind_fp_stats *fp_stats)
+{
+	const struct task_layout *layout = job->layout;
+	Dwarf_Half addr_size = job->image->addr_size;
+	struct unwind_regs regs = {
+		.slide = job->slide,
+	};
+	uint64_t stack, sp;
+
+	mem_cache_read(cache, task->addr + layout->pid, &task->pid,
+		       sizeof(task->pid));
+	mem_cache_read(cache, task->addr + layout->comm, task->comm,
+		       sizeof(task->comm));
+	task->comm[sizeof(task->comm) - 1] = '\0';
+	task->status = UNWIND_FAULT;
+
+	/* the registers of running tasks are not in thread_struct */
+	if (task->cpu >= 0) {
+		return;
+	}
+	if (read_ptr(cache, addr_size, task->addr + layout->stack,
+		     &stack) != 0) {
+		return;
+	}
+
+	if (layout->frame_in_task) {
+		if (read_frame_regs(cache, addr_size, layout, task->addr,
+				    &regs) != 0) {
+			return;
+		}
+	} else if (read_ptr(cache, addr_size, task->addr + layout->thread_sp,
+			    &sp) != 0) {
+		return;
+	} else if (layout->have_frame) {
+		if (read_frame_regs(cache, addr_size, layout, sp,
+				    &regs) != 0) {
+			return;
+		}
+		regs.regs[REG_SP] = sp + layout->frame_size;
+		regs.valid |= 1ULL << REG_SP;
+	} else if (layout->have_thread_ip) {
+		if (read_ptr(cache, addr_size, task->addr + layout->thread_ip,
+			     &regs.pc) != 0) {
+			return;
+		}
+		regs.regs[REG_SP] = sp;
+		regs.valid |= 1ULL << REG_SP;
+	} else {
+		task->status = UNWIND_NO_CFI;
+		return;
+	}
+	/* the saved pc is a runtime address */
+	if (regs.pc) {
+		regs.pc -= job->slide;
+	}
+
+	if (job->fp_check >= 0) {
+		task->frames_nb = unwind_stack_fp(job->cfi, cache, addr_size,
+						  &regs, stack,
+						  stack + layout->thread_size,
+						  task->pcs, TASK_MAX_FRAMES,
+						  job->fp_check, fp_stats,
+						  &task->status);
+	} else {
+		task->frames_nb = unwind_stack(job->cfi, cache, addr_size,
+					       &regs, stack,
+					       stack + layout->thread_size,
+					       task->pcs, TASK_MAX_FRAMES,
+					       &task->status);
+	}
+	task->reliable_nb = task->frames_nb;
+	if (job->text && task->status != UNWIND_END &&
+	    task->status != UNWIND_MAX_FRAMES) {
+		scan_task(job, cache, task, stack,
+			  regs.regs[job->image->arch->sp], words);
+	}
+}
+
+
+static uint64_t stack_hash(const struct task *task)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	int i;
+
+	for (i = 0; i < task->frames_nb; i++) {
+		hash = (hash ^ task->pcs[i]) * 0x100000001b3ULL;
+	}
+	hash = (hash ^ task->reliable_nb) * 0x100000001b3ULL;
+	return (hash ^ task->status) * 0x100000001b3ULL;
+}
+
+
+static void *bt_worker(void *arg)
+{
+	struct bt_job *job = arg;
+	struct unwind_fp_stats fp_stats = {};
+	struct mem_cache cache;
+	uint64_t *words = NULL;
+	unsigned int i;
+
+	mem_cache_init(&cache, job->image->mem, 64, 1);
+	if (job->text) {
+		words = malloc(job->layout->thread_size);
+	}
+	while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+	       job->nr) {
+		struct task *task = &job->tasks[i];
+
+		backtrace_task(job, &cache, task, words, &fp_stats);
+		task->hash = stack_hash(task);
+	}
+	__atomic_fetch_add(&job->fp_stats.frames, fp_stats.frames,
+			   __ATOMIC_RELAXED);
+	__atomic_fetch_add(&job->fp_stats.checked, fp_stats.checked,
+			   __ATOMIC_RELAXED);
+	__atomic_fetch_add(&job->fp_stats.mismatches, fp_stats.mismatches,
+			   __ATOMIC_RELAXED);
+	free(words);
+	mem_cache_free(&cache);
+
+	return NULL;
+}
+
+
+static int stack_cmp(const struct task *ta, const struct task *tb)
+{
+	int i;
+
+	if ((ta->cpu >= 0) != (tb->cpu >= 0)) {
+		return ta->cpu >= 0 ? 1 : -1;
+	}
+	if (ta->hash != tb->hash) {
+		return ta->hash < tb->hash ? -1 : 1;
+	}
+	if (ta->frames_nb != tb->frames_nb) {
+		return ta->frames_nb < tb->frames_nb ? -1 : 1;
+	}
+	if (ta->reliable_nb != tb->reliable_nb) {
+		return ta->reliable_nb < tb->reliable_nb ? -1 : 1;
+	}
+	for (i = 0; i < ta->frames_nb; i++) {
+		if (ta->pcs[i] != tb->pcs[i]) {
+			return ta->pcs[i] < tb->pcs[i] ? -1 : 1;
+		}
+	}
+	if (ta->status != tb->status) {
+		return ta->status < tb->status ? -1 : 1;
+	}
+	return 0;
+}
+
+
+/* order by stack, so that identical stacks are next to each other */
+static int task_stack_cmp(const void *a, const void *b)
+{
+	const struct task *ta = *(const struct task **) a;
+	const struct task *tb = *(const struct task **) b;
+	int retval;
+
+	if ((retval = stack_cmp(ta, tb)) != 0) {
+		return retval;
+	}
+	return ta->pid - tb->pid;
+}
+
+
+static int group_cmp(const void *a, const void *b)
+{
+	const struct task_group *ga = a, *gb = b;
+
+	if (ga->nr != gb->nr) {
+		return ga->nr < gb->nr ? 1 : -1;
+	}
+	return ga->tasks[0]->pid - gb->tasks[0]->pid;
+}
+
+
+static void print_group(struct image *image, const struct task_group *group,
+			struct strpool *pool)
+{
+	const struct task *task = group->tasks[0];
+	int i;
+
+	printf("%u task%s:", group->nr, group->nr > 1 ? "s" : "");
+	for (i = 0; i < group->nr && i < GROUP_EXAMPLES; i++) {
+		printf(" %s (%d)", group->tasks[i]->comm,
+		       group->tasks[i]->pid);
+	}
+	printf("%s\n", group->nr > GROUP_EXAMPLES ? " ..." : "");
+
+	for (i = 0; i < task->frames_nb; i++) {
+		struct resolved_frame frame;
+
+		printf("    #%-2d %s", i, i >= task->reliable_nb ? "? " : "");
+		if (i) {
+			resolve_return_pc(image, task->pcs[i], pool, &frame);
+		} else {
+			resolve_pc(image, task->pcs[i], pool, &frame);
+		}
+		resolved_frame_print_line(stdout, &frame, image->addr_size);
+	}
+	if (task->status != UNWIND_END) {
+		printf("    -- %s\n", unwind_status_names[task->status]);
+	}
+	printf("\n");
+}
+
+
+/*
+ * Unwind every task of the dump with jobs threads, then print one entry per
+ * distinct stack, the most common first. fp_check >= 0 follows the frame
+ * pointer chains, checking one frame in fp_check against CFI. slide is the
+ * KASLR slide of the dumped kernel: the data symbols are read at their link
+ * address plus slide, and the addresses found on the stacks are rebased by
+ * it.
+ */
+void tasks_print_backtraces(struct image *image, unsigned int jobs,
+			    bool scan, int fp_check, uint64_t slide,
+			    bool verbose)
+{
+	struct task_layout layout;
+	struct task_set set = {};
+	struct strpool pool = {};
+	struct task_group *groups;
+	struct task **sorted;
+	struct bt_job job;
+	struct timespec start, end;
+	pthread_t *threads;
+	unsigned int i, groups_nb, running = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (get_layout(image, &layout) != 0 ||
+	    map_page_tables(image, &layout, slide) != 0 ||
+	    find_tasks(image, &layout, slide, &set) != 0) {
+		return;
+	}
+
+	/* everything the workers share is built beforehand */
+	job = (struct bt_job) {
+		.image = image,
+		.cfi = image_cfi(image),
+		.layout = &layout,
+		.text = scan ? image_text_filter(image) : NULL,
+		.fp_check = fp_check,
+		.slide = slide,
+		.tasks = set.tasks,
+		.nr = set.nr,
+	};
+	image_symtab(image);
+	if (scan && !job.text) {
+		fprintf(stderr,
+			"Warning: stacks can only be scanned in x86_64 images.\n");
+	}
+
+	if (jobs < 1) {
+		jobs = 1;
+	}
+	threads = malloc(jobs * sizeof(*threads));
+	for (i = 0; i < jobs; i++) {
+		if (pthread_create(&threads[i], NULL, bt_worker, &job) != 0) {
+			fprintf(stderr, "Error: pthread_create failed.\n");
+			abort();
+		}
+	}
+	for (i = 0; i < jobs; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	sorted = malloc(set.nr * sizeof(*sorted));
+	for (i = 0; i < set.nr; i++) {
+		sorted[i] = &set.tasks[i];
+	}
+	qsort(sorted, set.nr, sizeof(*sorted), task_stack_cmp);
+
+	groups = malloc(set.nr * sizeof(*groups));
+	groups_nb = 0;
+	for (i = 0; i < set.nr; i++) {
+		if (sorted[i]->cpu >= 0) {
+			running++;
+			continue;
+		}
+		if (groups_nb && stack_cmp(sorted[i - 1], sorted[i]) == 0) {
+			groups[groups_nb - 1].nr++;
+			continue;
+		}
+		groups[groups_nb++] = (struct task_group) {
+			.tasks = &sorted[i],
+			.nr = 1,
+		};
+	}
+	qsort(groups, groups_nb, sizeof(*groups), group_cmp);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("%u tasks, %u distinct stacks, %u running\n\n", set.nr,
+	       groups_nb, running);
+	for (i = 0; i < groups_nb; i++) {
+		print_group(image, &groups[i], &pool);
+	}
+	strpool_free(&pool);
+	for (i = 0; i < set.nr; i++) {
+		if (sorted[i]->cpu >= 0) {
+			printf("running on cpu %d: %s (%d), registers are not in thread_struct\n",
+			       sorted[i]->cpu, sorted[i]->comm, sorted[i]->pid);
+		}
+	}
+
+	if (verbose) {
+		printf("\n%.3f s with %u threads, %u CFI rows, memory: %lu reads, %llu bytes\n",
+		       (end.tv_sec - start.tv_sec) +
+		       (end.tv_nsec - start.tv_nsec) / 1e9, jobs,
+		       job.cfi->rows_nb, image->mem->reads,
+		       image->mem->bytes_read);
+		if (fp_check >= 0) {
+			printf("frame pointers: %lu frames, %lu checked against CFI, %lu mismatches\n",
+			       job.fp_stats.frames, job.fp_stats.checked,
+			       job.fp_stats.mismatches);
+		}
+	}
+
+	free(groups);
+	free(sorted);
+	free(set.tasks);
+}
@@ -0,0 +1,39 @@
+#ifndef _TASKS_H
+#define _TASKS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "unwind.h"
+
+struct image;
+
+/*
+ * Backtraces of all the tasks of a dump. Tasks are found on the init_task
+ * list, the thread lists of each process and the runqueues of each cpu.
+ */
+
+#define TASK_COMM_LEN 16
+#define TASK_MAX_FRAMES 48
+/* one frame in 16 unwound through frame pointers is checked against CFI */
+#define TASK_FP_CHECK_DEFAULT 16
+
+struct task {
+	uint64_t addr;
+	/* current task of this cpu, -1 if not running */
+	int cpu;
+	int pid;
+	char comm[TASK_COMM_LEN];
+	unsigned int frames_nb;
+	/* pcs[reliable_nb] on were found by scanning the stack */
+	unsigned int reliable_nb;
+	uint64_t pcs[TASK_MAX_FRAMES];
+	enum unwind_status status;
+	uint64_t hash;
+};
+
+void tasks_print_backtraces(struct image *image, unsigned int jobs,
+			    bool scan, int fp_check, uint64_t slide,
+			    bool verbose);
+
+#endif
@@ -0,0 +1,127 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libdwarf/libdwarf.h>
+
+#include "../cluster.h"
+#include "../core_walk.h"
+#include "../image.h"
+#include "../symtab.h"
+
+/*
+ * The Space-Saving cluster set with more signatures than it keeps: evictions
+ * move entries around the heap, the hash table must follow them.
+ */
+
+#define CLUSTERS_MAX 1024
+#define SIGNATURES_NB 1500
+#define REPORTS_NB 200000
+
+/* the signer is not exercised, nothing is loaded */
+struct symtab *image_symtab(struct image *image)
+{
+	return NULL;
+}
+
+int image_find_cu(struct image *image, Dwarf_Addr pc, Dwarf_Die *result)
+{
+	return -1;
+}
+
+int find_lineno_by_pc(Dwarf_Debug dwarf, Dwarf_Die cu_die, Dwarf_Addr pc,
+		      char **file, unsigned int *line)
+{
+	return -1;
+}
+
+int symtab_find(struct symtab *symtab, const char *name)
+{
+	return -1;
+}
+
+void dwarf_dealloc(Dwarf_Debug dwarf, Dwarf_Ptr space, Dwarf_Unsigned type)
+{
+}
+
+
+/* Each cluster is found once in the table, the heap is ordered and no
+ * report is lost. */
+static int check_set(const struct cluster_set *set)
+{
+	unsigned long count = 0;
+	unsigned int i, j, used = 0;
+
+	for (i = 0; i < set->table_size; i++) {
+		if (set->table[i]) {
+			used++;
+		}
+	}
+	if (used != set->nr) {
+		fprintf(stderr, "FAIL: %u table slots for %u clusters\n",
+			used, set->nr);
+		return -1;
+	}
+	for (i = 0; i < set->nr; i++) {
+		unsigned int found = 0;
+
+		for (j = 0; j < set->table_size; j++) {
+			if (set->table[j] == i + 1) {
+				found++;
+			}
+		}
+		if (found != 1) {
+			fprintf(stderr, "FAIL: cluster %u in %u table slots\n",
+				i, found);
+			return -1;
+		}
+		if (i && set->heap[(i - 1) / 2].count > set->heap[i].count) {
+			fprintf(stderr, "FAIL: heap order broken at %u\n", i);
+			return -1;
+		}
+		count += set->heap[i].count;
+	}
+	/* an evicted count is inherited by the replacing cluster */
+	if (count != set->reports) {
+		fprintf(stderr, "FAIL: %lu counted for %lu reports\n", count,
+			set->reports);
+		return -1;
+	}
+	return 0;
+}
+
+
+int main(void)
+{
+	struct cluster_set set;
+	char signature[32];
+	unsigned long i;
+	int retval;
+
+	cluster_set_init(&set, CLUSTERS_MAX);
+	for (i = 0; i < REPORTS_NB; i++) {
+		/* skewed, so that some clusters stay and others churn */
+		unsigned int n = (i * 7919) % SIGNATURES_NB;
+
+		if (i % 4 == 0) {
+			snprintf(signature, sizeof(signature), "hot%lu",
+				 i % 16);
+		} else {
+			snprintf(signature, sizeof(signature), "sig%u", n);
+		}
+		cluster_add(&set, signature, "", -1, false);
+	}
+
+	retval = check_set(&set);
+	if (retval == 0 && (set.nr != CLUSTERS_MAX || !set.evictions)) {
+		fprintf(stderr, "FAIL: %u clusters, %lu evictions\n", set.nr,
+			set.evictions);
+		retval = -1;
+	}
+	cluster_set_free(&set);
+
+	if (retval == 0) {
+		printf("cluster_test: ok\n");
+	}
+	return retval ? EXIT_FAILURE : EXIT_SUCCESS;
+}
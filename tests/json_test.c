@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../json.h"
+#include "../util.h"
+
+/*
+ * Strings of requests: \u escapes are decoded to UTF-8, surrogate pairs
+ * included, and truncated or unpaired escapes are rejected without reading
+ * past the end of the text.
+ */
+
+static const struct {
+	const char *text;
+	/* NULL if the text must be rejected */
+	const char *string;
+} cases[] = {
+	{ "\"a\\u0041\\n\"", "aA\n" },
+	{ "\"\\u00e9\"", "\xc3\xa9" },
+	{ "\"\\u20AC\"", "\xe2\x82\xac" },
+	{ "\"\\uD83D\\uDE00\"", "\xf0\x9f\x98\x80" },
+	{ "\"\\u", NULL },
+	{ "\"\\u12", NULL },
+	{ "\"\\u12x4\"", NULL },
+	{ "\"\\uD83D\"", NULL },
+	{ "\"\\uD83Dx\"", NULL },
+	{ "\"\\uD83D\\u0041\"", NULL },
+	{ "\"\\uDE00\"", NULL },
+	{ "\"\\u0000\"", NULL },
+	{ "\"\\", NULL },
+};
+
+
+int main(void)
+{
+	int i, retval = 0;
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		/* exactly as long as the text, for tools that check bounds */
+		char *text = strdup(cases[i].text);
+		struct json_value value = {};
+		int parsed = json_parse(text, &value);
+
+		if (cases[i].string ?
+		    parsed != 0 || value.type != JSON_STRING ||
+		    strcmp(value.string, cases[i].string) != 0 :
+		    parsed == 0) {
+			fprintf(stderr, "FAIL: %s\n", cases[i].text);
+			retval = -1;
+		}
+		if (parsed == 0) {
+			json_free(&value);
+		}
+		free(text);
+	}
+
+	if (retval == 0) {
+		printf("json_test: ok\n");
+	}
+	return retval ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../rescache.h"
+#include "../resolve.h"
+
+/*
+ * The result cache across runs: records are found through the persisted
+ * index after a reopen and after the index is rebuilt larger, records
+ * appended by another process after the mapping are found too, and a record
+ * whose checksum is right but whose string is out of it is a miss.
+ */
+
+#define BUILD_ID 0x1234
+#define FRAMES_NB 3000
+#define PC_BASE 0x400000
+
+static char symbols[FRAMES_NB][32];
+
+
+static void make_frame(unsigned int i, struct resolved_frame *frame)
+{
+	snprintf(symbols[i], sizeof(symbols[i]), "function_%u", i);
+	*frame = (struct resolved_frame) {
+		.pc = PC_BASE + i * 4,
+		.symbol = symbols[i],
+		.offset = i % 16,
+		.debug_info = true,
+		.locs = { { symbols[i], "file.c", i } },
+		.locs_nb = 1,
+	};
+}
+
+
+static bool check_frame(struct rescache *cache, unsigned int i)
+{
+	struct resolved_frame frame;
+
+	return rescache_get(cache, BUILD_ID, PC_BASE + i * 4, &frame) == 0 &&
+		strcmp(frame.symbol, symbols[i]) == 0 &&
+		frame.offset == i % 16 && frame.locs_nb == 1 &&
+		strcmp(frame.locs[0].function, symbols[i]) == 0 &&
+		strcmp(frame.locs[0].file, "file.c") == 0 &&
+		frame.locs[0].line == i;
+}
+
+
+static uint64_t fnv1a(const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+
+/* as rescache.c computes it */
+static uint32_t record_checksum(const struct rescache_record *record)
+{
+	struct rescache_record head = *record;
+	uint64_t hash;
+
+	head.checksum = 0;
+	hash = fnv1a(&head, sizeof(head));
+	hash ^= fnv1a((const char *) record + sizeof(head),
+		      record->size - sizeof(head));
+	return hash ^ (hash >> 32);
+}
+
+
+/* Point the symbol of the record of pc past its end, with a valid checksum */
+static int corrupt_record(const char *path, uint64_t pc)
+{
+	struct rescache_header header;
+	struct rescache_record *record;
+	char buf[256];
+	uint64_t off;
+	int fd, i;
+
+	if ((fd = open(path, O_RDWR)) == -1 ||
+	    pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+		return -1;
+	}
+	for (i = 0; i < header.buckets_nb; i++) {
+		if (pread(fd, &off, sizeof(off),
+			  sizeof(header) + i * sizeof(off)) != sizeof(off) ||
+		    !off || pread(fd, buf, sizeof(buf), off) <= 0) {
+			continue;
+		}
+		record = (struct rescache_record *) buf;
+		if (record->pc != pc || record->size > sizeof(buf)) {
+			continue;
+		}
+		record->symbol = record->size + 64;
+		record->checksum = record_checksum(record);
+		i = pwrite(fd, record, record->size, off) == record->size ?
+			0 : -1;
+		close(fd);
+		return i;
+	}
+	close(fd);
+	return -1;
+}
+
+
+int main(void)
+{
+	char dir[] = "/tmp/rescache_testXXXXXX";
+	struct resolved_frame frame;
+	struct rescache *cache, *other;
+	char path[64];
+	unsigned int i;
+	int retval = 0;
+
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+	snprintf(path, sizeof(path), "%s/cache", dir);
+
+	/* past half of the first index */
+	if (!(cache = rescache_open(path))) {
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < FRAMES_NB; i++) {
+		make_frame(i, &frame);
+		rescache_put(cache, BUILD_ID, &frame);
+	}
+	rescache_close(cache);
+
+	/* rebuilt when opened */
+	cache = rescache_open(path);
+	for (i = 0; cache && i < FRAMES_NB; i++) {
+		if (!check_frame(cache, i)) {
+			fprintf(stderr, "FAIL: frame %u not found after reopen\n",
+				i);
+			retval = -1;
+			break;
+		}
+	}
+	if (!cache || cache->buckets_nb <= FRAMES_NB * 2 ||
+	    rescache_get(cache, BUILD_ID + 1, PC_BASE, &frame) == 0) {
+		fprintf(stderr, "FAIL: index not rebuilt or wrong key hit\n");
+		retval = -1;
+	}
+
+	/* appended by another process after the mapping */
+	other = rescache_open(path);
+	make_frame(0, &frame);
+	frame.pc = 0x10;
+	rescache_put(other, BUILD_ID, &frame);
+	if (rescache_get(cache, BUILD_ID, 0x10, &frame) != 0 ||
+	    strcmp(frame.symbol, symbols[0]) != 0) {
+		fprintf(stderr, "FAIL: record past the mapping not found\n");
+		retval = -1;
+	}
+	rescache_close(other);
+	rescache_close(cache);
+
+	if (corrupt_record(path, PC_BASE) != 0) {
+		fprintf(stderr, "FAIL: record to corrupt not found\n");
+		retval = -1;
+	}
+	cache = rescache_open(path);
+	if (rescache_get(cache, BUILD_ID, PC_BASE, &frame) == 0 ||
+	    !check_frame(cache, 1)) {
+		fprintf(stderr, "FAIL: corrupted record not rejected\n");
+		retval = -1;
+	}
+	rescache_close(cache);
+
+	unlink(path);
+	rmdir(dir);
+	if (retval == 0) {
+		printf("rescache_test: ok\n");
+	}
+	return retval ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,317 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libelf.h>
+#include <gelf.h>
+#include <libdwarf/libdwarf.h>
+#include <libdwarf/dwarf.h>
+
+#include "../arch.h"
+#include "../core_walk.h"
+#include "../location.h"
+#include "../resolve.h"
+#include "../slots.h"
+#include "../types.h"
+#include "../util.h"
+
+/*
+ * The slot map of an x86_64 function whose variables are in lexical blocks
+ * described by DW_AT_ranges. pc is between the two ranges of one block, in
+ * the second range of the other: only the variables of the latter are in
+ * scope. The DIE tree is the fixture, die_has_pc() is faked over its
+ * ranges.
+ */
+
+#define PC 0x1020
+/* CFA = %rsp + 32 */
+#define CFA_OFFSET 32
+
+struct fake_die {
+	Dwarf_Half tag;
+	const char *name;
+	/* [lo, hi[ ranges, DW_AT_ranges if there are two */
+	Dwarf_Addr ranges[2][2];
+	unsigned int ranges_nb;
+	/* variables are at DW_OP_breg7 (%rsp) + sp_offset */
+	Dwarf_Signed sp_offset;
+	struct fake_die *child;
+	struct fake_die *sibling;
+};
+
+static struct fake_die var_in = {
+	.tag = DW_TAG_variable,
+	.name = "in",
+	.sp_offset = 8,
+};
+
+static struct fake_die block_in = {
+	.tag = DW_TAG_lexical_block,
+	.ranges = { { 0x1004, 0x1008 }, { 0x1018, 0x1030 } },
+	.ranges_nb = 2,
+	.child = &var_in,
+};
+
+static struct fake_die var_out = {
+	.tag = DW_TAG_variable,
+	.name = "out",
+	.sp_offset = 16,
+};
+
+static struct fake_die block_out = {
+	.tag = DW_TAG_lexical_block,
+	/* covers PC if only its bounds are looked at */
+	.ranges = { { 0x1010, 0x1018 }, { 0x1030, 0x1040 } },
+	.ranges_nb = 2,
+	.child = &var_out,
+	.sibling = &block_in,
+};
+
+static struct fake_die var_arg = {
+	.tag = DW_TAG_formal_parameter,
+	.name = "arg",
+	.sp_offset = 0,
+	.sibling = &block_out,
+};
+
+static struct fake_die function = {
+	.tag = DW_TAG_subprogram,
+	.name = "function",
+	.ranges = { { 0x1000, 0x1100 } },
+	.ranges_nb = 1,
+	.child = &var_arg,
+};
+
+/* enough of an x86_64 ELF header for arch_of_dwarf() */
+static Elf64_Ehdr ehdr = {
+	.e_ident = { ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64,
+		     ELFDATA2LSB, EV_CURRENT },
+	.e_type = ET_EXEC,
+	.e_machine = EM_X86_64,
+	.e_version = EV_CURRENT,
+	.e_ehsize = sizeof(Elf64_Ehdr),
+};
+
+
+int dwarf_get_elf(Dwarf_Debug dwarf, Elf **elf, Dwarf_Error *error)
+{
+	*elf = elf_memory((char *) &ehdr, sizeof(ehdr));
+	return *elf ? DW_DLV_OK : DW_DLV_ERROR;
+}
+
+int dwarf_get_address_size(Dwarf_Debug dwarf, Dwarf_Half *size,
+			   Dwarf_Error *error)
+{
+	*size = 8;
+	return DW_DLV_OK;
+}
+
+int dwarf_child(Dwarf_Die die, Dwarf_Die *child, Dwarf_Error *error)
+{
+	*child = (Dwarf_Die) ((struct fake_die *) die)->child;
+	return *child ? DW_DLV_OK : DW_DLV_NO_ENTRY;
+}
+
+int dwarf_siblingof(Dwarf_Debug dwarf, Dwarf_Die die, Dwarf_Die *sibling,
+		    Dwarf_Error *error)
+{
+	*sibling = (Dwarf_Die) ((struct fake_die *) die)->sibling;
+	return *sibling ? DW_DLV_OK : DW_DLV_NO_ENTRY;
+}
+
+void dwarf_dealloc(Dwarf_Debug dwarf, void *space, Dwarf_Unsigned type)
+{
+}
+
+int dwarf_tag(Dwarf_Die die, Dwarf_Half *tag, Dwarf_Error *error)
+{
+	*tag = ((struct fake_die *) die)->tag;
+	return DW_DLV_OK;
+}
+
+int dwarf_diename(Dwarf_Die die, char **name, Dwarf_Error *error)
+{
+	*name = (char *) ((struct fake_die *) die)->name;
+	return *name ? DW_DLV_OK : DW_DLV_NO_ENTRY;
+}
+
+/* variables only have a location, the attribute stands for their DIE */
+int dwarf_attr(Dwarf_Die die, Dwarf_Half at, Dwarf_Attribute *attr,
+	       Dwarf_Error *error)
+{
+	Dwarf_Half tag = ((struct fake_die *) die)->tag;
+
+	if (at != DW_AT_location || (tag != DW_TAG_variable &&
+				     tag != DW_TAG_formal_parameter)) {
+		return DW_DLV_NO_ENTRY;
+	}
+	*attr = (Dwarf_Attribute) die;
+	return DW_DLV_OK;
+}
+
+int dwarf_global_formref(Dwarf_Attribute attr, Dwarf_Off *offset,
+			 Dwarf_Error *error)
+{
+	return DW_DLV_ERROR;
+}
+
+int loc_list_get(Dwarf_Attribute attr, struct loc_list *list)
+{
+	struct fake_die *die = (struct fake_die *) attr;
+
+	list->exprs = calloc(1, sizeof(*list->exprs));
+	list->exprs[0].ops = calloc(1, sizeof(*list->exprs[0].ops));
+	list->exprs[0].ops[0] = (struct loc_op) {
+		.atom = DW_OP_breg7,
+		.number = die->sp_offset,
+	};
+	list->exprs[0].ops_nb = 1;
+	list->nr = 1;
+	return 0;
+}
+
+const struct loc_expr *loc_list_find(const struct loc_list *list,
+				     Dwarf_Addr pc)
+{
+	return &list->exprs[0];
+}
+
+void loc_list_free(struct loc_list *list)
+{
+	free(list->exprs[0].ops);
+	free(list->exprs);
+}
+
+bool die_has_pc(Dwarf_Debug dwarf, Dwarf_Die die, Dwarf_Addr cu_base,
+		Dwarf_Addr pc)
+{
+	const struct fake_die *fake = (const struct fake_die *) die;
+	unsigned int i;
+
+	for (i = 0; i < fake->ranges_nb; i++) {
+		if (fake->ranges[i][0] <= pc && pc < fake->ranges[i][1]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* the return address at CFA - 8 */
+int find_regtable_by_pc(Dwarf_Debug dwarf, Dwarf_Addr pc,
+			Dwarf_Regtable3 *reg_table, Dwarf_Addr *lopc,
+			Dwarf_Addr *hipc, Dwarf_Addr *row_pc)
+{
+	int i;
+
+	reg_table->rt3_cfa_rule = (Dwarf_Regtable_Entry3) {
+		.dw_offset_relevant = 1,
+		.dw_value_type = DW_EXPR_OFFSET,
+		.dw_regnum = ARCH_X86_64_SP,
+		.dw_offset_or_block_len = CFA_OFFSET,
+	};
+	for (i = 0; i < reg_table->rt3_reg_table_size; i++) {
+		reg_table->rt3_rules[i] = (Dwarf_Regtable_Entry3) {
+			.dw_value_type = DW_EXPR_OFFSET,
+			.dw_regnum = DW_FRAME_SAME_VAL,
+		};
+	}
+	reg_table->rt3_rules[ARCH_X86_64_RA_COLUMN] = (Dwarf_Regtable_Entry3) {
+		.dw_offset_relevant = 1,
+		.dw_value_type = DW_EXPR_OFFSET,
+		.dw_regnum = DW_FRAME_CFA_COL3,
+		.dw_offset_or_block_len = -8,
+	};
+	*lopc = *row_pc = 0x1000;
+	*hipc = 0x1100;
+	return 0;
+}
+
+int find_abstract_origin(Dwarf_Debug dwarf, Dwarf_Die die, Dwarf_Die *result)
+{
+	return -1;
+}
+
+void print_die_info(Dwarf_Debug dwarf, Dwarf_Die die)
+{
+}
+
+int get_type_size(Dwarf_Debug dwarf, Dwarf_Die die, Dwarf_Unsigned *size)
+{
+	*size = 8;
+	return 0;
+}
+
+/* no type is known, members are never named */
+struct type_desc *type_cache_get(struct type_cache *cache,
+				 Dwarf_Off die_offset)
+{
+	return NULL;
+}
+
+int type_member_path(const struct type_desc *type, Dwarf_Unsigned offset,
+		     char *buf, size_t len)
+{
+	return -1;
+}
+
+
+static const struct slot *find_slot(const struct slot_map *map,
+				    const char *name)
+{
+	int i;
+
+	for (i = 0; i < map->nr; i++) {
+		if (strcmp(map->slots[i].name, name) == 0) {
+			return &map->slots[i];
+		}
+	}
+	return NULL;
+}
+
+
+int main(void)
+{
+	static const struct {
+		const char *name;
+		enum slot_kind kind;
+		Dwarf_Signed lo;
+	} expected[] = {
+		{ "retaddr", SLOT_RETADDR, -8 },
+		{ "arg", SLOT_PARAM, -CFA_OFFSET },
+		{ "in", SLOT_VAR, 8 - CFA_OFFSET },
+	};
+	struct slot_map map;
+	int i, retval = 0;
+
+	elf_version(EV_CURRENT);
+	if (slot_map_build(NULL, NULL, (Dwarf_Die) &function, 0, PC,
+			   &map) != 0) {
+		fprintf(stderr, "FAIL: no slot map\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(expected); i++) {
+		const struct slot *slot = find_slot(&map, expected[i].name);
+
+		if (!slot || slot->kind != expected[i].kind ||
+		    slot->lo != expected[i].lo || slot->hi != slot->lo + 8) {
+			fprintf(stderr, "FAIL: slot %s is missing or wrong\n",
+				expected[i].name);
+			retval = -1;
+		}
+	}
+	if (find_slot(&map, "out") || map.nr != ARRAY_SIZE(expected)) {
+		fprintf(stderr,
+			"FAIL: %u slots, the variable of a block out of scope is one\n",
+			map.nr);
+		slot_map_print(&map);
+		retval = -1;
+	}
+	slot_map_free(&map);
+
+	if (retval == 0) {
+		printf("slots_test: ok\n");
+	}
+	return retval ? EXIT_FAILURE : EXIT_SUCCESS;
+}
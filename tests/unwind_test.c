@@ -0,0 +1,351 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libelf.h>
+#include <gelf.h>
+#include <libdwarf/libdwarf.h>
+
+#include "../arch.h"
+#include "../core_walk.h"
+#include "../memsrc.h"
+#include "../unwind.h"
+#include "../util.h"
+
+/*
+ * A few frames of each architecture, unwound through CFI rows described by
+ * the fixtures instead of an image, then through the frame pointer chain
+ * where there is one. The return addresses of the stack and registers are
+ * then moved by a KASLR slide, the same link addresses must come out. The
+ * innermost frames of arm64 and s390x are leaves, whose return address is
+ * still in its register; the other arm64 frames put their frame record at
+ * the bottom of the frame.
+ */
+
+#define STACK_START 0x10000
+#define STACK_WORDS 32
+#define SLIDE 0x1e000000
+
+struct fixture_fde {
+	Dwarf_Addr lopc;
+	Dwarf_Addr hipc;
+	unsigned int cfa_column;
+	Dwarf_Signed cfa_offset;
+	/* columns saved at CFA + offset, the return address column first */
+	unsigned int columns[2];
+	Dwarf_Signed offsets[2];
+	unsigned int columns_nb;
+};
+
+struct fixture {
+	unsigned int machine;
+	const char *const *dwarf_regs;
+	/* names of the stack pointer and return address columns */
+	const char *sp_name;
+	const char *ra_name;
+	struct fixture_fde fdes[3];
+	/* the innermost frame, fp and ra are not known if 0 */
+	uint64_t pc;
+	uint64_t sp;
+	uint64_t fp;
+	uint64_t ra;
+	uint64_t stack[STACK_WORDS];
+	uint64_t pcs[3];
+	unsigned int pcs_nb;
+};
+
+static struct fixture fixtures[] = {
+	{
+		.machine = EM_X86_64,
+		.dwarf_regs = x86_64_dwarf_regs,
+		.sp_name = "%rsp",
+		.ra_name = "retaddr",
+		.fdes = {
+			/* push %rbp */
+			{ 0x1000, 0x1100, 7, 16, { 16, 6 }, { -8, -16 }, 2 },
+			/* push %rbp; mov %rsp, %rbp */
+			{ 0x2000, 0x2100, 6, 16, { 16, 6 }, { -8, -16 }, 2 },
+		},
+		.pc = 0x1010,
+		.sp = STACK_START,
+		.stack = { STACK_START + 0x20, 0x2011, 0, 0, 0, 0 },
+		.pcs = { 0x1010, 0x2011 },
+		.pcs_nb = 2,
+	},
+	{
+		.machine = EM_AARCH64,
+		.dwarf_regs = arm64_dwarf_regs,
+		.sp_name = "sp",
+		.ra_name = "x30",
+		.fdes = {
+			/* a leaf, x30 keeps its value */
+			{ 0x1000, 0x1100, 31, 0, { }, { }, 0 },
+			/* stp x29, x30, [sp, #-32]!; mov x29, sp */
+			{ 0x2000, 0x2100, 29, 32, { 30, 29 }, { -24, -32 },
+			  2 },
+			/* stp x29, x30, [sp, #-48]!; mov x29, sp */
+			{ 0x3000, 0x3100, 29, 48, { 30, 29 }, { -40, -48 },
+			  2 },
+		},
+		.pc = 0x1010,
+		.sp = STACK_START,
+		.fp = STACK_START,
+		.ra = 0x2011,
+		/* the frame records of 0x2000 and 0x3000 */
+		.stack = { STACK_START + 0x20, 0x3011, 0, 0, 0, 0 },
+		.pcs = { 0x1010, 0x2011, 0x3011 },
+		.pcs_nb = 3,
+	},
+	{
+		.machine = EM_PPC64,
+		.dwarf_regs = ppc64_dwarf_regs,
+		.sp_name = "r1",
+		.ra_name = "lr",
+		.fdes = {
+			/* stdu r1, -32(r1), lr saved in the frame of the
+			 * caller */
+			{ 0x1000, 0x1100, 1, 32, { 65 }, { 16 }, 1 },
+			{ 0x2000, 0x2100, 1, 32, { 65 }, { 16 }, 1 },
+		},
+		.pc = 0x1010,
+		.sp = STACK_START,
+		.stack = { STACK_START + 0x20, 0, 0, 0, 0, 0, 0x2011, 0,
+			   0, 0, 0, 0 },
+		.pcs = { 0x1010, 0x2011 },
+		.pcs_nb = 2,
+	},
+	{
+		.machine = EM_S390,
+		.dwarf_regs = s390x_dwarf_regs,
+		.sp_name = "%r15",
+		.ra_name = "%r14",
+		.fdes = {
+			/* a leaf, the caller's frame starts 160 bytes up */
+			{ 0x1000, 0x1100, 15, 160, { }, { }, 0 },
+			{ 0x2000, 0x2100, 15, 32, { 14 }, { -24 }, 1 },
+			{ 0x3000, 0x3100, 15, 32, { 14 }, { -24 }, 1 },
+		},
+		.pc = 0x1010,
+		.sp = STACK_START,
+		.ra = 0x2011,
+		/* r14 of 0x2000 at 160 + 32 - 24 */
+		.stack = { [21] = 0x3011 },
+		.pcs = { 0x1010, 0x2011, 0x3011 },
+		.pcs_nb = 3,
+	},
+};
+
+static struct fixture *current;
+
+
+/* the CFI of the current fixture stands for the image's */
+int get_fde_list(Dwarf_Debug dwarf, Dwarf_Cie **cie_list,
+		 Dwarf_Signed *cie_count, Dwarf_Fde **fde_list,
+		 Dwarf_Signed *fde_count)
+{
+	*cie_list = NULL;
+	*cie_count = 0;
+	*fde_list = (Dwarf_Fde *) current->fdes;
+	*fde_count = ARRAY_SIZE(current->fdes);
+	return 0;
+}
+
+void dwarf_fde_cie_list_dealloc(Dwarf_Debug dwarf, Dwarf_Cie *cie_list,
+				Dwarf_Signed cie_count, Dwarf_Fde *fde_list,
+				Dwarf_Signed fde_count)
+{
+}
+
+int dwarf_get_fde_at_pc(Dwarf_Fde *fde_list, Dwarf_Addr pc, Dwarf_Fde *fde,
+			Dwarf_Addr *lopc, Dwarf_Addr *hipc,
+			Dwarf_Error *error)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(current->fdes); i++) {
+		struct fixture_fde *f = &current->fdes[i];
+
+		if (f->lopc <= pc && pc < f->hipc) {
+			*fde = (Dwarf_Fde) f;
+			*lopc = f->lopc;
+			*hipc = f->hipc;
+			return DW_DLV_OK;
+		}
+	}
+	return DW_DLV_NO_ENTRY;
+}
+
+int dwarf_get_fde_info_for_all_regs3(Dwarf_Fde fde, Dwarf_Addr pc,
+				     Dwarf_Regtable3 *reg_table,
+				     Dwarf_Addr *row_pc, Dwarf_Error *error)
+{
+	const struct fixture_fde *f = (const struct fixture_fde *) fde;
+	int i;
+
+	reg_table->rt3_cfa_rule = (Dwarf_Regtable_Entry3) {
+		.dw_offset_relevant = 1,
+		.dw_value_type = DW_EXPR_OFFSET,
+		.dw_regnum = f->cfa_column,
+		.dw_offset_or_block_len = f->cfa_offset,
+	};
+	for (i = 0; i < reg_table->rt3_reg_table_size; i++) {
+		reg_table->rt3_rules[i] = (Dwarf_Regtable_Entry3) {
+			.dw_value_type = DW_EXPR_OFFSET,
+			.dw_regnum = DW_FRAME_SAME_VAL,
+		};
+	}
+	for (i = 0; i < f->columns_nb; i++) {
+		if (f->columns[i] >= reg_table->rt3_reg_table_size) {
+			return DW_DLV_ERROR;
+		}
+		reg_table->rt3_rules[f->columns[i]] = (Dwarf_Regtable_Entry3) {
+			.dw_offset_relevant = 1,
+			.dw_value_type = DW_EXPR_OFFSET,
+			.dw_regnum = DW_FRAME_CFA_COL3,
+			.dw_offset_or_block_len = f->offsets[i],
+		};
+	}
+	*row_pc = f->lopc;
+	return DW_DLV_OK;
+}
+
+/* arch_of_dwarf() is not used, there is no image */
+int dwarf_get_elf(Dwarf_Debug dwarf, Elf **elf, Dwarf_Error *error)
+{
+	return DW_DLV_ERROR;
+}
+
+
+static int check_regs(const struct arch *arch, const struct fixture *fix)
+{
+	if (strcmp(arch_column_name(arch, arch->sp), fix->sp_name) ||
+	    strcmp(fix->dwarf_regs[arch->sp], fix->sp_name) ||
+	    strcmp(arch_column_name(arch, arch->ra_column), fix->ra_name)) {
+		fprintf(stderr, "FAIL: %s: registers %s and %s are not named "
+			"%s and %s\n", arch->name,
+			arch_column_name(arch, arch->sp),
+			arch_column_name(arch, arch->ra_column), fix->sp_name,
+			fix->ra_name);
+		return -1;
+	}
+	if (strcmp(arch_column_name(arch, 1000), "?")) {
+		fprintf(stderr, "FAIL: %s: column 1000 is named\n",
+			arch->name);
+		return -1;
+	}
+	return 0;
+}
+
+
+/* value as the running kernel holds it: return addresses are moved by slide */
+static uint64_t slid(const struct fixture *fix, uint64_t value, uint64_t slide)
+{
+	unsigned int i;
+
+	for (i = 1; i < fix->pcs_nb; i++) {
+		if (value == fix->pcs[i]) {
+			return value + slide;
+		}
+	}
+	return value;
+}
+
+
+/* Unwind the fixture with its return addresses moved by slide, through the
+ * frame pointer chain if fp */
+static int check_unwind(const struct arch *arch, const struct fixture *fix,
+			uint64_t slide, bool fp)
+{
+	struct unwind_fp_stats stats = {};
+	enum unwind_status status;
+	uint64_t stack[STACK_WORDS];
+	struct unwind_regs regs = {
+		.pc = fix->pc,
+		.slide = slide,
+	};
+	struct mem_source *src;
+	struct mem_cache mem;
+	struct cfi_cache *cfi;
+	uint64_t pcs[4];
+	unsigned int i, nr;
+
+	for (i = 0; i < STACK_WORDS; i++) {
+		stack[i] = slid(fix, fix->stack[i], slide);
+	}
+	src = mem_source_open_words(STACK_START, stack, STACK_WORDS);
+	mem_cache_init(&mem, src, 64, 1);
+	cfi = cfi_cache_new(NULL, arch);
+
+	regs.regs[arch->sp] = fix->sp;
+	regs.valid = 1ULL << arch->sp;
+	if (fix->fp) {
+		regs.regs[arch->fp] = fix->fp;
+		regs.valid |= 1ULL << arch->fp;
+	}
+	if (fix->ra) {
+		regs.regs[arch->ra] = slid(fix, fix->ra, slide);
+		regs.valid |= 1ULL << arch->ra;
+	}
+	if (fp) {
+		nr = unwind_stack_fp(cfi, &mem, 8, &regs, STACK_START,
+				     STACK_START + sizeof(stack), pcs,
+				     ARRAY_SIZE(pcs), 1, &stats, &status);
+	} else {
+		nr = unwind_stack(cfi, &mem, 8, &regs, STACK_START,
+				  STACK_START + sizeof(stack), pcs,
+				  ARRAY_SIZE(pcs), &status);
+	}
+
+	cfi_cache_free(cfi);
+	mem_cache_free(&mem);
+	mem_source_close(src);
+
+	if (status != UNWIND_END || nr != fix->pcs_nb ||
+	    memcmp(pcs, fix->pcs, nr * sizeof(*pcs)) ||
+	    (fp && stats.mismatches)) {
+		fprintf(stderr, "FAIL: %s%s, slide 0x%" PRIx64
+			": %u frames, %s\n",
+			arch->name, fp ? " (frame pointers)" : "", slide, nr,
+			unwind_status_names[status]);
+		for (i = 0; i < nr; i++) {
+			fprintf(stderr, "    0x%" PRIx64 "\n", pcs[i]);
+		}
+		return -1;
+	}
+	return 0;
+}
+
+
+int main(void)
+{
+	int i, retval = 0;
+
+	for (i = 0; i < ARRAY_SIZE(fixtures) && retval == 0; i++) {
+		const struct arch *arch = arch_find(fixtures[i].machine);
+
+		current = &fixtures[i];
+		if (!arch) {
+			fprintf(stderr, "FAIL: machine %u is not supported\n",
+				fixtures[i].machine);
+			retval = -1;
+			break;
+		}
+		retval = check_regs(arch, current);
+		if (retval == 0) {
+			retval = check_unwind(arch, current, 0, false);
+		}
+		if (retval == 0) {
+			retval = check_unwind(arch, current, SLIDE, false);
+		}
+		if (retval == 0 && arch->fp != -1) {
+			retval = check_unwind(arch, current, SLIDE, true);
+		}
+	}
+
+	if (retval == 0) {
+		printf("unwind_test: ok\n");
+	}
+	return retval ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,1176 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdwarf/libdwarf.h>
+#include <libdwarf/dwarf.h>
+
+#include "location.h"
+#include "types.h"
+#include "util.h"
+
+
+/* Size in bytes of the object described by the DW_AT_type of die */
+int get_type_size(Dwarf_Debug dwarf, Dwarf_Die die,
+		  Dwarf_Unsigned *size)
+{
+	Dwarf_Attribute attr;
+	Dwarf_Off offset;
+	Dwarf_Die type_die;
+	Dwarf_Half tag;
+	int retval = -1;
+
+	if (dwarf_attr(die, DW_AT_type, &attr, NULL) != DW_DLV_OK) {
+		return -1;
+	}
+	dwarf_global_formref(attr, &offset, NULL);
+	dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+	if (dwarf_offdie(dwarf, offset, &type_die, NULL) != DW_DLV_OK) {
+		return -1;
+	}
+
+	if (dwarf_bytesize(type_die, size, NULL) == DW_DLV_OK) {
+		dwarf_dealloc(dwarf, type_die, DW_DLA_DIE);
+		return 0;
+	}
+
+	dwarf_tag(type_die, &tag, NULL);
+	switch (tag) {
+		Dwarf_Die child, sibling;
+		Dwarf_Unsigned elem_size, count;
+
+	case DW_TAG_typedef:
+	case DW_TAG_const_type:
+	case DW_TAG_volatile_type:
+	case DW_TAG_restrict_type:
+		retval = get_type_size(dwarf, type_die, size);
+		break;
+
+	case DW_TAG_array_type:
+		if (get_type_size(dwarf, type_die, &elem_size) == -1) {
+			break;
+		}
+		count = 1;
+		foreach_child(dwarf, type_die, child, sibling, retval) {
+			Dwarf_Unsigned ubound;
+
+			if (dwarf_attr(child, DW_AT_count, &attr, NULL) ==
+			    DW_DLV_OK) {
+				dwarf_formudata(attr, &ubound, NULL);
+				count *= ubound;
+			} else if (dwarf_attr(child, DW_AT_upper_bound, &attr,
+					      NULL) == DW_DLV_OK) {
+				dwarf_formudata(attr, &ubound, NULL);
+				count *= ubound + 1;
+			} else {
+				/* flexible array */
+				count = 0;
+				continue;
+			}
+			dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		}
+		*size = elem_size * count;
+		retval = 0;
+		break;
+	}
+
+	dwarf_dealloc(dwarf, type_die, DW_DLA_DIE);
+	return retval;
+}
+
+
+/* Offset of a DW_TAG_member within its parent. DWARF 2 producers use a
+ * DW_OP_plus_uconst location expression instead of a constant. */
+static int get_member_offset(Dwarf_Debug dwarf, Dwarf_Die member_die,
+			     Dwarf_Unsigned *offset)
+{
+	Dwarf_Attribute attr;
+	struct loc_list list;
+	int retval = -1;
+
+	if (dwarf_attr(member_die, DW_AT_data_member_location, &attr, NULL) !=
+	    DW_DLV_OK) {
+		/* union members */
+		*offset = 0;
+		return 0;
+	}
+
+	if (dwarf_formudata(attr, offset, NULL) == DW_DLV_OK) {
+		retval = 0;
+	} else if (loc_list_get(attr, &list) == 0) {
+		if (list.nr == 1 && list.exprs[0].ops_nb == 1 &&
+		    list.exprs[0].ops[0].atom == DW_OP_plus_uconst) {
+			*offset = list.exprs[0].ops[0].number;
+			retval = 0;
+		}
+		loc_list_free(&list);
+	}
+	dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+
+	return retval;
+}
+
+
+/* FNV-1a */
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+
+static uint64_t hash_string(uint64_t hash, const char *string)
+{
+	return hash_bytes(hash, string ? string : "", string ?
+			  strlen(string) + 1 : 1);
+}
+
+
+static unsigned int offset_slot(Dwarf_Off offset, unsigned int size)
+{
+	return (offset * 0x9e3779b97f4a7c15ULL >> 32) & (size - 1);
+}
+
+
+static void by_offset_set(struct type_cache *cache, struct type_desc *desc,
+			  Dwarf_Off offset)
+{
+	struct type_cache_entry *entry;
+	unsigned int i;
+
+	if ((cache->by_offset_nb + 1) * 2 > cache->by_offset_size) {
+		struct type_cache_entry *old = cache->by_offset;
+		unsigned int old_size = cache->by_offset_size;
+
+		cache->by_offset_size = old_size ? old_size * 2 : 4096;
+		cache->by_offset = calloc(cache->by_offset_size,
+					  sizeof(*cache->by_offset));
+		cache->by_offset_nb = 0;
+		for (i = 0; i < old_size; i++) {
+			if (old[i].desc) {
+				by_offset_set(cache, old[i].desc,
+					      old[i].die_offset);
+			}
+		}
+		free(old);
+	}
+
+	for (i = offset_slot(offset, cache->by_offset_size);
+	     (entry = &cache->by_offset[i])->desc;
+	     i = (i + 1) & (cache->by_offset_size - 1)) {
+		if (entry->die_offset == offset) {
+			/* replaced by its canonical layout */
+			entry->desc = desc;
+			return;
+		}
+	}
+	entry->die_offset = offset;
+	entry->desc = desc;
+	cache->by_offset_nb++;
+}
+
+
+static struct type_desc *by_offset_get(const struct type_cache *cache,
+				       Dwarf_Off offset)
+{
+	const struct type_cache_entry *entry;
+	unsigned int i;
+
+	if (!cache->by_offset_size) {
+		return NULL;
+	}
+	for (i = offset_slot(offset, cache->by_offset_size);
+	     (entry = &cache->by_offset[i])->desc;
+	     i = (i + 1) & (cache->by_offset_size - 1)) {
+		if (entry->die_offset == offset) {
+			return entry->desc;
+		}
+	}
+	return NULL;
+}
+
+
+static const char *type_name_concat(struct type_cache *cache,
+				    const char *prefix, const char *name,
+				    const char *suffix)
+{
+	char buf[512];
+
+	snprintf(buf, sizeof(buf), "%s%s%s", prefix, name ? name : "?",
+		 suffix);
+	return strpool_add(&cache->pool, buf);
+}
+
+
+/* "int[2]" + 3 -> "int[3][2]" */
+static const char *array_name(struct type_cache *cache,
+			      const struct type_desc *elem,
+			      Dwarf_Unsigned count)
+{
+	const char *elem_name = elem->name ? elem->name : "?";
+	const char *dims = strchr(elem_name, '[');
+	char buf[512];
+
+	if (!dims) {
+		dims = elem_name + strlen(elem_name);
+	}
+	snprintf(buf, sizeof(buf), "%.*s[%" DW_PR_DUu "]%s",
+		 (int) (dims - elem_name), elem_name, count, dims);
+	return strpool_add(&cache->pool, buf);
+}
+
+
+static struct type_desc *desc_new(struct type_cache *cache, Dwarf_Off offset)
+{
+	struct type_desc *desc = calloc(1, sizeof(*desc));
+
+	desc->die_offset = offset;
+	if (cache->pending_nb == cache->pending_alloc) {
+		cache->pending_alloc = cache->pending_alloc ?
+			cache->pending_alloc * 2 : 64;
+		cache->pending = realloc(cache->pending,
+					 cache->pending_alloc *
+					 sizeof(*cache->pending));
+	}
+	cache->pending[cache->pending_nb++] = desc;
+
+	return desc;
+}
+
+
+static struct type_desc *get_internal(struct type_cache *cache,
+				      Dwarf_Off offset);
+
+
+static struct type_desc *get_target(struct type_cache *cache, Dwarf_Die die)
+{
+	Dwarf_Attribute attr;
+	Dwarf_Off offset;
+
+	if (dwarf_attr(die, DW_AT_type, &attr, NULL) != DW_DLV_OK) {
+		return NULL;
+	}
+	dwarf_global_formref(attr, &offset, NULL);
+	dwarf_dealloc(cache->dwarf, attr, DW_DLA_ATTR);
+
+	return get_internal(cache, offset);
+}
+
+
+static void build_member(struct type_cache *cache, Dwarf_Die member_die,
+			 struct member_desc *member)
+{
+	Dwarf_Debug dwarf = cache->dwarf;
+	Dwarf_Attribute attr;
+	Dwarf_Unsigned value;
+	char *name;
+
+	if (dwarf_diename(member_die, &name, NULL) == DW_DLV_OK) {
+		member->name = strpool_add(&cache->pool, name);
+		dwarf_dealloc(dwarf, name, DW_DLA_STRING);
+	} else {
+		member->name = NULL;
+	}
+	member->type = get_target(cache, member_die);
+	if (get_member_offset(dwarf, member_die, &member->offset) == -1) {
+		member->offset = 0;
+	}
+
+	/* DW_AT_byte_size on a member is the size of the storage unit of a
+	 * DWARF 2/3 bit field */
+	if (dwarf_bytesize(member_die, &member->size, NULL) != DW_DLV_OK) {
+		member->size = member->type ? member->type->size : 0;
+	}
+
+	member->bit_size = 0;
+	member->bit_offset = 0;
+	if (dwarf_bitsize(member_die, &value, NULL) != DW_DLV_OK) {
+		return;
+	}
+	member->bit_size = value;
+	if (dwarf_bitoffset(member_die, &value, NULL) == DW_DLV_OK) {
+		/* counted from the most significant bit */
+		member->bit_offset = member->size * 8 - value -
+			member->bit_size;
+	} else if (dwarf_attr(member_die, DW_AT_data_bit_offset, &attr,
+			      NULL) == DW_DLV_OK) {
+		/* counted from the start of the parent */
+		dwarf_formudata(attr, &value, NULL);
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		if (member->size) {
+			member->offset = value / (member->size * 8) *
+				member->size;
+		} else {
+			member->offset = value / 8;
+		}
+		member->bit_offset = value - member->offset * 8;
+	}
+}
+
+
+static void build_members(struct type_cache *cache, Dwarf_Die type_die,
+			  struct type_desc *desc)
+{
+	Dwarf_Die child, sibling;
+	unsigned int alloc = 0;
+	int retval;
+
+	foreach_child(cache->dwarf, type_die, child, sibling, retval) {
+		Dwarf_Half tag;
+
+		dwarf_tag(child, &tag, NULL);
+		if (tag != DW_TAG_member) {
+			continue;
+		}
+		if (desc->members_nb == alloc) {
+			alloc = alloc ? alloc * 2 : 8;
+			desc->members = realloc(desc->members,
+						alloc * sizeof(*desc->members));
+		}
+		build_member(cache, child, &desc->members[desc->members_nb++]);
+	}
+}
+
+
+static int enum_value_cmp(const void *a, const void *b)
+{
+	const struct enum_value *ea = a, *eb = b;
+
+	if (ea->value != eb->value) {
+		return ea->value < eb->value ? -1 : 1;
+	}
+	return 0;
+}
+
+
+static void build_enumerators(struct type_cache *cache, Dwarf_Die type_die,
+			      struct type_desc *desc)
+{
+	Dwarf_Debug dwarf = cache->dwarf;
+	Dwarf_Die child, sibling;
+	unsigned int alloc = 0, bits = 0;
+	int retval, i;
+
+	foreach_child(dwarf, type_die, child, sibling, retval) {
+		Dwarf_Attribute attr;
+		struct enum_value *value;
+		Dwarf_Unsigned udata;
+		Dwarf_Half tag;
+		char *name;
+
+		dwarf_tag(child, &tag, NULL);
+		if (tag != DW_TAG_enumerator ||
+		    dwarf_attr(child, DW_AT_const_value, &attr, NULL) !=
+		    DW_DLV_OK) {
+			continue;
+		}
+		if (desc->enums_nb == alloc) {
+			alloc = alloc ? alloc * 2 : 8;
+			desc->enums = realloc(desc->enums,
+					      alloc * sizeof(*desc->enums));
+		}
+		value = &desc->enums[desc->enums_nb++];
+		if (dwarf_formsdata(attr, &value->value, NULL) != DW_DLV_OK) {
+			dwarf_formudata(attr, &udata, NULL);
+			value->value = udata;
+		}
+		dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		if (dwarf_diename(child, &name, NULL) == DW_DLV_OK) {
+			value->name = strpool_add(&cache->pool, name);
+			dwarf_dealloc(dwarf, name, DW_DLA_STRING);
+		} else {
+			value->name = "?";
+		}
+	}
+
+	qsort(desc->enums, desc->enums_nb, sizeof(*desc->enums),
+	      enum_value_cmp);
+
+	desc->flags = true;
+	for (i = 0; i < desc->enums_nb; i++) {
+		Dwarf_Unsigned value = desc->enums[i].value;
+
+		if (value == 0) {
+			continue;
+		}
+		if (value & (value - 1)) {
+			desc->flags = false;
+			break;
+		}
+		bits++;
+	}
+	if (bits < 2) {
+		desc->flags = false;
+	}
+}
+
+
+/* Array types have one subrange child per dimension. Dimensions after the
+ * first get their own anonymous array desc. */
+static void build_array(struct type_cache *cache, Dwarf_Die type_die,
+			struct type_desc *desc)
+{
+	Dwarf_Debug dwarf = cache->dwarf;
+	Dwarf_Unsigned counts[16];
+	unsigned int dims = 0;
+	struct type_desc *elem;
+	Dwarf_Die child, sibling;
+	int retval, i;
+
+	foreach_child(dwarf, type_die, child, sibling, retval) {
+		Dwarf_Attribute attr;
+		Dwarf_Unsigned count = 0;
+
+		if (dims == ARRAY_SIZE(counts)) {
+			continue;
+		}
+		if (dwarf_attr(child, DW_AT_count, &attr, NULL) ==
+		    DW_DLV_OK) {
+			dwarf_formudata(attr, &count, NULL);
+			dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		} else if (dwarf_attr(child, DW_AT_upper_bound, &attr,
+				      NULL) == DW_DLV_OK) {
+			dwarf_formudata(attr, &count, NULL);
+			dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+			count++;
+		}
+		counts[dims++] = count;
+	}
+
+	elem = get_target(cache, type_die);
+	for (i = dims - 1; i > 0; i--) {
+		struct type_desc *inner = desc_new(cache, 0);
+
+		inner->tag = DW_TAG_array_type;
+		inner->target = elem;
+		inner->count = counts[i];
+		inner->size = elem ? elem->size * counts[i] : 0;
+		inner->name = elem ? array_name(cache, elem, counts[i]) : "?";
+		elem = inner;
+	}
+
+	desc->target = elem;
+	desc->count = dims ? counts[0] : 0;
+	desc->size = elem ? elem->size * desc->count : 0;
+	desc->name = elem ? array_name(cache, elem, desc->count) : "?";
+}
+
+
+static struct type_desc *build(struct type_cache *cache, Dwarf_Off offset)
+{
+	Dwarf_Debug dwarf = cache->dwarf;
+	struct type_desc *desc;
+	Dwarf_Die type_die;
+	char *name;
+	bool named;
+
+	if (dwarf_offdie(dwarf, offset, &type_die, NULL) != DW_DLV_OK) {
+		return NULL;
+	}
+
+	desc = desc_new(cache, offset);
+	by_offset_set(cache, desc, offset);
+	dwarf_tag(type_die, &desc->tag, NULL);
+	if (dwarf_bytesize(type_die, &desc->size, NULL) != DW_DLV_OK) {
+		desc->size = 0;
+	}
+
+	/* Named types get their name before their target or members are
+	 * built, the latter may refer back to them. */
+	named = dwarf_diename(type_die, &name, NULL) == DW_DLV_OK;
+	switch (desc->tag) {
+		Dwarf_Attribute attr;
+		Dwarf_Half addr_size;
+
+	case DW_TAG_structure_type:
+	case DW_TAG_class_type:
+		desc->name = type_name_concat(cache, "struct ",
+					      named ? name : "{...}", "");
+		build_members(cache, type_die, desc);
+		break;
+
+	case DW_TAG_union_type:
+		desc->name = type_name_concat(cache, "union ",
+					      named ? name : "{...}", "");
+		build_members(cache, type_die, desc);
+		break;
+
+	case DW_TAG_enumeration_type:
+		desc->name = type_name_concat(cache, "enum ",
+					      named ? name : "{...}", "");
+		build_enumerators(cache, type_die, desc);
+		break;
+
+	case DW_TAG_base_type:
+		desc->name = strpool_add(&cache->pool, named ? name : "?");
+		if (dwarf_attr(type_die, DW_AT_encoding, &attr, NULL) ==
+		    DW_DLV_OK) {
+			dwarf_formudata(attr, &desc->encoding, NULL);
+			dwarf_dealloc(dwarf, attr, DW_DLA_ATTR);
+		}
+		break;
+
+	case DW_TAG_typedef:
+		desc->name = strpool_add(&cache->pool, named ? name : "?");
+		desc->target = get_target(cache, type_die);
+		desc->size = desc->target ? desc->target->size : 0;
+		break;
+
+	case DW_TAG_pointer_type:
+	case DW_TAG_reference_type:
+		desc->target = get_target(cache, type_die);
+		if (!desc->size) {
+			dwarf_get_address_size(dwarf, &addr_size, NULL);
+			desc->size = addr_size;
+		}
+		desc->name = desc->target ?
+			type_name_concat(cache, "", desc->target->name, " *") :
+			"void *";
+		break;
+
+	case DW_TAG_const_type:
+	case DW_TAG_volatile_type:
+	case DW_TAG_restrict_type:
+		desc->target = get_target(cache, type_die);
+		desc->size = desc->target ? desc->target->size : 0;
+		desc->name = type_name_concat(cache,
+			desc->tag == DW_TAG_const_type ? "const " :
+			desc->tag == DW_TAG_volatile_type ? "volatile " :
+			"restrict ",
+			desc->target ? desc->target->name : "void", "");
+		break;
+
+	case DW_TAG_array_type:
+		build_array(cache, type_die, desc);
+		break;
+
+	case DW_TAG_subroutine_type:
+		desc->name = "func";
+		break;
+
+	default:
+		desc->target = get_target(cache, type_die);
+		desc->name = strpool_add(&cache->pool, named ? name : "?");
+		break;
+	}
+
+	if (named) {
+		dwarf_dealloc(dwarf, name, DW_DLA_STRING);
+	}
+	dwarf_dealloc(dwarf, type_die, DW_DLA_DIE);
+
+	return desc;
+}
+
+
+static struct type_desc *get_internal(struct type_cache *cache,
+				      Dwarf_Off offset)
+{
+	struct type_desc *desc = by_offset_get(cache, offset);
+
+	if (desc) {
+		return desc;
+	}
+	return build(cache, offset);
+}
+
+
+static uint64_t layout_hash(const struct type_desc *desc)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	int i;
+
+	hash = hash_bytes(hash, &desc->tag, sizeof(desc->tag));
+	hash = hash_string(hash, desc->name);
+	hash = hash_bytes(hash, &desc->size, sizeof(desc->size));
+	for (i = 0; i < desc->members_nb; i++) {
+		const struct member_desc *member = &desc->members[i];
+
+		hash = hash_string(hash, member->name);
+		hash = hash_bytes(hash, &member->offset,
+				  sizeof(member->offset));
+		hash = hash_bytes(hash, &member->size, sizeof(member->size));
+		hash = hash_bytes(hash, &member->bit_size,
+				  sizeof(member->bit_size));
+		hash = hash_bytes(hash, &member->bit_offset,
+				  sizeof(member->bit_offset));
+		hash = hash_string(hash, member->type ?
+				   member->type->name : NULL);
+	}
+	return hash;
+}
+
+
+static bool streq(const char *a, const char *b)
+{
+	return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+
+/* pairs of types assumed identical while they are compared, so that
+ * recursive types compare equal */
+struct type_pair {
+	const struct type_desc *a;
+	const struct type_desc *b;
+};
+
+/* deeper types are assumed to differ */
+#define TYPE_COMPARE_DEPTH 32
+
+
+/*
+ * Whether a and b describe the same type: same spelling, and targets,
+ * members and enumerators that are themselves the same, down to the base
+ * types. Shared member arrays are the same layout.
+ */
+static bool type_same(const struct type_desc *a, const struct type_desc *b,
+		      struct type_pair *assumed, unsigned int depth)
+{
+	int i;
+
+	if (a == b) {
+		return true;
+	}
+	if (!a || !b) {
+		return false;
+	}
+	if (a->members_nb && a->members == b->members) {
+		return true;
+	}
+	if (a->tag != b->tag || a->size != b->size || a->count != b->count ||
+	    a->encoding != b->encoding || a->members_nb != b->members_nb ||
+	    a->enums_nb != b->enums_nb || !streq(a->name, b->name)) {
+		return false;
+	}
+	for (i = 0; i < depth; i++) {
+		if (assumed[i].a == a && assumed[i].b == b) {
+			return true;
+		}
+	}
+	if (depth == TYPE_COMPARE_DEPTH) {
+		return false;
+	}
+	assumed[depth] = (struct type_pair) {a, b};
+
+	for (i = 0; i < a->enums_nb; i++) {
+		if (a->enums[i].value != b->enums[i].value ||
+		    !streq(a->enums[i].name, b->enums[i].name)) {
+			return false;
+		}
+	}
+	for (i = 0; i < a->members_nb; i++) {
+		const struct member_desc *ma = &a->members[i];
+		const struct member_desc *mb = &b->members[i];
+
+		if (ma->offset != mb->offset || ma->size != mb->size ||
+		    ma->bit_size != mb->bit_size ||
+		    ma->bit_offset != mb->bit_offset ||
+		    !streq(ma->name, mb->name) ||
+		    !type_same(ma->type, mb->type, assumed, depth + 1)) {
+			return false;
+		}
+	}
+	return type_same(a->target, b->target, assumed, depth + 1);
+}
+
+
+static bool layout_equal(const struct type_desc *a, const struct type_desc *b)
+{
+	struct type_pair assumed[TYPE_COMPARE_DEPTH];
+
+	return type_same(a, b, assumed, 0);
+}
+
+
+/* Share the members of identical layouts, which are common since every CU
+ * that uses a structure has its own copy of the type. Only done once all the
+ * types reachable from a layout are built since member types are compared
+ * down to the base types. Two layouts whose members only have types of the
+ * same name, such as two CU-local structures, are kept apart. */
+static void dedup_layout(struct type_cache *cache, struct type_desc *desc)
+{
+	unsigned int i;
+
+	if ((cache->by_hash_nb + 1) * 2 > cache->by_hash_size) {
+		struct type_desc **old = cache->by_hash;
+		unsigned int old_size = cache->by_hash_size;
+
+		cache->by_hash_size = old_size ? old_size * 2 : 1024;
+		cache->by_hash = calloc(cache->by_hash_size,
+					sizeof(*cache->by_hash));
+		cache->by_hash_nb = 0;
+		for (i = 0; i < old_size; i++) {
+			if (old[i]) {
+				dedup_layout(cache, old[i]);
+			}
+		}
+		free(old);
+	}
+
+	for (i = desc->hash & (cache->by_hash_size - 1); cache->by_hash[i];
+	     i = (i + 1) & (cache->by_hash_size - 1)) {
+		struct type_desc *canonical = cache->by_hash[i];
+
+		if (canonical == desc) {
+			return;
+		}
+		if (canonical->hash == desc->hash &&
+		    layout_equal(canonical, desc)) {
+			free(desc->members);
+			desc->members = canonical->members;
+			desc->shared_members = true;
+			by_offset_set(cache, canonical, desc->die_offset);
+			return;
+		}
+	}
+	cache->by_hash[i] = desc;
+	cache->by_hash_nb++;
+}
+
+
+struct type_cache *type_cache_new(Dwarf_Debug dwarf)
+{
+	struct type_cache *cache = calloc(1, sizeof(*cache));
+
+	cache->dwarf = dwarf;
+	return cache;
+}
+
+
+/* Returns the description of the type DIE at die_offset, NULL if there is
+ * no such DIE */
+struct type_desc *type_cache_get(struct type_cache *cache,
+				 Dwarf_Off die_offset)
+{
+	struct type_desc *desc;
+	unsigned int start = cache->pending_nb;
+	int i;
+
+	if ((desc = by_offset_get(cache, die_offset)) != NULL) {
+		return desc;
+	}
+
+	desc = build(cache, die_offset);
+	/* types reached from a layout are built after it: deduplicating them
+	 * first lets the comparisons stop at shared member arrays */
+	for (i = cache->pending_nb - 1; i >= (int) start; i--) {
+		struct type_desc *pending = cache->pending[i];
+
+		if (pending->members_nb) {
+			pending->hash = layout_hash(pending);
+			dedup_layout(cache, pending);
+		}
+	}
+
+	/* the lookup may now return the canonical layout */
+	return by_offset_get(cache, die_offset);
+}
+
+
+/*
+ * Look a type up by its C spelling, ex. "struct task_struct" or "pid_t".
+ * Only top level definitions are searched, the first complete one is
+ * returned. This is a linear scan of the CUs, meant for command line
+ * arguments.
+ */
+struct type_desc *type_cache_find(struct type_cache *cache, const char *name)
+{
+	static const struct {
+		const char *prefix;
+		Dwarf_Half tag;
+	} kinds[] = {
+		{"struct ", DW_TAG_structure_type},
+		{"union ", DW_TAG_union_type},
+		{"enum ", DW_TAG_enumeration_type},
+	};
+	Dwarf_Debug dwarf = cache->dwarf;
+	Dwarf_Unsigned next_cu;
+	Dwarf_Off found = 0;
+	Dwarf_Half tag = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(kinds); i++) {
+		size_t len = strlen(kinds[i].prefix);
+
+		if (strncmp(name, kinds[i].prefix, len) == 0) {
+			tag = kinds[i].tag;
+			name += len;
+			break;
+		}
+	}
+
+	/* the CU iteration state of libdwarf is global, always go through
+	 * all of them */
+	while (dwarf_next_cu_header(dwarf, NULL, NULL, NULL, NULL, &next_cu,
+				    NULL) == DW_DLV_OK) {
+		Dwarf_Die cu_die, child, sibling;
+		int retval;
+
+		if (found || dwarf_siblingof(dwarf, NULL, &cu_die, NULL) !=
+		    DW_DLV_OK) {
+			continue;
+		}
+		foreach_child(dwarf, cu_die, child, sibling, retval) {
+			Dwarf_Half child_tag;
+			Dwarf_Bool declaration;
+			char *child_name;
+			bool match;
+
+			dwarf_tag(child, &child_tag, NULL);
+			if (tag ? child_tag != tag :
+			    child_tag != DW_TAG_typedef &&
+			    child_tag != DW_TAG_base_type) {
+				continue;
+			}
+			if (dwarf_diename(child, &child_name, NULL) !=
+			    DW_DLV_OK) {
+				continue;
+			}
+			match = strcmp(child_name, name) == 0;
+			dwarf_dealloc(dwarf, child_name, DW_DLA_STRING);
+			if (!match || (dwarf_hasattr(child, DW_AT_declaration,
+						     &declaration, NULL) ==
+				       DW_DLV_OK && declaration)) {
+				continue;
+			}
+
+			dwarf_dieoffset(child, &found, NULL);
+			dwarf_dealloc(dwarf, child, DW_DLA_DIE);
+			break;
+		}
+		dwarf_dealloc(dwarf, cu_die, DW_DLA_DIE);
+	}
+
+	return found ? type_cache_get(cache, found) : NULL;
+}
+
+
+void type_cache_free(struct type_cache *cache)
+{
+	int i;
+
+	/* every desc ever built is in pending */
+	for (i = 0; i < cache->pending_nb; i++) {
+		struct type_desc *desc = cache->pending[i];
+
+		if (!desc->shared_members) {
+			free(desc->members);
+		}
+		free(desc->enums);
+		free(desc);
+	}
+	free(cache->pending);
+	free(cache->by_offset);
+	free(cache->by_hash);
+	strpool_free(&cache->pool);
+	free(cache);
+}
+
+
+/* Skip typedefs and qualifiers */
+const struct type_desc *type_strip(const struct type_desc *type)
+{
+	while (type && type->target &&
+	       (type->tag == DW_TAG_typedef ||
+		type->tag == DW_TAG_const_type ||
+		type->tag == DW_TAG_volatile_type ||
+		type->tag == DW_TAG_restrict_type)) {
+		type = type->target;
+	}
+	return type;
+}
+
+
+/* Members of anonymous structures and unions are found as if they were
+ * members of the parent. offset is set to the offset of the member within
+ * type. */
+const struct member_desc *type_find_member(const struct type_desc *type,
+					   const char *name,
+					   Dwarf_Unsigned *offset)
+{
+	int i;
+
+	type = type_strip(type);
+	if (!type) {
+		return NULL;
+	}
+	for (i = 0; i < type->members_nb; i++) {
+		const struct member_desc *member = &type->members[i];
+
+		if (member->name) {
+			if (strcmp(member->name, name) == 0) {
+				*offset = member->offset;
+				return member;
+			}
+		} else {
+			const struct member_desc *inner;
+			Dwarf_Unsigned inner_offset;
+
+			inner = type_find_member(member->type, name,
+						 &inner_offset);
+			if (inner) {
+				*offset = member->offset + inner_offset;
+				return inner;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Compute the offset of an expression like "->a.b[3].c" relative to an object
+ * of the given type. A leading "->" dereferences type itself, which must be a
+ * pointer. Further dereferences need memory access and are not supported.
+ * result is set to the type of the designated member.
+ */
+int type_resolve_path(const struct type_desc *type, const char *path,
+		      Dwarf_Unsigned *offset, const struct type_desc **result)
+{
+	const char *p = path, *start;
+
+	*offset = 0;
+	if (strncmp(p, "->", 2) == 0) {
+		type = type_strip(type);
+		if (!type || type->tag != DW_TAG_pointer_type ||
+		    !type->target) {
+			return -1;
+		}
+		type = type->target;
+		p += 2;
+	} else if (*p == '.') {
+		p++;
+	}
+	start = p;
+
+	while (*p) {
+		const struct type_desc *stripped = type_strip(type);
+
+		if (*p == '[') {
+			char *end;
+			unsigned long index = strtoul(p + 1, &end, 0);
+
+			if (*end != ']' || !stripped ||
+			    stripped->tag != DW_TAG_array_type ||
+			    !stripped->target) {
+				return -1;
+			}
+			*offset += index * stripped->target->size;
+			type = stripped->target;
+			p = end + 1;
+		} else {
+			const struct member_desc *member;
+			Dwarf_Unsigned member_offset;
+			char name[256];
+			size_t len;
+
+			if (*p == '.') {
+				p++;
+			} else if (p != start) {
+				/* "->" or garbage */
+				return -1;
+			}
+			len = strcspn(p, ".[-");
+			if (len == 0 || len >= sizeof(name)) {
+				return -1;
+			}
+			memcpy(name, p, len);
+			name[len] = '\0';
+			member = type_find_member(stripped, name,
+						  &member_offset);
+			if (!member) {
+				return -1;
+			}
+			*offset += member_offset;
+			type = member->type;
+			p += len;
+		}
+	}
+
+	*result = type;
+	return 0;
+}
+
+
+/*
+ * Write in buf the member path (".a.b[3].c") of the innermost member of type
+ * that contains the byte at offset.
+ * Returns the number of characters written.
+ */
+int type_member_path(const struct type_desc *type, Dwarf_Unsigned offset,
+		     char *buf, size_t len)
+{
+	size_t pos = 0;
+
+	buf[0] = '\0';
+	while (pos < len && (type = type_strip(type)) != NULL) {
+		const struct member_desc *found = NULL;
+		int i;
+
+		if (type->tag == DW_TAG_array_type && type->target &&
+		    type->target->size) {
+			Dwarf_Unsigned index = offset / type->target->size;
+
+			pos += snprintf(buf + pos, len - pos,
+					"[%" DW_PR_DUu "]", index);
+			offset -= index * type->target->size;
+			type = type->target;
+			continue;
+		}
+
+		for (i = 0; i < type->members_nb; i++) {
+			const struct member_desc *member = &type->members[i];
+
+			if (offset >= member->offset &&
+			    offset < member->offset + member->size) {
+				found = member;
+				break;
+			}
+		}
+		if (!found) {
+			break;
+		}
+		/* members of anonymous structures and unions are accessed
+		 * directly */
+		if (found->name) {
+			pos += snprintf(buf + pos, len - pos, ".%s",
+					found->name);
+		}
+		offset -= found->offset;
+		type = found->type;
+	}
+
+	return pos < len ? pos : len - 1;
+}
+
+
+static void print_members(FILE *stream, const struct type_desc *type,
+			  unsigned int depth, unsigned int max_depth)
+{
+	int i;
+
+	for (i = 0; i < type->members_nb; i++) {
+		const struct member_desc *member = &type->members[i];
+		const struct type_desc *mtype = type_strip(member->type);
+		const char *type_name = member->type ? member->type->name :
+			"?";
+		char decl[256];
+		int indent = 4 * (depth + 1);
+
+		if (mtype && mtype->members_nb && depth + 1 < max_depth) {
+			fprintf(stream, "%*s%s {\n", indent, "", type_name);
+			print_members(stream, mtype, depth + 1, max_depth);
+			fprintf(stream, "%*s}", indent, "");
+			indent = 1;
+			type_name = "";
+		}
+
+		if (member->bit_size) {
+			snprintf(decl, sizeof(decl), "%s:%u",
+				 member->name ? member->name : "",
+				 member->bit_size);
+		} else {
+			snprintf(decl, sizeof(decl), "%s",
+				 member->name ? member->name : "");
+		}
+		fprintf(stream, "%*s%-*s %s;", indent, "",
+			type_name[0] ? 32 - 4 * (int) depth : 0, type_name,
+			decl);
+		if (member->bit_size) {
+			fprintf(stream, "\t/* %5" DW_PR_DUu ":%2u %4" DW_PR_DUu
+				" */\n", member->offset, member->bit_offset,
+				member->size);
+		} else {
+			fprintf(stream, "\t/* %5" DW_PR_DUu "    %4" DW_PR_DUu
+				" */\n", member->offset, member->size);
+		}
+	}
+}
+
+
+/* pahole style dump of a structure or union, offsets are relative to the
+ * enclosing type */
+void type_print_layout(FILE *stream, const struct type_desc *type,
+		       unsigned int max_depth)
+{
+	const struct type_desc *stripped = type_strip(type);
+
+	fprintf(stream, "%s {\n", stripped->name);
+	print_members(stream, stripped, 0, max_depth);
+	fprintf(stream, "}; /* size: %" DW_PR_DUu " */\n", stripped->size);
+}
+
+
+/* Returns NULL if no enumerator of type has this value, or if type is a
+ * typedef of void */
+const char *type_enum_name(const struct type_desc *type, Dwarf_Signed value)
+{
+	unsigned int lo = 0, hi;
+
+	type = type_strip(type);
+	if (!type) {
+		return NULL;
+	}
+	hi = type->enums_nb;
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (type->enums[mid].value == value) {
+			return type->enums[mid].name;
+		} else if (type->enums[mid].value < value) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return NULL;
+}
+
+
+/*
+ * Format value symbolically: the enumerator name, or for flag-style
+ * enumerations the names of the bits that are set joined by '|', followed by
+ * any remaining unknown bits. Falls back to the number.
+ * Returns the number of characters written.
+ */
+int type_enum_format(const struct type_desc *type, Dwarf_Signed value,
+		     char *buf, size_t len)
+{
+	const char *name;
+	Dwarf_Unsigned rest = value;
+	size_t pos = 0;
+	int i;
+
+	type = type_strip(type);
+	if ((name = type_enum_name(type, value)) != NULL) {
+		pos = snprintf(buf, len, "%s", name);
+	} else if (type && type->flags && value > 0) {
+		for (i = 0; i < type->enums_nb && pos < len; i++) {
+			Dwarf_Unsigned bit = type->enums[i].value;
+
+			if (bit && (rest & bit)) {
+				pos += snprintf(buf + pos, len - pos, "%s%s",
+						pos ? "|" : "",
+						type->enums[i].name);
+				rest &= ~bit;
+			}
+		}
+		if (rest && pos < len) {
+			pos += snprintf(buf + pos, len - pos,
+					"%s0x%" DW_PR_DUx, pos ? "|" : "",
+					rest);
+		}
+	} else {
+		pos = snprintf(buf, len, "%" DW_PR_DSd, value);
+	}
+
+	return pos < len ? pos : len - 1;
+}
@@ -0,0 +1,109 @@
+#ifndef _TYPES_H
+#define _TYPES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <libdwarf/libdwarf.h>
+
+#include "strpool.h"
+
+/*
+ * Type descriptions decoded once from DWARF and cached by DIE offset, so that
+ * member lookups and memory dumps do not need to walk the debugging
+ * information again. Layouts of structures and unions that are duplicated
+ * across CUs share their member array.
+ */
+
+struct member_desc {
+	/* NULL for anonymous structures and unions */
+	const char *name;
+	Dwarf_Unsigned offset;
+	/* size of the member, or of its storage unit for bit fields */
+	Dwarf_Unsigned size;
+	/* bit fields: bit_size != 0, bit_offset counts from the least
+	 * significant bit of the storage unit */
+	unsigned int bit_size;
+	unsigned int bit_offset;
+	struct type_desc *type;
+};
+
+struct enum_value {
+	Dwarf_Signed value;
+	const char *name;
+};
+
+struct type_desc {
+	Dwarf_Off die_offset;
+	/* DW_TAG_*_type */
+	Dwarf_Half tag;
+	/* C spelling, ex. "struct list_head *" */
+	const char *name;
+	Dwarf_Unsigned size;
+	/* DW_ATE_* of base types */
+	Dwarf_Unsigned encoding;
+	/* pointer, typedef, qualifiers: NULL for void. array: element */
+	struct type_desc *target;
+	/* array: number of elements, 0 for flexible arrays */
+	Dwarf_Unsigned count;
+	/* structure and union */
+	struct member_desc *members;
+	unsigned int members_nb;
+	bool shared_members;
+	uint64_t hash;
+	/* enumeration: sorted by value */
+	struct enum_value *enums;
+	unsigned int enums_nb;
+	/* all the non-zero values are single bits */
+	bool flags;
+};
+
+struct type_cache_entry {
+	Dwarf_Off die_offset;
+	struct type_desc *desc;
+};
+
+struct type_cache {
+	Dwarf_Debug dwarf;
+	/* open addressing, several offsets may map to the same canonical
+	 * layout */
+	struct type_cache_entry *by_offset;
+	unsigned int by_offset_nb;
+	unsigned int by_offset_size;
+	/* canonical structure and union layouts, keyed by hash */
+	struct type_desc **by_hash;
+	unsigned int by_hash_nb;
+	unsigned int by_hash_size;
+	/* every desc built, in order. The ones built by the current lookup
+	 * are deduplicated when it returns. */
+	struct type_desc **pending;
+	unsigned int pending_nb;
+	unsigned int pending_alloc;
+	struct strpool pool;
+};
+
+int get_type_size(Dwarf_Debug dwarf, Dwarf_Die die, Dwarf_Unsigned *size);
+
+struct type_cache *type_cache_new(Dwarf_Debug dwarf);
+struct type_desc *type_cache_get(struct type_cache *cache,
+				 Dwarf_Off die_offset);
+struct type_desc *type_cache_find(struct type_cache *cache, const char *name);
+void type_cache_free(struct type_cache *cache);
+
+const struct type_desc *type_strip(const struct type_desc *type);
+const struct member_desc *type_find_member(const struct type_desc *type,
+					   const char *name,
+					   Dwarf_Unsigned *offset);
+int type_resolve_path(const struct type_desc *type, const char *path,
+		      Dwarf_Unsigned *offset, const struct type_desc **result);
+int type_member_path(const struct type_desc *type, Dwarf_Unsigned offset,
+		     char *buf, size_t len);
+void type_print_layout(FILE *stream, const struct type_desc *type,
+		       unsigned int max_depth);
+const char *type_enum_name(const struct type_desc *type, Dwarf_Signed value);
+int type_enum_format(const struct type_desc *type, Dwarf_Signed value,
+		     char *buf, size_t len);
+
+#endif
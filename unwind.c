@@ -0,0 +1,444 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libelf.h>
+#include <libdwarf/libdwarf.h>
+#include <libdwarf/dwarf.h>
+
+#include "arch.h"
+#include "core_walk.h"
+#include "memsrc.h"
+#include "unwind.h"
+
+
+const char *unwind_status_names[] = {
+	[UNWIND_END] = "end of stack",
+	[UNWIND_NO_CFI] = "no CFI",
+	[UNWIND_FAULT] = "unreadable stack",
+	[UNWIND_BAD_SP] = "bad stack pointer",
+	[UNWIND_NO_RA] = "unknown return address",
+	[UNWIND_MAX_FRAMES] = "too many frames",
+};
+
+
+#define UNWIND_STEP_DECLARE(arch, em, NAME)				\
+static unwind_step_fn unwind_step_##arch;
+
+ARCH_LIST(UNWIND_STEP_DECLARE)
+
+
+struct cfi_cache *cfi_cache_new(Dwarf_Debug dwarf, const struct arch *arch)
+{
+	struct cfi_cache *cache;
+
+	cache = calloc(1, sizeof(*cache));
+	cache->dwarf = dwarf;
+	cache->arch = arch;
+#define UNWIND_STEP_SELECT(name, em, NAME)				\
+	if (arch && arch->machine == em) {				\
+		cache->step = unwind_step_##name;			\
+	}
+	ARCH_LIST(UNWIND_STEP_SELECT)
+	pthread_mutex_init(&cache->lock, NULL);
+	if (get_fde_list(dwarf, &cache->cie_list, &cache->cie_count,
+			 &cache->fde_list, &cache->fde_count) == -1) {
+		cache->fde_list = NULL;
+	}
+	cache->rows_size = 1024;
+	cache->rows = calloc(cache->rows_size, sizeof(*cache->rows));
+
+	return cache;
+}
+
+
+static struct cfi_row *row_slot(struct cfi_row *rows, unsigned int size,
+				Dwarf_Addr pc)
+{
+	unsigned int i = (pc * 0x9e3779b97f4a7c15ULL) >> 32;
+
+	/* pc 0 marks empty slots */
+	for (i &= size - 1; rows[i].pc && rows[i].pc != pc;
+	     i = (i + 1) & (size - 1)) {
+	}
+	return &rows[i];
+}
+
+
+static void rows_grow(struct cfi_cache *cache)
+{
+	struct cfi_row *old = cache->rows;
+	unsigned int old_size = cache->rows_size;
+	int i;
+
+	cache->rows_size *= 2;
+	cache->rows = calloc(cache->rows_size, sizeof(*cache->rows));
+	for (i = 0; i < old_size; i++) {
+		if (old[i].pc) {
+			*row_slot(cache->rows, cache->rows_size, old[i].pc) =
+				old[i];
+		}
+	}
+	free(old);
+}
+
+
+/* called with the lock held */
+static void decode_row(struct cfi_cache *cache, Dwarf_Addr pc,
+		       struct cfi_row *row)
+{
+	Dwarf_Regtable_Entry3 *cfa_rule;
+	Dwarf_Regtable3 reg_table;
+	Dwarf_Addr lopc, hipc, row_pc;
+	Dwarf_Fde fde;
+	int i;
+
+	*row = (struct cfi_row) {
+		.pc = pc,
+		.cfa_reg = -1,
+	};
+	if (!cache->arch || !cache->fde_list ||
+	    dwarf_get_fde_at_pc(cache->fde_list, pc, &fde, &lopc, &hipc,
+				NULL) != DW_DLV_OK) {
+		return;
+	}
+
+	reg_table.rt3_reg_table_size = cache->arch->columns_nb;
+	reg_table.rt3_rules = malloc(sizeof(Dwarf_Regtable_Entry3) *
+				     reg_table.rt3_reg_table_size);
+	if (dwarf_get_fde_info_for_all_regs3(fde, pc, &reg_table, &row_pc,
+					     NULL) != DW_DLV_OK) {
+		free(reg_table.rt3_rules);
+		return;
+	}
+
+	cfa_rule = &reg_table.rt3_cfa_rule;
+	if (cfa_rule->dw_value_type == DW_EXPR_OFFSET &&
+	    cfa_rule->dw_offset_relevant &&
+	    cfa_rule->dw_regnum < cache->arch->gprs_nb) {
+		row->cfa_reg = cfa_rule->dw_regnum;
+		row->cfa_offset = cfa_rule->dw_offset_or_block_len;
+	}
+	for (i = 0; i < reg_table.rt3_reg_table_size; i++) {
+		Dwarf_Regtable_Entry3 *entry = &reg_table.rt3_rules[i];
+		int slot = arch_column_slot(cache->arch, i);
+
+		if (slot == -1 || entry->dw_value_type != DW_EXPR_OFFSET) {
+			continue;
+		}
+		if (entry->dw_offset_relevant &&
+		    entry->dw_regnum == DW_FRAME_CFA_COL3) {
+			row->saved |= 1ULL << slot;
+			row->offsets[slot] = entry->dw_offset_or_block_len;
+		} else if (entry->dw_regnum == DW_FRAME_UNDEFINED_VAL) {
+			row->undefined |= 1ULL << slot;
+		}
+	}
+	free(reg_table.rt3_rules);
+}
+
+
+/* Returns -1 if there is no usable CFI at pc */
+int cfi_cache_lookup(struct cfi_cache *cache, Dwarf_Addr pc,
+		     struct cfi_row *row)
+{
+	struct cfi_row *slot;
+
+	pthread_mutex_lock(&cache->lock);
+	slot = row_slot(cache->rows, cache->rows_size, pc);
+	if (!slot->pc) {
+		decode_row(cache, pc, slot);
+		if (++cache->rows_nb * 2 > cache->rows_size) {
+			rows_grow(cache);
+			slot = row_slot(cache->rows, cache->rows_size, pc);
+		}
+	}
+	*row = *slot;
+	pthread_mutex_unlock(&cache->lock);
+
+	return row->cfa_reg == -1 ? -1 : 0;
+}
+
+
+void cfi_cache_free(struct cfi_cache *cache)
+{
+	if (cache->fde_list) {
+		dwarf_fde_cie_list_dealloc(cache->dwarf, cache->cie_list,
+					   cache->cie_count, cache->fde_list,
+					   cache->fde_count);
+	}
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->rows);
+	free(cache);
+}
+
+
+/*
+ * Replace regs, the state of a frame, by the state of its caller. inner is
+ * set for the innermost frame, whose pc is not a return address. The pc of
+ * the caller is the value of the return address column: saved in the frame,
+ * or still in its register if the rule is same value, as in leaf functions
+ * of arm64 and s390x. Returns -1 and sets status, leaving regs alone, if the
+ * frame cannot be unwound. Instantiated for each architecture with its sp
+ * and ra slots as constants.
+ */
+static inline __attribute__((always_inline)) int unwind_step_arch(
+	const int sp, const int ra, struct cfi_cache *cfi,
+	struct mem_cache *mem, Dwarf_Half addr_size,
+	struct unwind_regs *regs, bool inner, uint64_t stack_lo,
+	uint64_t stack_hi, enum unwind_status *status)
+{
+	uint64_t pc = regs->pc;
+	struct unwind_regs caller;
+	struct cfi_row row;
+	uint64_t cfa, saved;
+
+	/* outer pcs are return addresses, which may be the start of another
+	 * function if the call was the last instruction */
+	if (cfi_cache_lookup(cfi, inner ? pc : pc - 1, &row) == -1 ||
+	    !(regs->valid & (1ULL << row.cfa_reg))) {
+		*status = UNWIND_NO_CFI;
+		return -1;
+	}
+	if (row.undefined & (1ULL << ra)) {
+		/* entry code marks the return address undefined */
+		*status = UNWIND_END;
+		return -1;
+	}
+	if (!(row.saved & (1ULL << ra)) && !(regs->valid & (1ULL << ra))) {
+		*status = UNWIND_NO_RA;
+		return -1;
+	}
+	/* the frame of a leaf may be empty, those of its callers may not */
+	cfa = regs->regs[row.cfa_reg] + row.cfa_offset;
+	if (cfa < regs->regs[sp] || (cfa == regs->regs[sp] && !inner) ||
+	    cfa < stack_lo || cfa > stack_hi) {
+		*status = UNWIND_BAD_SP;
+		return -1;
+	}
+
+	/* only the saved registers are visited */
+	caller = *regs;
+	for (saved = row.saved; saved; saved &= saved - 1) {
+		int i = __builtin_ctzll(saved);
+
+		caller.regs[i] = 0;
+		if (mem_cache_read(mem, cfa + row.offsets[i], &caller.regs[i],
+				   addr_size) != 0) {
+			*status = UNWIND_FAULT;
+			return -1;
+		}
+	}
+	caller.valid |= row.saved;
+	caller.valid &= ~row.undefined;
+	caller.pc = caller.regs[ra] ? caller.regs[ra] - regs->slide : 0;
+	caller.regs[sp] = cfa;
+	caller.valid |= 1ULL << sp;
+	*regs = caller;
+
+	return 0;
+}
+
+
+#define UNWIND_STEP_DEFINE(arch, em, NAME)				\
+static int unwind_step_##arch(struct cfi_cache *cfi,			\
+			      struct mem_cache *mem,			\
+			      Dwarf_Half addr_size,			\
+			      struct unwind_regs *regs, bool inner,	\
+			      uint64_t stack_lo, uint64_t stack_hi,	\
+			      enum unwind_status *status)		\
+{									\
+	return unwind_step_arch(ARCH_##NAME##_SP, ARCH_##NAME##_RA,	\
+				cfi, mem, addr_size, regs, inner,	\
+				stack_lo, stack_hi, status);		\
+}
+
+ARCH_LIST(UNWIND_STEP_DEFINE)
+
+
+int unwind_step(struct cfi_cache *cfi, struct mem_cache *mem,
+		Dwarf_Half addr_size, struct unwind_regs *regs, bool inner,
+		uint64_t stack_lo, uint64_t stack_hi,
+		enum unwind_status *status)
+{
+	if (!cfi->step) {
+		*status = UNWIND_NO_CFI;
+		return -1;
+	}
+	return cfi->step(cfi, mem, addr_size, regs, inner, stack_lo,
+			 stack_hi, status);
+}
+
+
+/*
+ * Unwind from regs, the state of the innermost frame. The pc of each frame
+ * is stored in pcs, the number of frames is returned.
+ * Frames must stay in [stack_lo, stack_hi[. regs is left with the state of
+ * the outermost frame.
+ */
+unsigned int unwind_stack(struct cfi_cache *cfi, struct mem_cache *mem,
+			  Dwarf_Half addr_size, struct unwind_regs *regs,
+			  uint64_t stack_lo, uint64_t stack_hi, uint64_t *pcs,
+			  unsigned int max, enum unwind_status *status)
+{
+	unsigned int nr = 0;
+
+	if (!cfi->arch) {
+		*status = UNWIND_NO_CFI;
+		return 0;
+	}
+	while (true) {
+		uint64_t pc = regs->pc;
+
+		if (!pc) {
+			*status = UNWIND_END;
+			break;
+		}
+		if (nr == max) {
+			*status = UNWIND_MAX_FRAMES;
+			break;
+		}
+		pcs[nr++] = pc;
+
+		if (unwind_step(cfi, mem, addr_size, regs, nr == 1, stack_lo,
+				stack_hi, status) == -1) {
+			break;
+		}
+	}
+
+	return nr;
+}
+
+
+/* Whether the rules of row are those of the body of a function that set up
+ * a frame pointer to its frame record, ex. with push %rbp; mov %rsp, %rbp on
+ * x86_64, or stp x29, x30, [sp, #-N]!; mov x29, sp on arm64 */
+static bool row_is_fp_frame(const struct arch *arch,
+			    const struct cfi_row *row, Dwarf_Half addr_size)
+{
+	Dwarf_Signed size = addr_size;
+
+	if (arch->fp_cfa ? row->cfa_offset != arch->fp_cfa :
+	    row->cfa_offset < 2 * size) {
+		return false;
+	}
+	return row->cfa_reg == arch->fp &&
+		(row->saved & (1ULL << arch->fp)) &&
+		row->offsets[arch->fp] == -row->cfa_offset &&
+		(row->saved & (1ULL << arch->ra)) &&
+		row->offsets[arch->ra] == size - row->cfa_offset;
+}
+
+
+/* unwind_step through the frame pointer chain: the frame pointer of the
+ * caller and the return address are saved at the frame pointer. When the
+ * record is not at a fixed place of the frame, the stack pointer of the
+ * caller is only known to be above it. */
+static int fp_step(const struct arch *arch, struct mem_cache *mem,
+		   Dwarf_Half addr_size, struct unwind_regs *regs,
+		   uint64_t stack_lo, uint64_t stack_hi,
+		   enum unwind_status *status)
+{
+	uint64_t bp = regs->regs[arch->fp];
+	uint64_t cfa = bp + (arch->fp_cfa ? arch->fp_cfa : 2 * addr_size);
+	uint64_t caller_bp = 0, ra = 0;
+
+	if (!(regs->valid & (1ULL << arch->fp)) || bp % addr_size ||
+	    bp < regs->regs[arch->sp] || bp < stack_lo || cfa > stack_hi) {
+		*status = UNWIND_BAD_SP;
+		return -1;
+	}
+	if (mem_cache_read(mem, bp, &caller_bp, addr_size) != 0 ||
+	    mem_cache_read(mem, bp + addr_size, &ra, addr_size) != 0) {
+		*status = UNWIND_FAULT;
+		return -1;
+	}
+	regs->pc = ra ? ra - regs->slide : 0;
+	regs->regs[arch->fp] = caller_bp;
+	regs->regs[arch->ra] = ra;
+	regs->regs[arch->sp] = cfa;
+	regs->valid |= 1ULL << arch->fp | 1ULL << arch->ra;
+	if (arch->fp_cfa) {
+		regs->valid |= 1ULL << arch->sp;
+	} else {
+		regs->valid &= ~(1ULL << arch->sp);
+	}
+
+	return 0;
+}
+
+
+/*
+ * unwind_stack for code built with frame pointers, without looking up CFI
+ * for most frames. The innermost frame, whose pc may be in a prologue, is
+ * unwound through CFI. Then one frame in check, and every frame once one
+ * did not match, is checked against its CFI rules and unwound through them
+ * if they do not describe a frame pointer frame. check 0 never checks, 1
+ * checks every frame. Frames the chain cannot unwind are also unwound
+ * through CFI, and so are all frames on architectures without frame
+ * pointer chains. stats is added to, it may be shared by stacks.
+ */
+unsigned int unwind_stack_fp(struct cfi_cache *cfi, struct mem_cache *mem,
+			     Dwarf_Half addr_size, struct unwind_regs *regs,
+			     uint64_t stack_lo, uint64_t stack_hi,
+			     uint64_t *pcs, unsigned int max,
+			     unsigned int check, struct unwind_fp_stats *stats,
+			     enum unwind_status *status)
+{
+	const struct arch *arch = cfi->arch;
+	unsigned int nr = 0;
+	bool trusted = true;
+
+	if (!arch || arch->fp == -1) {
+		return unwind_stack(cfi, mem, addr_size, regs, stack_lo,
+				    stack_hi, pcs, max, status);
+	}
+	while (true) {
+		uint64_t pc = regs->pc;
+		struct cfi_row row;
+		int retval;
+
+		if (!pc) {
+			*status = UNWIND_END;
+			break;
+		}
+		if (nr == max) {
+			*status = UNWIND_MAX_FRAMES;
+			break;
+		}
+		pcs[nr++] = pc;
+
+		if (nr == 1) {
+			retval = unwind_step(cfi, mem, addr_size, regs, true,
+					     stack_lo, stack_hi, status);
+		} else if (!trusted || (check && stats->frames % check == 0)) {
+			stats->checked++;
+			if (cfi_cache_lookup(cfi, pc - 1, &row) == 0 &&
+			    row_is_fp_frame(arch, &row, addr_size)) {
+				retval = fp_step(arch, mem, addr_size, regs,
+						 stack_lo, stack_hi, status);
+			} else {
+				stats->mismatches++;
+				trusted = false;
+				retval = unwind_step(cfi, mem, addr_size, regs,
+						     false, stack_lo, stack_hi,
+						     status);
+			}
+		} else if (fp_step(arch, mem, addr_size, regs, stack_lo,
+				   stack_hi, status) == 0) {
+			retval = 0;
+		} else {
+			/* the end of the chain, entry code has no frame */
+			retval = unwind_step(cfi, mem, addr_size, regs, false,
+					     stack_lo, stack_hi, status);
+		}
+		stats->frames++;
+		if (retval == -1) {
+			break;
+		}
+	}
+
+	return nr;
+}
@@ -0,0 +1,117 @@
+#ifndef _UNWIND_H
+#define _UNWIND_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libdwarf/libdwarf.h>
+
+#include "arch.h"
+#include "core_walk.h"
+#include "memsrc.h"
+
+/* slots of x86_64, for the code reading its register dumps */
+#define REG_BX 3
+#define REG_BP ARCH_X86_64_FP
+#define REG_SP ARCH_X86_64_SP
+#define REG_RA ARCH_X86_64_RA
+
+/*
+ * CFI rows decoded once per pc. Lookups may come from several threads,
+ * libdwarf calls are serialized by the lock. Registers are in the slots of
+ * the architecture, see arch.h.
+ */
+
+struct cfi_row {
+	Dwarf_Addr pc;
+	/* -1 if there is no usable CFA rule at pc */
+	int cfa_reg;
+	Dwarf_Signed cfa_offset;
+	/* registers saved at CFA + offsets[reg] */
+	uint64_t saved;
+	/* registers whose rule is undefined, the others keep their value */
+	uint64_t undefined;
+	Dwarf_Signed offsets[ARCH_REGS_MAX];
+};
+
+struct unwind_regs {
+	/* pc of the frame, 0 past the outermost one. It is not the ra slot:
+	 * the return address column holds the pc of the caller. */
+	uint64_t pc;
+	uint64_t regs[ARCH_REGS_MAX];
+	/* bit mask of the known registers */
+	uint64_t valid;
+	/* KASLR: the code runs at its link address plus slide. pc is a link
+	 * address, registers hold runtime values: the return address is
+	 * rebased when it becomes the pc of the caller. */
+	uint64_t slide;
+};
+
+enum unwind_status {
+	/* the return address is 0, ex. at the top of a kernel thread */
+	UNWIND_END,
+	UNWIND_NO_CFI,
+	UNWIND_FAULT,
+	/* the stack pointer left the stack or did not grow */
+	UNWIND_BAD_SP,
+	/* the return address is left in a register that is not known */
+	UNWIND_NO_RA,
+	UNWIND_MAX_FRAMES,
+};
+
+struct cfi_cache;
+
+/* unwind_step, instantiated for an architecture */
+typedef int unwind_step_fn(struct cfi_cache *cfi, struct mem_cache *mem,
+			   Dwarf_Half addr_size, struct unwind_regs *regs,
+			   bool inner, uint64_t stack_lo, uint64_t stack_hi,
+			   enum unwind_status *status);
+
+struct cfi_cache {
+	Dwarf_Debug dwarf;
+	/* NULL if the architecture is not supported, nothing is unwound */
+	const struct arch *arch;
+	unwind_step_fn *step;
+	pthread_mutex_t lock;
+	Dwarf_Cie *cie_list;
+	Dwarf_Signed cie_count;
+	Dwarf_Fde *fde_list;
+	Dwarf_Signed fde_count;
+	/* open addressing, keyed by pc */
+	struct cfi_row *rows;
+	unsigned int rows_nb;
+	unsigned int rows_size;
+};
+
+/* counters of unwind_stack_fp */
+struct unwind_fp_stats {
+	unsigned long frames;
+	/* frames checked against CFI, and those it did not agree with */
+	unsigned long checked;
+	unsigned long mismatches;
+};
+
+extern const char *unwind_status_names[];
+
+struct cfi_cache *cfi_cache_new(Dwarf_Debug dwarf, const struct arch *arch);
+int cfi_cache_lookup(struct cfi_cache *cache, Dwarf_Addr pc,
+		     struct cfi_row *row);
+void cfi_cache_free(struct cfi_cache *cache);
+
+int unwind_step(struct cfi_cache *cfi, struct mem_cache *mem,
+		Dwarf_Half addr_size, struct unwind_regs *regs, bool inner,
+		uint64_t stack_lo, uint64_t stack_hi,
+		enum unwind_status *status);
+unsigned int unwind_stack(struct cfi_cache *cfi, struct mem_cache *mem,
+			  Dwarf_Half addr_size, struct unwind_regs *regs,
+			  uint64_t stack_lo, uint64_t stack_hi, uint64_t *pcs,
+			  unsigned int max, enum unwind_status *status);
+unsigned int unwind_stack_fp(struct cfi_cache *cfi, struct mem_cache *mem,
+			     Dwarf_Half addr_size, struct unwind_regs *regs,
+			     uint64_t stack_lo, uint64_t stack_hi,
+			     uint64_t *pcs, unsigned int max,
+			     unsigned int check, struct unwind_fp_stats *stats,
+			     enum unwind_status *status);
+
+#endif
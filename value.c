@@ -0,0 +1,490 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdwarf/libdwarf.h>
+#include <libdwarf/dwarf.h>
+
+#include "datasym.h"
+#include "memsrc.h"
+#include "types.h"
+#include "value.h"
+
+
+void value_printer_init(struct value_printer *vp, struct mem_source *src,
+			FILE *stream)
+{
+	*vp = (struct value_printer) {
+		.src = src,
+		.stream = stream,
+		.max_depth = 0,
+		.max_elems = 16,
+		.max_string = 64,
+	};
+}
+
+
+/* target and host are both little-endian for now */
+static uint64_t load_uint(const unsigned char *data, Dwarf_Unsigned size)
+{
+	uint64_t value = 0;
+
+	memcpy(&value, data, size > sizeof(value) ? sizeof(value) : size);
+	return value;
+}
+
+
+static int64_t sign_extend(uint64_t value, unsigned int bits)
+{
+	if (bits >= 64) {
+		return value;
+	}
+	return (int64_t) (value << (64 - bits)) >> (64 - bits);
+}
+
+
+static bool is_char(const struct type_desc *type)
+{
+	type = type_strip(type);
+	return type && type->tag == DW_TAG_base_type && type->size == 1 &&
+		(type->encoding == DW_ATE_signed_char ||
+		 type->encoding == DW_ATE_unsigned_char);
+}
+
+
+static bool is_aggregate(const struct type_desc *type)
+{
+	return type && (type->tag == DW_TAG_structure_type ||
+			type->tag == DW_TAG_union_type);
+}
+
+
+/* Strings may end before a hole in the dump, fall back to what is left of
+ * the page. */
+static const char *get_string(struct value_printer *vp, uint64_t addr,
+			      size_t *len)
+{
+	const char *s;
+
+	*len = vp->max_string;
+	if ((s = read_plan_get(&vp->plan, addr, *len)) != NULL) {
+		return s;
+	}
+	*len = vp->src->page_size - (addr & (vp->src->page_size - 1));
+	if (*len > vp->max_string) {
+		*len = vp->max_string;
+	}
+	return read_plan_get(&vp->plan, addr, *len);
+}
+
+
+/* Request the memory pointed to by the object at data, that has already been
+ * fetched. */
+static void collect(struct value_printer *vp, const struct type_desc *type,
+		    const unsigned char *data, unsigned int depth)
+{
+	unsigned int i, nr;
+
+	type = type_strip(type);
+	if (!type || !data) {
+		return;
+	}
+
+	switch (type->tag) {
+		const struct type_desc *target;
+		uint64_t ptr;
+
+	case DW_TAG_pointer_type:
+		ptr = load_uint(data, type->size);
+		target = type_strip(type->target);
+		if (!ptr || !target) {
+			break;
+		}
+		if (is_char(target)) {
+			read_plan_add(&vp->plan, ptr, vp->max_string);
+		} else if (depth < vp->max_depth && is_aggregate(target) &&
+			   target->size) {
+			const void *target_data;
+
+			target_data = read_plan_get(&vp->plan, ptr,
+						    target->size);
+			if (target_data) {
+				collect(vp, target, target_data, depth + 1);
+			} else {
+				read_plan_add(&vp->plan, ptr, target->size);
+			}
+		}
+		break;
+
+	case DW_TAG_structure_type:
+	case DW_TAG_union_type:
+		for (i = 0; i < type->members_nb; i++) {
+			const struct member_desc *member = &type->members[i];
+
+			if (!member->bit_size) {
+				collect(vp, member->type, data + member->offset,
+					depth);
+			}
+		}
+		break;
+
+	case DW_TAG_array_type:
+		target = type_strip(type->target);
+		if (!target || is_char(target) || !target->size) {
+			break;
+		}
+		nr = type->count < vp->max_elems ? type->count :
+			vp->max_elems;
+		for (i = 0; i < nr; i++) {
+			collect(vp, target, data + i * target->size, depth);
+		}
+		break;
+	}
+}
+
+
+/* data is NULL if the object itself still has to be read from addr */
+static void fetch(struct value_printer *vp, const struct type_desc *type,
+		  const unsigned char *data, uint64_t addr)
+{
+	unsigned int round;
+
+	if (!data) {
+		read_plan_add(&vp->plan, addr, type->size);
+		read_plan_execute(&vp->plan, vp->src);
+	}
+	for (round = 0; round <= vp->max_depth; round++) {
+		collect(vp, type, data ? data :
+			read_plan_get(&vp->plan, addr, type->size), 0);
+		if (!vp->plan.reqs_nb) {
+			break;
+		}
+		read_plan_execute(&vp->plan, vp->src);
+	}
+}
+
+
+static void print_indent(FILE *stream, unsigned int indent)
+{
+	fprintf(stream, "%*s", 4 * indent, "");
+}
+
+
+static void print_string(FILE *stream, const char *s, size_t len)
+{
+	size_t i;
+
+	fputc('"', stream);
+	for (i = 0; i < len && s[i]; i++) {
+		unsigned char c = s[i];
+
+		if (c == '"' || c == '\\') {
+			fprintf(stream, "\\%c", c);
+		} else if (c == '\n') {
+			fprintf(stream, "\\n");
+		} else if (c == '\t') {
+			fprintf(stream, "\\t");
+		} else if (isprint(c)) {
+			fputc(c, stream);
+		} else {
+			fprintf(stream, "\\%03o", c);
+		}
+	}
+	fputc('"', stream);
+	if (i == len) {
+		fprintf(stream, "...");
+	}
+}
+
+
+static void print_base(struct value_printer *vp, const struct type_desc *type,
+		       uint64_t value)
+{
+	unsigned int bits = type->size * 8;
+
+	switch (type->encoding) {
+		float f;
+		double d;
+
+	case DW_ATE_boolean:
+		fprintf(vp->stream, "%s", value ? "true" : "false");
+		break;
+
+	case DW_ATE_float:
+		if (type->size == sizeof(f)) {
+			memcpy(&f, &value, sizeof(f));
+			fprintf(vp->stream, "%g", f);
+		} else if (type->size == sizeof(d)) {
+			memcpy(&d, &value, sizeof(d));
+			fprintf(vp->stream, "%g", d);
+		} else {
+			fprintf(vp->stream, "0x%llx",
+				(unsigned long long) value);
+		}
+		break;
+
+	case DW_ATE_signed_char:
+	case DW_ATE_unsigned_char:
+		if (type->encoding == DW_ATE_signed_char) {
+			fprintf(vp->stream, "%lld",
+				(long long) sign_extend(value, bits));
+		} else {
+			fprintf(vp->stream, "%llu", (unsigned long long) value);
+		}
+		if (type->size == 1 && isprint(value)) {
+			fprintf(vp->stream, " '%c'", (char) value);
+		}
+		break;
+
+	case DW_ATE_signed:
+		fprintf(vp->stream, "%lld", (long long) sign_extend(value,
+								    bits));
+		break;
+
+	case DW_ATE_unsigned:
+		fprintf(vp->stream, "%llu", (unsigned long long) value);
+		break;
+
+	default:
+		fprintf(vp->stream, "0x%llx", (unsigned long long) value);
+		break;
+	}
+}
+
+
+static void render(struct value_printer *vp, const struct type_desc *type,
+		   const unsigned char *data, unsigned int indent,
+		   unsigned int depth);
+
+
+static void print_pointer(struct value_printer *vp,
+			  const struct type_desc *type,
+			  const unsigned char *data, unsigned int indent,
+			  unsigned int depth)
+{
+	const struct type_desc *target = type_strip(type->target);
+	uint64_t ptr = load_uint(data, type->size);
+	struct data_ref ref;
+	char buf[256];
+
+	fprintf(vp->stream, "0x%llx", (unsigned long long) ptr);
+	if (!ptr) {
+		return;
+	}
+
+	if (vp->data_index &&
+	    data_index_lookup(vp->data_index, ptr, 0, &ref) == 0) {
+		data_ref_format(vp->types, &ref, buf, sizeof(buf));
+		fprintf(vp->stream, " <%s>", buf);
+	}
+
+	if (is_char(target)) {
+		const char *s;
+		size_t len;
+
+		if ((s = get_string(vp, ptr, &len)) != NULL) {
+			fputc(' ', vp->stream);
+			print_string(vp->stream, s, len);
+		}
+	} else if (depth < vp->max_depth && is_aggregate(target) &&
+		   target->size) {
+		const unsigned char *target_data;
+
+		target_data = read_plan_get(&vp->plan, ptr, target->size);
+		fprintf(vp->stream, " -> ");
+		render(vp, target, target_data, indent, depth + 1);
+	}
+}
+
+
+static void print_array(struct value_printer *vp,
+			const struct type_desc *type,
+			const unsigned char *data, unsigned int indent,
+			unsigned int depth)
+{
+	const struct type_desc *target = type_strip(type->target);
+	bool multiline;
+	unsigned int i, nr;
+
+	if (!target || !target->size) {
+		fprintf(vp->stream, "{}");
+		return;
+	}
+	if (is_char(target)) {
+		print_string(vp->stream, (const char *) data, type->count);
+		return;
+	}
+
+	multiline = is_aggregate(target) || target->tag == DW_TAG_array_type;
+	nr = type->count < vp->max_elems ? type->count : vp->max_elems;
+	fprintf(vp->stream, "{");
+	for (i = 0; i < nr; i++) {
+		if (multiline) {
+			fprintf(vp->stream, "\n");
+			print_indent(vp->stream, indent + 1);
+		} else if (i) {
+			fprintf(vp->stream, " ");
+		}
+		render(vp, target, data + i * target->size, indent + 1, depth);
+		if (i + 1 < type->count) {
+			fprintf(vp->stream, ",");
+		}
+	}
+	if (nr < type->count) {
+		if (multiline) {
+			fprintf(vp->stream, "\n");
+			print_indent(vp->stream, indent + 1);
+		} else {
+			fprintf(vp->stream, " ");
+		}
+		fprintf(vp->stream, "... (%llu elements)",
+			(unsigned long long) type->count);
+	}
+	if (multiline) {
+		fprintf(vp->stream, "\n");
+		print_indent(vp->stream, indent);
+	}
+	fprintf(vp->stream, "}");
+}
+
+
+static void print_bitfield(struct value_printer *vp,
+			   const struct member_desc *member,
+			   const unsigned char *data)
+{
+	const struct type_desc *type = type_strip(member->type);
+	uint64_t value;
+
+	value = load_uint(data + member->offset, member->size);
+	value >>= member->bit_offset;
+	if (member->bit_size < 64) {
+		value &= (1ULL << member->bit_size) - 1;
+	}
+
+	if (type && type->tag == DW_TAG_enumeration_type) {
+		char buf[256];
+
+		type_enum_format(type, value, buf, sizeof(buf));
+		fprintf(vp->stream, "%s", buf);
+	} else if (type && (type->encoding == DW_ATE_signed ||
+			    type->encoding == DW_ATE_signed_char)) {
+		fprintf(vp->stream, "%lld",
+			(long long) sign_extend(value, member->bit_size));
+	} else {
+		fprintf(vp->stream, "%llu", (unsigned long long) value);
+	}
+}
+
+
+static void print_aggregate(struct value_printer *vp,
+			    const struct type_desc *type,
+			    const unsigned char *data, unsigned int indent,
+			    unsigned int depth)
+{
+	unsigned int i;
+
+	fprintf(vp->stream, "{\n");
+	for (i = 0; i < type->members_nb; i++) {
+		const struct member_desc *member = &type->members[i];
+
+		print_indent(vp->stream, indent + 1);
+		if (member->name) {
+			fprintf(vp->stream, "%s = ", member->name);
+		}
+		if (member->bit_size) {
+			print_bitfield(vp, member, data);
+		} else {
+			render(vp, member->type, data + member->offset,
+			       indent + 1, depth);
+		}
+		fprintf(vp->stream, ",\n");
+	}
+	print_indent(vp->stream, indent);
+	fprintf(vp->stream, "}");
+}
+
+
+static void render(struct value_printer *vp, const struct type_desc *type,
+		   const unsigned char *data, unsigned int indent,
+		   unsigned int depth)
+{
+	char buf[256];
+
+	type = type_strip(type);
+	if (!type) {
+		fprintf(vp->stream, "void");
+		return;
+	}
+	if (!data) {
+		fprintf(vp->stream, "<unavailable>");
+		return;
+	}
+
+	switch (type->tag) {
+	case DW_TAG_base_type:
+		print_base(vp, type, load_uint(data, type->size));
+		break;
+
+	case DW_TAG_enumeration_type:
+		type_enum_format(type, sign_extend(load_uint(data, type->size),
+						   type->size * 8),
+				 buf, sizeof(buf));
+		fprintf(vp->stream, "%s", buf);
+		break;
+
+	case DW_TAG_pointer_type:
+		print_pointer(vp, type, data, indent, depth);
+		break;
+
+	case DW_TAG_array_type:
+		print_array(vp, type, data, indent, depth);
+		break;
+
+	case DW_TAG_structure_type:
+	case DW_TAG_union_type:
+		print_aggregate(vp, type, data, indent, depth);
+		break;
+
+	default:
+		fprintf(vp->stream, "0x%llx",
+			(unsigned long long) load_uint(data, type->size));
+		break;
+	}
+}
+
+
+/* Print "name = value" for the object of the given type at addr. Returns -1
+ * if the object itself could not be read. */
+int value_print(struct value_printer *vp, const char *name,
+		const struct type_desc *type, uint64_t addr)
+{
+	const unsigned char *data;
+
+	fetch(vp, type, NULL, addr);
+	data = read_plan_get(&vp->plan, addr, type->size);
+	fprintf(vp->stream, "%s = ", name);
+	render(vp, type, data, 0, 0);
+	fprintf(vp->stream, "\n");
+
+	return data ? 0 : -1;
+}
+
+
+/* Print an object that does not live in memory, ex. a register or a
+ * constant. Memory it points to is still read from the source. */
+void value_print_bytes(struct value_printer *vp, const char *name,
+		       const struct type_desc *type, const void *data)
+{
+	fetch(vp, type, data, 0);
+	fprintf(vp->stream, "%s = ", name);
+	render(vp, type, data, 0, 0);
+	fprintf(vp->stream, "\n");
+}
+
+
+void value_printer_free(struct value_printer *vp)
+{
+	read_plan_free(&vp->plan);
+}
@@ -0,0 +1,43 @@
+#ifndef _VALUE_H
+#define _VALUE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "memsrc.h"
+
+struct data_index;
+struct type_cache;
+struct type_desc;
+
+/*
+ * Print objects from a memory source according to their cached type layout.
+ * All the memory needed to print an object is requested before any of it is
+ * printed, so that reads are coalesced: one round for the object itself, then
+ * one round per level of pointers followed (strings and, up to max_depth,
+ * structures).
+ */
+struct value_printer {
+	struct mem_source *src;
+	struct read_plan plan;
+	FILE *stream;
+	/* optional, annotate pointers with the data object they point into */
+	struct data_index *data_index;
+	struct type_cache *types;
+	/* levels of pointers to structures and unions that are followed */
+	unsigned int max_depth;
+	/* elements printed per array */
+	unsigned int max_elems;
+	/* bytes read for char * strings */
+	unsigned int max_string;
+};
+
+void value_printer_init(struct value_printer *vp, struct mem_source *src,
+			FILE *stream);
+int value_print(struct value_printer *vp, const char *name,
+		const struct type_desc *type, uint64_t addr);
+void value_print_bytes(struct value_printer *vp, const char *name,
+		       const struct type_desc *type, const void *data);
+void value_printer_free(struct value_printer *vp);
+
+#endif